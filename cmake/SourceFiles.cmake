@@ -25,6 +25,7 @@ set(SOURCE_FILES
         src/cia.cpp
         src/consolehook.cpp
         src/cpuboard.cpp
+        src/cpuprofile.cpp
         src/crc32.cpp
         src/custom.cpp
         src/debug.cpp
@@ -50,6 +51,7 @@ set(SOURCE_FILES
         src/fpp_native.cpp
         src/framebufferboards.cpp
         src/fsdb.cpp
+        src/fsjournal.cpp
         src/fsusage.cpp
         src/gayle.cpp
         src/gfxboard.cpp
@@ -77,6 +79,7 @@ set(SOURCE_FILES
         src/pci.cpp
         src/rommgr.cpp
         src/rtc.cpp
+        src/runahead.cpp
         src/sampler.cpp
         src/sana2.cpp
         src/savestate.cpp
@@ -6,6 +6,12 @@
 #include "blitter.h"
 #include "blitfunc.h"
 
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define BLIT_SIMD 1
+#define BLIT_SIMD_WORDS 8
+typedef uae_u16 blit_vec __attribute__((vector_size(16)));
+#endif
+
 void blitdofast_0 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -46,6 +52,20 @@ for (j = 0; j < b->vblitsize; j++) {
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_0 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec dstd = zero | (0);
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	d[i] = (0) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -106,6 +126,26 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((~srca & srcc));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((~srca & srcc)) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_2a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -182,6 +222,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_2a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc & ~(srca & srcb)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc & ~(srca & srcb))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_30 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -250,6 +313,26 @@ b->bltbhold = srcb;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_30 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec dstd = zero | ((srca & ~srcb));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	d[i] = ((srca & ~srcb)) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_3a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -326,6 +409,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_3a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcb ^ (srca | (srcb ^ srcc))));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcb ^ (srca | (srcb ^ srcc)))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_3c (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -394,6 +500,26 @@ b->bltbhold = srcb;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_3c (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec dstd = zero | ((srca ^ srcb));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	d[i] = ((srca ^ srcb)) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_4a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -470,6 +596,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_4a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc ^ (srca & (srcb | srcc))));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc ^ (srca & (srcb | srcc)))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_6a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -546,6 +695,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_6a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc ^ (srca & srcb)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc ^ (srca & srcb))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_8a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -622,6 +794,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_8a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc & (~srca | srcb)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc & (~srca | srcb))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_8c (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -698,6 +893,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_8c (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcb & (~srca | srcc)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcb & (~srca | srcc))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_9a (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -774,6 +992,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_9a (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc ^ (srca & ~srcb)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc ^ (srca & ~srcb))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_a8 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -850,6 +1091,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_a8 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc & (srca | srcb)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc & (srca | srcb))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_aa (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -898,6 +1162,23 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_aa (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | (srcc);
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srcc = pc[i];
+	d[i] = (srcc) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_b1 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -974,6 +1255,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_b1 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | (~(srca ^ (srcc | (srca ^ srcb))));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = (~(srca ^ (srcc | (srca ^ srcb)))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_ca (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1050,6 +1354,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_ca (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc ^ (srca & (srcb ^ srcc))));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc ^ (srca & (srcb ^ srcc)))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_cc (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1106,6 +1433,23 @@ b->bltbhold = srcb;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_cc (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec dstd = zero | (srcb);
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srcb = pb[i];
+	d[i] = (srcb) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_d8 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1182,6 +1526,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_d8 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srca ^ (srcc & (srca ^ srcb))));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srca ^ (srcc & (srca ^ srcb)))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_e2 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1258,6 +1625,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_e2 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc ^ (srcb & (srca ^ srcc))));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc ^ (srcb & (srca ^ srcc)))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_ea (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1334,6 +1724,29 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_ea (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srcc | (srca & srcb)));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srcc | (srca & srcb))) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_f0 (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1386,6 +1799,23 @@ for (j = 0; j < b->vblitsize; j++) {
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_f0 (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec dstd = zero | (srca);
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	d[i] = (srca) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_fa (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1446,6 +1876,26 @@ b->bltcdat = srcc;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_fa (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcc;
+	memcpy(&srcc, pc + i, sizeof srcc);
+	blit_vec dstd = zero | ((srca | srcc));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcc = pc[i];
+	d[i] = ((srca | srcc)) & 0xFFFF;
+}
+#endif
+}
 void blitdofast_fc (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, struct bltinfo *b)
 {
 int i,j;
@@ -1514,3 +1964,57 @@ b->bltbhold = srcb;
 		if (dstp) chipmem_wput_indirect(dstp, dstd);
 if (totald != 0) b->blitzero = 0;
 }
+void blitrow_fc (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)
+{
+#ifdef BLIT_SIMD
+blit_vec zero = { 0 };
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec srca;
+	memcpy(&srca, pa + i, sizeof srca);
+	blit_vec srcb;
+	memcpy(&srcb, pb + i, sizeof srcb);
+	blit_vec dstd = zero | ((srca | srcb));
+	memcpy(d + i, &dstd, sizeof dstd);
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u32 srca = pa[i];
+	uae_u32 srcb = pb[i];
+	d[i] = ((srca | srcb)) & 0xFFFF;
+}
+#endif
+}
+int blitrow_fill (uae_u16 *d, int n, int fc, int ife)
+{
+uae_u16 fcmask = fc ? 0xffff : 0;
+#ifdef BLIT_SIMD
+for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {
+	blit_vec x, p;
+	uae_u16 xs[BLIT_SIMD_WORDS], ps[BLIT_SIMD_WORDS];
+	memcpy(&x, d + i, sizeof x);
+	p = x ^ (x << 1);
+	p ^= p << 2;
+	p ^= p << 4;
+	p ^= p << 8;
+	memcpy(xs, &x, sizeof x);
+	memcpy(ps, &p, sizeof p);
+	for (int j = 0; j < BLIT_SIMD_WORDS && i + j < n; j++) {
+		d[i + j] = ife ? xs[j] | (ps[j] ^ xs[j] ^ fcmask) : ps[j] ^ fcmask;
+		if (ps[j] & 0x8000)
+			fcmask ^= 0xffff;
+	}
+}
+#else
+for (int i = 0; i < n; i++) {
+	uae_u16 x = d[i];
+	uae_u16 p = x ^ (x << 1);
+	p ^= p << 2;
+	p ^= p << 4;
+	p ^= p << 8;
+	d[i] = ife ? x | (p ^ x ^ fcmask) : p ^ fcmask;
+	if (p & 0x8000)
+		fcmask ^= 0xffff;
+}
+#endif
+return fcmask != 0;
+}
@@ -75,3 +75,38 @@ blitdofast_desc_d8, 0, 0, 0, 0, 0, 0, 0,
 blitdofast_desc_f0, 0, 0, 0, 0, 0, 0, 0, 
 0, 0, blitdofast_desc_fa, 0, blitdofast_desc_fc, 0, 0, 0
 };
+
+blitter_row_func * const blitfunc_row[256] = {
+blitrow_0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_a, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_2a, 0, 0, 0, 0, 0, 
+blitrow_30, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_3a, 0, blitrow_3c, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_4a, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_6a, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_8a, 0, blitrow_8c, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_9a, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+blitrow_a8, 0, blitrow_aa, 0, 0, 0, 0, 0, 
+0, blitrow_b1, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_ca, 0, blitrow_cc, 0, 0, 0, 
+0, 0, 0, 0, 0, 0, 0, 0, 
+blitrow_d8, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_e2, 0, 0, 0, 0, 0, 
+0, 0, blitrow_ea, 0, 0, 0, 0, 0, 
+blitrow_f0, 0, 0, 0, 0, 0, 0, 0, 
+0, 0, blitrow_fa, 0, blitrow_fc, 0, 0, 0
+};
@@ -21,6 +21,7 @@
 #include "newcpu.h"
 #include "blitter.h"
 #include "blit.h"
+#include "blitfunc.h"
 #include "savestate.h"
 #include "debug.h"
 
@@ -503,6 +504,170 @@ static void blit_chipmem_agnus_wput(uaecptr addr, uae_u32 w, uae_u32 typemask)
 	}
 }
 
+#define BLIT_ROW_PAD 16
+static uae_u16 blit_rowt[BLITTER_MAX_WORDS + BLIT_ROW_PAD];
+static uae_u16 blit_rowa[BLITTER_MAX_WORDS + BLIT_ROW_PAD];
+static uae_u16 blit_rowb[BLITTER_MAX_WORDS + BLIT_ROW_PAD];
+static uae_u16 blit_rowc[BLITTER_MAX_WORDS + BLIT_ROW_PAD];
+static uae_u16 blit_rowd[BLITTER_MAX_WORDS + BLIT_ROW_PAD];
+
+// byte range touched by one channel, false if not all in plain chip RAM
+static bool blit_row_span (uaecptr pt, int mod, bool desc, uae_u32 *lo, uae_u32 *hi)
+{
+	int n = blt_info.hblitsize;
+	uae_s64 step = (uae_s64)(n * 2 + mod) * (desc ? -1 : 1);
+	uae_s64 first = desc ? (uae_s64)pt - (n - 1) * 2 : (uae_s64)pt;
+	uae_s64 last = first + step * (blt_info.vblitsize - 1);
+	uae_s64 l = first < last ? first : last;
+	uae_s64 h = (first < last ? last : first) + n * 2;
+	if (l < 0 || h > 0xffffffff)
+		return false;
+	if (!chipmem_check_indirect ((uaecptr)l, (uae_u32)(h - l)))
+		return false;
+	*lo = (uae_u32)l;
+	*hi = (uae_u32)h;
+	return true;
+}
+
+// one row of chip RAM words in blit order
+static void blit_row_load (uae_u16 *dst, uaecptr pt, int n, bool desc)
+{
+	if (desc) {
+		uae_u16 *p = (uae_u16*)chipmem_xlate_indirect (pt - (n - 1) * 2);
+		for (int i = 0; i < n; i++)
+			dst[i] = do_get_mem_word (p + n - 1 - i);
+	} else {
+		uae_u16 *p = (uae_u16*)chipmem_xlate_indirect (pt);
+		for (int i = 0; i < n; i++)
+			dst[i] = do_get_mem_word (p + i);
+	}
+}
+
+static void blit_row_store (const uae_u16 *src, uaecptr pt, int n, bool desc)
+{
+	if (desc) {
+		uae_u16 *p = (uae_u16*)chipmem_xlate_indirect (pt - (n - 1) * 2);
+		for (int i = 0; i < n; i++)
+			do_put_mem_word (p + n - 1 - i, src[i]);
+	} else {
+		uae_u16 *p = (uae_u16*)chipmem_xlate_indirect (pt);
+		for (int i = 0; i < n; i++)
+			do_put_mem_word (p + i, src[i]);
+	}
+}
+
+// t[0] is the previous word, t[1..n] the row
+static void blit_row_shift (uae_u16 *dst, const uae_u16 *t, int n, int shift, bool desc)
+{
+	if (!shift) {
+		memcpy (dst, t + 1, n * sizeof (uae_u16));
+	} else if (desc) {
+		for (int i = 0; i < n; i++)
+			dst[i] = (t[i + 1] << shift) | (t[i] >> (16 - shift));
+	} else {
+		for (int i = 0; i < n; i++)
+			dst[i] = (t[i] << (16 - shift)) | (t[i + 1] >> shift);
+	}
+}
+
+/* Immediate blit a whole row at a time with the blitfunc_row kernels.
+ * Only when all channels are in plain chip RAM and D does not overwrite
+ * source data before the word by word blitter would have read it. */
+static bool blitter_dofast_rows (uaecptr pta, uaecptr ptb, uaecptr ptc, uaecptr ptd, bool desc)
+{
+	int n = blt_info.hblitsize;
+	uae_u8 mt = bltcon0 & 0xFF;
+	uaecptr pt[4] = { pta, ptb, ptc, ptd };
+	int mod[4] = { blt_info.bltamod, blt_info.bltbmod, blt_info.bltcmod, blt_info.bltdmod };
+	uae_u32 lo[4], hi[4];
+
+	if (chipmem_wget_indirect != chipmem_agnus_wget || (log_blitter & 4) || blit_dof)
+		return false;
+#ifdef DEBUGGER
+	if (memwatch_enabled)
+		return false;
+#endif
+	for (int i = 0; i < 4; i++) {
+		if (pt[i] && !blit_row_span (pt[i], mod[i], desc, &lo[i], &hi[i]))
+			return false;
+	}
+	if (ptd) {
+		for (int i = 0; i < 3; i++) {
+			// reading and writing in place is fine, any other overlap is not
+			if (pt[i] && lo[i] < hi[3] && lo[3] < hi[i] && (pt[i] != ptd || mod[i] != mod[3] || mod[i] < 0))
+				return false;
+		}
+	}
+
+	int ashift = bltcon0 >> 12;
+	int bshift = bltcon1 >> 12;
+	int step = desc ? -1 : 1;
+	blitter_row_func *kernel = blitfunc_row[mt];
+	uae_u32 totald = 0;
+
+	if (!ptb) {
+		for (int i = 0; i < n; i++)
+			blit_rowb[i] = blt_info.bltbhold;
+	}
+	if (!ptc) {
+		for (int i = 0; i < n; i++)
+			blit_rowc[i] = blt_info.bltcdat;
+	}
+	for (int j = 0; j < blt_info.vblitsize; j++) {
+		uae_u16 *t = blit_rowt;
+
+		t[0] = blt_info.bltaold;
+		if (pta) {
+			blit_row_load (t + 1, pta, n, desc);
+			blt_info.bltadat = t[n];
+			pta += step * (n * 2 + blt_info.bltamod);
+		} else {
+			for (int i = 1; i <= n; i++)
+				t[i] = blt_info.bltadat;
+		}
+		t[1] &= blit_masktable[0];
+		t[n] &= blit_masktable[n - 1];
+		blt_info.bltaold = t[n];
+		blit_row_shift (blit_rowa, t, n, ashift, desc);
+
+		if (ptb) {
+			t[0] = blt_info.bltbold;
+			blit_row_load (t + 1, ptb, n, desc);
+			blt_info.bltbdat = blt_info.bltbold = t[n];
+			blit_row_shift (blit_rowb, t, n, bshift, desc);
+			blt_info.bltbhold = blit_rowb[n - 1];
+			ptb += step * (n * 2 + blt_info.bltbmod);
+		}
+		if (ptc) {
+			blit_row_load (blit_rowc, ptc, n, desc);
+			blt_info.bltcdat = blit_rowc[n - 1];
+			ptc += step * (n * 2 + blt_info.bltcmod);
+		}
+
+		if (kernel) {
+			kernel (blit_rowd, blit_rowa, blit_rowb, blit_rowc, n);
+		} else {
+			for (int i = 0; i < n; i++)
+				blit_rowd[i] = blit_func (blit_rowa[i], blit_rowb[i], blit_rowc[i], mt) & 0xFFFF;
+		}
+		if (blitfill)
+			blitfc = blitrow_fill (blit_rowd, n, !!(bltcon1 & BLTFC), blitife);
+		for (int i = 0; i < n; i++)
+			totald |= blit_rowd[i];
+
+		if (ptd) {
+			blit_row_store (blit_rowd, ptd, n, desc);
+			ptd += step * (n * 2 + blt_info.bltdmod);
+		}
+	}
+	blt_info.bltddat = blit_rowd[n - 1];
+	if (pt[3])
+		regs.chipset_latch_rw = blt_info.bltddat;
+	if (totald)
+		blt_info.blitzero = 0;
+	return true;
+}
+
 static void blitter_dofast (void)
 {
 	int i,j;
@@ -532,7 +697,9 @@ static void blitter_dofast (void)
 	}
 
 #if SPEEDUP
-	if (blitfunc_dofast[mt] && !blitfill) {
+	if (blitter_dofast_rows (bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, false)) {
+		;
+	} else if (blitfunc_dofast[mt] && !blitfill) {
 		(*blitfunc_dofast[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
 	} else
 #endif
@@ -633,7 +800,9 @@ static void blitter_dofast_desc (void)
 		bltdpt -= (blt_info.hblitsize * 2 + blt_info.bltdmod) * blt_info.vblitsize;
 	}
 #if SPEEDUP
-	if (blitfunc_dofast_desc[mt] && !blitfill) {
+	if (blitter_dofast_rows (bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, true)) {
+		;
+	} else if (blitfunc_dofast_desc[mt] && !blitfill) {
 		(*blitfunc_dofast_desc[mt])(bltadatptr, bltbdatptr, bltcdatptr, bltddatptr, &blt_info);
 	} else
 #endif
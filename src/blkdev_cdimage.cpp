@@ -50,11 +50,14 @@
 
 enum audenc { AUDENC_NONE, AUDENC_PCM, AUDENC_MP3, AUDENC_FLAC, ENC_CHD };
 
+// decoded audio kept ahead of the play position for MP3/FLAC tracks
+#define CDDA_STREAM_SECTORS (2 * 75)
+
 struct cdtoc
 {
 	struct zfile *handle;
 	uae_s64 offset;
-	uae_u8 *data;
+	struct cdda_stream *stream;
 	struct zfile *subhandle;
 	int suboffset;
 	uae_u8 *subdata;
@@ -71,13 +74,26 @@ struct cdtoc
 	int pregap; // sectors of silence
 	int postgap; // sectors of silence
 	audenc enctype;
-	int writeoffset;
 	int subcode;
 #ifdef WITH_CHD
 	const cdrom_track_info *chdtrack;
 #endif
 };
 
+// Window of decoded PCM of one compressed track. Only used by the play thread.
+struct cdda_stream
+{
+	struct cdtoc *t;
+	FLAC__StreamDecoder *flac;
+	mp3decoder *mp3;
+	uae_u8 *ring;
+	int ringsize;
+	int head, fill;	// ring index and length of decoded data
+	uae_s64 pos;	// decoded stream offset of ring[head]
+	int maxframe;
+	bool eof;
+};
+
 struct cdunit {
 	bool enabled;
 	bool open;
@@ -110,13 +126,15 @@ struct cdunit {
 	volatile int cda_bufon[2];
 	cda_audio *cda;
 	struct cd_audio_state cas;
+	struct cdda_stream stream;
 };
 
 static struct cdunit cdunits[MAX_TOTAL_SCSI_DEVICES];
 static int bus_open;
 
-static volatile int cdimage_unpack_thread, cdimage_unpack_active;
+static volatile int cdimage_unpack_thread;
 static smp_comm_pipe unpack_pipe;
+static uae_sem_t unpack_sem;
 static uae_sem_t play_sem;
 
 static struct cdunit *unitisopen (int unitnum)
@@ -197,8 +215,11 @@ static int do_read (struct cdunit *cdu, struct cdtoc *t, uae_u8 *data, int secto
 static void flac_metadata_callback (const FLAC__StreamDecoder *decoder, const FLAC__StreamMetadata *metadata, void *client_data)
 {
 	struct cdtoc *t = (struct cdtoc*)client_data;
-	if (t->data)
+	if (t->stream) {
+		if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
+			t->stream->maxframe = metadata->data.stream_info.max_blocksize * 4;
 		return;
+	}
 	if(metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
 		t->filesize = metadata->data.stream_info.total_samples * (metadata->data.stream_info.bits_per_sample / 8) * metadata->data.stream_info.channels;
 	} else if (metadata->type == FLAC__METADATA_TYPE_CUESHEET) {
@@ -212,11 +233,19 @@ static void flac_error_callback (const FLAC__StreamDecoder *decoder, FLAC__Strea
 static FLAC__StreamDecoderWriteStatus flac_write_callback (const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 * const buffer[], void *client_data)
 {
 	struct cdtoc *t = (struct cdtoc*)client_data;
-	uae_u16 *p = (uae_u16*)(t->data + t->writeoffset);
-	int size = 4;
-	for (int i = 0; i < frame->header.blocksize && t->writeoffset < t->filesize - size; i++, t->writeoffset += size) {
-		*p++ = (FLAC__int16)buffer[0][i];
-		*p++ = (FLAC__int16)buffer[1][i];
+	struct cdda_stream *s = t->stream;
+	if (!s)
+		return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	const FLAC__int32 *right = buffer[frame->header.channels > 1 ? 1 : 0];
+	int tail = (s->head + s->fill) % s->ringsize;
+	for (int i = 0; i < frame->header.blocksize && s->fill < s->ringsize; i++) {
+		uae_u16 *p = (uae_u16*)(s->ring + tail);
+		p[0] = (FLAC__int16)buffer[0][i];
+		p[1] = (FLAC__int16)right[i];
+		tail += 4;
+		if (tail >= s->ringsize)
+			tail = 0;
+		s->fill += 4;
 	}
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -265,24 +294,6 @@ static void flac_get_size (struct cdtoc *t)
 		FLAC__stream_decoder_delete (decoder);
 	}
 }
-static uae_u8 *flac_get_data (struct cdtoc *t)
-{
-	write_log (_T("FLAC: unpacking '%s'..\n"), zfile_getname (t->handle));
-	t->writeoffset = 0;
-	FLAC__StreamDecoder *decoder = FLAC__stream_decoder_new ();
-	if (decoder) {
-		FLAC__stream_decoder_set_md5_checking (decoder, false);
-		int init_status = FLAC__stream_decoder_init_stream (decoder,
-			&file_read_callback, &file_seek_callback, &file_tell_callback,
-			&file_len_callback, &file_eof_callback,
-			&flac_write_callback, &flac_metadata_callback, &flac_error_callback, t);
-		FLAC__stream_decoder_process_until_end_of_stream (decoder);
-		FLAC__stream_decoder_delete (decoder);
-		write_log (_T("FLAC: %s unpacked\n"), zfile_getname (t->handle));
-	}
-	return t->data;
-}
-
 void sub_to_interleaved (const uae_u8 *s, uae_u8 *d)
 {
 	for (int i = 0; i < 8 * SUB_ENTRY_SIZE; i ++) {
@@ -392,10 +403,146 @@ static int setstate (struct cdunit *cdu, int state, int playpos)
 	return 0;
 }
 
+static void stream_close (struct cdunit *cdu)
+{
+	struct cdda_stream *s = &cdu->stream;
+	if (s->flac) {
+		FLAC__stream_decoder_finish (s->flac);
+		FLAC__stream_decoder_delete (s->flac);
+	}
+	delete s->mp3;
+	if (s->t)
+		s->t->stream = NULL;
+	xfree (s->ring);
+	memset (s, 0, sizeof (struct cdda_stream));
+}
+
+static bool stream_open (struct cdunit *cdu, struct cdtoc *t)
+{
+	struct cdda_stream *s = &cdu->stream;
+	if (s->t == t)
+		return s->ring != NULL;
+	stream_close (cdu);
+	if (!t->handle)
+		return false;
+	s->t = t;
+	t->stream = s;
+	if (t->enctype == AUDENC_FLAC) {
+		s->flac = FLAC__stream_decoder_new ();
+		if (s->flac) {
+			FLAC__stream_decoder_set_md5_checking (s->flac, false);
+			zfile_fseek (t->handle, 0, SEEK_SET);
+			if (FLAC__stream_decoder_init_stream (s->flac,
+				&file_read_callback, &file_seek_callback, &file_tell_callback,
+				&file_len_callback, &file_eof_callback,
+				&flac_write_callback, &flac_metadata_callback, &flac_error_callback, t) != FLAC__STREAM_DECODER_INIT_STATUS_OK ||
+				!FLAC__stream_decoder_process_until_end_of_metadata (s->flac)) {
+				FLAC__stream_decoder_delete (s->flac);
+				s->flac = NULL;
+			}
+		}
+		if (!s->flac) {
+			write_log (_T("IMAGE CDDA: FLAC open failed '%s'\n"), zfile_getname (t->handle));
+			return false;
+		}
+		// frames are decoded whole, make sure the largest one always fits
+		if (s->maxframe <= 0)
+			s->maxframe = 65535 * 4;
+	} else {
+		try {
+			s->mp3 = new mp3decoder();
+		} catch (exception) { };
+		if (!s->mp3 || !s->mp3->open (t->handle)) {
+			write_log (_T("IMAGE CDDA: MP3 open failed '%s'\n"), zfile_getname (t->handle));
+			return false;
+		}
+		s->maxframe = 4096;
+	}
+	s->ringsize = CDDA_STREAM_SECTORS * 2352;
+	if (s->ringsize < s->maxframe * 2)
+		s->ringsize = s->maxframe * 2;
+	s->ring = xmalloc (uae_u8, s->ringsize);
+	if (!s->ring)
+		return false;
+	write_log (_T("IMAGE CDDA: streaming '%s'\n"), zfile_getname (t->handle));
+	return true;
+}
+
+// decode next block into the ring, returns false if full or at end of stream
+static bool stream_decode (struct cdunit *cdu)
+{
+	struct cdda_stream *s = &cdu->stream;
+	if (!s->ring || s->eof || s->ringsize - s->fill < s->maxframe)
+		return false;
+	if (s->flac) {
+		if (!FLAC__stream_decoder_process_single (s->flac) ||
+			FLAC__stream_decoder_get_state (s->flac) == FLAC__STREAM_DECODER_END_OF_STREAM)
+			s->eof = true;
+	} else {
+		int tail = (s->head + s->fill) % s->ringsize;
+		int len = std::min (s->ringsize - s->fill, s->ringsize - tail);
+		int v = s->mp3->read (s->ring + tail, len & ~3);
+		if (v <= 0)
+			s->eof = true;
+		else
+			s->fill += v;
+	}
+	return !s->eof;
+}
+
+static void stream_seek (struct cdunit *cdu, uae_s64 pos)
+{
+	struct cdda_stream *s = &cdu->stream;
+	pos &= ~3;
+	s->head = s->fill = 0;
+	s->pos = pos;
+	s->eof = false;
+	if (s->flac) {
+		// decoder trims the first frame so that it starts at the target sample
+		if (!FLAC__stream_decoder_seek_absolute (s->flac, pos / 4)) {
+			if (FLAC__stream_decoder_get_state (s->flac) == FLAC__STREAM_DECODER_SEEK_ERROR)
+				FLAC__stream_decoder_flush (s->flac);
+			s->fill = 0;
+			s->eof = true;
+		}
+	} else {
+		if (!s->mp3->seek (pos / 4))
+			s->eof = true;
+	}
+}
+
+// read decoded audio at stream offset pos, seeking only when pos is outside of the window
+static bool stream_read (struct cdunit *cdu, struct cdtoc *t, uae_u8 *dst, uae_s64 pos, int size)
+{
+	struct cdda_stream *s = &cdu->stream;
+	if (!stream_open (cdu, t))
+		return false;
+	if (pos < s->pos || pos >= s->pos + s->fill + s->ringsize)
+		stream_seek (cdu, pos);
+	for (;;) {
+		if (pos > s->pos) {
+			int drop = (int)std::min (pos - s->pos, (uae_s64)s->fill);
+			s->head = (s->head + drop) % s->ringsize;
+			s->fill -= drop;
+			s->pos += drop;
+		}
+		if (s->pos + s->fill >= pos + size)
+			break;
+		if (!stream_decode (cdu))
+			return false;
+	}
+	int offset = (int)(pos - s->pos);
+	int idx = (s->head + offset) % s->ringsize;
+	int len = std::min (size, s->ringsize - idx);
+	memcpy (dst, s->ring + idx, len);
+	if (len < size)
+		memcpy (dst + len, s->ring, size - len);
+	return true;
+}
+
 static int cdda_unpack_func (void *v)
 {
 	cdimage_unpack_thread = 1;
-	mp3decoder *mp3dec = NULL;
 
 	for (;;) {
 		uae_u32 cduidx = read_comm_pipe_u32_blocking (&unpack_pipe);
@@ -411,42 +558,28 @@ static int cdda_unpack_func (void *v)
 			uae_u8 b;
 			zfile_fread (&b, 1, 1, t->handle);
 			zfile_fseek (t->handle, pos, SEEK_SET);
-			if (!t->data && (t->enctype == AUDENC_MP3 || t->enctype == AUDENC_FLAC)) {
-				t->data = xcalloc (uae_u8, (int)t->filesize + 2352);
-				cdimage_unpack_active = 1;
-				if (t->data) {
-					if (t->enctype == AUDENC_MP3) {
-						if (!mp3dec) {
-							try {
-								mp3dec = new mp3decoder();
-							} catch (exception) { };
-						}
-						if (mp3dec)
-							t->data = mp3dec->get (t->handle, t->data, (int)t->filesize);
-					} else if (t->enctype == AUDENC_FLAC) {
-						flac_get_data (t);
-					}
-				}
-			}
 		}
-		cdimage_unpack_active = 2;
+		uae_sem_post (&unpack_sem);
 	}
-	delete mp3dec;
 	cdimage_unpack_thread = -1;
 	return 0;
 }
 
 static void audio_unpack(struct cdunit *cdu, struct cdtoc *t)
 {
-	// do this even if audio is not compressed, t->handle also could be
-	// compressed and we want to unpack it in background too
-	while (cdimage_unpack_active == 1)
-		sleep_millis(10);
-	cdimage_unpack_active = 0;
+	if (t->enctype == AUDENC_MP3 || t->enctype == AUDENC_FLAC) {
+		// decoded on demand by the play thread
+		stream_open(cdu, t);
+		return;
+	}
+	// t->handle could be compressed, unpack it in background.
+	// Wait for previous request to finish first.
+	uae_sem_wait(&unpack_sem);
 	write_comm_pipe_u32(&unpack_pipe, addrdiff(cdu, &cdunits[0]), 0);
 	write_comm_pipe_u32(&unpack_pipe, addrdiff(t, &cdu->toc[0]), 1);
-	while (cdimage_unpack_active == 0)
-		sleep_millis(10);
+	// the caller reads t->handle next, the unpack thread must be done with it
+	uae_sem_wait(&unpack_sem);
+	uae_sem_post(&unpack_sem);
 }
 
 static void next_cd_audio_buffer_callback(int bufnum, void *params)
@@ -598,7 +731,9 @@ static bool cdda_play_func2 (struct cdunit *cdu, int *outpos)
 				restart = true;
 				goto end;
 			}
-			sleep_millis(10);
+			// keep decoding ahead while waiting
+			if (!stream_decode(cdu))
+				sleep_millis(10);
 		}
 
 		cdu->cda_bufon[bufnum] = 0;
@@ -652,9 +787,9 @@ static bool cdda_play_func2 (struct cdunit *cdu, int *outpos)
 							int totalsize = t->size + t->skipsize;
 							int offset = (int)t->offset;
 							if (offset >= 0) {
-								if ((t->enctype == AUDENC_MP3 || t->enctype == AUDENC_FLAC) && t->data) {
+								if (t->enctype == AUDENC_MP3 || t->enctype == AUDENC_FLAC) {
 									if (t->filesize >= sector * totalsize + offset + t->size)
-										memcpy (dst, t->data + sector * totalsize + offset, t->size);
+										stream_read (cdu, t, dst, (uae_s64)sector * totalsize + offset, t->size);
 								} else if (t->enctype == AUDENC_PCM) {
 									if (sector * totalsize + offset + totalsize < t->filesize) {
 										zfile_fseek (t->handle, (uae_u64)sector * totalsize + offset, SEEK_SET);
@@ -738,8 +873,9 @@ end:
 	if (restart)
 		audio_cda_new_buffer(&cdu->cas, NULL, -1, -1, NULL, NULL);
 
-	while (cdimage_unpack_active == 1)
-		sleep_millis(10);
+	uae_sem_wait(&unpack_sem);
+	uae_sem_post(&unpack_sem);
+	stream_close(cdu);
 
 	delete cdu->cda;
 
@@ -2236,7 +2372,6 @@ static void unload_image (struct cdunit *cdu)
 		if (t->handle != t->subhandle)
 			zfile_fclose (t->subhandle);
 		xfree (t->fname);
-		xfree (t->data);
 		xfree (t->subdata);
 		xfree (t->extrainfo);
 	}
@@ -2273,6 +2408,7 @@ static int open_device (int unitnum, const TCHAR *ident, int flags)
 		cdu->cdda_volume[1] = 0x7fff;
 		if (cdimage_unpack_thread == 0) {
 			init_comm_pipe (&unpack_pipe, 10, 1);
+			uae_sem_init (&unpack_sem, 0, 1);
 			uae_start_thread (_T("cdimage_unpack"), cdda_unpack_func, NULL, NULL);
 			while (cdimage_unpack_thread == 0)
 				Sleep (10);
@@ -2297,6 +2433,7 @@ static void close_device (int unitnum)
 				Sleep (10);
 			cdimage_unpack_thread = 0;
 			destroy_comm_pipe (&unpack_pipe);
+			uae_sem_destroy (&unpack_sem);
 		}
 		unload_image (cdu);
 		uae_sem_destroy (&cdu->sub_sem);
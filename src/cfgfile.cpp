@@ -190,6 +190,7 @@ static const TCHAR *qsmodes[] = {
 };
 /* 3-state boolean! */
 static const TCHAR *fullmodes[] = { _T("false"), _T("true"), /* "FILE_NOT_FOUND", */ _T("fullwindow"), nullptr };
+static const TCHAR *hdfoverlaymode[] = { _T("none"), _T("keep"), _T("discard"), _T("commit"), nullptr };
 /* bleh for compatibility */
 static const TCHAR *scsimode[] = { _T("false"), _T("true"), _T("scsi"), nullptr };
 static const TCHAR *maxhoriz[] = { _T("lores"), _T("hires"), _T("superhires"), nullptr };
@@ -1362,6 +1363,12 @@ static void write_filesys_config (struct uae_prefs *p, struct zfile *f)
 				_tcscat(tmp, _T(",identity"));
 				_tcscat(tmp3, _T(",identity"));
 			}
+			if (ci->overlay != HDF_OVERLAY_DEFAULT) {
+				TCHAR tmpx[32];
+				_sntprintf(tmpx, sizeof tmpx, _T(",overlay=%s"), hdfoverlaymode[ci->overlay]);
+				_tcscat(tmp, tmpx);
+				_tcscat(tmp3, tmpx);
+			}
 
 			if (ci->type == UAEDEV_HDF)
 				cfgfile_write_str (f, _T("hardfile2"), tmp);
@@ -2572,6 +2579,7 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_dwrite (f, _T("blitter_throttle"), _T("%.8f"), p->blitter_speed_throttle);
 #ifdef AMIBERRY
 	cfgfile_write_bool(f, _T("multithreaded_drawing"), p->multithreaded_drawing);
+	cfgfile_write(f, _T("multithreaded_drawing_workers"), _T("%d"), p->multithreaded_drawing_workers);
 #endif
 	cfgfile_write_bool (f, _T("ntsc"), p->ntscmode);
 
@@ -2944,6 +2952,7 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_dwrite_bool(f, _T("cpu_reset_pause"), p->reset_delay);
 	cfgfile_dwrite_bool(f, _T("cpu_halt_auto_reset"), p->crash_auto_reset);
 	cfgfile_dwrite_bool(f, _T("cpu_threaded"), p->cpu_thread);
+	cfgfile_dwrite_bool(f, _T("cpu_block_cache"), p->cpu_blockcache);
 	if (p->ppc_mode)
 		cfgfile_write_strarr(f, _T("ppc_implementation"), ppc_implementations, p->ppc_implementation);
 
@@ -3009,6 +3018,8 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 
 	cfgfile_dwrite(f, _T("state_replay_rate"), _T("%d"), p->statecapturerate);
 	cfgfile_dwrite(f, _T("state_replay_buffers"), _T("%d"), p->statecapturebuffersize);
+	cfgfile_dwrite(f, _T("state_replay_budget"), _T("%d"), p->statecapturebudget);
+	cfgfile_dwrite(f, _T("runahead"), _T("%d"), p->runahead_frames);
 	cfgfile_dwrite_bool(f, _T("state_replay_autoplay"), p->inprec_autoplay);
 	cfgfile_dwrite_bool(f, _T("warp"), p->turbo_emulation);
 	cfgfile_dwrite(f, _T("warp_limit"), _T("%d"), p->turbo_emulation_limit);
@@ -3029,6 +3040,9 @@ void cfgfile_save_options (struct zfile *f, struct uae_prefs *p, int type)
 	cfgfile_dwrite_strarr(f, _T("scsidev_mode"), uaescsidevmodes, p->uaescsidevmode);
 #endif
 	cfgfile_dwrite_bool(f, _T("harddrive_write_protect"), p->harddrive_read_only);
+	cfgfile_dwrite_strarr(f, _T("harddrive_overlay"), hdfoverlaymode, p->harddrive_overlay);
+	if (p->harddrive_overlay_path[0])
+		cfgfile_write_path2(f, _T("harddrive_overlay_path"), p->harddrive_overlay_path, PATH_NONE);
 
 	write_inputdevice_config (p, f);
 
@@ -3675,6 +3689,8 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 		|| cfgfile_intval (option, value, _T("sound_max_buff"), &p->sound_maxbsiz, 1)
 		|| cfgfile_intval (option, value, _T("state_replay_rate"), &p->statecapturerate, 1)
 		|| cfgfile_intval (option, value, _T("state_replay_buffers"), &p->statecapturebuffersize, 1)
+		|| cfgfile_intval (option, value, _T("state_replay_budget"), &p->statecapturebudget, 1)
+		|| cfgfile_intval (option, value, _T("runahead"), &p->runahead_frames, 1)
 		|| cfgfile_yesno (option, value, _T("state_replay_autoplay"), &p->inprec_autoplay)
 		|| cfgfile_intval (option, value, _T("sound_frequency"), &p->sound_freq, 1)
 		|| cfgfile_intval (option, value, _T("sound_volume"), &p->sound_volume_master, 1)
@@ -4360,6 +4376,9 @@ static int cfgfile_parse_host (struct uae_prefs *p, TCHAR *option, TCHAR *value)
 	if (cfgfile_path(option, value, _T("trainerfile"), p->trainerfile, sizeof p->trainerfile / sizeof(TCHAR)))
 		return 1;
 
+	if (cfgfile_path(option, value, _T("harddrive_overlay_path"), p->harddrive_overlay_path, sizeof p->harddrive_overlay_path / sizeof(TCHAR)))
+		return 1;
+
 	if (cfgfile_path(option, value, _T("statefile_quit"), p->quitstatefile, sizeof p->quitstatefile / sizeof (TCHAR)))
 		return 1;
 
@@ -5436,6 +5455,14 @@ static int cfgfile_parse_newfilesys (struct uae_prefs *p, int nr, int type, TCHA
 				uci.lock = true;
 			if (cfgfile_option_find(tmpp2, _T("identity")))
 				uci.loadidentity = true;
+			TCHAR *povl;
+			if ((povl = cfgfile_option_get(tmpp2, _T("overlay")))) {
+				for (int i = 0; hdfoverlaymode[i]; i++) {
+					if (!_tcsicmp(povl, hdfoverlaymode[i]))
+						uci.overlay = i;
+				}
+				xfree(povl);
+			}
 
 			if (cfgfile_option_find(tmpp2, _T("SCSI2")))
 				uci.unit_feature_level = HD_LEVEL_SCSI_2;
@@ -5942,6 +5969,7 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, const TCHAR *option, TCH
 	if (cfgfile_yesno(option, value, _T("immediate_blits"), &p->immediate_blits)
 #ifdef AMIBERRY
 		|| cfgfile_yesno(option, value, _T("multithreaded_drawing"), &p->multithreaded_drawing)
+		|| cfgfile_intval(option, value, _T("multithreaded_drawing_workers"), &p->multithreaded_drawing_workers, 1)
 #endif
 		|| cfgfile_yesno(option, value, _T("fpu_no_unimplemented"), &p->fpu_no_unimplemented)
 		|| cfgfile_yesno(option, value, _T("cpu_no_unimplemented"), &p->int_no_unimplemented)
@@ -5984,6 +6012,7 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, const TCHAR *option, TCH
 		|| cfgfile_yesno(option, value, _T("genlock_aspect"), &p->genlock_aspect)
 		|| cfgfile_yesno(option, value, _T("cpu_data_cache"), &p->cpu_data_cache)
 		|| cfgfile_yesno(option, value, _T("cpu_threaded"), &p->cpu_thread)
+		|| cfgfile_yesno(option, value, _T("cpu_block_cache"), &p->cpu_blockcache)
 		|| cfgfile_yesno(option, value, _T("cpu_24bit_addressing"), &p->address_space_24)
 		|| cfgfile_yesno(option, value, _T("cpu_reset_pause"), &p->reset_delay)
 		|| cfgfile_yesno(option, value, _T("cpu_halt_auto_reset"), &p->crash_auto_reset)
@@ -6074,6 +6103,7 @@ static int cfgfile_parse_hardware (struct uae_prefs *p, const TCHAR *option, TCH
 		return 1;
 
 	if (cfgfile_strval(option, value, _T("comp_trustbyte"), &p->comptrustbyte, compmode, 0)
+		|| cfgfile_strval(option, value, _T("harddrive_overlay"), &p->harddrive_overlay, hdfoverlaymode, 0)
 		|| cfgfile_strval(option, value, _T("rtc"), &p->cs_rtc, rtctype, 0)
 		|| cfgfile_strval(option, value, _T("ciaatod"), &p->cs_ciaatod, ciaatodmode, 0)
 		|| cfgfile_strval(option, value, _T("scsi"), &p->scsi, scsimode, 0)
@@ -8713,6 +8743,7 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 	p->fpu_mode = 0;
 	p->m68k_speed = 0;
 	p->cpu_compatible = true;
+	p->cpu_blockcache = false;
 	p->address_space_24 = true;
 	p->cpu_cycle_exact = false;
 	p->cpu_memory_cycle_exact = false;
@@ -8766,6 +8797,8 @@ void default_prefs (struct uae_prefs *p, bool reset, int type)
 	p->cd_speed = 100;
 
 	p->statecapturebuffersize = 100;
+	p->statecapturebudget = 256;
+	p->runahead_frames = 0;
 	p->statecapturerate = 5 * 50;
 	p->inprec_autoplay = true;
 	p->statefile_path[0] = 0;
@@ -31,6 +31,7 @@
 #include "memory.h"
 #include "newcpu.h"
 #include "cpummu.h"
+#include "cpummu030.h"
 #include "debug.h"
 
 #define MMUDUMP 1
@@ -71,11 +72,13 @@ struct mmu_icache mmu_icache_data[MMU_ICACHE_SZ];
 #if MMU_IPAGECACHE
 uae_u32 atc_last_ins_laddr, atc_last_ins_paddr;
 uae_u8 atc_last_ins_cache;
+uae_u8 *atc_last_ins_host;
 #endif
 #if MMU_DPAGECACHE
 struct mmufastcache atc_data_cache_read[MMUFASTCACHE_ENTRIES];
 struct mmufastcache atc_data_cache_write[MMUFASTCACHE_ENTRIES];
 #endif
+bool mmu_host_direct;
 
 #if CACHE_HIT_COUNT
 int mmu_ins_hit, mmu_ins_miss;
@@ -352,16 +355,18 @@ static void flush_shortcut_cache(uaecptr addr, bool super)
 #endif
 #if MMU_DPAGECACHE
 	if (addr == 0xffffffff) {
-		memset(&atc_data_cache_read, 0xff, sizeof atc_data_cache_read);
-		memset(&atc_data_cache_write, 0xff, sizeof atc_data_cache_write);
-	} else {
 		for (int i = 0; i < MMUFASTCACHE_ENTRIES; i++) {
-			uae_u32 idx = ((addr & mmu_pagemaski) >> mmu_pageshift1m) | (super ? 1 : 0);
-			if (atc_data_cache_read[i].log == idx)
-				atc_data_cache_read[i].log = 0xffffffff;
-			if (atc_data_cache_write[i].log == idx)
-				atc_data_cache_write[i].log = 0xffffffff;
+			atc_data_cache_read[i].log = 0xffffffff;
+			atc_data_cache_write[i].log = 0xffffffff;
 		}
+	} else {
+		// direct mapped, only this page's slot can match
+		uae_u32 idx = ((addr & mmu_pagemaski) >> mmu_pageshift1m) | (super ? 1 : 0);
+		int i = idx & (MMUFASTCACHE_ENTRIES - 1);
+		if (atc_data_cache_read[i].log == idx)
+			atc_data_cache_read[i].log = 0xffffffff;
+		if (atc_data_cache_write[i].log == idx)
+			atc_data_cache_write[i].log = 0xffffffff;
 	}
 #endif
 }
@@ -808,6 +813,7 @@ static void mmu_add_cache(uaecptr addr, uaecptr phys, bool super, bool data, boo
 		atc_last_ins_laddr = laddr;
 		atc_last_ins_paddr = phys;
 		atc_last_ins_cache = mmu_cache_state;
+		atc_last_ins_host = mmu_host_page(phys, mmu_pagemask, false);
 #else
 	;
 #endif
@@ -820,12 +826,14 @@ static void mmu_add_cache(uaecptr addr, uaecptr phys, bool super, bool data, boo
 				atc_data_cache_write[idx2].log = idx1;
 				atc_data_cache_write[idx2].phys = phys;
 				atc_data_cache_write[idx2].cache_state = mmu_cache_state;
+				atc_data_cache_write[idx2].host = mmu_host_page(phys, mmu_pagemask, true);
 			}
 		} else {
 			if (idx2 < MMUFASTCACHE_ENTRIES - 1) {
 				atc_data_cache_read[idx2].log = idx1;
 				atc_data_cache_read[idx2].phys = phys;
 				atc_data_cache_read[idx2].cache_state = mmu_cache_state;
+				atc_data_cache_read[idx2].host = mmu_host_page(phys, mmu_pagemask, false);
 			}
 		}
 #endif
@@ -1453,11 +1461,26 @@ void REGPARAM2 mmu_flush_atc_all(bool global)
 	mmu_flush_cache();
 }
 
+/* memory map changed, cached host pointers may be stale */
+void mmu_flush_host_pages(void)
+{
+	if (currprefs.mmu_model == 68030)
+		mmu030_flush_host_pages();
+	else if (currprefs.mmu_model)
+		flush_shortcut_cache(0xffffffff, 0);
+}
+
 void REGPARAM2 mmu_set_funcs(void)
 {
 	if (currprefs.mmu_model != 68040 && currprefs.mmu_model != 68060)
 		return;
 
+	bool direct = !currprefs.cpu_memory_cycle_exact && !currprefs.cpu_compatible;
+	if (direct != mmu_host_direct) {
+		mmu_host_direct = direct;
+		flush_shortcut_cache(0xffffffff, 0);
+	}
+
 	x_phys_get_iword = phys_get_word;
 	x_phys_get_ilong = phys_get_long;
 	x_phys_get_byte = phys_get_byte;
@@ -86,12 +86,13 @@ static uae_u32 mmu030_table_search(uaecptr addr, uae_u32 fc, bool write, int lev
 static TT_info mmu030_decode_tt(uae_u32 TT);
 
 #if MMU_DPAGECACHE030
-#define MMUFASTCACHE_ENTRIES030 256
+#define MMUFASTCACHE_ENTRIES030 4096
 struct mmufastcache030
 {
 	uae_u32 log;
 	uae_u32 phys;
 	uae_u8 cs;
+	uae_u8 *host;
 };
 static struct mmufastcache030 atc_data_cache_read[MMUFASTCACHE_ENTRIES030];
 static struct mmufastcache030 atc_data_cache_write[MMUFASTCACHE_ENTRIES030];
@@ -223,11 +224,15 @@ static void mmu030_flush_cache(uaecptr addr)
 #endif
 #if MMU_DPAGECACHE030
 	if (addr == 0xffffffff) {
-		memset(&atc_data_cache_read, 0xff, sizeof atc_data_cache_read);
-		memset(&atc_data_cache_write, 0xff, sizeof atc_data_cache_write);
+		for (int i = 0; i < MMUFASTCACHE_ENTRIES030; i++) {
+			atc_data_cache_read[i].log = 0xffffffff;
+			atc_data_cache_write[i].log = 0xffffffff;
+		}
 	} else {
+		// direct mapped, only the slots of this page's function codes can match
 		uae_u32 idx = ((addr & mmu030.translation.page.imask) >> mmu030.translation.page.size3m) | 7;
-		for (int i = 0; i < MMUFASTCACHE_ENTRIES030; i++) {
+		for (int fc = 0; fc < 8; fc++) {
+			int i = ((idx & ~7) | fc) & (MMUFASTCACHE_ENTRIES030 - 1);
 			if ((atc_data_cache_read[i].log | 7) == idx)
 				atc_data_cache_read[i].log = 0xffffffff;
 			if ((atc_data_cache_write[i].log | 7) == idx)
@@ -1907,6 +1912,7 @@ static void mmu030_add_data_read_cache(uaecptr addr, uaecptr phys, uae_u32 fc)
 		atc_data_cache_read[idx2].log = idx1;
 		atc_data_cache_read[idx2].phys = phys;
 		atc_data_cache_read[idx2].cs = mmu030_cache_state;
+		atc_data_cache_read[idx2].host = mmu_host_page(phys, mmu030.translation.page.mask, false);
 	}
 #endif
 }
@@ -1920,6 +1926,7 @@ static void mmu030_add_data_write_cache(uaecptr addr, uaecptr phys, uae_u32 fc)
 		atc_data_cache_write[idx2].log = idx1;
 		atc_data_cache_write[idx2].phys = phys;
 		atc_data_cache_write[idx2].cs = mmu030_cache_state;
+		atc_data_cache_write[idx2].host = mmu_host_page(phys, mmu030.translation.page.mask, true);
 	}
 #endif
 }
@@ -2103,6 +2110,11 @@ void mmu030_put_long(uaecptr addr, uae_u32 val, uae_u32 fc)
 		if (atc_data_cache_write[idx2].log == idx1) {
 			addr = atc_data_cache_write[idx2].phys | (addr & mmu030.translation.page.mask);
 			mmu030_cache_state = atc_data_cache_write[idx2].cs;
+			if (atc_data_cache_write[idx2].host) {
+				cacheablecheck(addr);
+				do_put_mem_long((uae_u32 *)(atc_data_cache_write[idx2].host + (addr & mmu030.translation.page.mask)), val);
+				return;
+			}
 		} else
 #endif
 		{
@@ -2129,6 +2141,11 @@ void mmu030_put_word(uaecptr addr, uae_u16 val, uae_u32 fc)
 		if (atc_data_cache_write[idx2].log == idx1) {
 			addr = atc_data_cache_write[idx2].phys | (addr & mmu030.translation.page.mask);
 			mmu030_cache_state = atc_data_cache_write[idx2].cs;
+			if (atc_data_cache_write[idx2].host) {
+				cacheablecheck(addr);
+				do_put_mem_word((uae_u16 *)(atc_data_cache_write[idx2].host + (addr & mmu030.translation.page.mask)), val);
+				return;
+			}
 		} else
 #endif
 		{
@@ -2155,6 +2172,11 @@ void mmu030_put_byte(uaecptr addr, uae_u8 val, uae_u32 fc)
 		if (atc_data_cache_write[idx2].log == idx1) {
 			addr = atc_data_cache_write[idx2].phys | (addr & mmu030.translation.page.mask);
 			mmu030_cache_state = atc_data_cache_write[idx2].cs;
+			if (atc_data_cache_write[idx2].host) {
+				cacheablecheck(addr);
+				do_put_mem_byte(atc_data_cache_write[idx2].host + (addr & mmu030.translation.page.mask), val);
+				return;
+			}
 		} else
 #endif
 		{
@@ -2182,6 +2204,10 @@ uae_u32 mmu030_get_long(uaecptr addr, uae_u32 fc)
 		if (atc_data_cache_read[idx2].log == idx1) {
 			addr = atc_data_cache_read[idx2].phys | (addr & mmu030.translation.page.mask);
 			mmu030_cache_state = atc_data_cache_read[idx2].cs;
+			if (atc_data_cache_read[idx2].host) {
+				cacheablecheck(addr);
+				return do_get_mem_long((uae_u32 *)(atc_data_cache_read[idx2].host + (addr & mmu030.translation.page.mask)));
+			}
 		} else
 #endif
 		{
@@ -2209,6 +2235,10 @@ uae_u16 mmu030_get_word(uaecptr addr, uae_u32 fc)
 		if (atc_data_cache_read[idx2].log == idx1) {
 			addr = atc_data_cache_read[idx2].phys | (addr & mmu030.translation.page.mask);
 			mmu030_cache_state = atc_data_cache_read[idx2].cs;
+			if (atc_data_cache_read[idx2].host) {
+				cacheablecheck(addr);
+				return do_get_mem_word((uae_u16 *)(atc_data_cache_read[idx2].host + (addr & mmu030.translation.page.mask)));
+			}
 		} else
 #endif
 		{
@@ -2236,6 +2266,10 @@ uae_u8 mmu030_get_byte(uaecptr addr, uae_u32 fc)
 		if (atc_data_cache_read[idx2].log == idx1) {
 			addr = atc_data_cache_read[idx2].phys | (addr & mmu030.translation.page.mask);
 			mmu030_cache_state = atc_data_cache_read[idx2].cs;
+			if (atc_data_cache_read[idx2].host) {
+				cacheablecheck(addr);
+				return do_get_mem_byte(atc_data_cache_read[idx2].host + (addr & mmu030.translation.page.mask));
+			}
 		} else
 #endif
 		{
@@ -2657,10 +2691,19 @@ void mmu030_reset(int hardreset)
 	mmu030_set_funcs();
 }
 
+void mmu030_flush_host_pages(void)
+{
+	mmu030_flush_cache(0xffffffff);
+}
+
 void mmu030_set_funcs(void)
 {
 	if (currprefs.mmu_model != 68030)
 		return;
+	if (mmu_host_direct != !currprefs.cpu_memory_cycle_exact) {
+		mmu_host_direct = !currprefs.cpu_memory_cycle_exact;
+		mmu030_flush_cache(0xffffffff);
+	}
 	if (currprefs.cpu_memory_cycle_exact) {
 		x_phys_get_iword = mem_access_delay_wordi_read_ce020;
 		x_phys_get_ilong = mem_access_delay_longi_read_ce020;
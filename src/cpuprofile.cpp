@@ -0,0 +1,485 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Instruction level execution profiler
+  *
+  * Counts interpreted instructions per opcode and per PC, returns from
+  * JIT compiled code to the main loop and host time spent in each
+  * event handler. Results can be listed in the debugger or written as
+  * a pprof profile (profile.proto, uncompressed) and as folded stacks
+  * for flamegraph.pl. Samples are keyed by Amiga address, memory bank
+  * and, when debugmem has symbols, by function.
+  *
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include <time.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "options.h"
+#include "memory.h"
+#include "newcpu.h"
+#include "events.h"
+#include "readcpu.h"
+#ifdef DEBUGGER
+#include "debugmem.h"
+#endif
+#include "uae/io.h"
+#include "cpuprofile.h"
+
+#define PROFILE_EVENTS (ev_max + 2)
+#define PROFILE_EMPTY 0xffffffff
+#define PROFILE_MINBITS 14
+
+bool cpu_profile_active;
+
+struct profile_pc
+{
+	uaecptr pc;
+	uae_u32 jit_exit;
+	uae_u64 count;
+	uae_u64 jit_normal;
+};
+
+static struct profile_pc *pc_table;
+static int pc_bits;
+static uae_u32 pc_used;
+static uae_u64 *opcode_counts;
+static uae_u64 instr_total;
+static uae_u64 jit_counts[CPU_PROFILE_JIT_MAX];
+static uae_u64 event_counts[PROFILE_EVENTS], event_time[PROFILE_EVENTS];
+static uae_u64 profile_started, profile_duration;
+
+static const TCHAR *event_names[PROFILE_EVENTS] = {
+	_T("cia"), _T("hsync"), _T("hsynch"), _T("misc"), _T("audio"),
+	_T("blitter"), _T("event2")
+};
+static const TCHAR *jit_names[CPU_PROFILE_JIT_MAX] = {
+	_T("compiled code exits"), _T("interpreted blocks"), _T("blocks compiled")
+};
+
+uae_u64 cpu_profile_clock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uae_u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool pc_alloc(int bits)
+{
+	struct profile_pc *t = xmalloc(struct profile_pc, 1 << bits);
+	if (!t)
+		return false;
+	for (int i = 0; i < (1 << bits); i++) {
+		memset(&t[i], 0, sizeof(struct profile_pc));
+		t[i].pc = PROFILE_EMPTY;
+	}
+	struct profile_pc *old = pc_table;
+	int oldbits = pc_bits;
+	pc_table = t;
+	pc_bits = bits;
+	pc_used = 0;
+	if (old) {
+		// rehash
+		for (int i = 0; i < (1 << oldbits); i++) {
+			if (old[i].pc == PROFILE_EMPTY)
+				continue;
+			uae_u32 mask = (1 << bits) - 1;
+			uae_u32 idx = ((old[i].pc >> 1) * 0x9e3779b1) >> (32 - bits);
+			while (t[idx].pc != PROFILE_EMPTY)
+				idx = (idx + 1) & mask;
+			t[idx] = old[i];
+			pc_used++;
+		}
+		xfree(old);
+	}
+	return true;
+}
+
+static struct profile_pc *pc_get(uaecptr pc)
+{
+	for (;;) {
+		uae_u32 mask = (1 << pc_bits) - 1;
+		uae_u32 idx = ((pc >> 1) * 0x9e3779b1) >> (32 - pc_bits);
+		for (;;) {
+			struct profile_pc *p = &pc_table[idx];
+			if (p->pc == pc)
+				return p;
+			if (p->pc == PROFILE_EMPTY)
+				break;
+			idx = (idx + 1) & mask;
+		}
+		if ((pc_used + 1) * 4 <= (1U << pc_bits) * 3) {
+			struct profile_pc *p = &pc_table[idx];
+			p->pc = pc;
+			pc_used++;
+			return p;
+		}
+		if (pc_bits >= 26 || !pc_alloc(pc_bits + 1)) {
+			write_log(_T("CPUPROFILE: PC table full, profiling stopped\n"));
+			cpu_profile_stop();
+			return NULL;
+		}
+	}
+}
+
+void cpu_profile_instr(uae_u32 opcode, uaecptr pc)
+{
+	opcode_counts[opcode & 0xffff]++;
+	instr_total++;
+	struct profile_pc *p = pc_get(pc);
+	if (p)
+		p->count++;
+}
+
+void cpu_profile_jit(int type, uaecptr pc)
+{
+	jit_counts[type]++;
+	if (type == CPU_PROFILE_JIT_COMPILE)
+		return;
+	struct profile_pc *p = pc_get(pc);
+	if (!p)
+		return;
+	if (type == CPU_PROFILE_JIT_EXIT)
+		p->jit_exit++;
+	else
+		p->jit_normal++;
+}
+
+void cpu_profile_event(int type, uae_u64 start)
+{
+	event_counts[type]++;
+	event_time[type] += cpu_profile_clock() - start;
+}
+
+static void profile_clear(void)
+{
+	for (int i = 0; i < (1 << pc_bits); i++) {
+		memset(&pc_table[i], 0, sizeof(struct profile_pc));
+		pc_table[i].pc = PROFILE_EMPTY;
+	}
+	pc_used = 0;
+	memset(opcode_counts, 0, 65536 * sizeof(uae_u64));
+	memset(jit_counts, 0, sizeof jit_counts);
+	memset(event_counts, 0, sizeof event_counts);
+	memset(event_time, 0, sizeof event_time);
+	instr_total = 0;
+	profile_duration = 0;
+}
+
+void cpu_profile_free(void)
+{
+	cpu_profile_active = false;
+	xfree(pc_table);
+	pc_table = NULL;
+	pc_bits = 0;
+	pc_used = 0;
+	xfree(opcode_counts);
+	opcode_counts = NULL;
+}
+
+void cpu_profile_start(void)
+{
+	if (cpu_profile_active)
+		return;
+	if (!opcode_counts) {
+		opcode_counts = xcalloc(uae_u64, 65536);
+		if (!opcode_counts || !pc_alloc(PROFILE_MINBITS)) {
+			cpu_profile_free();
+			return;
+		}
+	}
+	profile_clear();
+	profile_started = cpu_profile_clock();
+	cpu_profile_active = true;
+}
+
+void cpu_profile_stop(void)
+{
+	if (!cpu_profile_active)
+		return;
+	cpu_profile_active = false;
+	profile_duration += cpu_profile_clock() - profile_started;
+}
+
+static uae_u64 profile_time(void)
+{
+	if (cpu_profile_active)
+		return profile_duration + cpu_profile_clock() - profile_started;
+	return profile_duration;
+}
+
+static const TCHAR *opcode_name(uae_u32 opcode)
+{
+	int mnemo = table68k[opcode].mnemo;
+	for (int i = 0; lookuptab[i].name[0]; i++) {
+		if (lookuptab[i].mnemo == mnemo)
+			return lookuptab[i].name;
+	}
+	return _T("?");
+}
+
+// folded stacks use ';' between frames and a space before the count
+static void profile_sanitize(TCHAR *s)
+{
+	for (; *s; s++) {
+		if (*s == ';')
+			*s = ':';
+		else if (*s == ' ' || *s == '\t' || *s == '\n')
+			*s = '_';
+	}
+}
+
+static void profile_names(uaecptr pc, TCHAR *region, int rsize, TCHAR *func, int fsize)
+{
+	addrbank *ab = &get_mem_bank(pc);
+	_tcsncpy(region, ab->name ? ab->name : _T("unmapped"), rsize - 1);
+	region[rsize - 1] = 0;
+	profile_sanitize(region);
+#ifdef DEBUGGER
+	if (debugmem_get_function(pc, func, fsize) >= 0) {
+		profile_sanitize(func);
+		return;
+	}
+#endif
+	_sntprintf(func, fsize, _T("%08X"), pc & ~0xff);
+}
+
+static std::vector<struct profile_pc*> profile_sorted(int type)
+{
+	std::vector<struct profile_pc*> v;
+	for (int i = 0; pc_table && i < (1 << pc_bits); i++) {
+		struct profile_pc *p = &pc_table[i];
+		if (p->pc == PROFILE_EMPTY)
+			continue;
+		if ((type == 0 && p->count) || (type == 1 && (p->jit_exit || p->jit_normal)))
+			v.push_back(p);
+	}
+	std::sort(v.begin(), v.end(), [type](struct profile_pc *a, struct profile_pc *b) {
+		if (type == 0)
+			return a->count > b->count;
+		return a->jit_exit + a->jit_normal > b->jit_exit + b->jit_normal;
+	});
+	return v;
+}
+
+void cpu_profile_report(int lines)
+{
+	TCHAR region[64], func[64];
+
+	if (!opcode_counts) {
+		console_out(_T("Profiler has no data\n"));
+		return;
+	}
+	if (lines <= 0)
+		lines = 20;
+	uae_u64 t = profile_time();
+	console_out_f(_T("Profiler %s, %.3f s, %llu instructions interpreted, %u PCs\n"),
+		cpu_profile_active ? _T("running") : _T("stopped"), t / 1000000000.0, instr_total, pc_used);
+
+	if (instr_total) {
+		std::vector<int> ops;
+		for (int i = 0; i < 65536; i++) {
+			if (opcode_counts[i])
+				ops.push_back(i);
+		}
+		std::sort(ops.begin(), ops.end(), [](int a, int b) { return opcode_counts[a] > opcode_counts[b]; });
+		console_out(_T("Opcodes:\n"));
+		for (int i = 0; i < lines && i < (int)ops.size(); i++) {
+			console_out_f(_T(" %04X %-8s %12llu %6.2f%%\n"), ops[i], opcode_name(ops[i]),
+				opcode_counts[ops[i]], opcode_counts[ops[i]] * 100.0 / instr_total);
+		}
+		std::vector<struct profile_pc*> pcs = profile_sorted(0);
+		console_out(_T("PCs:\n"));
+		for (int i = 0; i < lines && i < (int)pcs.size(); i++) {
+			profile_names(pcs[i]->pc, region, sizeof region / sizeof(TCHAR), func, sizeof func / sizeof(TCHAR));
+			console_out_f(_T(" %08X %12llu %6.2f%% %s %s\n"), pcs[i]->pc, pcs[i]->count,
+				pcs[i]->count * 100.0 / instr_total, region, func);
+		}
+	}
+	if (jit_counts[CPU_PROFILE_JIT_EXIT] || jit_counts[CPU_PROFILE_JIT_NORMAL]) {
+		for (int i = 0; i < CPU_PROFILE_JIT_MAX; i++)
+			console_out_f(_T("JIT %s: %llu\n"), jit_names[i], jit_counts[i]);
+		std::vector<struct profile_pc*> pcs = profile_sorted(1);
+		for (int i = 0; i < lines && i < (int)pcs.size(); i++) {
+			profile_names(pcs[i]->pc, region, sizeof region / sizeof(TCHAR), func, sizeof func / sizeof(TCHAR));
+			console_out_f(_T(" %08X exits %10u interpreted %10llu %s %s\n"), pcs[i]->pc,
+				pcs[i]->jit_exit, pcs[i]->jit_normal, region, func);
+		}
+	}
+	console_out(_T("Events (misc includes blitter and event2):\n"));
+	for (int i = 0; i < PROFILE_EVENTS; i++) {
+		if (!event_counts[i])
+			continue;
+		console_out_f(_T(" %-8s %12llu %10.3f ms %8llu ns avg %6.2f%%\n"), event_names[i], event_counts[i],
+			event_time[i] / 1000000.0, event_time[i] / event_counts[i], t ? event_time[i] * 100.0 / t : 0.0);
+	}
+}
+
+/* minimal protocol buffers writer for profile.proto */
+
+struct pbuf
+{
+	std::vector<uae_u8> d;
+
+	void varint(uae_u64 v)
+	{
+		while (v >= 0x80) {
+			d.push_back((uae_u8)(v | 0x80));
+			v >>= 7;
+		}
+		d.push_back((uae_u8)v);
+	}
+	void num(int field, uae_u64 v)
+	{
+		varint(field << 3);
+		varint(v);
+	}
+	void bytes(int field, const void *p, size_t len)
+	{
+		varint((field << 3) | 2);
+		varint(len);
+		d.insert(d.end(), (const uae_u8*)p, (const uae_u8*)p + len);
+	}
+	void msg(int field, const pbuf &m)
+	{
+		bytes(field, m.d.data(), m.d.size());
+	}
+	void packed(int field, const std::vector<uae_u64> &v)
+	{
+		pbuf p;
+		for (uae_u64 x : v)
+			p.varint(x);
+		msg(field, p);
+	}
+};
+
+struct pprof
+{
+	pbuf out;
+	std::vector<std::string> strings;
+	std::unordered_map<std::string, uae_u64> stringids;
+	std::unordered_map<std::string, uae_u64> functions;
+	std::unordered_map<std::string, uae_u64> regions;
+	uae_u64 nextloc = 1;
+
+	uae_u64 str(const std::string &s)
+	{
+		auto it = stringids.find(s);
+		if (it != stringids.end())
+			return it->second;
+		uae_u64 id = strings.size();
+		strings.push_back(s);
+		stringids[s] = id;
+		return id;
+	}
+	void valuetype(int field, const TCHAR *type, const TCHAR *unit)
+	{
+		pbuf m;
+		m.num(1, str(type));
+		m.num(2, str(unit));
+		out.msg(field, m);
+	}
+	uae_u64 function(const std::string &name)
+	{
+		auto it = functions.find(name);
+		if (it != functions.end())
+			return it->second;
+		uae_u64 id = functions.size() + 1;
+		functions[name] = id;
+		pbuf m;
+		m.num(1, id);
+		m.num(2, str(name));
+		m.num(3, str(name));
+		out.msg(5, m);
+		return id;
+	}
+	uae_u64 location(uae_u64 address, const std::string &name)
+	{
+		uae_u64 id = nextloc++;
+		pbuf m, line;
+		m.num(1, id);
+		m.num(3, address);
+		line.num(1, function(name));
+		m.msg(4, line);
+		out.msg(4, m);
+		return id;
+	}
+	uae_u64 region(const std::string &name)
+	{
+		auto it = regions.find(name);
+		if (it != regions.end())
+			return it->second;
+		uae_u64 id = location(0, name);
+		regions[name] = id;
+		return id;
+	}
+	void sample(const std::vector<uae_u64> &locs, const std::vector<uae_u64> &values)
+	{
+		pbuf m;
+		m.packed(1, locs);
+		m.packed(2, values);
+		out.msg(2, m);
+	}
+};
+
+static bool write_file(const TCHAR *name, const void *data, size_t len)
+{
+	FILE *f = uae_tfopen(name, _T("wb"));
+	if (!f)
+		return false;
+	bool ok = fwrite(data, 1, len, f) == len;
+	fclose(f);
+	return ok;
+}
+
+bool cpu_profile_write(const TCHAR *name)
+{
+	TCHAR region[64], func[64];
+	std::string folded;
+	pprof p;
+
+	if (!opcode_counts)
+		return false;
+	p.str("");
+	// value order: instructions, JIT exits, interpreted JIT blocks, event time
+	p.valuetype(1, _T("instructions"), _T("count"));
+	p.valuetype(1, _T("jit_exits"), _T("count"));
+	p.valuetype(1, _T("jit_interpreted"), _T("count"));
+	p.valuetype(1, _T("event_time"), _T("nanoseconds"));
+
+	for (int i = 0; i < (1 << pc_bits); i++) {
+		struct profile_pc *pp = &pc_table[i];
+		if (pp->pc == PROFILE_EMPTY)
+			continue;
+		profile_names(pp->pc, region, sizeof region / sizeof(TCHAR), func, sizeof func / sizeof(TCHAR));
+		std::vector<uae_u64> locs = { p.location(pp->pc, func), p.region(region) };
+		p.sample(locs, { pp->count, pp->jit_exit, pp->jit_normal, 0 });
+		if (pp->count) {
+			TCHAR line[200];
+			_sntprintf(line, sizeof line / sizeof(TCHAR), _T("%s;%s;%08X %llu\n"), region, func, pp->pc, pp->count);
+			folded += line;
+		}
+	}
+	for (int i = 0; i < PROFILE_EVENTS; i++) {
+		if (!event_counts[i])
+			continue;
+		std::vector<uae_u64> locs = { p.location(0, event_names[i]), p.region("events") };
+		p.sample(locs, { 0, 0, 0, event_time[i] });
+	}
+	p.out.num(10, profile_time());
+	for (const std::string &s : p.strings)
+		p.out.bytes(6, s.data(), s.size());
+
+	bool ok = write_file(name, p.out.d.data(), p.out.d.size());
+	TCHAR fname[MAX_DPATH];
+	_sntprintf(fname, MAX_DPATH, _T("%s.folded"), name);
+	ok = write_file(fname, folded.data(), folded.size()) && ok;
+	write_log(_T("CPUPROFILE: wrote '%s' and '%s'\n"), name, fname);
+	return ok;
+}
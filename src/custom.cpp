@@ -39,6 +39,7 @@
 #include "picasso96.h"
 #include "drawing.h"
 #include "savestate.h"
+#include "runahead.h"
 #include "ar.h"
 #include "debug.h"
 #include "akiko.h"
@@ -2334,7 +2335,11 @@ static void update_mirrors(void)
 	}
 }
 
+#ifdef AMIBERRY
+extern thread_local struct color_entry colors_for_drawing;
+#else
 extern struct color_entry colors_for_drawing;
+#endif
 
 void notice_new_xcolors(void)
 {
@@ -11957,6 +11962,12 @@ static bool framewait(void)
 
 	events_reset_syncline();
 
+	// ahead frames run unthrottled, only the real frame waits
+	if (runahead_active) {
+		frameskiptime = 0;
+		return true;
+	}
+
 	static struct mavg_data ma_frameskipt;
 	frame_time_t frameskipt_avg = mavg(&ma_frameskipt, frameskiptime, MAVG_VSYNC_SIZE);
 
@@ -12268,7 +12279,7 @@ static void vsync_handler_render(void)
 	fpscounter(frameok);
 
 	bool waspaused = false;
-	while (handle_events()) {
+	while (!runahead_active && handle_events()) {
 		if (!waspaused) {
 			if (crender_screen(0, 1, true)) {
 				show_screen(0, 0);
@@ -14237,6 +14248,11 @@ static void hsync_handler_post(bool onvsync)
 
 		maybe_process_pull_audio();
 
+	} else if (runahead_active) {
+
+		// ahead frames are emulated as fast as possible
+		maybe_process_pull_audio();
+
 	} else if (isvsync_chipset() < 0) {
 #ifdef WITH_BEAMRACER
 		if (currprefs.gfx_display_sections <= 1) {
@@ -14418,6 +14434,10 @@ static void hsync_handler(void)
 			uae_reset(0, 0);
 			return;
 		}
+		if (runahead_vsync()) {
+			uae_reset(0, 0);
+			return;
+		}
 		eventtab[ev_hsynch].evtime = get_cycles() + hsyncstartpos_start_cycles * CYCLE_UNIT;
 		eventtab[ev_hsynch].active = 1;
 		events_schedule();
@@ -14507,17 +14527,23 @@ void custom_cpuchange(void)
 
 void custom_reset(bool hardreset, bool keyboardreset)
 {
+	// run-ahead rollback: the machine is not reset, only chipset state derived
+	// from the restored registers is rebuilt, devices and memory map are kept.
+	bool rollback = savestate_state == STATE_RUNAHEAD;
+
 	if (hardreset) {
 		board_prefs_changed(-1, -1);
 		initial_frame = true;
 	}
 
-	target_reset();
-	devices_reset(hardreset);
-	write_log(_T("Reset at %08X. Chipset mask = %08X\n"), M68K_GETPC, currprefs.chipset_mask);
+	if (!rollback) {
+		target_reset();
+		devices_reset(hardreset);
+		write_log(_T("Reset at %08X. Chipset mask = %08X\n"), M68K_GETPC, currprefs.chipset_mask);
 #ifdef DEBUGGER
-	memory_map_dump();
+		memory_map_dump();
 #endif
+	}
 
 	bool ntsc = currprefs.ntscmode;
 
@@ -14689,7 +14715,8 @@ void custom_reset(bool hardreset, bool keyboardreset)
 		}
 	}
 #ifdef WITH_SPECIALMONITORS
-	specialmonitor_reset();
+	if (!rollback)
+		specialmonitor_reset();
 #endif
 
 	unset_special (~(SPCFLAG_BRK | SPCFLAG_MODE_CHANGE));
@@ -14698,7 +14725,8 @@ void custom_reset(bool hardreset, bool keyboardreset)
 	vpos_prev = maxvpos - 1;
 	vpos_count = vpos_count_diff = 0;
 
-	inputdevice_reset();
+	if (!rollback)
+		inputdevice_reset();
 	timehack_alive = 0;
 
 	curr_sprite_entries = 0;
@@ -14725,7 +14753,9 @@ void custom_reset(bool hardreset, bool keyboardreset)
 	lof_togglecnt_nlace = lof_togglecnt_lace = 0;
 	//nlace_cnt = NLACE_CNT_NEEDED;
 
-	audio_reset();
+	// restore_audio_finish() resynchronizes audio after a rollback
+	if (!rollback)
+		audio_reset();
 	if (!isrestore()) {
 		memset(&cop_state, 0, sizeof(cop_state));
 		cop_state.state = COP_stop;
@@ -14738,7 +14768,8 @@ void custom_reset(bool hardreset, bool keyboardreset)
 	}
 
 	init_hardware_frame();
-	drawing_init();
+	if (!rollback)
+		drawing_init();
 
 	reset_decisions_scanline_start();
 	reset_decisions_hsync_start();
@@ -14798,14 +14829,16 @@ void custom_reset(bool hardreset, bool keyboardreset)
 			events_schedule();
 		}
 
-		write_log(_T("CPU=%d Chipset=%s %s\n"),
-			currprefs.cpu_model,
-			(aga_mode ? _T("AGA") :
-			(ecs_agnus && ecs_denise ? _T("Full ECS") :
-			(ecs_denise ? _T("ECS Denise") :
-			(ecs_agnus ? _T("ECS") : _T("OCS"))))),
-			currprefs.ntscmode ? _T("NTSC") : _T("PAL"));
-		write_log(_T("State restored\n"));
+		if (!rollback) {
+			write_log(_T("CPU=%d Chipset=%s %s\n"),
+				currprefs.cpu_model,
+				(aga_mode ? _T("AGA") :
+				(ecs_agnus && ecs_denise ? _T("Full ECS") :
+				(ecs_denise ? _T("ECS Denise") :
+				(ecs_agnus ? _T("ECS") : _T("OCS"))))),
+				currprefs.ntscmode ? _T("NTSC") : _T("PAL"));
+			write_log(_T("State restored\n"));
+		}
 	}
 
 	sprres = expand_sprres(bplcon0, bplcon3);
@@ -14816,6 +14849,9 @@ void custom_reset(bool hardreset, bool keyboardreset)
 	setup_fmodes(0, bplcon0);
 	shdelay_disabled = false;
 
+	if (rollback)
+		return;
+
 #ifdef ACTION_REPLAY
 	/* Doing this here ensures we can use the 'reset' command from within AR */
 	action_replay_reset(hardreset, keyboardreset);
@@ -16398,6 +16434,7 @@ void check_prefs_changed_custom(void)
 	currprefs.waiting_blits = changed_prefs.waiting_blits;
 	currprefs.blitter_speed_throttle = changed_prefs.blitter_speed_throttle;
 	currprefs.collision_level = changed_prefs.collision_level;
+	currprefs.runahead_frames = changed_prefs.runahead_frames;
 	currprefs.keyboard_nkro = changed_prefs.keyboard_nkro;
 	if (currprefs.keyboard_mode != changed_prefs.keyboard_mode) {
 		currprefs.keyboard_mode = changed_prefs.keyboard_mode;
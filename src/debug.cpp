@@ -56,6 +56,7 @@
 #include "readcpu.h"
 #include "cputbl.h"
 #include "keybuf.h"
+#include "cpuprofile.h"
 
 static int trace_mode;
 static uae_u32 trace_param[3];
@@ -244,6 +245,9 @@ static const TCHAR help[] = {
 	_T("                        Show DMA data (accurate only in cycle-exact mode).\n")
 	_T("                        v [-1 to -4] = enable visual DMA debugger.\n")
 	_T("  vh [<ratio> <lines>]  \"Heat map\"\n")
+	_T("  P <0-1>               Stop/start instruction profiler.\n")
+	_T("  P [<lines>]           Show profiler opcode, PC, JIT and event statistics.\n")
+	_T("  Pw <file>             Write profile in pprof format and <file>.folded flame graph stacks.\n")
 	_T("  I <custom event>      Send custom event string\n")
 	_T("  ?<value>              Hex ($ and 0x)/Bin (%)/Dec (!) converter and calculator.\n")
 #ifdef _WIN32
@@ -7113,6 +7117,28 @@ static bool debug_line (TCHAR *input)
 			}
 		case 'O':
 			break;
+		case 'P':
+			if (*inptr == 'w') {
+				next_char(&inptr);
+				ignore_ws(&inptr);
+				if (!*inptr || !cpu_profile_write(inptr))
+					console_out(_T("Profile write failed\n"));
+			} else if (*inptr == '1') {
+				cpu_profile_start();
+				if (cpu_profile_active)
+					console_out(_T("Profiler started\n"));
+				else
+					console_out(_T("Profiler start failed, out of memory\n"));
+			} else if (*inptr == '0') {
+				cpu_profile_stop();
+				console_out(_T("Profiler stopped\n"));
+			} else {
+				int lines = 0;
+				if (more_params(&inptr))
+					lines = readint(&inptr, NULL);
+				cpu_profile_report(lines);
+			}
+			break;
 		case 'b':
 			if (staterecorder (&inptr))
 				return true;
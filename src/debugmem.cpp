@@ -3704,6 +3704,32 @@ int debugmem_get_symbol(uaecptr addr, TCHAR *out, int maxsize)
 	return found;
 }
 
+/* Nearest function or global symbol at or below addr, used to attribute
+ * profiler samples. Returns the offset from the symbol, -1 if none. */
+int debugmem_get_function(uaecptr addr, TCHAR *out, int maxsize)
+{
+	struct debugsymbol *best = NULL;
+
+	if (out)
+		out[0] = 0;
+	for (int i = 0; i < symbolcnt; i++) {
+		struct debugsymbol *ds = symbols[i];
+		if (!ds->allocid || ds->value > addr)
+			continue;
+		if (ds->type != SYMBOLTYPE_FUNC && !(ds->flags & SYMBOL_GLOBAL))
+			continue;
+		if (!best || ds->value > best->value)
+			best = ds;
+	}
+	if (!best || addr - best->value >= 65536)
+		return -1;
+	if (out) {
+		_tcsncpy(out, best->name, maxsize - 1);
+		out[maxsize - 1] = 0;
+	}
+	return addr - best->value;
+}
+
 struct debugcodefile *last_codefile;
 
 int debugmem_get_sourceline(uaecptr addr, TCHAR *out, int maxsize)
@@ -34,6 +34,7 @@
 #include "autoconf.h"
 #include "sampler.h"
 #include "newcpu.h"
+#include "cpuprofile.h"
 #include "blitter.h"
 #include "xwin.h"
 #include "custom.h"
@@ -367,6 +368,7 @@ void virtualdevice_free(void)
 	inputdevice_close();
 	DISK_free();
 	//dump_counts();
+	cpu_profile_free();
 #ifdef SERIAL_PORT
 	serial_exit();
 #endif
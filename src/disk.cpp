@@ -185,6 +185,7 @@ typedef struct {
 	drive_filetype filetype;
 	trackid trackdata[MAX_TRACKS];
 	trackid writetrackdata[MAX_TRACKS];
+	uae_u16 *mfmcache[MAX_TRACKS]; /* encoded AmigaDOS tracks */
 	int buffered_cyl, buffered_side;
 	int cyl;
 	bool motoroff;
@@ -765,8 +766,19 @@ static void drive_settype_id (drive *drv)
 #endif
 }
 
+static void drive_mfmcache_free (drive *drv, int tr)
+{
+	for (int i = 0; i < MAX_TRACKS; i++) {
+		if (tr < 0 || i == tr) {
+			xfree (drv->mfmcache[i]);
+			drv->mfmcache[i] = NULL;
+		}
+	}
+}
+
 static void drive_image_free (drive *drv)
 {
+	drive_mfmcache_free (drv, -1);
 	switch (drv->filetype)
 	{
 	case ADF_IPF:
@@ -2061,6 +2073,21 @@ static void read_floppy_data(struct zfile *diskfile, int type, trackid *tid, int
 static void mfmcode (uae_u16 * mfm, int words)
 {
 	uae_u32 lastword = 0;
+	/* four words at a time, clock bit is set if both neighbouring data bits are zero */
+	while (words >= 4) {
+		uae_u64 v = ((uae_u64)mfm[0] << 48) | ((uae_u64)mfm[1] << 32) | ((uae_u64)mfm[2] << 16) | mfm[3];
+		v &= 0x5555555555555555ULL;
+		uae_u64 nv = 0x5555555555555555ULL & ~v;
+		uae_u64 mfmbits = (nv << 1) & ((nv >> 1) | ((uae_u64)(~lastword & 1) << 63));
+		v |= mfmbits;
+		mfm[0] = (uae_u16)(v >> 48);
+		mfm[1] = (uae_u16)(v >> 32);
+		mfm[2] = (uae_u16)(v >> 16);
+		mfm[3] = (uae_u16)v;
+		lastword = (uae_u32)v & 1;
+		mfm += 4;
+		words -= 4;
+	}
 	while (words--) {
 		uae_u32 v = (*mfm) & 0x55555555;
 		uae_u32 lv = (lastword << 16) | v;
@@ -2178,10 +2205,14 @@ static void decode_amigados(drive *drv, int tside)
 	int prevbit;
 
 	trackid *ti = drv->trackdata + tr;
-	memset (dstmfmbuf, 0xaa, len * 2);
-	dstmfmoffset += FLOPPY_GAP_LEN;
 	drv->skipoffset = (FLOPPY_GAP_LEN * 8) / 3 * 2;
 	drv->tracklen = len * 2 * 8;
+	if (drv->mfmcache[tr]) {
+		memcpy (dstmfmbuf, drv->mfmcache[tr], len * 2);
+		return;
+	}
+	memset (dstmfmbuf, 0xaa, len * 2);
+	dstmfmoffset += FLOPPY_GAP_LEN;
 
 	prevbit = 0;
 	for (sec = 0; sec < drv->num_secs; sec++) {
@@ -2274,6 +2305,11 @@ static void decode_amigados(drive *drv, int tside)
 		dstmfmbuf[dstmfmoffset % len] = mfmbuf[i];
 	}
 
+	// head steps back and forth a lot, keep the encoded track until it is written to
+	drv->mfmcache[tr] = xmalloc (uae_u16, len);
+	if (drv->mfmcache[tr])
+		memcpy (drv->mfmcache[tr], dstmfmbuf, len * 2);
+
 	if (disk_debug_logging > 0)
 		write_log (_T("amigados read track %d\n"), tr);
 }
@@ -2919,6 +2955,7 @@ static void drive_write_data (drive * drv)
 	int ret = -1;
 	int tr = drv->cyl * 2 + side;
 
+	drive_mfmcache_free (drv, tr);
 	if (drive_writeprotected (drv) || drv->trackdata[tr].type == TRACK_NONE) {
 		/* read original track back because we didn't really write anything */
 		drv->buffered_side = 2;
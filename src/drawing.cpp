@@ -50,6 +50,7 @@ happening, all ports should restrict window widths to be multiples of 16 pixels.
 #include "picasso96.h"
 #include "drawing.h"
 #include "savestate.h"
+#include "runahead.h"
 #include "statusline.h"
 #include "inputdevice.h"
 #include "debug.h"
@@ -83,6 +84,48 @@ static uae_thread_id drawing_tid = nullptr;
 static smp_comm_pipe *volatile drawing_pipe = nullptr;
 static uae_sem_t drawing_sem = nullptr;
 static bool volatile drawing_thread_busy = false;
+
+/* Band-parallel rendering: finished linestate ranges are handed to a pool of
+ * workers, each drawing a horizontal band of the frame with its own copy of
+ * the per-line state below. */
+#define MAX_DRAWING_WORKERS 8
+#define DRAWING_BAND_LINES 32
+#define DRAWING_BAND_MIN_LINES 8
+#define MAX_DRAWING_BANDS 128
+struct drawing_band_worker {
+	uae_thread_id tid;
+	smp_comm_pipe pipe;
+	frame_time_t time, time_total;
+	int frames;
+};
+static struct drawing_band_worker drawing_workers[MAX_DRAWING_WORKERS];
+static int drawing_worker_count;
+static int drawing_worker_next;
+static uae_sem_t drawing_band_sem = nullptr;
+static volatile uae_atomic drawing_bands_in_flight;
+static int drawing_bands_pending;
+static int drawing_band_next;
+static struct drawing_band_time drawing_band_times[MAX_DRAWING_BANDS];
+static struct drawing_band_time drawing_band_times_last[MAX_DRAWING_BANDS];
+static int drawing_band_count, drawing_band_count_last;
+/* Blanking state that carries over from line to line. The drawing thread
+ * follows it through the frame while queueing bands, each band starts from
+ * the state a single renderer would have had at its first line. */
+struct drawing_band_state {
+	uae_u8 vb_state;
+	int exthblank;
+	bool exthblank_force;
+	bool hblank_debug;
+};
+static struct drawing_band_state drawing_band_states[MAX_DRAWING_BANDS];
+static int drawing_band_replayed;
+static bool drawing_band_replay_started;
+static volatile uae_atomic drawing_reset_gen;
+
+/* State used while a single line is drawn. */
+#define DRAWING_TLS thread_local
+#else
+#define DRAWING_TLS
 #endif
 
 extern int sprite_buffer_res;
@@ -93,8 +136,8 @@ static void pfield_set_linetoscr(void);
 
 int debug_bpl_mask = 0xff, debug_bpl_mask_one;
 
-static struct decision *dp_for_drawing;
-static struct draw_info *dip_for_drawing;
+static DRAWING_TLS struct decision *dp_for_drawing;
+static DRAWING_TLS struct draw_info *dip_for_drawing;
 
 static void lores_set(int lores)
 {
@@ -137,7 +180,7 @@ bool direct_rgb;
 coordinates.  Zero if the resolution is the same, positive if window coordinates
 have a higher resolution (i.e. we're stretching the image), negative if window
 coordinates have a lower resolution (i.e. we're shrinking the image).  */
-static int res_shift;
+static DRAWING_TLS int res_shift;
 
 static int linedbl, linedbld;
 
@@ -146,7 +189,7 @@ int detected_screen_resolution;
 
 #define AUTO_LORES_FRAMES 10
 static int can_use_lores = 0, frame_res, frame_res_lace;
-static int resolution_count[RES_MAX + 1], lines_count;
+static volatile uae_atomic resolution_count[RES_MAX + 1], lines_count;
 static int center_reset;
 static bool init_genlock_data;
 bool need_genlock_data;
@@ -182,10 +225,10 @@ struct spritepixelsbuf {
 	uae_u16 stfmdata;
 	uae_u16 data;
 };
-static struct spritepixelsbuf spritepixels_buffer[MAX_PIXELS_PER_LINE];
-static struct spritepixelsbuf *spritepixels;
-static int sprite_first_x, sprite_last_x;
-static bool sprite_visibility;
+static DRAWING_TLS struct spritepixelsbuf spritepixels_buffer[MAX_PIXELS_PER_LINE];
+static DRAWING_TLS struct spritepixelsbuf *spritepixels;
+static DRAWING_TLS int sprite_first_x, sprite_last_x;
+static DRAWING_TLS bool sprite_visibility;
 
 #ifdef AGA
 /* AGA mode color lookup tables */
@@ -199,17 +242,17 @@ int xredcolor_s, xredcolor_b, xredcolor_m;
 int xgreencolor_s, xgreencolor_b, xgreencolor_m;
 int xbluecolor_s, xbluecolor_b, xbluecolor_m;
 
-struct color_entry colors_for_drawing;
+DRAWING_TLS struct color_entry colors_for_drawing;
 xcolnr fullblack;
 static struct color_entry direct_colors_for_drawing;
 
-static xcolnr *p_acolors;
-static xcolnr *p_xcolors;
+static DRAWING_TLS xcolnr *p_acolors;
+static DRAWING_TLS xcolnr *p_xcolors;
 
 /* The size of these arrays is pretty arbitrary; it was chosen to be "more
 than enough".  The coordinates used for indexing into these arrays are
 almost, but not quite, Amiga coordinates (there's a constant offset).  */
-static union {
+static DRAWING_TLS union {
 	uae_u64 apixels_q[MAX_PIXELS_PER_LINE * 2 / sizeof(uae_u64)];
 	uae_u32 apixels_l[MAX_PIXELS_PER_LINE * 2 / sizeof(uae_u32)];
 	uae_u8  apixels[MAX_PIXELS_PER_LINE * 2];
@@ -227,12 +270,12 @@ uae_u16 spixels[2 * MAX_SPR_PIXELS];
 
 struct sprite_stb spixstate;
 
-static uae_u32 ham_linebuf[MAX_PIXELS_PER_LINE * 2];
+static DRAWING_TLS uae_u32 ham_linebuf[MAX_PIXELS_PER_LINE * 2];
 
 static uae_u8 all_ones[MAX_PIXELS_PER_LINE];
 static uae_u8 all_zeros[MAX_PIXELS_PER_LINE];
 
-uae_u8 *xlinebuffer, *xlinebuffer_genlock;
+DRAWING_TLS uae_u8 *xlinebuffer, *xlinebuffer_genlock;
 
 static int *amiga2aspect_line_map, *native2amiga_line_map;
 static int native2amiga_line_map_height;
@@ -274,14 +317,14 @@ int visible_left_border, visible_right_border;
 static int visible_left_start, visible_right_stop;
 static int visible_top_start, visible_bottom_stop;
 /* same for blank */
-static int vblank_top_start, vblank_bottom_stop;
-static int hblank_left_start, hblank_right_stop;
-static int hblank_left_start_hard, hblank_right_stop_hard;
-static bool extborder, exthblanken, exthblankon;
-static int exthblank;
-static bool exthblank_force;
+static DRAWING_TLS int vblank_top_start, vblank_bottom_stop;
+static DRAWING_TLS int hblank_left_start, hblank_right_stop;
+static DRAWING_TLS int hblank_left_start_hard, hblank_right_stop_hard;
+static DRAWING_TLS bool extborder, exthblanken, exthblankon;
+static DRAWING_TLS int exthblank;
+static DRAWING_TLS bool exthblank_force;
 static int exthblank_set;
-static bool ehb_enable;
+static DRAWING_TLS bool ehb_enable;
 static bool syncdebug;
 
 static int linetoscr_x_adjust_pixbytes, linetoscr_x_adjust_pixels;
@@ -300,23 +343,24 @@ static int first_drawn_line, last_drawn_line;
 /* These are generated by the drawing code from the line_decisions array for
 each line that needs to be drawn.  These are basically extracted out of
 bit fields in the hardware registers.  */
-static int bplmode, bplehb, bplham, bpldualpf, bpldualpfpri;
-static int bpldualpf2of, bplplanecnt, bplmaxplanecnt, ecsshres;
-static int bplbypass, bplcolorburst, bplcolorburst_field;
-static int bplres;
-static int plf1pri, plf2pri, bplxor, bplxorsp, bpland, bpldelay_sh;
-static uae_u32 plf_sprite_mask;
-static int sbasecol[2] = { 16, 16 };
-static int hposblank;
-static bool ecs_genlock_features_active;
-static uae_u8 ecs_genlock_features_mask;
-static bool ecs_genlock_features_colorkey;
-static bool aga_genlock_features_zdclken;
-static bool sprite_smaller_than_64, sprite_smaller_than_64_inuse;
-static bool full_blank;
-static bool hsync_debug, vsync_debug, hblank_debug, vblank_debug;
-static int hcenter_debug;
-static uae_u8 vb_state;
+static DRAWING_TLS int bplmode, bplehb, bplham, bpldualpf, bpldualpfpri;
+static DRAWING_TLS int bpldualpf2of, bplplanecnt, bplmaxplanecnt, ecsshres;
+static DRAWING_TLS int bplbypass, bplcolorburst;
+static int bplcolorburst_field;
+static DRAWING_TLS int bplres;
+static DRAWING_TLS int plf1pri, plf2pri, bplxor, bplxorsp, bpland, bpldelay_sh;
+static DRAWING_TLS uae_u32 plf_sprite_mask;
+static DRAWING_TLS int sbasecol[2] = { 16, 16 };
+static DRAWING_TLS int hposblank;
+static DRAWING_TLS bool ecs_genlock_features_active;
+static DRAWING_TLS uae_u8 ecs_genlock_features_mask;
+static DRAWING_TLS bool ecs_genlock_features_colorkey;
+static DRAWING_TLS bool aga_genlock_features_zdclken;
+static DRAWING_TLS bool sprite_smaller_than_64, sprite_smaller_than_64_inuse;
+static DRAWING_TLS bool full_blank;
+static DRAWING_TLS bool hsync_debug, vsync_debug, hblank_debug, vblank_debug;
+static DRAWING_TLS int hcenter_debug;
+static DRAWING_TLS uae_u8 vb_state;
 
 uae_sem_t gui_sem;
 
@@ -400,7 +444,7 @@ static void count_frame(int monid)
 	ad->framecnt++;
 	if (ad->framecnt >= currprefs.gfx_framerate || currprefs.monitoremu == MONITOREMU_A2024)
 		ad->framecnt = 0;
-	if (ad->inhibit_frame)
+	if (ad->inhibit_frame || runahead_frame_hidden())
 		ad->framecnt = 1;
 }
 
@@ -1069,22 +1113,22 @@ STATIC_INLINE int get_shdelay_add(void)
 where do we start drawing the playfield, where do we start drawing the right border.
 All of these are forced into the visible window (VISIBLE_LEFT_BORDER .. VISIBLE_RIGHT_BORDER).
 PLAYFIELD_START and PLAYFIELD_END are in window coordinates.  */
-static int playfield_start_pre, playfield_end_pre;
-static int playfield_start, playfield_end;
-static int real_playfield_start, real_playfield_end;
-static int playfield_diff;
-static int sprite_playfield_start, sprite_end;
-static int may_require_hard_way;
-static int linetoscr_diw_start, linetoscr_diw_end;
-static int native_ddf_left, native_ddf_right;
+static DRAWING_TLS int playfield_start_pre, playfield_end_pre;
+static DRAWING_TLS int playfield_start, playfield_end;
+static DRAWING_TLS int real_playfield_start, real_playfield_end;
+static DRAWING_TLS int playfield_diff;
+static DRAWING_TLS int sprite_playfield_start, sprite_end;
+static DRAWING_TLS int may_require_hard_way;
+static DRAWING_TLS int linetoscr_diw_start, linetoscr_diw_end;
+static DRAWING_TLS int native_ddf_left, native_ddf_right;
 #if 0
 static int hamleftborderhidden;
 #endif
 
-static int pixels_offset;
-static int src_pixel;
+static DRAWING_TLS int pixels_offset;
+static DRAWING_TLS int src_pixel;
 /* How many pixels in window coordinates which are to the left of the left border.  */
-static int unpainted;
+static DRAWING_TLS int unpainted;
 
 // blank = -1: force normal border color even if borderblank is active
 static xcolnr getbgc(int blank)
@@ -1730,7 +1774,7 @@ static void fill_line_border(int lineno, int bordertype)
 	}
 }
 
-static int sprite_shdelay;
+static DRAWING_TLS int sprite_shdelay;
 #define SPRITE_DEBUG 0
 static uae_u8 render_sprites(int pos, int dualpf, uae_u8 apixel, int aga)
 {
@@ -2217,9 +2261,9 @@ static int linetoscr_16_shrink2f_sh(int spix, int dpix, int stoppos)
 typedef int(*call_linetoscr)(int spix, int dpix, int dpix_end);
 typedef int(*call_linetoscrb)(int spix, int dpix, int dpix_end, int blank);
 
-static call_linetoscr pfield_do_linetoscr_normal, pfield_do_linetoscr_normal2;
-static call_linetoscr pfield_do_linetoscr_sprite, pfield_do_linetoscr_sprite2;
-static call_linetoscrb pfield_do_linetoscr_spriteonly;
+static DRAWING_TLS call_linetoscr pfield_do_linetoscr_normal, pfield_do_linetoscr_normal2;
+static DRAWING_TLS call_linetoscr pfield_do_linetoscr_sprite, pfield_do_linetoscr_sprite2;
+static DRAWING_TLS call_linetoscrb pfield_do_linetoscr_spriteonly;
 
 static void pfield_do_linetoscr(int start, int stop, int blank)
 {
@@ -2265,8 +2309,8 @@ static int pfield_do_nothingb(int a, int b, int c, int d)
 }
 
 /* AGA subpixel delay hack */
-static call_linetoscr pfield_do_linetoscr_shdelay_normal;
-static call_linetoscr pfield_do_linetoscr_shdelay_sprite;
+static DRAWING_TLS call_linetoscr pfield_do_linetoscr_shdelay_normal;
+static DRAWING_TLS call_linetoscr pfield_do_linetoscr_shdelay_sprite;
 
 static int pfield_do_linetoscr_normal_shdelay(int spix, int dpix, int dpix_end)
 {
@@ -2665,8 +2709,8 @@ static void dummy_worker (int start, int stop, int blank)
 {
 }
 
-static int ham_decode_pixel;
-static uae_u32 ham_lastcolor;
+static DRAWING_TLS int ham_decode_pixel;
+static DRAWING_TLS uae_u32 ham_lastcolor;
 
 static void decode_ham_pixel(int hdp)
 {
@@ -3527,8 +3571,8 @@ static void pfield_expand_dp_bplconx (int regno, int v, int hp, int vp)
 	set_res_shift();
 }
 
-static int drawing_color_matches;
-static enum { color_match_acolors, color_match_full } color_match_type;
+static DRAWING_TLS int drawing_color_matches;
+static DRAWING_TLS enum { color_match_acolors, color_match_full } color_match_type;
 
 /* Set up colors_for_drawing to the state at the beginning of the currently drawn
 line.  Try to avoid copying color tables around whenever possible.  */
@@ -3822,8 +3866,8 @@ static void pfield_draw_line(struct vidbuffer *vb, int lineno, int gfx_ypos, int
 	dip_for_drawing = curr_drawinfo + lineno;
 
 	if (dp_for_drawing->plfleft >= 0) {
-		lines_count++;
-		resolution_count[dp_for_drawing->bplres]++;
+		atomic_inc(&lines_count);
+		atomic_inc(&resolution_count[dp_for_drawing->bplres]);
 	}
 
 	switch (ls)
@@ -4596,12 +4640,97 @@ static void refresh_indicator_update(struct vidbuffer *vb)
 
 #define LARGEST_LINE_DEBUG 0
 
-static void draw_frame2(struct vidbuffer *vbin, struct vidbuffer *vbout)
+static void reset_line_drawing_state(void)
+{
+	vb_state = 0;
+	exthblank = 0;
+	exthblank_force = false;
+	exthblanken = false;
+	exthblankon = false;
+	extborder = false;
+	ehb_enable = true;
+	hblank_debug = vblank_debug = hsync_debug = vsync_debug = false;
+	hcenter_debug = 0;
+	memset(spritepixels_buffer, 0, sizeof(spritepixels_buffer));
+	memset(ham_linebuf, 0, sizeof(ham_linebuf));
+	ecs_genlock_features_active = false;
+	aga_genlock_features_zdclken = false;
+	ecs_genlock_features_colorkey = false;
+}
+
+#ifdef AMIBERRY
+static DRAWING_TLS uae_atomic drawing_reset_gen_seen;
+#endif
+
+/* Per-line state is private to the drawing thread(s), sync it with
+ * reset_drawing() and the frame setup done by the emulation thread. */
+static void begin_drawing_pass(void)
+{
+#ifdef AMIBERRY
+	if (drawing_reset_gen_seen != drawing_reset_gen) {
+		drawing_reset_gen_seen = drawing_reset_gen;
+		reset_line_drawing_state();
+	}
+#endif
+	drawing_color_matches = -1;
+	pfield_set_linetoscr();
+}
+
+#ifdef AMIBERRY
+static void save_band_state(struct drawing_band_state *st)
+{
+	st->vb_state = vb_state;
+	st->exthblank = exthblank;
+	st->exthblank_force = exthblank_force;
+	st->hblank_debug = hblank_debug;
+}
+
+static void load_band_state(const struct drawing_band_state *st)
+{
+	vb_state = st->vb_state;
+	expand_vb_state();
+	exthblank = st->exthblank;
+	exthblank_force = st->exthblank_force;
+	hblank_debug = st->hblank_debug;
+}
+
+/* Run the colour change records of lines [drawing_band_replayed, first) on
+ * the calling thread's state without drawing anything. */
+static void replay_band_lines(int first)
+{
+	if (!drawing_band_replay_started) {
+		begin_drawing_pass();
+		set_vblanking_limits();
+		reset_hblanking_limits();
+		set_hblanking_limits();
+		extblankcheck();
+		expand_vb_state();
+		// same two lines draw_frame_range() scans before the first line
+		drawing_band_replayed = -2;
+		drawing_band_replay_started = true;
+	}
+	for (; drawing_band_replayed < first; drawing_band_replayed++) {
+		int line = drawing_band_replayed + thisframe_y_adjust_real;
+		if (line < 0)
+			continue;
+		dp_for_drawing = line_decisions + line;
+		dip_for_drawing = curr_drawinfo + line;
+		if (vb_state != dp_for_drawing->vb) {
+			vb_state = dp_for_drawing->vb;
+			expand_vb_state();
+		}
+		do_color_changes(NULL, NULL, -1);
+	}
+}
+#endif
+
+static void draw_frame_range(struct vidbuffer *vbin, struct vidbuffer *vbout, int first, int last, const struct drawing_band_state *st)
 {
 #if LARGEST_LINE_DEBUG
 	int largest = 0;
 #endif
 
+	begin_drawing_pass();
 	set_vblanking_limits();
 	reset_hblanking_limits();
 	set_hblanking_limits();
@@ -4609,8 +4738,14 @@ static void draw_frame2(struct vidbuffer *vbin, struct vidbuffer *vbout)
 	expand_vb_state();
 
 	bool firstline = true;
-	int lastline = thisframe_y_adjust_real - (1 << linedbl);
-	for (int i = 0; i < max_ypos_thisframe1; i++) {
+#ifdef AMIBERRY
+	if (st) {
+		load_band_state(st);
+		firstline = false;
+	}
+#endif
+	int lastline = first + thisframe_y_adjust_real - (1 << linedbl);
+	for (int i = first; i < last; i++) {
 		int i1 = i + min_ypos_for_screen;
 		int line = i + thisframe_y_adjust_real;
 		int whereline = amiga2aspect_line_map[i1];
@@ -4659,6 +4794,11 @@ static void draw_frame2(struct vidbuffer *vbin, struct vidbuffer *vbout)
 #endif
 }
 
+static void draw_frame2(struct vidbuffer *vbin, struct vidbuffer *vbout)
+{
+	draw_frame_range(vbin, vbout, 0, max_ypos_thisframe1, NULL);
+}
+
 static void draw_frame_extras(struct vidbuffer *vb, int y_start, int y_end)
 {
 #ifdef DEBUGGER
@@ -4718,6 +4858,7 @@ void draw_lines(int end, int section)
 	if (!lockscr(vb, false, vb->last_drawn_line ? false : true, display_reset > 0))
 		return;
 
+	begin_drawing_pass();
 	set_vblanking_limits();
 	reset_hblanking_limits();
 	set_hblanking_limits();
@@ -5087,6 +5228,165 @@ bool vsync_handle_check (void)
 }
 
 #ifdef AMIBERRY
+static int drawing_band_thread(void *arg)
+{
+	auto *w = static_cast<struct drawing_band_worker*>(arg);
+	struct vidbuf_description *vidinfo = &adisplays[0].gfxvidinfo;
+
+	for (;;) {
+		const int first = read_comm_pipe_int_blocking(&w->pipe);
+		if (first < 0)
+			break;
+		const int last = read_comm_pipe_int_blocking(&w->pipe);
+		const int slot = read_comm_pipe_int_blocking(&w->pipe);
+		const frame_time_t start = read_processor_time();
+		draw_frame_range(&vidinfo->drawbuffer, &vidinfo->drawbuffer, first, last, slot >= 0 ? &drawing_band_states[slot] : NULL);
+		const frame_time_t t = read_processor_time() - start;
+		w->time += t;
+		if (slot >= 0)
+			drawing_band_times[slot].time = static_cast<int>(t);
+		atomic_dec(&drawing_bands_in_flight);
+		uae_sem_post(&drawing_band_sem);
+	}
+	return 0;
+}
+
+static void stop_drawing_workers(void)
+{
+	for (int i = 0; i < drawing_worker_count; i++) {
+		struct drawing_band_worker *w = &drawing_workers[i];
+		write_comm_pipe_int(&w->pipe, -1, 1);
+		uae_wait_thread(&w->tid);
+		destroy_comm_pipe(&w->pipe);
+		if (w->frames > 0)
+			write_log(_T("Drawing worker %d: %d frames, average %d us per frame\n"), i, w->frames, static_cast<int>(w->time_total / w->frames));
+	}
+	drawing_worker_count = 0;
+	if (drawing_band_sem) {
+		uae_sem_destroy(&drawing_band_sem);
+		drawing_band_sem = nullptr;
+	}
+}
+
+static void start_drawing_workers(int count)
+{
+	uae_sem_init(&drawing_band_sem, 0, 0);
+	for (int i = 0; i < count; i++) {
+		struct drawing_band_worker *w = &drawing_workers[i];
+		memset(w, 0, sizeof(struct drawing_band_worker));
+		init_comm_pipe(&w->pipe, 60, 3);
+		uae_start_thread(_T("drawing band"), drawing_band_thread, w, &w->tid);
+	}
+	drawing_worker_count = count;
+	drawing_worker_next = 0;
+	write_log(_T("Band-parallel drawing: %d workers\n"), count);
+}
+
+/* Called by the drawing thread between frames, no bands are in flight. */
+static void check_drawing_workers(void)
+{
+	int count = 0;
+	if (currprefs.multithreaded_drawing_workers > 1)
+		count = std::min(currprefs.multithreaded_drawing_workers, MAX_DRAWING_WORKERS);
+	if (count == drawing_worker_count)
+		return;
+	stop_drawing_workers();
+	if (count > 0)
+		start_drawing_workers(count);
+}
+
+static void dispatch_drawing_band(int first, int last)
+{
+	struct drawing_band_worker *w = &drawing_workers[drawing_worker_next];
+	int slot = -1;
+	if (drawing_band_count < MAX_DRAWING_BANDS) {
+		slot = drawing_band_count++;
+		drawing_band_times[slot].first_line = first;
+		drawing_band_times[slot].last_line = last;
+		drawing_band_times[slot].worker = drawing_worker_next;
+		drawing_band_times[slot].time = 0;
+		replay_band_lines(first);
+		save_band_state(&drawing_band_states[slot]);
+	}
+	drawing_worker_next = (drawing_worker_next + 1) % drawing_worker_count;
+	atomic_inc(&drawing_bands_in_flight);
+	drawing_bands_pending++;
+	write_comm_pipe_int(&w->pipe, first, 0);
+	write_comm_pipe_int(&w->pipe, last, 0);
+	write_comm_pipe_int(&w->pipe, slot, 1);
+}
+
+/* Don't split a doubled line from the line it was doubled from, drawing a
+ * LINE_DECIDED_DOUBLE line also updates the linestate of the line below. */
+static int drawing_band_boundary(int i, int limit)
+{
+	while (i < limit) {
+		int ls = linestate[i + thisframe_y_adjust_real];
+		int lsprev = linestate[i + thisframe_y_adjust_real - 1];
+		if (ls != LINE_AS_PREVIOUS && ls != LINE_DONE_AS_PREVIOUS && ls != LINE_REMEMBERED_AS_PREVIOUS && lsprev != LINE_DECIDED_DOUBLE)
+			break;
+		i++;
+	}
+	return i;
+}
+
+static void queue_drawing_bands(bool frame_done)
+{
+	int limit = std::min(linestate_first_undecided - thisframe_y_adjust_real, max_ypos_thisframe1);
+	if (!frame_done) {
+		// Lines next to the beam can still change (nln_lower, doubled lines)
+		limit -= 2;
+		while (limit - drawing_band_next >= DRAWING_BAND_LINES) {
+			int last = drawing_band_boundary(drawing_band_next + DRAWING_BAND_LINES, limit);
+			dispatch_drawing_band(drawing_band_next, last);
+			drawing_band_next = last;
+		}
+		return;
+	}
+	int remaining = limit - drawing_band_next;
+	if (remaining <= 0)
+		return;
+	int lines = std::max((remaining + drawing_worker_count - 1) / drawing_worker_count, DRAWING_BAND_MIN_LINES);
+	while (drawing_band_next < limit) {
+		int last = drawing_band_boundary(std::min(drawing_band_next + lines, limit), limit);
+		dispatch_drawing_band(drawing_band_next, last);
+		drawing_band_next = last;
+	}
+}
+
+static void finish_drawing_bands(void)
+{
+	while (drawing_bands_pending > 0) {
+		uae_sem_wait(&drawing_band_sem);
+		drawing_bands_pending--;
+	}
+	for (int i = 0; i < drawing_worker_count; i++) {
+		struct drawing_band_worker *w = &drawing_workers[i];
+		w->time_total += w->time;
+		w->time = 0;
+		w->frames++;
+	}
+	memcpy(drawing_band_times_last, drawing_band_times, sizeof(struct drawing_band_time) * drawing_band_count);
+	drawing_band_count_last = drawing_band_count;
+	drawing_band_count = 0;
+	drawing_band_next = 0;
+	drawing_band_replay_started = false;
+}
+
+/* Wait until no band worker is touching the drawing state. */
+static void wait_drawing_bands(void)
+{
+	while (drawing_bands_in_flight > 0)
+		sleep_micros(1);
+}
+
+int get_drawing_band_times(struct drawing_band_time *bands, int max)
+{
+	int count = std::min(drawing_band_count_last, max);
+	memcpy(bands, drawing_band_times_last, sizeof(struct drawing_band_time) * count);
+	return count;
+}
+
 void quit_drawing_thread()
 {
 	while (drawing_thread_busy)
@@ -5404,19 +5704,16 @@ void reset_drawing(void)
 	struct amigadisplay *ad = &adisplays[monid];
 	struct vidbuf_description *vidinfo = &ad->gfxvidinfo;
 
+#ifdef AMIBERRY
+	wait_drawing_bands();
+	atomic_inc(&drawing_reset_gen);
+#endif
+
 	syncdebug = currprefs.gfx_overscanmode >= OVERSCANMODE_ULTRA;
 	max_diwstop = 0;
-	vb_state = 0;
-	exthblank = 0;
-	exthblank_force = false;
 	exthblank_set = syncdebug ? -1 : 1;
-	exthblanken = false;
-	exthblankon = false;
-	extborder = false;
 	display_reset = 1;
-	ehb_enable = true;
-	hblank_debug = vblank_debug = hsync_debug = vsync_debug = false;
-	hcenter_debug = 0;
+	reset_line_drawing_state();
 
 	lores_reset ();
 
@@ -5434,9 +5731,7 @@ void reset_drawing(void)
 
 	memset(spixels, 0, sizeof spixels);
 	memset(&spixstate, 0, sizeof spixstate);
-	memset(spritepixels_buffer, 0, sizeof(spritepixels_buffer));
 	memset(line_data, 0, sizeof(line_data));
-	memset(ham_linebuf, 0, sizeof(ham_linebuf));
 
 	init_hardware_for_drawing_frame();
 		
@@ -5456,9 +5751,6 @@ void reset_drawing(void)
 	center_reset = 1;
 	ad->specialmonitoron = false;
 	bplcolorburst_field = 1;
-	ecs_genlock_features_active = false;
-	aga_genlock_features_zdclken = false;
-	ecs_genlock_features_colorkey = false;
 }
 
 static void gen_direct_drawing_table(void)
@@ -5475,6 +5767,7 @@ static void gen_direct_drawing_table(void)
 #ifdef AMIBERRY
 static int drawing_thread(void *unused)
 {
+	check_drawing_workers();
 	for (;;) {
 		drawing_thread_busy = false;
 		const auto signal = read_comm_pipe_u32_blocking(drawing_pipe);
@@ -5482,15 +5775,25 @@ static int drawing_thread(void *unused)
 		switch (signal) {
 
 			case RENDER_SIGNAL_PARTIAL:
-				draw_lines(0, 0);
+				if (drawing_worker_count > 0)
+					queue_drawing_bands(false);
+				else
+					draw_lines(0, 0);
 				break;
 
 			case RENDER_SIGNAL_FRAME_DONE:
+				if (drawing_worker_count > 0) {
+					queue_drawing_bands(true);
+					finish_drawing_bands();
+				}
 				finish_drawing_frame(true);
+				check_drawing_workers();
 				uae_sem_post(&drawing_sem);
 				break;
 
 			case RENDER_SIGNAL_QUIT:
+				finish_drawing_bands();
+				stop_drawing_workers();
 				drawing_tid = nullptr;
 				if (drawing_pipe)
 				{
@@ -39,6 +39,19 @@ static const int slirp_ports[] = { 21, 22, 23, 80, 0 };
 static struct ethernet_data *slirp_data;
 static bool slirp_inited;
 uae_sem_t slirp_sem1, slirp_sem2;
+
+/* Packets slirp sends to the guest are queued while slirp runs and
+ * handed to the device in one batch afterwards. Two queues: slirp
+ * fills one while the other is delivered. */
+#define SLIRP_OUTQUEUE_MAX (4 * 1024 * 1024)
+struct slirp_outqueue
+{
+	uae_u8 *buf;
+	int size, alloc;
+};
+static struct slirp_outqueue slirp_outq[2];
+static int slirp_outq_cur;
+static uae_sem_t slirp_outsem;
 static int netmode;
 
 static struct netdriverdata slirpd =
@@ -64,12 +77,60 @@ void slirp_output (const uint8_t *pkt, int pkt_len)
 {
 	if (!slirp_data)
 		return;
-	gui_flicker_led(LED_NET, 0, gui_data.net | 1);
+	uae_sem_wait (&slirp_outsem);
+	struct slirp_outqueue *q = &slirp_outq[slirp_outq_cur];
+	int size = q->size + sizeof (int) + pkt_len;
+	if (size > q->alloc) {
+		int alloc = q->alloc ? q->alloc * 2 : 65536;
+		while (alloc < size)
+			alloc *= 2;
+		uae_u8 *buf = size <= SLIRP_OUTQUEUE_MAX ? xrealloc (uae_u8, q->buf, alloc) : NULL;
+		if (!buf) {
+			/* device is not keeping up, the guest's TCP retransmits */
+			uae_sem_post (&slirp_outsem);
+			return;
+		}
+		q->buf = buf;
+		q->alloc = alloc;
+	}
+	memcpy (q->buf + q->size, &pkt_len, sizeof (int));
+	memcpy (q->buf + q->size + sizeof (int), pkt, pkt_len);
+	q->size = size;
+	uae_sem_post (&slirp_outsem);
+}
+
+void slirp_flush (void)
+{
+	if (!slirp_data)
+		return;
 	uae_sem_wait (&slirp_sem1);
-	slirp_data->gotfunc (slirp_data->userdata, pkt, pkt_len);
+	uae_sem_wait (&slirp_outsem);
+	struct slirp_outqueue *q = &slirp_outq[slirp_outq_cur];
+	slirp_outq_cur ^= 1;
+	uae_sem_post (&slirp_outsem);
+	if (q->size)
+		gui_flicker_led(LED_NET, 0, gui_data.net | 1);
+	for (int pos = 0; pos < q->size;) {
+		int len;
+		memcpy (&len, q->buf + pos, sizeof (int));
+		pos += sizeof (int);
+		slirp_data->gotfunc (slirp_data->userdata, q->buf + pos, len);
+		pos += len;
+	}
+	q->size = 0;
 	uae_sem_post (&slirp_sem1);
 }
 
+static void slirp_outqueue_free (void)
+{
+	for (int i = 0; i < 2; i++) {
+		xfree (slirp_outq[i].buf);
+		slirp_outq[i].buf = NULL;
+		slirp_outq[i].size = slirp_outq[i].alloc = 0;
+	}
+	slirp_outq_cur = 0;
+}
+
 void ethernet_trigger (struct netdriverdata *ndd, void *vsd)
 {
 	if (!ndd)
@@ -84,15 +145,26 @@ void ethernet_trigger (struct netdriverdata *ndd, void *vsd)
 			struct ethernet_data *ed = (struct ethernet_data*)vsd;
 			if (slirp_data) {
 				uae_u8 pkt[4000];
-				int len = sizeof pkt;
-				int v;
-				uae_sem_wait (&slirp_sem1);
-				v = slirp_data->getfunc(ed->userdata, pkt, &len);
-				uae_sem_post (&slirp_sem1);
-				if (v) {
+				int len;
+				int v, cnt = 0;
+				/* take everything the device has queued for sending */
+				for (;;) {
+					len = sizeof pkt;
+					uae_sem_wait (&slirp_sem1);
+					v = slirp_data->getfunc(ed->userdata, pkt, &len);
+					uae_sem_post (&slirp_sem1);
+					if (!v)
+						break;
 					uae_sem_wait (&slirp_sem2);
 					uae_slirp_input(pkt, len);
 					uae_sem_post (&slirp_sem2);
+					cnt++;
+				}
+				if (cnt) {
+					/* replies slirp generated directly, then let the
+					 * slirp thread see new sockets and data to send */
+					slirp_flush ();
+					uae_slirp_wakeup ();
 				}
 			}
 		}
@@ -121,6 +193,7 @@ int ethernet_open (struct netdriverdata *ndd, void *vsd, void *user, ethernet_go
 			slirp_data = ed;
 			uae_sem_init (&slirp_sem1, 0, 1);
 			uae_sem_init (&slirp_sem2, 0, 1);
+			uae_sem_init (&slirp_outsem, 0, 1);
 			uae_slirp_init();
 			for (int i = 0; i < MAX_SLIRP_REDIRS; i++) {
 				struct slirp_redir *sr = &currprefs.slirp_redirs[i];
@@ -186,6 +259,8 @@ void ethernet_close (struct netdriverdata *ndd, void *vsd)
 			uae_slirp_cleanup ();
 			uae_sem_destroy (&slirp_sem1);
 			uae_sem_destroy (&slirp_sem2);
+			uae_sem_destroy (&slirp_outsem);
+			slirp_outqueue_free ();
 		}
 		return;
 #endif
@@ -24,6 +24,7 @@
 #endif
 #include "audio.h"
 #include "cia.h"
+#include "cpuprofile.h"
 
 static const int pissoff_nojit_value = 256 * CYCLE_UNIT;
 
@@ -309,6 +310,10 @@ void do_cycles_slow(int cycles_to_add)
 				if (eventtab[i].handler == NULL) {
 					gui_message(_T("eventtab[%d].handler is null!\n"), i);
 					eventtab[i].active = 0;
+				} else if (cpu_profile_active) {
+					uae_u64 t = cpu_profile_clock();
+					(*eventtab[i].handler)();
+					cpu_profile_event(i, t);
 				} else {
 					(*eventtab[i].handler)();
 				}
@@ -323,6 +328,17 @@ void do_cycles_slow(int cycles_to_add)
 static ev2 *last_event2;
 static ev2 dummy_event;
 
+static void ev2_call(ev2 *e)
+{
+	if (cpu_profile_active) {
+		uae_u64 t = cpu_profile_clock();
+		e->handler(e->data);
+		cpu_profile_event(ev_max + (e == &eventtab2[ev2_blitter] ? 0 : 1), t);
+		return;
+	}
+	e->handler(e->data);
+}
+
 void MISC_handler(void)
 {
 	static bool dorecheck;
@@ -347,13 +363,13 @@ void MISC_handler(void)
 			if (e->active) {
 				if (e->evtime == ct) {
 					e->active = false;
-					e->handler(e->data);
+					ev2_call(e);
 					ev2 *e2 = e->next;
 					if (e2) {
 						e->next = NULL;
 						if (e2->active && e2->evtime == e->evtime + 1) {
 							e2->active = false;
-							e2->handler(e2->data);
+							ev2_call(e2);
 						}
 					}
 					if (dorecheck || e->active) {
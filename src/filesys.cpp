@@ -30,6 +30,9 @@
 #include "traps.h"
 #include "uae.h"
 #include "memory.h"
+#ifdef AMIBERRY
+#include "uae/mman.h"
+#endif
 #include "custom.h"
 #include "events.h"
 #include "newcpu.h"
@@ -40,6 +43,7 @@
 #include "scsidev.h"
 #include "uaeserial.h"
 #include "fsdb.h"
+#include "fsjournal.h"
 #include "zfile.h"
 #include "zarchive.h"
 #include "gui.h"
@@ -429,6 +433,14 @@ typedef struct key {
 	int createmode;
 	int notifyactive;
 	struct lockrecord *record;
+	/* read-ahead or write-behind data at buf_pos */
+	uae_u8 *buf;
+	unsigned int buf_alloc, buf_len;
+	uae_u64 buf_pos;
+	bool buf_dirty;
+	bool host_stale;
+	unsigned int ra_size;
+	uae_u64 ra_next;
 } Key;
 
 typedef struct notify {
@@ -436,6 +448,9 @@ typedef struct notify {
 	uaecptr notifyrequest;
 	TCHAR *fullname;
 	TCHAR *partname;
+	/* directory kept watched for host side changes */
+	bool watching;
+	uae_u32 watchuniq;
 } Notify;
 
 typedef struct exallkey {
@@ -451,7 +466,7 @@ typedef struct exallkey {
 
 #define EXKEYS 128
 #define EXALLKEYS 100
-#define MAX_AINO_HASH 128
+#define MIN_AINO_HASH 1024
 #define NOTIFY_HASH_SIZE 127
 
 /* handler state info */
@@ -476,6 +491,8 @@ typedef struct _unit {
 	volatile unsigned int cmds_sent;
 	volatile unsigned int cmds_complete;
 	volatile unsigned int cmds_acked;
+	/* packets queued to or running in the unit thread */
+	volatile uae_atomic packets_pending;
 
 	/* ExKeys */
 	ExamineKey examine_keys[EXKEYS];
@@ -493,10 +510,17 @@ typedef struct _unit {
 
 	a_inode rootnode;
 	unsigned int aino_cache_size;
-	a_inode *aino_hash[MAX_AINO_HASH];
+	/* all a_inodes except rootnode, by uniq and by parent + nname */
+	a_inode **aino_hash;
+	a_inode **aino_name_hash;
+	unsigned int aino_hash_size;
+	unsigned int aino_hash_count;
 	unsigned int nr_cache_hits;
 	unsigned int nr_cache_lookups;
 
+	struct fsdb_dircache_set *dircache;
+	int dircache_mountcount;
+
 	struct notify *notifyhash[NOTIFY_HASH_SIZE];
 
 	int volflags;
@@ -915,6 +939,7 @@ void uci_set_defaults (struct uaedev_config_info *uci, bool rdb)
 	uci->priority = 10;
 	uci->sectorsperblock = 1;
 	uci->device_emu_unit = -1;
+	uci->overlay = HDF_OVERLAY_DEFAULT;
 }
 
 static void get_usedblocks(struct fs_usage *fsu, bool fs, int *pblocksize, uae_s64 *pnumblocks, uae_s64 *pinuse, bool reduce)
@@ -1814,10 +1839,14 @@ static uae_u32 fs_fsize (struct fs_filehandle *fsf)
 	return (uae_u32)fs_fsize64 (fsf);
 }
 
-static uae_s64 key_filesize(Key *k)
+static int key_flush (Key *k);
+static void key_flush_aino (Unit *unit, Key *k);
+static uae_s64 key_filesize(Unit *unit, Key *k)
 {
 	if (k->aino->vfso)
 		return k->aino->vfso->size;
+	key_flush (k);
+	key_flush_aino (unit, k);
 	return fs_fsize64 (k->fd);
 }
 static uae_s64 key_seek(Key *k, uae_s64 offset, int whence)
@@ -1827,6 +1856,159 @@ static uae_s64 key_seek(Key *k, uae_s64 offset, int whence)
 	return fs_lseek64 (k->fd, offset, whence);
 }
 
+/* Host side buffering of directory filesystem keys.
+ * Reads are served from a read-ahead window that doubles while access
+ * stays sequential, consecutive writes are collected and written in one
+ * go. Both use positional I/O, the host file offset is only updated by
+ * key_sync(), which handle_packet() calls before any packet other than
+ * read and write. */
+
+#define KEY_BUF_MIN 4096
+#define KEY_BUF_MAX (256 * 1024)
+
+static bool key_buffered (Key *k)
+{
+	return k->fd && k->fd->fstype == FS_DIRECTORY && !k->aino->vfso;
+}
+
+static bool key_buf_alloc (Key *k, unsigned int size)
+{
+	if (k->buf_alloc >= size)
+		return true;
+	uae_u8 *b = xrealloc (uae_u8, k->buf, size);
+	if (!b)
+		return false;
+	k->buf = b;
+	k->buf_alloc = size;
+	return true;
+}
+
+/* write pending data, -1 = write failed and data was lost */
+static int key_flush (Key *k)
+{
+	if (!k->buf_dirty)
+		return 0;
+	unsigned int len = k->buf_len;
+	k->buf_dirty = false;
+	k->buf_len = 0;
+	return my_pwrite (k->fd->of, k->buf, len, k->buf_pos) == len ? 0 : -1;
+}
+
+/* returns true if buffered data was written */
+static bool key_sync (Key *k)
+{
+	if (!key_buffered (k))
+		return false;
+	bool dirty = k->buf_dirty;
+	if (key_flush (k) < 0)
+		write_log (_T("FS: delayed write to '%s' failed\n"), k->aino->nname);
+	k->buf_len = 0;
+	if (k->host_stale) {
+		fs_lseek64 (k->fd, k->file_pos, SEEK_SET);
+		k->host_stale = false;
+	}
+	return dirty;
+}
+
+/* write pending data of other handles of the same file */
+static void key_flush_aino (Unit *unit, Key *k)
+{
+	for (Key *k2 = unit->keys; k2; k2 = k2->next) {
+		if (k2 != k && k2->aino == k->aino && k2->buf_dirty && key_flush (k2) < 0)
+			write_log (_T("FS: delayed write to '%s' failed\n"), k2->aino->nname);
+	}
+}
+
+static bool key_sync_all (Unit *unit)
+{
+	bool written = false;
+	for (Key *k = unit->keys; k; k = k->next)
+		written |= key_sync (k);
+	return written;
+}
+
+static void key_buf_free (Key *k)
+{
+	xfree (k->buf);
+	k->buf = NULL;
+	k->buf_alloc = k->buf_len = 0;
+}
+
+static bool key_inbuf (Key *k, uae_u64 pos, unsigned int size)
+{
+	return k->buf_len && !k->buf_dirty && pos >= k->buf_pos && pos + size <= k->buf_pos + k->buf_len;
+}
+
+static unsigned int key_read (Unit *unit, Key *k, uae_u64 pos, uae_u8 *b, unsigned int size)
+{
+	unsigned int total = 0;
+
+	if (!key_buffered (k))
+		return fs_read (k->fd, b, size);
+	if (key_flush (k) < 0)
+		return 0;
+	key_flush_aino (unit, k);
+	k->host_stale = true;
+	bool seq = pos == k->ra_next;
+	while (size > 0) {
+		if (k->buf_len && pos >= k->buf_pos && pos < k->buf_pos + k->buf_len) {
+			unsigned int off = (unsigned int)(pos - k->buf_pos);
+			unsigned int len = k->buf_len - off;
+			if (len > size)
+				len = size;
+			memcpy (b, k->buf + off, len);
+			b += len;
+			pos += len;
+			size -= len;
+			total += len;
+			continue;
+		}
+		if (!seq || !k->ra_size)
+			k->ra_size = KEY_BUF_MIN;
+		else if (k->ra_size < KEY_BUF_MAX)
+			k->ra_size *= 2;
+		if (size >= k->ra_size || !key_buf_alloc (k, k->ra_size)) {
+			unsigned int len = my_pread (k->fd->of, b, size, pos);
+			pos += len;
+			total += len;
+			break;
+		}
+		k->buf_pos = pos;
+		k->buf_len = my_pread (k->fd->of, k->buf, k->ra_size, pos);
+		if (!k->buf_len)
+			break;
+		seq = true;
+	}
+	k->ra_next = pos;
+	return total;
+}
+
+static unsigned int key_write (Unit *unit, Key *k, uae_u64 pos, uae_u8 *b, unsigned int size)
+{
+	if (!key_buffered (k))
+		return fs_write (k->fd, b, size);
+	/* other handles of the same file must not see stale data */
+	for (Key *k2 = unit->keys; k2; k2 = k2->next) {
+		if (k2 != k && k2->aino == k->aino)
+			key_sync (k2);
+	}
+	k->host_stale = true;
+	if (k->buf_dirty && (pos != k->buf_pos + k->buf_len || k->buf_len + size > KEY_BUF_MAX)) {
+		if (key_flush (k) < 0)
+			return 0;
+	}
+	if (!k->buf_dirty) {
+		k->buf_len = 0;
+		if (size >= KEY_BUF_MAX / 2 || !key_buf_alloc (k, KEY_BUF_MAX))
+			return my_pwrite (k->fd->of, b, size, pos);
+		k->buf_pos = pos;
+		k->buf_dirty = true;
+	}
+	memcpy (k->buf + k->buf_len, b, size);
+	k->buf_len += size;
+	return size;
+}
+
 static void set_highcyl(uaecptr volume, uae_u32 blocks)
 {
 	put_long(volume + 184 - 32, blocks);
@@ -2452,6 +2634,106 @@ static void prepare_for_open (TCHAR *name)
 {
 }
 
+static unsigned int aino_name_hash (uae_u32 parent, const TCHAR *name)
+{
+	unsigned int h = 2166136261u ^ parent;
+	for (const uae_u8 *p = (const uae_u8*)name; *p; p++) {
+		h ^= *p;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void aino_hash_insert (Unit *unit, a_inode *aino)
+{
+	unsigned int mask = unit->aino_hash_size - 1;
+	unsigned int h = aino->uniq & mask;
+	aino->uniq_next = unit->aino_hash[h];
+	unit->aino_hash[h] = aino;
+	h = aino_name_hash (aino->parent->uniq, nname_begin (aino->nname)) & mask;
+	aino->name_next = unit->aino_name_hash[h];
+	unit->aino_name_hash[h] = aino;
+}
+
+static void aino_hash_resize (Unit *unit, unsigned int size)
+{
+	a_inode **old = unit->aino_hash;
+	unsigned int oldsize = unit->aino_hash_size;
+
+	unit->aino_hash = xcalloc (a_inode*, size);
+	xfree (unit->aino_name_hash);
+	unit->aino_name_hash = xcalloc (a_inode*, size);
+	unit->aino_hash_size = size;
+	for (unsigned int i = 0; i < oldsize; i++) {
+		a_inode *a = old[i];
+		while (a) {
+			a_inode *next = a->uniq_next;
+			aino_hash_insert (unit, a);
+			a = next;
+		}
+	}
+	xfree (old);
+}
+
+static void aino_hash_add (Unit *unit, a_inode *aino)
+{
+	if (unit->aino_hash_count >= unit->aino_hash_size)
+		aino_hash_resize (unit, unit->aino_hash_size ? unit->aino_hash_size * 2 : MIN_AINO_HASH);
+	aino_hash_insert (unit, aino);
+	unit->aino_hash_count++;
+}
+
+static void aino_hash_remove (Unit *unit, a_inode *aino)
+{
+	a_inode **ap;
+
+	if (!unit->aino_hash_size)
+		return;
+	for (ap = &unit->aino_hash[aino->uniq & (unit->aino_hash_size - 1)]; *ap; ap = &(*ap)->uniq_next) {
+		if (*ap == aino) {
+			*ap = aino->uniq_next;
+			unit->aino_hash_count--;
+			break;
+		}
+	}
+	unsigned int h = aino_name_hash (aino->parent->uniq, nname_begin (aino->nname));
+	for (ap = &unit->aino_name_hash[h & (unit->aino_hash_size - 1)]; *ap; ap = &(*ap)->name_next) {
+		if (*ap == aino) {
+			*ap = aino->name_next;
+			break;
+		}
+	}
+	aino->uniq_next = aino->name_next = NULL;
+}
+
+static void free_aino_hash (Unit *unit)
+{
+	xfree (unit->aino_hash);
+	xfree (unit->aino_name_hash);
+	unit->aino_hash = unit->aino_name_hash = NULL;
+	unit->aino_hash_size = unit->aino_hash_count = 0;
+}
+
+/* Child of base with host name name, in the current volume */
+static a_inode *lookup_child_nname (Unit *unit, a_inode *base, const TCHAR *name)
+{
+	if (!unit->aino_hash_size)
+		return 0;
+	unsigned int h = aino_name_hash (base->uniq, name) & (unit->aino_hash_size - 1);
+	for (a_inode *a = unit->aino_name_hash[h]; a; a = a->name_next) {
+		if (a->parent == base && a->mountcount == unit->mountcount && !_tcscmp (nname_begin (a->nname), name))
+			return a;
+	}
+	return 0;
+}
+
+static bool dircache_load (Unit *unit, a_inode *dir)
+{
+	if ((unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS)) || dir->vfso)
+		return false;
+	return fsdb_dircache_load (unit->dircache, dir);
+}
+
 static void de_recycle_aino (Unit *unit, a_inode *aino)
 {
 	aino_test (aino);
@@ -2473,9 +2755,8 @@ static void free_aino(a_inode *aino)
 
 static void dispose_aino (Unit *unit, a_inode **aip, a_inode *aino)
 {
-	int hash = aino->uniq % MAX_AINO_HASH;
-	if (unit->aino_hash[hash] == aino)
-		unit->aino_hash[hash] = 0;
+	aino_hash_remove (unit, aino);
+	fsdb_dircache_free (aino);
 
 	if (aino->dirty && aino->parent)
 		fsdb_dir_writeback (aino->parent);
@@ -2671,54 +2952,21 @@ static void delete_aino (Unit *unit, a_inode *aino)
 	dispose_aino (unit, aip, aino);
 }
 
-static a_inode *lookup_sub (a_inode *dir, uae_u32 uniq)
-{
-	a_inode **cp = &dir->child;
-	a_inode *c, *retval;
-
-	for (;;) {
-		c = *cp;
-		if (c == 0)
-			return 0;
-
-		if (c->uniq == uniq) {
-			retval = c;
-			break;
-		}
-		if (c->dir) {
-			a_inode *a = lookup_sub (c, uniq);
-			if (a != 0) {
-				retval = a;
-				break;
-			}
-		}
-		cp = &c->sibling;
-	}
-	if (! dir->locked_children) {
-		/* Move to the front to speed up repeated lookups.  Don't do this if
-		an ExNext is going on in this directory, or we'll terminally
-		confuse it.  */
-		*cp = c->sibling;
-		c->sibling = dir->child;
-		dir->child = c;
-	}
-	return retval;
-}
-
 static a_inode *lookup_aino (Unit *unit, uae_u32 uniq)
 {
-	a_inode *a;
-	int hash = uniq % MAX_AINO_HASH;
+	a_inode *a = 0;
 
 	if (uniq == 0)
 		return &unit->rootnode;
-	a = unit->aino_hash[hash];
-	if (a == 0 || a->uniq != uniq)
-		a = lookup_sub (&unit->rootnode, uniq);
-	else
-		unit->nr_cache_hits++;
 	unit->nr_cache_lookups++;
-	unit->aino_hash[hash] = a;
+	if (unit->aino_hash_size) {
+		for (a = unit->aino_hash[uniq & (unit->aino_hash_size - 1)]; a; a = a->uniq_next) {
+			if (a->uniq == uniq)
+				break;
+		}
+	}
+	if (a)
+		unit->nr_cache_hits++;
 	aino_test (a);
 	return a;
 }
@@ -2765,6 +3013,7 @@ static TCHAR *get_nname (Unit *unit, a_inode *base, TCHAR *rel, TCHAR **modified
 	}
 
 	aino_test (base);
+	dircache_load (unit, base);
 
 	/* If we have a mapping of some other aname to "rel", we must pretend
 	* it does not exist.
@@ -2787,7 +3036,8 @@ static TCHAR *get_nname (Unit *unit, a_inode *base, TCHAR *rel, TCHAR **modified
 	TCHAR *relalt = NULL;
 	found = fsdb_search_dir (base->nname, rel, &relalt);
 #else
-	found = fsdb_search_dir (base->nname, rel);
+	if (fsdb_dircache_search (base, rel, &found) < 0)
+		found = fsdb_search_dir (base->nname, rel);
 #endif
 	if (found == 0) {
 		return found;
@@ -2913,6 +3163,7 @@ static void init_child_aino_tree (Unit *unit, a_inode *base, a_inode *aino)
 	base->child = aino;
 	aino->next = aino->prev = 0;
 	aino->volflags = unit->volflags;
+	aino_hash_add (unit, aino);
 }
 
 static void init_child_aino (Unit *unit, a_inode *base, a_inode *aino)
@@ -3048,22 +3299,14 @@ static a_inode *lookup_child_aino (Unit *unit, a_inode *base, TCHAR *rel, int *e
 /* Different version because for this one, REL is an nname.  */
 static a_inode *lookup_child_aino_for_exnext (Unit *unit, a_inode *base, TCHAR *rel, uae_u32 *err, uae_u64 uniq_external, struct virtualfilesysobject *vfso)
 {
-	a_inode *c = base->child;
-	int l0 = uaetcslen (rel);
+	a_inode *c;
 	int isvirtual = unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS);
 
 	aino_test (base);
-	aino_test (c);
 
 	*err = 0;
-	while (c != 0) {
-		int l1 = uaetcslen (c->nname);
-		/* Note: using _tcscmp here.  */
-		if (l0 <= l1 && _tcscmp (rel, c->nname + l1 - l0) == 0
-			&& (l0 == l1 || c->nname[l1-l0-1] == FSDB_DIR_SEPARATOR) && c->mountcount == unit->mountcount)
-			break;
-		c = c->sibling;
-	}
+	/* Note: exact match here.  */
+	c = lookup_child_nname (unit, base, rel);
 	if (c != 0)
 		return c;
 	if (!isvirtual && !vfso)
@@ -3281,8 +3524,8 @@ static Unit *startup_create_unit(TrapContext *ctx, UnitInfo *uinfo, int num)
 	unit->rootnode.volflags = uinfo->volflags;
 	aino_test_init (&unit->rootnode);
 	unit->aino_cache_size = 0;
-	for (i = 0; i < MAX_AINO_HASH; i++)
-		unit->aino_hash[i] = 0;
+	unit->dircache = fsdb_dircache_open ();
+	unit->dircache_mountcount = unit->mountcount;
 	return unit;
 }
 
@@ -3605,8 +3848,11 @@ static void free_key (Unit *unit, Key *k)
 		lr = next;
 	}
 
-	if (k->fd != NULL)
+	if (k->fd != NULL) {
+		key_sync (k);
 		fs_closefile (k->fd);
+	}
+	key_buf_free (k);
 
 	xfree(k);
 }
@@ -3768,12 +4014,11 @@ static void notify_send(TrapContext *ctx, Unit *unit, Notify *n)
 	}
 }
 
-static void notify_check(TrapContext *ctx, Unit *unit, a_inode *a)
+static void notify_check_one(TrapContext *ctx, Unit *unit, a_inode *a)
 {
 	Notify *n;
 	int hash = notifyhash (a->aname);
 	for (n = unit->notifyhash[hash]; n; n = n->next) {
-		uaecptr nr = n->notifyrequest;
 		if (same_aname (n->partname, a->aname)) {
 			int err;
 			a_inode *a2 = find_aino(ctx, unit, 0, n->fullname, &err);
@@ -3781,18 +4026,66 @@ static void notify_check(TrapContext *ctx, Unit *unit, a_inode *a)
 				notify_send(ctx, unit, n);
 		}
 	}
-	if (a->parent) {
-		hash = notifyhash (a->parent->aname);
-		for (n = unit->notifyhash[hash]; n; n = n->next) {
-			uaecptr nr = n->notifyrequest;
-			if (same_aname (n->partname, a->parent->aname)) {
-				int err;
-				a_inode *a2 = find_aino(ctx, unit, 0, n->fullname, &err);
-				if (err == 0 && a->parent == a2)
-					notify_send(ctx, unit, n);
-			}
-		}
+}
+
+static void notify_check(TrapContext *ctx, Unit *unit, a_inode *a)
+{
+	notify_check_one(ctx, unit, a);
+	if (a->parent)
+		notify_check_one(ctx, unit, a->parent);
+}
+
+struct dircache_notify
+{
+	TrapContext *ctx;
+	Unit *unit;
+};
+
+/* host side change in a cached directory */
+static void dircache_changed(void *ud, a_inode *dir, const TCHAR *name)
+{
+	struct dircache_notify *dn = (struct dircache_notify*)ud;
+	a_inode *a = name ? lookup_child_nname (dn->unit, dir, name) : NULL;
+	if (a)
+		notify_check(dn->ctx, dn->unit, a);
+	else
+		notify_check_one(dn->ctx, dn->unit, dir);
+}
+
+static void dircache_poll(TrapContext *ctx, Unit *unit, bool notify)
+{
+	struct dircache_notify dn = { ctx, unit };
+
+	if (!unit->dircache)
+		return;
+	if (unit->dircache_mountcount != unit->mountcount) {
+		fsdb_dircache_flush (unit->dircache);
+		unit->dircache_mountcount = unit->mountcount;
 	}
+	fsdb_dircache_poll (unit->dircache, notify ? dircache_changed : NULL, &dn);
+}
+
+/* Keep the directory of a notification target watched, so that host side
+ * changes are noticed without the Amiga side listing it first.  */
+static void notify_watch(TrapContext *ctx, Unit *unit, Notify *n, bool watch)
+{
+	a_inode *a;
+	int err;
+
+	if (!watch) {
+		if (n->watching && (a = lookup_aino (unit, n->watchuniq)))
+			fsdb_dircache_pin (a, false);
+		n->watching = false;
+		return;
+	}
+	a = find_aino(ctx, unit, 0, n->fullname, &err);
+	if (err == 0 && !a->dir)
+		a = a->parent;
+	if (err != 0 || !a || !dircache_load (unit, a))
+		return;
+	fsdb_dircache_pin (a, true);
+	n->watching = true;
+	n->watchuniq = a->uniq;
 }
 
 static void action_add_notify(TrapContext *ctx, Unit *unit, dpacket *packet)
@@ -3839,6 +4132,7 @@ static void action_add_notify(TrapContext *ctx, Unit *unit, dpacket *packet)
 	n = new_notify (unit, partname);
 	n->notifyrequest = nr;
 	n->fullname = name;
+	notify_watch(ctx, unit, n, true);
 	if (flags & NRF_NOTIFY_INITIAL) {
 		int err;
 		a_inode *a = find_aino(ctx, unit, 0, n->fullname, &err);
@@ -3858,6 +4152,7 @@ static void	action_remove_notify(TrapContext *ctx, Unit *unit, dpacket *packet)
 		for (n = unit->notifyhash[hash]; n; n = n->next) {
 			if (n->notifyrequest == nr) {
 				//write_log (_T("NotifyRequest %08X freed\n"), n->notifyrequest);
+				notify_watch(ctx, unit, n, false);
 				xfree (n->fullname);
 				xfree (n->partname);
 				free_notify (unit, hash, n);
@@ -4210,7 +4505,7 @@ static bool get_statinfo(Unit *unit, a_inode *aino, struct mystat *statbuf)
 		ok = zfile_stat_archive (aino->nname, statbuf) != 0;
 	else if (unit->volflags & MYVOLUMEINFO_CDFS)
 		ok = isofs_stat (unit->ui.cdfs_superblock, aino->uniq_external, statbuf);
-	else
+	else if (fsdb_dircache_stat (aino, statbuf) < 0)
 		my_stat (aino->nname, statbuf);
 	return ok;
 }
@@ -4573,13 +4868,7 @@ static int exalldo(TrapContext *ctx, uaecptr exalldata, uae_u32 exalldatasize, u
 	char *x = NULL, *comment = NULL;
 	int ret = 0;
 
-	memset (&statbuf, 0, sizeof statbuf);
-	if (unit->volflags & MYVOLUMEINFO_ARCHIVE)
-		zfile_stat_archive (aino->nname, &statbuf);
-	else if (unit->volflags & MYVOLUMEINFO_CDFS)
-		isofs_stat (unit->ui.cdfs_superblock, aino->uniq_external, &statbuf);
-	else
-		my_stat (aino->nname, &statbuf);
+	get_statinfo (unit, aino, &statbuf);
 
 	if (aino->parent == 0) {
 		entrytype = ST_USERDIR;
@@ -4843,6 +5132,7 @@ static int action_examine_all(TrapContext *ctx, Unit *unit, dpacket *packet)
 #if EXALL_DEBUG > 0
 		write_log("exall: ID=%d '%s'\n", eak->id, base->nname);
 #endif
+		dircache_load (unit, base);
 		d = fs_opendir (unit, base);
 		if (!d)
 			goto fail;
@@ -5029,12 +5319,16 @@ finished - they may never finish!  */
 
 static void populate_directory (Unit *unit, a_inode *base)
 {
-	struct fs_dirhandle *d;
+	struct fs_dirhandle *d = NULL;
 	a_inode *aino;
+	int idx = 0;
 
-	d = fs_opendir (unit, base);
-	if (!d)
-		return;
+	/* directory units list from the cache when possible */
+	if (!dircache_load (unit, base)) {
+		d = fs_opendir (unit, base);
+		if (!d)
+			return;
+	}
 	for (aino = base->child; aino; aino = aino->sibling) {
 		base->locked_children++;
 		unit->total_locked_ainos++;
@@ -5049,20 +5343,34 @@ static void populate_directory (Unit *unit, a_inode *base)
 
 		/* Find next file that belongs to the Amiga fs (skipping things
 		like "..", "." etc.  */
-		do {
-			ok = filesys_readdir(d, fn, &uniq);
-		} while (ok && d->fstype == FS_DIRECTORY && (filesys_name_invalid (fn) || fsdb_name_invalid_dir (NULL, fn)));
+		if (!d) {
+			do {
+				ok = fsdb_dircache_readdir (base, &idx, fn) > 0;
+			} while (ok && (filesys_name_invalid (fn) || fsdb_name_invalid_dir (NULL, fn)));
+		} else {
+			do {
+				ok = filesys_readdir(d, fn, &uniq);
+			} while (ok && d->fstype == FS_DIRECTORY && (filesys_name_invalid (fn) || fsdb_name_invalid_dir (NULL, fn)));
+		}
 		if (!ok)
 			break;
 		/* This calls init_child_aino, which will notice that the parent is
 		being ExNext()ed, and it will increment the locked counts.  */
 		aino = lookup_child_aino_for_exnext (unit, base, fn, &err, uniq, NULL);
 	}
-	fs_closedir (d);
+	if (d)
+		fs_closedir (d);
 	if (currprefs.filesys_inject_icons || unit->ui.inject_icons)
 		inject_icons_to_directory(unit, base);
 }
 
+static bool aino_exists (a_inode *aino)
+{
+	struct mystat statbuf;
+	int ret = fsdb_dircache_stat (aino, &statbuf);
+	return ret < 0 ? fsdb_exists (aino->nname) != 0 : ret > 0;
+}
+
 static bool do_examine(TrapContext *ctx, Unit *unit, dpacket *packet, a_inode *aino, uaecptr info, bool longfilesize)
 {
 	for (;;) {
@@ -5071,7 +5379,7 @@ static bool do_examine(TrapContext *ctx, Unit *unit, dpacket *packet, a_inode *a
 			break;
 		name = aino->nname;
 		get_fileinfo(ctx, unit, packet, info, aino, longfilesize);
-		if (!aino->vfso && !(unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS)) && !fsdb_exists(name)) {
+		if (!aino->vfso && !(unit->volflags & (MYVOLUMEINFO_ARCHIVE | MYVOLUMEINFO_CDFS)) && !aino_exists(aino)) {
 			TRACE ((_T("%s orphaned"), name));
 			return false;
 		}
@@ -5268,6 +5576,9 @@ static void do_find(TrapContext *ctx, Unit *unit, dpacket *packet, int mode, int
 
 	prepare_for_open (aino->nname);
 
+	if (!aino->vfso && !isvirtual && create == 2 && !aino_created && fsjournal_active ())
+		fsjournal_setsize (aino->nname, 0);
+
 	if (!aino->vfso) {
 		openmode = (((mode & A_FIBF_READ) == 0 ? O_WRONLY
 			: (mode & A_FIBF_WRITE) == 0 ? O_RDONLY
@@ -5284,6 +5595,8 @@ static void do_find(TrapContext *ctx, Unit *unit, dpacket *packet, int mode, int
 			PUT_PCK_RES2 (packet, isvirtual ? ERROR_OBJECT_NOT_AROUND : dos_errno ());
 			return;
 		}
+		if (aino_created && !isvirtual)
+			fsjournal_create (aino->nname, false);
 	}
 
 	k = new_key (unit);
@@ -5473,10 +5786,12 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 		/* check if filesize < size */
 		uae_s64 filesize, cur;
 
-		filesize = key_filesize(k);
 		cur = k->file_pos;
-		if (size > filesize - cur)
-			size = (uae_u32)(filesize - cur);
+		if (!key_inbuf (k, cur, size)) {
+			filesize = key_filesize(unit, k);
+			if (size > filesize - cur)
+				size = (uae_u32)(filesize - cur);
+		}
 
 		if (size == 0) {
 			PUT_PCK_RES1 (packet, 0);
@@ -5487,7 +5802,7 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 			
 			/* ugh this is inefficient but easy */
 
-			if (key_seek(k, k->file_pos, SEEK_SET) < 0) {
+			if (!key_buffered (k) && key_seek(k, k->file_pos, SEEK_SET) < 0) {
 				PUT_PCK_RES1 (packet, 0);
 				PUT_PCK_RES2 (packet, dos_errno ());
 				return;
@@ -5500,7 +5815,7 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 				return;
 			}
 
-			actual = fs_read (k->fd, buf, size);
+			actual = key_read (unit, k, k->file_pos, buf, size);
 
 			if ((uae_s32)actual == -1) {
 				PUT_PCK_RES1 (packet, 0);
@@ -5517,7 +5832,7 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 
 	if (size) {
 
-		if (key_seek(k, k->file_pos, SEEK_SET) < 0) {
+		if (!key_buffered (k) && key_seek(k, k->file_pos, SEEK_SET) < 0) {
 			PUT_PCK_RES1(packet, 0);
 			PUT_PCK_RES2(packet, dos_errno());
 			return;
@@ -5529,7 +5844,7 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 			actual = 0;
 			while (size > 0) {
 				int toread = size > RTAREA_TRAP_DATA_EXTRA_SIZE ? RTAREA_TRAP_DATA_EXTRA_SIZE : size;
-				int read = fs_read(k->fd, buf, toread);
+				int read = key_read(unit, k, k->file_pos + actual, buf, toread);
 				if (read < 0) {
 					actual = -1;
 					break;
@@ -5548,7 +5863,13 @@ static void	action_read(TrapContext *ctx, Unit *unit, dpacket *packet)
 
 			/* normal fast read */
 			uae_u8 *realpt = get_real_address (addr);
-			actual = fs_read (k->fd, realpt, size);
+#ifdef AMIBERRY
+			uae_mman_writewatch_begin (realpt, size);
+#endif
+			actual = key_read (unit, k, k->file_pos, realpt, size);
+#ifdef AMIBERRY
+			uae_mman_writewatch_end (realpt, size);
+#endif
 
 		}
 
@@ -5590,6 +5911,12 @@ static void action_write(TrapContext *ctx, Unit *unit, dpacket *packet)
 		return;
 	}
 
+	if (size && fsjournal_active ()) {
+		key_flush (k);
+		key_flush_aino (unit, k);
+		fsjournal_write (k->aino->nname, k->file_pos, size);
+	}
+
 	if (size == 0) {
 
 		actual = 0;
@@ -5598,7 +5925,7 @@ static void action_write(TrapContext *ctx, Unit *unit, dpacket *packet)
 
 	} else if (trap_valid_address(ctx, addr, size)) {
 
-		if (key_seek(k, k->file_pos, SEEK_SET) < 0) {
+		if (!key_buffered (k) && key_seek(k, k->file_pos, SEEK_SET) < 0) {
 			PUT_PCK_RES1(packet, 0);
 			PUT_PCK_RES2(packet, dos_errno());
 			return;
@@ -5612,7 +5939,7 @@ static void action_write(TrapContext *ctx, Unit *unit, dpacket *packet)
 			while (sizecnt > 0) {
 				int towrite = sizecnt > RTAREA_TRAP_DATA_EXTRA_SIZE ? RTAREA_TRAP_DATA_EXTRA_SIZE : sizecnt;
 				trap_get_bytes(ctx, buf, addr, towrite);
-				int write = fs_write(k->fd, buf, towrite);
+				int write = key_write(unit, k, k->file_pos + actual, buf, towrite);
 				if (write < 0) {
 					actual = -1;
 					break;
@@ -5629,13 +5956,13 @@ static void action_write(TrapContext *ctx, Unit *unit, dpacket *packet)
 		} else {
 
 			uae_u8 *realpt = get_real_address (addr);
-			actual = fs_write (k->fd, realpt, size);
+			actual = key_write (unit, k, k->file_pos, realpt, size);
 		}
 
 	} else {
 		/* ugh this is inefficient but easy */
 
-		if (key_seek(k, k->file_pos, SEEK_SET) < 0) {
+		if (!key_buffered (k) && key_seek(k, k->file_pos, SEEK_SET) < 0) {
 			PUT_PCK_RES1 (packet, 0);
 			PUT_PCK_RES2 (packet, dos_errno ());
 			return;
@@ -5650,7 +5977,7 @@ static void action_write(TrapContext *ctx, Unit *unit, dpacket *packet)
 
 		trap_get_bytes(ctx, buf, addr, size);
 
-		actual = fs_write (k->fd, buf, size);
+		actual = key_write (unit, k, k->file_pos, buf, size);
 		xfree (buf);
 	}
 
@@ -5689,7 +6016,7 @@ static void	action_seek(TrapContext *ctx, Unit *unit, dpacket *packet)
 	TRACE((_T("ACTION_SEEK(%s,%d,%d)=%lld\n"), k->aino->nname, pos, mode, cur));
 	gui_flicker_led (UNIT_LED(unit), unit->unit, 1);
 
-	filesize = key_filesize(k);
+	filesize = key_filesize(unit, k);
 	if (whence == SEEK_CUR)
 		temppos = cur + pos;
 	if (whence == SEEK_SET)
@@ -5983,6 +6310,7 @@ static void	action_create_dir(TrapContext *ctx, Unit *unit, dpacket *packet)
 		PUT_PCK_RES2 (packet, dos_errno ());
 		return;
 	}
+	fsjournal_create (aino->nname, true);
 	aino->shlock = 1;
 	fsdb_set_file_attrs (aino);
 	de_recycle_aino (unit, aino);
@@ -6041,7 +6369,7 @@ static void	action_set_file_size(TrapContext *ctx, Unit *unit, dpacket *packet)
 	}
 
 	/* Fail if file is >=2G, it is not safe operation. */
-	if (key_filesize(k) > MAXFILESIZE32_2G) {
+	if (key_filesize(unit, k) > MAXFILESIZE32_2G) {
 		PUT_PCK_RES1 (packet, DOS_TRUE);
 		PUT_PCK_RES2 (packet, ERROR_BAD_NUMBER); /* ? */
 		return;
@@ -6061,6 +6389,7 @@ static void	action_set_file_size(TrapContext *ctx, Unit *unit, dpacket *packet)
 	/* Write one then truncate: that should give the right size in all cases.  */
 	fs_lseek (k->fd, offset, whence);
 	offset = fs_lseek (k->fd, 0, SEEK_CUR);
+	fsjournal_setsize (k->aino->nname, offset);
 	fs_write (k->fd, /* whatever */(uae_u8*)&k1, 1);
 	if (k->file_pos > offset)
 		k->file_pos = offset;
@@ -6170,7 +6499,9 @@ static void	action_delete_object(TrapContext *ctx, Unit *unit, dpacket *packet)
 				PUT_PCK_RES2 (packet, dos_errno ());
 				return;
 			}
+			fsjournal_delete (a->nname, true);
 		} else {
+			fsjournal_delete_prepare (a->nname);
 #ifdef _WIN32
 			if (my_unlink (a->nname, false) == -1) {
 #else
@@ -6178,8 +6509,10 @@ static void	action_delete_object(TrapContext *ctx, Unit *unit, dpacket *packet)
 #endif
 				PUT_PCK_RES1 (packet, DOS_FALSE);
 				PUT_PCK_RES2 (packet, dos_errno ());
+				fsjournal_delete_abort ();
 				return;
 			}
+			fsjournal_delete (a->nname, false);
 		}
 	}
 	notify_check(ctx, unit, a);
@@ -6317,6 +6650,7 @@ static void	action_rename_object(TrapContext *ctx, Unit *unit, dpacket *packet)
 				return;
 			}
 		}
+		fsjournal_rename (a1->nname, a2->nname);
 	}
 
 	notify_check(ctx, unit, a1);
@@ -6324,6 +6658,7 @@ static void	action_rename_object(TrapContext *ctx, Unit *unit, dpacket *packet)
 	a2->comment = a1->comment;
 	a1->comment = 0;
 	a2->amigaos_mode = a1->amigaos_mode;
+	aino_hash_remove (unit, a2);
 	a2->uniq = a1->uniq;
 	a2->elock = a1->elock;
 	a2->shlock = a1->shlock;
@@ -6333,7 +6668,9 @@ static void	action_rename_object(TrapContext *ctx, Unit *unit, dpacket *packet)
 	a2->vfso = a1->vfso;
 	move_exkeys (unit, a1, a2);
 	move_aino_children (unit, a1, a2);
+	fsdb_dircache_move (a1, a2);
 	delete_aino (unit, a1);
+	aino_hash_add (unit, a2);
 	a2->dirty = 1;
 	if (a2->parent)
 		fsdb_dir_writeback (a2->parent);
@@ -6533,7 +6870,7 @@ static void action_change_file_position64(TrapContext *ctx, Unit *unit, dpacket
 	cur = k->file_pos;
 	{
 		uae_s64 temppos;
-		uae_s64 filesize = key_filesize(k);
+		uae_s64 filesize = key_filesize(unit, k);
 
 		if (whence == SEEK_CUR)
 			temppos = cur + pos;
@@ -6614,6 +6951,7 @@ static void action_change_file_size64(TrapContext *ctx, Unit *unit, dpacket *pac
 	/* Write one then truncate: that should give the right size in all cases.  */
 	fs_lseek (k->fd, offset, whence);
 	offset = key_seek(k, offset, whence);
+	fsjournal_setsize (k->aino->nname, offset);
 	fs_write (k->fd, /* whatever */(uae_u8*)&k1, 1);
 	if (k->file_pos > offset)
 		k->file_pos = offset;
@@ -6642,7 +6980,7 @@ static void action_get_file_size64(TrapContext *ctx, Unit *unit, dpacket *packet
 		return;
 	}
 	TRACE((_T("ACTION_GET_FILE_SIZE64(%s)\n"), k->aino->nname));
-	filesize = key_filesize(k);
+	filesize = key_filesize(unit, k);
 	TRACE((_T("ACTION_GET_FILE_SIZE64(%s)=%lld\n"), k->aino->nname, filesize));
 	if (filesize >= 0) {
 		PUT_PCK64_RES1 (packet, filesize);
@@ -6707,6 +7045,7 @@ static void action_set_file_size64(TrapContext *ctx, Unit *unit, dpacket *packet
 	/* Write one then truncate: that should give the right size in all cases.  */
 	fs_lseek (k->fd, offset, whence);
 	offset = key_seek(k, offset, whence);
+	fsjournal_setsize (k->aino->nname, offset);
 	fs_write (k->fd, /* whatever */(uae_u8*)&k1, 1);
 	if (k->file_pos > offset)
 		k->file_pos = offset;
@@ -6747,7 +7086,7 @@ static void action_seek64(TrapContext *ctx, Unit *unit, dpacket *packet)
 	cur = k->file_pos;
 	{
 		uae_s64 temppos;
-		uae_s64 filesize = key_filesize(k);
+		uae_s64 filesize = key_filesize(unit, k);
 
 		if (whence == SEEK_CUR)
 			temppos = cur + pos;
@@ -7084,6 +7423,15 @@ static int handle_packet(TrapContext *ctx, Unit *unit, dpacket *pck, uae_u32 msg
 			return 1;
 	}
 
+	/* Host side changes first, then the changes our own flushed
+	 * writes caused, which must not trigger notifications. */
+	bool rw = type == ACTION_READ || type == ACTION_WRITE;
+	if (!rw) {
+		dircache_poll (ctx, unit, true);
+		if (key_sync_all (unit))
+			dircache_poll (ctx, unit, false);
+	}
+
 	switch (type) {
 	case ACTION_LOCATE_OBJECT: action_lock (ctx, unit, pck); break;
 	case ACTION_FREE_LOCK: action_free_lock (ctx, unit, pck); break;
@@ -7155,6 +7503,8 @@ static int handle_packet(TrapContext *ctx, Unit *unit, dpacket *pck, uae_u32 msg
 		write_log (_T("FILESYS: UNKNOWN PACKET %x\n"), type);
 		return 0;
 	}
+	if (!rw)
+		dircache_poll (ctx, unit, false);
 	if (noidle) {
 		m68k_cancel_idle();
 	}
@@ -7251,6 +7601,7 @@ static int filesys_iteration(UnitInfo *ui)
 #endif
 
 	trap_background_set_complete(ctx);
+	atomic_dec(&ui->self->packets_pending);
 	return 1;
 }
 
@@ -7325,6 +7676,7 @@ static uae_u32 REGPARAM2 filesys_handler(TrapContext *ctx)
 #endif
 
 		trap_set_background(ctx);
+		atomic_inc(&unit->packets_pending);
 		write_comm_pipe_pvoid(unit->ui.unit_pipe, ctx, 0);
 		write_comm_pipe_u32(unit->ui.unit_pipe, packet_addr, 0);
 		write_comm_pipe_u32(unit->ui.unit_pipe, message_addr, 0);
@@ -7376,8 +7728,11 @@ void filesys_free_handles (void)
 		u1 = u->next;
 		for (k1 = u->keys; k1; k1 = knext) {
 			knext = k1->next;
-			if (k1->fd)
+			if (k1->fd) {
+				key_sync (k1);
 				fs_closefile (k1->fd);
+			}
+			key_buf_free (k1);
 			xfree (k1);
 		}
 		u->keys = NULL;
@@ -7388,6 +7743,7 @@ void filesys_free_handles (void)
 		}
 		u->waitingrecords = NULL;
 		free_all_ainos (u, &u->rootnode);
+		fsdb_dircache_flush (u->dircache);
 		u->rootnode.next = u->rootnode.prev = &u->rootnode;
 		u->aino_cache_size = 0;
 		xfree (u->newrootdir);
@@ -7416,6 +7772,8 @@ static void filesys_reset2 (void)
 	filesys_free_handles ();
 	for (u = units; u; u = u1) {
 		u1 = u->next;
+		fsdb_dircache_close (u->dircache);
+		free_aino_hash (u);
 		xfree (u);
 	}
 	units = 0;
@@ -9873,7 +10231,7 @@ static uae_u8 *restore_key (UnitInfo *ui, Unit *u, uae_u8 *src)
 			missing = 1;
 		} else {
 			uae_s64 s;
-			s = key_filesize(k);
+			s = key_filesize(u, k);
 			if (s != savedsize)
 				write_log (_T("FS: restored file '%s' size changed! orig=%llu, now=%lld!!\n"), p, savedsize, s);
 			if (k->file_pos > s) {
@@ -9925,9 +10283,8 @@ static uae_u8 *restore_exkey (UnitInfo *ui, Unit *u, uae_u8 *src)
 	return src;
 }
 
-static uae_u8 *restore_filesys_virtual (UnitInfo *ui, uae_u8 *src, int num)
+static uae_u8 *restore_filesys_unit (UnitInfo *ui, Unit *u, uae_u8 *src)
 {
-	Unit *u = startup_create_unit(NULL, ui, num);
 	int cnt;
 
 	u->dosbase = restore_u32();
@@ -9965,6 +10322,12 @@ static uae_u8 *restore_filesys_virtual (UnitInfo *ui, uae_u8 *src, int num)
 	return src;
 }
 
+static uae_u8 *restore_filesys_virtual (UnitInfo *ui, uae_u8 *src, int num)
+{
+	Unit *u = startup_create_unit(NULL, ui, num);
+	return restore_filesys_unit (ui, u, src);
+}
+
 static TCHAR *getfullaname (a_inode *a)
 {
 	TCHAR *p;
@@ -10036,6 +10399,7 @@ static uae_u8 *save_key (uae_u8 *dst, Key *k)
 	save_u32 ((uae_u32)k->file_pos);
 	save_u32 (k->createmode);
 	save_u32 (k->dosmode);
+	key_sync (k);
 	size = fs_fsize (k->fd);
 	save_u32 ((uae_u32)size);
 	save_u64 (k->aino->uniq);
@@ -10336,6 +10700,111 @@ int save_filesys_cando (void)
 	return filesys_in_interrupt ? 0 : 1;
 }
 
+/* Rewind captures: unit state is restored in place, without restarting
+ * the unit threads, so it can only be captured when no packet is in flight. */
+int save_filesys_rewind_cando (void)
+{
+	if (nr_units () == 0)
+		return -1;
+	if (filesys_in_interrupt)
+		return 0;
+	for (Unit *u = units; u; u = u->next) {
+		if (u->packets_pending)
+			return 0;
+		if (u->ui.back_pipe && comm_pipe_has_data (u->ui.back_pipe))
+			return 0;
+	}
+	return 1;
+}
+
+static bool filesys_rewind_unit (int num)
+{
+	UnitInfo *ui = &mountinfo.ui[num];
+	int type = is_hardfile (num);
+	return ui->open > 0 && ui->self && (type == FILESYS_VIRTUAL || type == FILESYS_CD);
+}
+
+uae_u8 *save_filesys_rewind (size_t *len)
+{
+	uae_u8 *dstbak, *dst;
+	int cnt = 0;
+
+	for (int i = 0; i < MAX_FILESYSTEM_UNITS; i++) {
+		if (filesys_rewind_unit (i))
+			cnt++;
+	}
+	if (!cnt)
+		return NULL;
+	dstbak = dst = xmalloc (uae_u8, 16 + cnt * 100000);
+	save_u64 (a_uniq);
+	save_u64 (key_uniq);
+	for (int i = 0; i < MAX_FILESYSTEM_UNITS; i++) {
+		if (!filesys_rewind_unit (i))
+			continue;
+		save_u32 (i);
+		dst = save_filesys_virtual (&mountinfo.ui[i], dst);
+	}
+	save_u32 (0xffffffff);
+	*len = dst - dstbak;
+	return dstbak;
+}
+
+/* forget current locks, open files and notifications of a running unit */
+static void filesys_rewind_clear_unit (Unit *u)
+{
+	Key *k, *knext;
+	for (k = u->keys; k; k = knext) {
+		knext = k->next;
+		if (k->fd)
+			fs_closefile (k->fd);
+		/* buffered writes belong to the state being replaced */
+		key_buf_free (k);
+		xfree (k);
+	}
+	u->keys = NULL;
+	struct lockrecord *lrnext;
+	for (struct lockrecord *lr = u->waitingrecords; lr; lr = lrnext) {
+		lrnext = lr->next;
+		xfree (lr);
+	}
+	u->waitingrecords = NULL;
+	for (int i = 0; i < NOTIFY_HASH_SIZE; i++) {
+		Notify *n = u->notifyhash[i];
+		while (n) {
+			Notify *n2 = n;
+			n = n->next;
+			xfree (n2->fullname);
+			xfree (n2->partname);
+			xfree (n2);
+		}
+		u->notifyhash[i] = 0;
+	}
+	clear_exkeys (u);
+	free_all_ainos (u, &u->rootnode);
+	fsdb_dircache_flush (u->dircache);
+	u->rootnode.next = u->rootnode.prev = &u->rootnode;
+	u->aino_cache_size = 0;
+}
+
+uae_u8 *restore_filesys_rewind (uae_u8 *src)
+{
+	a_uniq = restore_u64to32 ();
+	key_uniq = restore_u64to32 ();
+	for (;;) {
+		uae_u32 num = restore_u32 ();
+		if (num >= MAX_FILESYSTEM_UNITS)
+			break;
+		UnitInfo *ui = &mountinfo.ui[num];
+		if (!filesys_rewind_unit (num)) {
+			write_log (_T("FS: rewind, unit %d is not mounted anymore\n"), num);
+			break;
+		}
+		filesys_rewind_clear_unit (ui->self);
+		src = restore_filesys_unit (ui, ui->self, src);
+	}
+	return src;
+}
+
 static void shellexecute2_free(struct ShellExecute2 *se2)
 {
 	if (!se2) {
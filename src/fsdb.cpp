@@ -128,6 +128,7 @@ void fsdb_clean_dir (a_inode *dir)
 
 	if (!dir->nname)
 		return;
+	fsdb_dircache_records_changed (dir);
 	n = build_nname (dir->nname, FSDB_FILE);
 	f = uae_tfopen (n, _T("r+b"));
 	if (f == 0) {
@@ -183,6 +184,23 @@ static a_inode *aino_from_buf (a_inode *base, uae_u8 *buf, long off)
 a_inode *fsdb_lookup_aino_aname (a_inode *base, const TCHAR *aname)
 {
 	FILE *f;
+	const uae_u8 *recs;
+	int cnt;
+
+	if ((recs = fsdb_dircache_records (base, &cnt))) {
+		for (int i = 0; i < cnt; i++) {
+			uae_u8 buf[FSDB_RECORD_SIZE];
+			memcpy (buf, recs + i * FSDB_RECORD_SIZE, sizeof buf);
+			if (buf[0] == 0)
+				continue;
+			TCHAR *s = au ((char*)buf + 5);
+			int same = same_aname (s, aname);
+			xfree (s);
+			if (same)
+				return aino_from_buf (base, buf, i * FSDB_RECORD_SIZE);
+		}
+		return 0;
+	}
 
 	f = get_fsdb (base, _T("r+b"));
 	if (f == 0) {
@@ -210,6 +228,21 @@ a_inode *fsdb_lookup_aino_nname (a_inode *base, const TCHAR *nname)
 {
 	FILE *f;
 	char *s;
+	const uae_u8 *recs;
+	int cnt;
+
+	if ((recs = fsdb_dircache_records (base, &cnt))) {
+		a_inode *aino = 0;
+		s = ua (nname);
+		for (int i = 0; i < cnt && !aino; i++) {
+			uae_u8 buf[FSDB_RECORD_SIZE];
+			memcpy (buf, recs + i * FSDB_RECORD_SIZE, sizeof buf);
+			if (buf[0] != 0 && strcmp ((char*)buf + 5 + 257, s) == 0)
+				aino = aino_from_buf (base, buf, i * FSDB_RECORD_SIZE);
+		}
+		xfree (s);
+		return aino;
+	}
 
 	f = get_fsdb (base, _T("r+b"));
 	if (f == 0) {
@@ -236,6 +269,22 @@ int fsdb_used_as_nname (a_inode *base, const TCHAR *nname)
 {
 	FILE *f;
 	uae_u8 buf[1 + 4 + 257 + 257 + 81];
+	const uae_u8 *recs;
+	int cnt;
+
+	if ((recs = fsdb_dircache_records (base, &cnt))) {
+		for (int i = 0; i < cnt; i++) {
+			const uae_u8 *r = recs + i * FSDB_RECORD_SIZE;
+			if (r[0] == 0)
+				continue;
+			TCHAR *s = au ((const char*)r + 5 + 257);
+			int used = _tcscmp (s, nname) == 0;
+			xfree (s);
+			if (used)
+				return 1;
+		}
+		return 0;
+	}
 
 	f = get_fsdb (base, _T("r+b"));
 	if (f == 0) {
@@ -303,6 +352,7 @@ void fsdb_dir_writeback (a_inode *dir)
 	int size, i;
 
 	TRACE ((_T("fsdb writeback %s\n"), dir->aname));
+	fsdb_dircache_records_changed (dir);
 	/* First pass: clear dirty bits where unnecessary, and see if any work
 	* needs to be done.  */
 	for (aino = dir->child; aino; aino = aino->sibling) {
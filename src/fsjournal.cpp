@@ -0,0 +1,366 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Undo journal for host side directory filesystem changes
+  *
+  * Rewind and input recording restore machine state to an earlier
+  * capture point. With directory filesystems mounted, the host files
+  * must follow: every mutation filesys.cpp does to the host filesystem
+  * is recorded with enough data to undo it, and rolling back to a mark
+  * undoes all later mutations in reverse order.
+  *
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "fsdb.h"
+#include "fsjournal.h"
+
+#define FSJOURNAL_MAX_DATA (64 * 1024 * 1024)
+
+enum {
+	FSJ_DATA,	// restore old contents and size
+	FSJ_CREATE,	// remove created object
+	FSJ_DELETE,	// recreate deleted object
+	FSJ_RENAME	// rename back
+};
+
+struct fsjournal_entry
+{
+	int type;
+	bool dir;
+	TCHAR *path;
+	TCHAR *path2;
+	uae_u64 pos;
+	uae_u64 oldsize;
+	uae_u8 *data;
+	uae_u64 datalen;
+};
+
+static struct fsjournal_entry *entries;
+static int entry_count, entry_alloc;
+static uae_u32 entry_base;
+static uae_u32 journal_valid;
+static size_t journal_bytes;
+static bool journal_active;
+
+static void free_entry (struct fsjournal_entry *e)
+{
+	journal_bytes -= sizeof (struct fsjournal_entry) + e->datalen;
+	xfree (e->path);
+	xfree (e->path2);
+	xfree (e->data);
+	memset (e, 0, sizeof (struct fsjournal_entry));
+}
+
+/* Undo information could not be saved: older marks can't be restored anymore */
+static void journal_lost (const TCHAR *path)
+{
+	write_log (_T("FSJOURNAL: can't journal '%s', older rewind points discarded\n"), path);
+	journal_valid = entry_base + entry_count;
+}
+
+static struct fsjournal_entry *new_entry (int type, const TCHAR *path)
+{
+	if (entry_count >= entry_alloc) {
+		int alloc = entry_alloc ? entry_alloc * 2 : 256;
+		struct fsjournal_entry *n = xrealloc (struct fsjournal_entry, entries, alloc);
+		if (!n)
+			return NULL;
+		entries = n;
+		entry_alloc = alloc;
+	}
+	struct fsjournal_entry *e = &entries[entry_count++];
+	memset (e, 0, sizeof (struct fsjournal_entry));
+	e->type = type;
+	e->path = my_strdup (path);
+	journal_bytes += sizeof (struct fsjournal_entry);
+	return e;
+}
+
+/* Consecutive writes usually hit the same file, keep it open for reading.
+ * Anything that can replace the file behind the path drops it. */
+static struct my_openfile_s *read_of;
+static TCHAR *read_path;
+
+static void read_close (void)
+{
+	if (read_of)
+		my_close (read_of);
+	xfree (read_path);
+	read_of = NULL;
+	read_path = NULL;
+}
+
+static struct my_openfile_s *read_open (const TCHAR *path)
+{
+	if (read_of && !_tcscmp (read_path, path))
+		return read_of;
+	read_close ();
+	read_of = my_open (path, O_RDONLY | O_BINARY);
+	if (read_of)
+		read_path = my_strdup (path);
+	return read_of;
+}
+
+static bool read_range (const TCHAR *path, uae_u64 pos, uae_u64 len, uae_u8 **datap, uae_u64 *sizep)
+{
+	struct my_openfile_s *of = read_open (path);
+	*datap = NULL;
+	if (!of)
+		return false;
+	uae_s64 size = my_fsize (of);
+	if (size < 0) {
+		read_close ();
+		return false;
+	}
+	*sizep = size;
+	if (pos >= (uae_u64)size || !len)
+		return true;
+	if (pos + len > (uae_u64)size)
+		len = size - pos;
+	if (len > FSJOURNAL_MAX_DATA)
+		return false;
+	uae_u8 *data = xmalloc (uae_u8, len);
+	if (!data || my_lseek (of, pos, SEEK_SET) < 0 || my_read (of, data, (unsigned int)len) != len) {
+		xfree (data);
+		read_close ();
+		return false;
+	}
+	*datap = data;
+	return true;
+}
+
+void fsjournal_write (const TCHAR *path, uae_u64 pos, uae_u64 size)
+{
+	uae_u8 *data;
+	uae_u64 oldsize;
+
+	if (!journal_active)
+		return;
+	if (!read_range (path, pos, size, &data, &oldsize)) {
+		journal_lost (path);
+		return;
+	}
+	struct fsjournal_entry *e = new_entry (FSJ_DATA, path);
+	if (!e) {
+		xfree (data);
+		journal_lost (path);
+		return;
+	}
+	e->pos = pos;
+	e->oldsize = oldsize;
+	e->data = data;
+	e->datalen = data ? (pos + size > oldsize ? oldsize - pos : size) : 0;
+	journal_bytes += e->datalen;
+}
+
+void fsjournal_setsize (const TCHAR *path, uae_u64 size)
+{
+	// only the part beyond the new size can be lost
+	fsjournal_write (path, size, FSJOURNAL_MAX_DATA);
+}
+
+/* contents of the file about to be deleted, kept until the deletion is done */
+static TCHAR *delete_path;
+static uae_u8 *delete_data;
+static uae_u64 delete_size;
+static bool delete_saved;
+
+void fsjournal_delete_abort (void)
+{
+	xfree (delete_path);
+	xfree (delete_data);
+	delete_path = NULL;
+	delete_data = NULL;
+	delete_size = 0;
+	delete_saved = false;
+}
+
+void fsjournal_delete_prepare (const TCHAR *path)
+{
+	fsjournal_delete_abort ();
+	if (!journal_active)
+		return;
+	delete_path = my_strdup (path);
+	delete_saved = read_range (path, 0, FSJOURNAL_MAX_DATA, &delete_data, &delete_size);
+	read_close ();
+}
+
+void fsjournal_delete (const TCHAR *path, bool dir)
+{
+	uae_u8 *data = NULL;
+	uae_u64 oldsize = 0;
+
+	if (!journal_active) {
+		fsjournal_delete_abort ();
+		return;
+	}
+	if (!dir) {
+		if (!delete_saved || !delete_path || _tcscmp (delete_path, path)) {
+			fsjournal_delete_abort ();
+			journal_lost (path);
+			return;
+		}
+		data = delete_data;
+		oldsize = delete_size;
+		delete_data = NULL;
+		fsjournal_delete_abort ();
+	}
+	struct fsjournal_entry *e = new_entry (FSJ_DELETE, path);
+	if (!e) {
+		xfree (data);
+		journal_lost (path);
+		return;
+	}
+	e->dir = dir;
+	e->oldsize = oldsize;
+	e->data = data;
+	e->datalen = data ? oldsize : 0;
+	journal_bytes += e->datalen;
+}
+
+void fsjournal_create (const TCHAR *path, bool dir)
+{
+	if (!journal_active)
+		return;
+	read_close ();
+	struct fsjournal_entry *e = new_entry (FSJ_CREATE, path);
+	if (!e) {
+		journal_lost (path);
+		return;
+	}
+	e->dir = dir;
+}
+
+void fsjournal_rename (const TCHAR *oldpath, const TCHAR *newpath)
+{
+	if (!journal_active)
+		return;
+	read_close ();
+	struct fsjournal_entry *e = new_entry (FSJ_RENAME, oldpath);
+	if (!e) {
+		journal_lost (oldpath);
+		return;
+	}
+	e->path2 = my_strdup (newpath);
+}
+
+static bool undo_entry (struct fsjournal_entry *e)
+{
+	struct my_openfile_s *of;
+
+	switch (e->type)
+	{
+	case FSJ_DATA:
+		if (e->datalen) {
+			of = my_open (e->path, O_WRONLY | O_BINARY);
+			if (!of)
+				return false;
+			bool ok = my_lseek (of, e->pos, SEEK_SET) >= 0 && my_write (of, e->data, (unsigned int)e->datalen) == e->datalen;
+			my_close (of);
+			if (!ok)
+				return false;
+		}
+		return my_truncate (e->path, e->oldsize) == 0;
+	case FSJ_CREATE:
+		if (e->dir) {
+			TCHAR *n = build_nname (e->path, FSDB_FILE);
+			if (my_existsfile (n))
+				my_unlink (n);
+			xfree (n);
+			return my_rmdir (e->path) == 0;
+		}
+		return my_unlink (e->path) == 0;
+	case FSJ_DELETE:
+		if (e->dir)
+			return my_mkdir (e->path) == 0;
+		of = my_open (e->path, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY);
+		if (!of)
+			return false;
+		if (e->datalen && my_write (of, e->data, (unsigned int)e->datalen) != e->datalen) {
+			my_close (of);
+			return false;
+		}
+		my_close (of);
+		return true;
+	case FSJ_RENAME:
+		return my_rename (e->path2, e->path) == 0;
+	}
+	return false;
+}
+
+void fsjournal_start (void)
+{
+	journal_active = true;
+}
+
+void fsjournal_reset (void)
+{
+	fsjournal_delete_abort ();
+	read_close ();
+	for (int i = 0; i < entry_count; i++)
+		free_entry (&entries[i]);
+	xfree (entries);
+	entries = NULL;
+	entry_count = entry_alloc = 0;
+	entry_base = 0;
+	journal_valid = 0;
+	journal_bytes = 0;
+	journal_active = false;
+}
+
+bool fsjournal_active (void)
+{
+	return journal_active;
+}
+
+uae_u32 fsjournal_mark (void)
+{
+	return entry_base + entry_count;
+}
+
+size_t fsjournal_size (void)
+{
+	return journal_bytes;
+}
+
+bool fsjournal_canrollback (uae_u32 mark)
+{
+	return mark >= entry_base && mark >= journal_valid && mark <= entry_base + entry_count;
+}
+
+bool fsjournal_rollback (uae_u32 mark)
+{
+	bool ok = true;
+
+	if (!fsjournal_canrollback (mark))
+		return false;
+	read_close ();
+	while (entry_base + entry_count > mark) {
+		struct fsjournal_entry *e = &entries[entry_count - 1];
+		if (!undo_entry (e)) {
+			write_log (_T("FSJOURNAL: undo %d failed '%s'\n"), e->type, e->path);
+			ok = false;
+		}
+		free_entry (e);
+		entry_count--;
+	}
+	return ok;
+}
+
+/* forget undo data older than mark */
+void fsjournal_trim (uae_u32 mark)
+{
+	if (mark <= entry_base)
+		return;
+	int cnt = mark - entry_base;
+	if (cnt > entry_count)
+		cnt = entry_count;
+	for (int i = 0; i < cnt; i++)
+		free_entry (&entries[i]);
+	memmove (entries, entries + cnt, (entry_count - cnt) * sizeof (struct fsjournal_entry));
+	entry_count -= cnt;
+	entry_base += cnt;
+}
@@ -33,6 +33,48 @@ static void generate_include(void)
     printf("}\n");
 }
 
+static void generate_fill(void)
+{
+    /* Fill carry runs from bit 0 upwards and from word to word. Bit k of
+     * the prefix XOR p is the parity of bits 0..k, so exclusive fill is
+     * p ^ carry and inclusive fill is d | (p ^ d ^ carry). Only the carry
+     * between words is serial. */
+    printf("int blitrow_fill (uae_u16 *d, int n, int fc, int ife)\n");
+    printf("{\n");
+    printf("uae_u16 fcmask = fc ? 0xffff : 0;\n");
+    printf("#ifdef BLIT_SIMD\n");
+    printf("for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {\n");
+    printf("\tblit_vec x, p;\n");
+    printf("\tuae_u16 xs[BLIT_SIMD_WORDS], ps[BLIT_SIMD_WORDS];\n");
+    printf("\tmemcpy(&x, d + i, sizeof x);\n");
+    printf("\tp = x ^ (x << 1);\n");
+    printf("\tp ^= p << 2;\n");
+    printf("\tp ^= p << 4;\n");
+    printf("\tp ^= p << 8;\n");
+    printf("\tmemcpy(xs, &x, sizeof x);\n");
+    printf("\tmemcpy(ps, &p, sizeof p);\n");
+    printf("\tfor (int j = 0; j < BLIT_SIMD_WORDS && i + j < n; j++) {\n");
+    printf("\t\td[i + j] = ife ? xs[j] | (ps[j] ^ xs[j] ^ fcmask) : ps[j] ^ fcmask;\n");
+    printf("\t\tif (ps[j] & 0x8000)\n");
+    printf("\t\t\tfcmask ^= 0xffff;\n");
+    printf("\t}\n");
+    printf("}\n");
+    printf("#else\n");
+    printf("for (int i = 0; i < n; i++) {\n");
+    printf("\tuae_u16 x = d[i];\n");
+    printf("\tuae_u16 p = x ^ (x << 1);\n");
+    printf("\tp ^= p << 2;\n");
+    printf("\tp ^= p << 4;\n");
+    printf("\tp ^= p << 8;\n");
+    printf("\td[i] = ife ? x | (p ^ x ^ fcmask) : p ^ fcmask;\n");
+    printf("\tif (p & 0x8000)\n");
+    printf("\t\tfcmask ^= 0xffff;\n");
+    printf("}\n");
+    printf("#endif\n");
+    printf("return fcmask != 0;\n");
+    printf("}\n");
+}
+
 static void generate_func(void)
 {
     unsigned int i;
@@ -44,6 +86,14 @@ static void generate_func(void)
     printf("#include \"blitter.h\"\n");
     printf("#include \"blitfunc.h\"\n\n");
 
+    /* Row kernels work on host order words, GCC/Clang vector extensions
+     * map them to SSE2 or NEON. Buffers are padded to full vectors. */
+    printf("#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON))\n");
+    printf("#define BLIT_SIMD 1\n");
+    printf("#define BLIT_SIMD_WORDS 8\n");
+    printf("typedef uae_u16 blit_vec __attribute__((vector_size(16)));\n");
+    printf("#endif\n\n");
+
     for (i = 0; i < sizeof(blttbl); i++) {
 		int active = blitops[blttbl[i]].used;
 		int a_is_on = active & 1, b_is_on = active & 2, c_is_on = active & 4;
@@ -124,7 +174,29 @@ static void generate_func(void)
 		printf("\t\tif (dstp) chipmem_wput_indirect(dstp, dstd);\n");
 		printf("if (totald != 0) b->blitzero = 0;\n");
 		printf("}\n");
+
+		printf("void blitrow_%x (uae_u16 *d, const uae_u16 *pa, const uae_u16 *pb, const uae_u16 *pc, int n)\n", blttbl[i]);
+		printf("{\n");
+		printf("#ifdef BLIT_SIMD\n");
+		printf("blit_vec zero = { 0 };\n");
+		printf("for (int i = 0; i < n; i += BLIT_SIMD_WORDS) {\n");
+		if (a_is_on) printf("\tblit_vec srca;\n\tmemcpy(&srca, pa + i, sizeof srca);\n");
+		if (b_is_on) printf("\tblit_vec srcb;\n\tmemcpy(&srcb, pb + i, sizeof srcb);\n");
+		if (c_is_on) printf("\tblit_vec srcc;\n\tmemcpy(&srcc, pc + i, sizeof srcc);\n");
+		printf("\tblit_vec dstd = zero | (%s);\n", blitops[blttbl[i]].s);
+		printf("\tmemcpy(d + i, &dstd, sizeof dstd);\n");
+		printf("}\n");
+		printf("#else\n");
+		printf("for (int i = 0; i < n; i++) {\n");
+		if (a_is_on) printf("\tuae_u32 srca = pa[i];\n");
+		if (b_is_on) printf("\tuae_u32 srcb = pb[i];\n");
+		if (c_is_on) printf("\tuae_u32 srcc = pc[i];\n");
+		printf("\td[i] = (%s) & 0xFFFF;\n", blitops[blttbl[i]].s);
+		printf("}\n");
+		printf("#endif\n");
+		printf("}\n");
     }
+    generate_fill();
 }
 
 static void generate_table(void)
@@ -161,6 +233,19 @@ static void generate_table(void)
 		if (i < 255) printf(", ");
 		if ((i & 7) == 7) printf("\n");
     }
+    printf("};\n\n");
+
+    index = 0;
+    printf("blitter_row_func * const blitfunc_row[256] = {\n");
+    for (i = 0; i < 256; i++) {
+		if (index < sizeof(blttbl) && i == blttbl[index]) {
+			printf("blitrow_%x",i);
+			index++;
+		}
+		else printf("0");
+		if (i < 255) printf(", ");
+		if ((i & 7) == 7) printf("\n");
+    }
     printf("};\n");
 }
 
@@ -170,7 +255,9 @@ static void generate_header(void)
     for (i = 0; i < sizeof(blttbl); i++) {
 		printf("extern blitter_func blitdofast_%x;\n",blttbl[i]);
 		printf("extern blitter_func blitdofast_desc_%x;\n",blttbl[i]);
+		printf("extern blitter_row_func blitrow_%x;\n",blttbl[i]);
     }
+    printf("extern int blitrow_fill(uae_u16 *d, int n, int fc, int ife);\n");
 }
 
 int main(int argc, char **argv)
@@ -13,6 +13,9 @@
 #include "threaddep/thread.h"
 #include "options.h"
 #include "memory.h"
+#ifdef AMIBERRY
+#include "uae/mman.h"
+#endif
 #include "custom.h"
 #include "newcpu.h"
 #include "disk.h"
@@ -32,6 +35,8 @@
 #include "ini.h"
 #include "rommgr.h"
 #include "zarchive.h"
+#include "crc32.h"
+#include "fsdb.h"
 
 #ifdef WITH_CHD
 #include "archivers/chd/chd.h"
@@ -610,6 +615,12 @@ static uae_u32 vhd_checksum (uae_u8 *p, int offset)
 
 static int hdf_write2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 static int hdf_read2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+static int hdf_read_image(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+static int hdf_write_image(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+static int hdf_overlay_read(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+static int hdf_overlay_write(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
+static bool hdf_overlay_open(struct hardfiledata *hfd, int mode);
+static void hdf_overlay_close(struct hardfiledata *hfd);
 
 static void hdf_init_cache(struct hardfiledata *hfd)
 {
@@ -755,9 +766,22 @@ end:
 }
 int hdf_open (struct hardfiledata *hfd)
 {
+	int overlay = hfd->ci.overlay == HDF_OVERLAY_DEFAULT ? currprefs.harddrive_overlay : hfd->ci.overlay;
+	if (hfd->ci.readonly)
+		overlay = HDF_OVERLAY_NONE;
+	// base image is only written to when the overlay gets committed
+	bool basereadonly = overlay == HDF_OVERLAY_KEEP || overlay == HDF_OVERLAY_DISCARD;
+	if (basereadonly)
+		hfd->ci.readonly = true;
 	int v = hdf_open (hfd, NULL);
+	if (basereadonly)
+		hfd->ci.readonly = false;
 	if (!v)
 		return v;
+	if (v > 0 && overlay != HDF_OVERLAY_NONE && !hfd->ci.readonly && !hdf_overlay_open (hfd, overlay)) {
+		hdf_close (hfd);
+		return 0;
+	}
 	get_hd_geometry(&hfd->ci);
 	hfd->geometry = ini_load(hfd->ci.geometry, true);
 	return v;
@@ -765,6 +789,7 @@ int hdf_open (struct hardfiledata *hfd)
 
 void hdf_close (struct hardfiledata *hfd)
 {
+	hdf_overlay_close (hfd);
 	hdf_flush_cache (hfd);
 	hdf_close_target (hfd);
 #ifdef WITH_CHD
@@ -1104,6 +1129,21 @@ static int hdf_read2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 	}
 	offset -= hfd->virtual_size;
 
+	if (hfd->overlay)
+		ret = hdf_overlay_read (hfd, buffer, offset, len);
+	else
+		ret = hdf_read_image (hfd, buffer, offset, len);
+
+	if (ret <= 0)
+		return ret;
+	ret += extra;
+	return ret;
+}
+
+static int hdf_read_image(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	int ret = 0;
+
 	if (hfd->hfd_type == HFD_VHD_DYNAMIC)
 		ret = (int)vhd_read (hfd, buffer, offset, len);
 	else if (hfd->hfd_type == HFD_VHD_FIXED)
@@ -1135,10 +1175,6 @@ static int hdf_read2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 #endif
 	else
 		ret = hdf_read_target (hfd, buffer, offset, len);
-
-	if (ret <= 0)
-		return ret;
-	ret += extra;
 	return ret;
 }
 
@@ -1162,6 +1198,21 @@ static int hdf_write2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, in
 	}
 	offset -= hfd->virtual_size;
 
+	if (hfd->overlay)
+		ret = hdf_overlay_write (hfd, buffer, offset, len);
+	else
+		ret = hdf_write_image (hfd, buffer, offset, len);
+
+	if (ret <= 0)
+		return ret;
+	ret += extra;
+	return ret;
+}
+
+static int hdf_write_image(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	int ret = 0;
+
 	if (hfd->hfd_type == HFD_VHD_DYNAMIC)
 		ret = (int)vhd_write(hfd, buffer, offset, len);
 	else if (hfd->hfd_type == HFD_VHD_FIXED)
@@ -1191,13 +1242,314 @@ static int hdf_write2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, in
 #endif
 	else
 		ret = hdf_write_target(hfd, buffer, offset, len);
-
-	if (ret <= 0)
-		return ret;
-	ret += extra;
 	return ret;
 }
 
+/* Copy-on-write overlay. Writes go to a sparse delta file, blocks never
+ * written are read from the base image, which can be shared by several
+ * instances. Delta file layout: header, block bitmap, then block data at
+ * its image offset. */
+
+#define HDF_OVERLAY_MAGIC "UAEHDOVL"
+#define HDF_OVERLAY_VERSION 1
+#define HDF_OVERLAY_HEADER 512
+#define HDF_OVERLAY_BLOCK 512
+
+struct hdf_overlay
+{
+	struct zfile *zf;
+	TCHAR *path;
+	int mode;
+	uae_u64 size;
+	uae_u64 blocks;
+	uae_u8 *bitmap;
+	int bitmapsize;
+	uae_u64 dataoffset;
+	uae_u8 block[HDF_OVERLAY_BLOCK];
+};
+
+static bool hdf_overlay_isset(struct hdf_overlay *ov, uae_u64 block)
+{
+	return block < ov->blocks && (ov->bitmap[block >> 3] & (1 << (block & 7)));
+}
+
+#ifdef AMIBERRY
+extern char last_active_config[MAX_DPATH];
+#endif
+
+/* Without harddrive_overlay_path deltas go to a directory of their own for
+ * each configuration, never next to the base image: the image directory may
+ * be read-only and other instances using the same image must not share it. */
+static void hdf_overlay_dir(TCHAR *path)
+{
+	if (currprefs.harddrive_overlay_path[0]) {
+		cfgfile_resolve_path_out_load(currprefs.harddrive_overlay_path, path, MAX_DPATH, PATH_HDF);
+		fix_trailing(path);
+		return;
+	}
+	const TCHAR *instance = _T("default");
+#ifdef AMIBERRY
+	if (last_active_config[0])
+		instance = last_active_config;
+#endif
+	get_nvram_path(path, MAX_DPATH);
+	fix_trailing(path);
+	_tcsncat(path, _T("hdoverlay"), MAX_DPATH - _tcslen(path) - 1);
+	if (!my_existsdir(path))
+		my_mkdir(path);
+	fix_trailing(path);
+	_tcsncat(path, instance, MAX_DPATH - _tcslen(path) - 1);
+	if (!my_existsdir(path))
+		my_mkdir(path);
+	fix_trailing(path);
+}
+
+static TCHAR *hdf_overlay_name(const TCHAR *image)
+{
+	TCHAR *name = xmalloc(TCHAR, MAX_DPATH);
+	TCHAR path[MAX_DPATH];
+	const TCHAR *base = _tcsrchr(image, '/');
+	const TCHAR *base2 = _tcsrchr(image, '\\');
+	if (base2 > base)
+		base = base2;
+	base = base ? base + 1 : image;
+	hdf_overlay_dir(path);
+	// images with the same name in different directories need their own overlay
+	uae_u32 crc = get_crc32((void*)image, (int)(_tcslen(image) * sizeof(TCHAR)));
+	_sntprintf(name, MAX_DPATH, _T("%s%s.%08X.overlay"), path, base, crc);
+	return name;
+}
+
+static bool hdf_overlay_create(struct hdf_overlay *ov)
+{
+	uae_u8 header[HDF_OVERLAY_HEADER] = { 0 };
+
+	zfile_fclose(ov->zf);
+	ov->zf = zfile_fopen(ov->path, _T("wb+"), ZFD_NORMAL);
+	if (!ov->zf)
+		return false;
+	memcpy(header, HDF_OVERLAY_MAGIC, 8);
+	pl(header, 2, HDF_OVERLAY_VERSION);
+	pl(header, 3, HDF_OVERLAY_BLOCK);
+	pl(header, 4, (uae_u32)(ov->size >> 32));
+	pl(header, 5, (uae_u32)ov->size);
+	memset(ov->bitmap, 0, ov->bitmapsize);
+	if (zfile_fwrite(header, sizeof header, 1, ov->zf) != 1)
+		return false;
+	if (zfile_fwrite(ov->bitmap, ov->bitmapsize, 1, ov->zf) != 1)
+		return false;
+	return true;
+}
+
+static bool hdf_overlay_open(struct hardfiledata *hfd, int mode)
+{
+	TCHAR image[MAX_DPATH];
+	uae_u8 header[HDF_OVERLAY_HEADER];
+	struct hdf_overlay *ov = xcalloc(struct hdf_overlay, 1);
+
+	cfgfile_resolve_path_out_load(hfd->ci.rootdir, image, MAX_DPATH, PATH_HDF);
+	ov->mode = mode;
+	ov->path = hdf_overlay_name(image);
+	ov->size = hfd->virtsize;
+	ov->blocks = (ov->size + HDF_OVERLAY_BLOCK - 1) / HDF_OVERLAY_BLOCK;
+	ov->bitmapsize = (int)((ov->blocks + 7) / 8);
+	ov->dataoffset = (HDF_OVERLAY_HEADER + ov->bitmapsize + 4095) & ~4095;
+	ov->bitmap = xcalloc(uae_u8, ov->bitmapsize);
+
+	// leftover delta from an earlier discard session is not reused
+	if (mode != HDF_OVERLAY_DISCARD)
+		ov->zf = zfile_fopen(ov->path, _T("rb+"), ZFD_NORMAL);
+	if (ov->zf) {
+		if (zfile_fread(header, sizeof header, 1, ov->zf) != 1 || memcmp(header, HDF_OVERLAY_MAGIC, 8)
+			|| gl(header + 8) != HDF_OVERLAY_VERSION || gl(header + 12) != HDF_OVERLAY_BLOCK
+			|| (((uae_u64)gl(header + 16) << 32) | gl(header + 20)) != ov->size
+			|| zfile_fread(ov->bitmap, ov->bitmapsize, 1, ov->zf) != 1) {
+			write_log(_T("HDF overlay '%s' does not match '%s'\n"), ov->path, image);
+			gui_message(_T("\"%s\"\n\nHard disk overlay does not match the image."), ov->path);
+			goto fail;
+		}
+	} else if (!hdf_overlay_create(ov)) {
+		write_log(_T("HDF overlay '%s' can't be created\n"), ov->path);
+		goto fail;
+	}
+	hfd->overlay = ov;
+	write_log(_T("HDF '%s' overlay '%s' (%s)\n"), image, ov->path,
+		mode == HDF_OVERLAY_COMMIT ? _T("commit") : mode == HDF_OVERLAY_DISCARD ? _T("discard") : _T("keep"));
+	return true;
+fail:
+	zfile_fclose(ov->zf);
+	xfree(ov->bitmap);
+	xfree(ov->path);
+	xfree(ov);
+	return false;
+}
+
+static int hdf_overlay_read(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	struct hdf_overlay *ov = hfd->overlay;
+	uae_u8 *buf = (uae_u8*)buffer;
+	int got = 0;
+
+	while (len > 0) {
+		uae_u64 block = offset / HDF_OVERLAY_BLOCK;
+		bool delta = hdf_overlay_isset(ov, block);
+		// longest run coming from the same file
+		int run = HDF_OVERLAY_BLOCK - (int)(offset % HDF_OVERLAY_BLOCK);
+		while (run < len && hdf_overlay_isset(ov, ++block) == delta)
+			run += HDF_OVERLAY_BLOCK;
+		if (run > len)
+			run = len;
+		int ret;
+		if (delta) {
+			zfile_fseek(ov->zf, ov->dataoffset + offset, SEEK_SET);
+			ret = (int)zfile_fread(buf, 1, run, ov->zf);
+		} else {
+			ret = hdf_read_image(hfd, buf, offset, run);
+		}
+		if (ret > 0)
+			got += ret;
+		if (ret != run)
+			break;
+		buf += run;
+		offset += run;
+		len -= run;
+	}
+	return got;
+}
+
+static bool hdf_overlay_mark(struct hdf_overlay *ov, uae_u64 first, uae_u64 last)
+{
+	bool changed = false;
+	for (uae_u64 b = first; b <= last; b++) {
+		if (!hdf_overlay_isset(ov, b)) {
+			ov->bitmap[b >> 3] |= 1 << (b & 7);
+			changed = true;
+		}
+	}
+	if (!changed)
+		return true;
+	// data is already written, bitmap update makes it visible
+	zfile_fseek(ov->zf, HDF_OVERLAY_HEADER + (first >> 3), SEEK_SET);
+	size_t n = (size_t)((last >> 3) - (first >> 3) + 1);
+	return zfile_fwrite(ov->bitmap + (first >> 3), 1, n, ov->zf) == n;
+}
+
+static int hdf_overlay_write(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	struct hdf_overlay *ov = hfd->overlay;
+	uae_u8 *buf = (uae_u8*)buffer;
+	int got = 0;
+
+	if (offset + len > ov->size)
+		return 0;
+	while (len > 0) {
+		uae_u64 block = offset / HDF_OVERLAY_BLOCK;
+		int boffset = (int)(offset % HDF_OVERLAY_BLOCK);
+		int n;
+		if (boffset == 0 && len >= HDF_OVERLAY_BLOCK) {
+			// whole blocks, write as one run
+			n = len - len % HDF_OVERLAY_BLOCK;
+			zfile_fseek(ov->zf, ov->dataoffset + offset, SEEK_SET);
+			if (zfile_fwrite(buf, 1, n, ov->zf) != (size_t)n)
+				break;
+		} else {
+			n = HDF_OVERLAY_BLOCK - boffset;
+			if (n > len)
+				n = len;
+			uae_u64 boff = block * HDF_OVERLAY_BLOCK;
+			if (hdf_overlay_isset(ov, block)) {
+				zfile_fseek(ov->zf, ov->dataoffset + boff, SEEK_SET);
+				if (zfile_fread(ov->block, 1, HDF_OVERLAY_BLOCK, ov->zf) != HDF_OVERLAY_BLOCK)
+					break;
+			} else if (hdf_read_image(hfd, ov->block, boff, HDF_OVERLAY_BLOCK) != HDF_OVERLAY_BLOCK) {
+				memset(ov->block, 0, HDF_OVERLAY_BLOCK);
+			}
+			memcpy(ov->block + boffset, buf, n);
+			zfile_fseek(ov->zf, ov->dataoffset + boff, SEEK_SET);
+			if (zfile_fwrite(ov->block, 1, HDF_OVERLAY_BLOCK, ov->zf) != HDF_OVERLAY_BLOCK)
+				break;
+		}
+		if (!hdf_overlay_mark(ov, block, (offset + n - 1) / HDF_OVERLAY_BLOCK))
+			break;
+		got += n;
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+	return got;
+}
+
+/* write all delta blocks back to the base image and empty the delta */
+bool hdf_overlay_commit(struct hardfiledata *hfd)
+{
+	struct hdf_overlay *ov = hfd->overlay;
+	uae_u8 *buf;
+	bool ok = true;
+
+	if (!ov)
+		return false;
+	if (ov->mode != HDF_OVERLAY_COMMIT) {
+		write_log(_T("HDF overlay '%s': base image was opened read-only, can't commit\n"), ov->path);
+		return false;
+	}
+	buf = xmalloc(uae_u8, 64 * HDF_OVERLAY_BLOCK);
+	if (!buf)
+		return false;
+	for (uae_u64 b = 0; b < ov->blocks && ok; ) {
+		if (!hdf_overlay_isset(ov, b)) {
+			b++;
+			continue;
+		}
+		uae_u64 cnt = 1;
+		while (cnt < 64 && hdf_overlay_isset(ov, b + cnt))
+			cnt++;
+		int len = (int)(cnt * HDF_OVERLAY_BLOCK);
+		if (b * HDF_OVERLAY_BLOCK + len > ov->size)
+			len = (int)(ov->size - b * HDF_OVERLAY_BLOCK);
+		zfile_fseek(ov->zf, ov->dataoffset + b * HDF_OVERLAY_BLOCK, SEEK_SET);
+		if (zfile_fread(buf, 1, len, ov->zf) != (size_t)len || hdf_write_image(hfd, buf, b * HDF_OVERLAY_BLOCK, len) != len)
+			ok = false;
+		b += cnt;
+	}
+	xfree(buf);
+	if (!ok) {
+		write_log(_T("HDF overlay '%s': commit failed, delta kept\n"), ov->path);
+		return false;
+	}
+	write_log(_T("HDF overlay '%s' committed\n"), ov->path);
+	return hdf_overlay_create(ov);
+}
+
+/* forget all changes made since the delta was created */
+bool hdf_overlay_discard(struct hardfiledata *hfd)
+{
+	struct hdf_overlay *ov = hfd->overlay;
+	if (!ov)
+		return false;
+	write_log(_T("HDF overlay '%s' discarded\n"), ov->path);
+	return hdf_overlay_create(ov);
+}
+
+static void hdf_overlay_close(struct hardfiledata *hfd)
+{
+	struct hdf_overlay *ov = hfd->overlay;
+	bool unlinkdelta = false;
+
+	if (!ov)
+		return;
+	if (ov->mode == HDF_OVERLAY_COMMIT)
+		unlinkdelta = hdf_overlay_commit(hfd);
+	else if (ov->mode == HDF_OVERLAY_DISCARD)
+		unlinkdelta = true;
+	hfd->overlay = NULL;
+	zfile_fclose(ov->zf);
+	if (unlinkdelta)
+		_wunlink(ov->path);
+	xfree(ov->bitmap);
+	xfree(ov->path);
+	xfree(ov);
+}
+
 static void adide_decode (void *v, int len)
 {
 	int i;
@@ -1316,7 +1668,14 @@ static uae_u64 cmd_read(TrapContext *ctx, struct hardfiledata *hfd, uaecptr data
 			return 0;
 		if (bank_data->check(dataptr, (uae_u32)len)) {
 			uae_u8 *buffer = bank_data->xlateaddr(dataptr);
+#ifdef AMIBERRY
+			uae_mman_writewatch_begin(buffer, (size_t)len);
+			uae_u64 v = cmd_readx(hfd, buffer, offset, (uae_u32)len);
+			uae_mman_writewatch_end(buffer, (size_t)len);
+			return v;
+#else
 			return cmd_readx(hfd, buffer, offset, (uae_u32)len);
+#endif
 		}
 	}
 	int total = 0;
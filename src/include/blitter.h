@@ -54,11 +54,14 @@ extern void restore_blitter_start(void);
 extern void set_blitter_last(int);
 
 typedef void blitter_func(uaecptr, uaecptr, uaecptr, uaecptr, struct bltinfo *);
+/* d = minterm(a, b, c) for n host order words, buffers padded to 16 words */
+typedef void blitter_row_func(uae_u16 *, const uae_u16 *, const uae_u16 *, const uae_u16 *, int);
 
 #define BLITTER_MAX_WORDS 2048
 
 extern blitter_func *const blitfunc_dofast[256];
 extern blitter_func *const blitfunc_dofast_desc[256];
+extern blitter_row_func *const blitfunc_row[256];
 extern uae_u32 blit_masktable[BLITTER_MAX_WORDS];
 
 #endif /* UAE_BLITTER_H */
@@ -38,6 +38,8 @@ extern void deinit_socket_layer (void);
 #define SOCKET_TYPE int
 #endif
 
+struct reactor_waiter;
+
 /* allocated and maintained on a per-task basis */
 struct socketbase {
 	struct socketbase *next;
@@ -81,9 +83,8 @@ struct socketbase {
 	void *hAsyncTask;		/* async task handle */
 	void *hEvent;		/* thread event handle */
 #else
-	uae_sem_t sem;		/* semaphore to notify the socket thread of work */
-	uae_thread_id thread;	/* socket thread */
-	int  sockabort[2];		/* pipe used to tell the thread to abort a select */
+	uae_sem_t sem;		/* posted by the socket reactor when it has released the base */
+	int  sockabort[2];		/* pipe used to abort a pending operation */
 	int action;
 	int s;			/* for accept */
 	uae_u32 name;		/* For gethostbyname */
@@ -97,6 +98,17 @@ struct socketbase {
 	uae_u32 sets [3];
 	uae_u32 timeout;
 	uae_u32 sigmp;
+	/* socket reactor state */
+	struct socketbase *nextsubmit;	/* operations queued for the reactor */
+	struct socketbase *nextop;	/* pending or resolver list */
+	int submitted, pending, deferred;
+	uae_u32 (*tryfunc)(struct socketbase *);
+	int sockflags;		/* file flags restored after a blocking call */
+	struct pollfd *pfd;		/* abort pipe followed by the sockets waited on */
+	int *pfdsd;			/* Amiga descriptor of each pfd entry */
+	struct reactor_waiter *pfdw;	/* links the pfd entries to the reactor's descriptor table */
+	int pfdcount, pfdalloc;
+	uae_s64 deadline;		/* WaitSelect timeout, -1 if none */
 #endif
 #ifdef AMIBERRY
 	TrapContext *context;
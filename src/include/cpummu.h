@@ -237,15 +237,19 @@ extern void mmu_put_move16(uaecptr addr, uae_u32 *val, bool data, int size);
 #if MMU_IPAGECACHE
 extern uae_u32 atc_last_ins_laddr, atc_last_ins_paddr;
 extern uae_u8 atc_last_ins_cache;
+extern uae_u8 *atc_last_ins_host;
 #endif
 
 #if MMU_DPAGECACHE
-#define MMUFASTCACHE_ENTRIES 256
+/* direct mapped by logical page and S bit, host is NULL unless the
+ * physical page can be accessed without going through its addrbank */
+#define MMUFASTCACHE_ENTRIES 4096
 struct mmufastcache
 {
 	uae_u32 log;
 	uae_u32 phys;
 	uae_u8 cache_state;
+	uae_u8 *host;
 };
 extern struct mmufastcache atc_data_cache_read[MMUFASTCACHE_ENTRIES];
 extern struct mmufastcache atc_data_cache_write[MMUFASTCACHE_ENTRIES];
@@ -268,6 +272,8 @@ static ALWAYS_INLINE uae_u32 mmu_get_ilong(uaecptr addr, int size)
 #endif
 			addr = atc_last_ins_paddr | (addr & mmu_pagemask);
 			mmu_cache_state = atc_last_ins_cache;
+			if (atc_last_ins_host)
+				return do_get_mem_long((uae_u32 *)(atc_last_ins_host + (addr & mmu_pagemask)));
 		} else {
 #if CACHE_HIT_COUNT
 			mmu_ins_miss++;
@@ -292,6 +298,8 @@ static ALWAYS_INLINE uae_u16 mmu_get_iword(uaecptr addr, int size)
 #endif
 			addr = atc_last_ins_paddr | (addr & mmu_pagemask);
 			mmu_cache_state = atc_last_ins_cache;
+			if (atc_last_ins_host)
+				return do_get_mem_word((uae_u16 *)(atc_last_ins_host + (addr & mmu_pagemask)));
 		} else {
 #if CACHE_HIT_COUNT
 			mmu_ins_miss++;
@@ -316,6 +324,8 @@ static ALWAYS_INLINE uae_u32 mmu_get_long(uaecptr addr, bool data, int size)
 		if (atc_data_cache_read[idx2].log == idx1) {
 			addr = atc_data_cache_read[idx2].phys | (addr & mmu_pagemask);
 			mmu_cache_state = atc_data_cache_read[idx2].cache_state;
+			if (atc_data_cache_read[idx2].host)
+				return do_get_mem_long((uae_u32 *)(atc_data_cache_read[idx2].host + (addr & mmu_pagemask)));
 #if CACHE_HIT_COUNT
 			mmu_data_read_hit++;
 #endif
@@ -342,6 +352,8 @@ static ALWAYS_INLINE uae_u16 mmu_get_word(uaecptr addr, bool data, int size)
 		if (atc_data_cache_read[idx2].log == idx1) {
 			addr = atc_data_cache_read[idx2].phys | (addr & mmu_pagemask);
 			mmu_cache_state = atc_data_cache_read[idx2].cache_state;
+			if (atc_data_cache_read[idx2].host)
+				return do_get_mem_word((uae_u16 *)(atc_data_cache_read[idx2].host + (addr & mmu_pagemask)));
 #if CACHE_HIT_COUNT
 			mmu_data_read_hit++;
 #endif
@@ -368,6 +380,8 @@ static ALWAYS_INLINE uae_u8 mmu_get_byte(uaecptr addr, bool data, int size)
 		if (atc_data_cache_read[idx2].log == idx1) {
 			addr = atc_data_cache_read[idx2].phys | (addr & mmu_pagemask);
 			mmu_cache_state = atc_data_cache_read[idx2].cache_state;
+			if (atc_data_cache_read[idx2].host)
+				return do_get_mem_byte(atc_data_cache_read[idx2].host + (addr & mmu_pagemask));
 #if CACHE_HIT_COUNT
 			mmu_data_read_hit++;
 #endif
@@ -393,7 +407,11 @@ static ALWAYS_INLINE void mmu_put_long(uaecptr addr, uae_u32 val, bool data, int
 		uae_u32 idx2 = idx1 & (MMUFASTCACHE_ENTRIES - 1);
 		if (atc_data_cache_write[idx2].log == idx1) {
 			addr = atc_data_cache_write[idx2].phys | (addr & mmu_pagemask);
-			mmu_cache_state = atc_data_cache_read[idx2].cache_state;
+			mmu_cache_state = atc_data_cache_write[idx2].cache_state;
+			if (atc_data_cache_write[idx2].host) {
+				do_put_mem_long((uae_u32 *)(atc_data_cache_write[idx2].host + (addr & mmu_pagemask)), val);
+				return;
+			}
 #if CACHE_HIT_COUNT
 			mmu_data_write_hit++;
 #endif
@@ -419,7 +437,11 @@ static ALWAYS_INLINE void mmu_put_word(uaecptr addr, uae_u16 val, bool data, int
 		uae_u32 idx2 = idx1 & (MMUFASTCACHE_ENTRIES - 1);
 		if (atc_data_cache_write[idx2].log == idx1) {
 			addr = atc_data_cache_write[idx2].phys | (addr & mmu_pagemask);
-			mmu_cache_state = atc_data_cache_read[idx2].cache_state;
+			mmu_cache_state = atc_data_cache_write[idx2].cache_state;
+			if (atc_data_cache_write[idx2].host) {
+				do_put_mem_word((uae_u16 *)(atc_data_cache_write[idx2].host + (addr & mmu_pagemask)), val);
+				return;
+			}
 #if CACHE_HIT_COUNT
 			mmu_data_write_hit++;
 #endif
@@ -445,7 +467,11 @@ static ALWAYS_INLINE void mmu_put_byte(uaecptr addr, uae_u8 val, bool data, int
 		uae_u32 idx2 = idx1 & (MMUFASTCACHE_ENTRIES - 1);
 		if (atc_data_cache_write[idx2].log == idx1) {
 			addr = atc_data_cache_write[idx2].phys | (addr & mmu_pagemask);
-			mmu_cache_state = atc_data_cache_read[idx2].cache_state;
+			mmu_cache_state = atc_data_cache_write[idx2].cache_state;
+			if (atc_data_cache_write[idx2].host) {
+				do_put_mem_byte(atc_data_cache_write[idx2].host + (addr & mmu_pagemask), val);
+				return;
+			}
 #if CACHE_HIT_COUNT
 			mmu_data_write_hit++;
 #endif
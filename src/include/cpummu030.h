@@ -70,6 +70,7 @@ bool mmu030_decode_rp(uae_u64 RP);
 void mmu030_flush_atc_all(void);
 void mmu030_reset(int hardreset);
 void mmu030_set_funcs(void);
+void mmu030_flush_host_pages(void);
 uaecptr mmu030_translate(uaecptr addr, bool super, bool data, bool write);
 void mmu030_hardware_bus_error(uaecptr addr, uae_u32 v, bool read, bool ins, int size);
 bool mmu030_is_super_access(bool read);
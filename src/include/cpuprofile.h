@@ -0,0 +1,35 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Instruction level execution profiler
+  *
+  */
+
+#ifndef UAE_CPUPROFILE_H
+#define UAE_CPUPROFILE_H
+
+#include "uae/types.h"
+
+enum {
+	CPU_PROFILE_JIT_EXIT,		// compiled code returned to the main loop
+	CPU_PROFILE_JIT_NORMAL,		// block interpreted before it is compiled
+	CPU_PROFILE_JIT_COMPILE,
+	CPU_PROFILE_JIT_MAX
+};
+
+extern bool cpu_profile_active;
+
+extern void cpu_profile_start(void);
+extern void cpu_profile_stop(void);
+extern void cpu_profile_free(void);
+extern void cpu_profile_report(int lines);
+extern bool cpu_profile_write(const TCHAR *name);
+
+/* only called while cpu_profile_active is set */
+extern void cpu_profile_instr(uae_u32 opcode, uaecptr pc);
+extern void cpu_profile_jit(int type, uaecptr pc);
+extern uae_u64 cpu_profile_clock(void);
+/* type is ev_* or ev_max + 0 (blitter) / 1 (other ev2 events) */
+extern void cpu_profile_event(int type, uae_u64 start);
+
+#endif /* UAE_CPUPROFILE_H */
@@ -365,6 +365,14 @@ extern void hsync_record_line_state_last(int lineno, enum nln_how, int changed);
 extern void vsync_handle_redraw (int long_field, int lof_changed, uae_u16, uae_u16, bool drawlines, bool initial);
 extern bool vsync_handle_check (void);
 extern void draw_lines(int end, int section);
+#ifdef AMIBERRY
+struct drawing_band_time {
+	int first_line, last_line;
+	int worker;
+	int time; /* microseconds */
+};
+extern int get_drawing_band_times(struct drawing_band_time *bands, int max);
+#endif
 extern void init_hardware_for_drawing_frame (void);
 extern void reset_drawing (void);
 extern void drawing_init (void);
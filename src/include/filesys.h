@@ -13,6 +13,7 @@
 #include "traps.h"
 
 struct hardfilehandle;
+struct hdf_overlay;
 
 #define MAX_HDF_CACHE_BLOCKS 128
 #define MAX_SCSI_SENSE 36
@@ -63,6 +64,7 @@ struct hardfiledata {
     uae_u64 vhd_footerblock;
 
 	void *chd_handle;
+	struct hdf_overlay *overlay;
 
     int drive_empty;
     TCHAR *emptyname;
@@ -84,6 +86,13 @@ struct hardfiledata {
 #define HFD_FLAGS_REALDRIVE 1
 #define HFD_FLAGS_REALDRIVEPARTITION 2
 
+/* harddrive_overlay modes, what happens to the delta file when the image is closed */
+#define HDF_OVERLAY_DEFAULT -1
+#define HDF_OVERLAY_NONE 0
+#define HDF_OVERLAY_KEEP 1
+#define HDF_OVERLAY_DISCARD 2
+#define HDF_OVERLAY_COMMIT 3
+
 struct hd_hardfiledata {
     struct hardfiledata hfd;
     uae_u64 size;
@@ -130,6 +139,8 @@ extern int hdf_open (struct hardfiledata *hfd);
 extern int hdf_open (struct hardfiledata *hfd, const TCHAR *altname);
 extern int hdf_dup (struct hardfiledata *dhfd, const struct hardfiledata *shfd);
 extern void hdf_close (struct hardfiledata *hfd);
+extern bool hdf_overlay_commit (struct hardfiledata *hfd);
+extern bool hdf_overlay_discard (struct hardfiledata *hfd);
 extern int hdf_read_rdb (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 extern int hdf_read(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 extern int hdf_write(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
@@ -153,6 +164,9 @@ extern void hdf_close_target (struct hardfiledata *hfd);
 extern int hdf_read_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 extern int hdf_write_target (struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len);
 extern int hdf_resize_target (struct hardfiledata *hfd, uae_u64 newsize);
+#ifdef AMIBERRY
+extern void hdf_cache_stats_target (const struct hardfiledata *hfd, uae_u64 *hits, uae_u64 *misses, uae_u64 *readaheads);
+#endif
 
 extern void getchsgeometry (uae_u64 size, int *pcyl, int *phead, int *psectorspertrack);
 extern void getchsgeometry_hdf (struct hardfiledata *hfd, uae_u64 size, int *pcyl, int *phead, int *psectorspertrack);
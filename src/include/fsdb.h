@@ -111,6 +111,10 @@ typedef struct a_inode_struct {
 	unsigned int mountcount;
 	uae_u64 uniq_external;
 	struct virtualfilesysobject *vfso;
+	/* Hash chains by uniq and by parent uniq + host name.  */
+	struct a_inode_struct *uniq_next, *name_next;
+	/* Cached host directory contents, see fsdb_dircache_load ().  */
+	struct fsdb_dircache *dircache;
 } a_inode;
 
 extern TCHAR *nname_begin (TCHAR *);
@@ -128,6 +132,9 @@ extern a_inode *fsdb_lookup_aino_nname (a_inode *base, const TCHAR *);
 extern int fsdb_exists (const TCHAR *nname);
 extern int same_aname(const char* an1, const char* an2);
 
+/* Size of a _UAEFSDB.___ record.  */
+#define FSDB_RECORD_SIZE (1 + 4 + 257 + 257 + 81)
+
 /* Filesystem-dependent functions.  */
 extern int fsdb_name_invalid (a_inode *, const TCHAR *n);
 extern int fsdb_name_invalid_dir (a_inode *, const TCHAR *n);
@@ -137,6 +144,29 @@ extern int fsdb_mode_representable_p (const a_inode *, int);
 extern int fsdb_mode_supported (const a_inode *);
 extern TCHAR *fsdb_create_unique_nname (const a_inode *base, const TCHAR *);
 
+/* Directory metadata cache. A set belongs to one filesystem unit and is
+ * only used from that unit's thread. Cached directories are kept coherent
+ * with the host filesystem by fsdb_dircache_poll (), hosts without change
+ * notifications don't cache anything and all lookups fall back to the
+ * host filesystem.  */
+struct fsdb_dircache_set;
+typedef void (*fsdb_dircache_func)(void *ud, a_inode *dir, const TCHAR *name);
+extern struct fsdb_dircache_set *fsdb_dircache_open (void);
+extern void fsdb_dircache_close (struct fsdb_dircache_set *);
+extern void fsdb_dircache_flush (struct fsdb_dircache_set *);
+/* Apply host changes, changed is called for changes worth a notification.  */
+extern void fsdb_dircache_poll (struct fsdb_dircache_set *, fsdb_dircache_func changed, void *ud);
+extern bool fsdb_dircache_load (struct fsdb_dircache_set *, a_inode *dir);
+extern void fsdb_dircache_free (a_inode *dir);
+extern void fsdb_dircache_move (a_inode *from, a_inode *to);
+extern void fsdb_dircache_pin (a_inode *dir, bool pin);
+extern void fsdb_dircache_records_changed (a_inode *dir);
+/* The following return -1 or NULL if dir is not cached.  */
+extern int fsdb_dircache_readdir (a_inode *dir, int *idx, TCHAR *fn);
+extern int fsdb_dircache_search (a_inode *dir, TCHAR *rel, TCHAR **found);
+extern int fsdb_dircache_stat (a_inode *aino, struct mystat *ms);
+extern const uae_u8 *fsdb_dircache_records (a_inode *dir, int *count);
+
 struct my_opendir_s;
 struct my_openfile_s;
 
@@ -159,6 +189,8 @@ extern uae_s64 my_lseek (struct my_openfile_s*, uae_s64, int);
 extern uae_s64 my_fsize (struct my_openfile_s*);
 extern unsigned int my_read (struct my_openfile_s*, void*, unsigned int);
 extern unsigned int my_write (struct my_openfile_s*, void*, unsigned int);
+extern unsigned int my_pread (struct my_openfile_s*, void*, unsigned int, uae_u64);
+extern unsigned int my_pwrite (struct my_openfile_s*, const void*, unsigned int, uae_u64);
 extern int my_truncate (const TCHAR *name, uae_u64 len);
 extern int dos_errno (void);
 extern bool my_existslink(const char* name);
@@ -190,6 +222,7 @@ extern int my_getvolumeinfo (const TCHAR *root);
 extern std::string my_get_sha1_of_file(const char* filepath);
 
 #ifdef AMIBERRY
+bool my_readdir_ignored(const char* name);
 char* fsdb_native_path(const char* root_dir, const char* amiga_path);
 void fsdb_get_file_time(a_inode* node, int* days, int* mins, int* ticks);
 int fsdb_set_file_time(a_inode* node, int days, int mins, int ticks);
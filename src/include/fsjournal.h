@@ -0,0 +1,35 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Undo journal for host side directory filesystem changes
+  *
+  */
+
+#ifndef UAE_FSJOURNAL_H
+#define UAE_FSJOURNAL_H
+
+#include "uae/types.h"
+
+/* Recording is only active between fsjournal_start() and fsjournal_reset().
+ * Marks are monotonic positions in the journal. */
+extern void fsjournal_start (void);
+extern void fsjournal_reset (void);
+extern bool fsjournal_active (void);
+extern uae_u32 fsjournal_mark (void);
+extern bool fsjournal_canrollback (uae_u32 mark);
+extern bool fsjournal_rollback (uae_u32 mark);
+extern void fsjournal_trim (uae_u32 mark);
+extern size_t fsjournal_size (void);
+
+/* called before the host file is modified */
+extern void fsjournal_write (const TCHAR *path, uae_u64 pos, uae_u64 size);
+extern void fsjournal_setsize (const TCHAR *path, uae_u64 size);
+/* saves file contents before deletion, dropped by fsjournal_delete_abort() if it fails */
+extern void fsjournal_delete_prepare (const TCHAR *path);
+extern void fsjournal_delete_abort (void);
+/* called after the host object was created, deleted or renamed */
+extern void fsjournal_delete (const TCHAR *path, bool dir);
+extern void fsjournal_create (const TCHAR *path, bool dir);
+extern void fsjournal_rename (const TCHAR *oldpath, const TCHAR *newpath);
+
+#endif /* UAE_FSJOURNAL_H */
@@ -143,6 +143,23 @@ static ALWAYS_INLINE uae_u32 phys_get_byte(uaecptr addr)
     return get_byte(addr);
 }
 
+/* Host pointers of directly accessible physical pages are cached next to
+ * the logical to physical shortcuts, valid only while x_phys_* are the
+ * plain memory accessors and the memory map is unchanged. */
+extern bool mmu_host_direct;
+extern void mmu_flush_host_pages(void);
+
+static ALWAYS_INLINE uae_u8 *mmu_host_page(uaecptr phys, uae_u32 pagemask, bool write)
+{
+	if (!mmu_host_direct)
+		return NULL;
+	addrbank *ab = &get_mem_bank(phys);
+	uae_u8 *base = write ? ab->baseaddr_direct_w : ab->baseaddr_direct_r;
+	if (!base || ab->mask < pagemask)
+		return NULL;
+	return base + ((phys - ab->startaccessmask) & ab->mask);
+}
+
 extern uae_u32(*x_phys_get_iword)(uaecptr);
 extern uae_u32(*x_phys_get_ilong)(uaecptr);
 extern uae_u32(*x_phys_get_byte)(uaecptr);
@@ -259,6 +259,7 @@ struct uaedev_config_info
 	int forceload;
 	int device_emu_unit;
 	bool inject_icons;
+	int overlay; // HDF_OVERLAY_*, HDF_OVERLAY_DEFAULT uses harddrive_overlay
 	int badblock_num;
 	struct uaedev_badblock badblocks[MAX_UAEDEV_BADBLOCKS];
 	int uae_unitnum; // mountunit nr
@@ -776,6 +777,7 @@ struct uae_prefs
 	int leds_on_screen;
 #ifdef AMIBERRY
 	int multithreaded_drawing;
+	int multithreaded_drawing_workers;
 #endif
 	int leds_on_screen_mask[2];
 	int leds_on_screen_multiplier[2];
@@ -921,6 +923,7 @@ struct uae_prefs
 	bool fpu_no_unimplemented;
 	bool address_space_24;
 	bool cpu_data_cache;
+	bool cpu_blockcache;
 	bool picasso96_nocustom;
 	int picasso96_modeflags;
 	int cpu_model_fallback;
@@ -983,6 +986,8 @@ struct uae_prefs
 	struct floppyslot floppyslots[4];
 	bool floppy_read_only;
 	bool harddrive_read_only;
+	int harddrive_overlay;
+	TCHAR harddrive_overlay_path[MAX_DPATH];
 	TCHAR dfxlist[MAX_SPARE_DRIVES][MAX_DPATH];
 	int dfxclickvolume_disk[4];
 	int dfxclickvolume_empty[4];
@@ -1051,7 +1056,8 @@ struct uae_prefs
 #ifdef WITH_SLIRP
 	struct slirp_redir slirp_redirs[MAX_SLIRP_REDIRS];
 #endif
-	int statecapturerate, statecapturebuffersize;
+	int statecapturerate, statecapturebuffersize, statecapturebudget;
+	int runahead_frames;
 
 	TCHAR open_gui[256];
 	TCHAR quit_amiberry[256];
@@ -1366,6 +1372,8 @@ struct amiberry_options
 	bool default_whd_writecache = false;
 	bool default_whd_quit_on_exit = false;
 	bool use_jst_instead_of_whd = false;
+	int archive_cache_size = 1024; // MB, 0 = disabled
+	bool jit_profile_cache = false;
 	bool disable_shutdown_button = true;
 	bool allow_display_settings_from_xml = true;
 	int default_soundcard = 0;
@@ -0,0 +1,26 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Run-ahead input latency reduction
+  *
+  */
+
+#ifndef UAE_RUNAHEAD_H
+#define UAE_RUNAHEAD_H
+
+#define RUNAHEAD_MAX_FRAMES 4
+
+/* Ahead frames are being emulated: no audio output, no frame pacing and no
+ * host input processing until the machine is rolled back. */
+extern bool runahead_active;
+
+/* called at each emulated vsync, true if the machine must be rolled back */
+extern bool runahead_vsync(void);
+/* called from m68k_go when savestate_state is STATE_RUNAHEAD, false if the
+ * snapshot could not be restored and emulation continues unchanged */
+extern bool runahead_restore(void);
+/* next frame is emulated but not displayed */
+extern bool runahead_frame_hidden(void);
+extern void runahead_reset(void);
+
+#endif /* UAE_RUNAHEAD_H */
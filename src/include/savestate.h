@@ -176,6 +176,9 @@ extern uae_u8 *save_filesys_common(size_t *len);
 extern uae_u8 *restore_filesys_paths(uae_u8 *src);
 extern uae_u8 *save_filesys_paths(int num, size_t *len);
 extern int save_filesys_cando(void);
+extern uae_u8 *restore_filesys_rewind(uae_u8 *src);
+extern uae_u8 *save_filesys_rewind(size_t *len);
+extern int save_filesys_rewind_cando(void);
 
 extern uae_u8 *restore_gayle(uae_u8 *src);
 extern uae_u8 *save_gayle(size_t *len, uae_u8*);
@@ -269,6 +272,7 @@ extern bool savestate_check(void);
 #define STATE_DORESTORE 8
 #define STATE_REWIND 16
 #define STATE_DOREWIND 32
+#define STATE_RUNAHEAD 64
 
 #define STATE_SAVE_DESCRIPTION _T("Description!")
 
@@ -279,7 +283,7 @@ extern struct zfile *savestate_file;
 
 STATIC_INLINE bool isrestore(void)
 {
-	return savestate_state == STATE_RESTORE || savestate_state == STATE_REWIND;
+	return savestate_state == STATE_RESTORE || savestate_state == STATE_REWIND || savestate_state == STATE_RUNAHEAD;
 }
 
 extern void savestate_quick(int slot, int save);
@@ -292,5 +296,8 @@ extern int savestate_dorewind(int);
 extern void savestate_listrewind(void);
 extern void statefile_save_recording(const TCHAR*);
 extern void savestate_capture_request(void);
+extern bool savestate_runahead_capture(void);
+extern bool savestate_runahead_restore(void);
+extern void savestate_runahead_free(void);
 
 #endif /* UAE_SAVESTATE_H */
@@ -43,4 +43,10 @@ struct uae_mman_data
 };
 bool uae_mman_info(addrbank *ab, struct uae_mman_data *md);
 
+/* Write watched memory is write protected between queries. */
+bool uae_mman_writewatch_fault(void *addr);
+/* Bracket host syscalls that write into Amiga memory (read(), recv()). */
+void uae_mman_writewatch_begin(void *addr, size_t size);
+void uae_mman_writewatch_end(void *addr, size_t size);
+
 #endif /* UAE_MMAN_H */
@@ -17,7 +17,10 @@ int uae_slirp_redir(int is_udp, int host_port, struct in_addr guest_addr,
 bool uae_slirp_start (void);
 void uae_slirp_end (void);
 void uae_slirp_input(const uint8_t *pkt, int pkt_len);
+void uae_slirp_wakeup(void);
 
+/* slirp_output() queues, slirp_flush() delivers the queue to the device */
 void slirp_output(const uint8_t *pkt, int pkt_len);
+void slirp_flush(void);
 
 #endif /* UAE_SLIRP_H */
@@ -33,6 +33,8 @@ struct zfile {
     ZFILESEEK zfileseek;
     void *userdata;
     int useparent;
+    size_t mapsize; // data is mmap()ed
+    int mapfile; // data maps the real file f, opened read only
 };
 
 #define ZNODE_FILE 0
@@ -51,6 +51,9 @@ extern uae_u8 *zfile_load_data(const TCHAR *name, const uae_u8 *data,int datalen
 extern uae_u8 *zfile_load_file(const TCHAR *name, int *outlen);
 extern struct zfile *zfile_fopen_parent(struct zfile*, const TCHAR*, uae_u64 offset, uae_u64 size);
 extern uae_u8 *zfile_get_data_pointer(struct zfile *z, size_t *len);
+#ifdef AMIBERRY
+extern void zfile_cache_init(const TCHAR *path, uae_u64 maxsize);
+#endif
 extern const TCHAR *zfile_get_ext(const TCHAR *);
 
 extern int zfile_exists (const TCHAR *name);
@@ -47,6 +47,7 @@
 #include "audio.h"
 #include "sounddep/sound.h"
 #include "savestate.h"
+#include "runahead.h"
 #ifdef ARCADIA
 #include "arcadia.h"
 #endif
@@ -3531,6 +3532,9 @@ static int inputread;
 void inputdevice_read_msg(bool vblank)
 {
 	int got2 = 0;
+	// input state is rolled back after ahead frames, host events would be lost
+	if (runahead_active)
+		return;
 	for (;;) {
 		int got = handle_msgpump(vblank);
 		if (!got)
@@ -5861,7 +5865,8 @@ void inputdevice_vsync (void)
 	mouseupdate (0, true);
 	inputread = -1;
 
-	inputdevice_handle_inputcode ();
+	if (!runahead_active)
+		inputdevice_handle_inputcode ();
 	if (mouseedge_alive > 0)
 		mouseedge_alive--;
 	if (mouseedge(monid))
@@ -137,6 +137,11 @@ extern void (*flush_icache)(int);
 #endif
 extern void alloc_cache(void);
 extern void compile_block(cpu_history* pc_hist, int blocklen, int totcyles);
+extern int compile_trace_start(void* pc_p);
+extern bool compile_trace_branch(uae_u32 opcode, void* start_p, void* next_p);
+extern bool compile_cached_block(void* pc_p);
+extern void compiler_cache_init(const TCHAR* path);
+extern void compiler_cache_save(void);
 extern int check_for_cache_miss(void);
 
 #define scaled_cycles(x) (currprefs.m68k_speed<0?(((x)/SCALE)?(((x)/SCALE<MAXCYCLES?((x)/SCALE):MAXCYCLES)):1):(x))
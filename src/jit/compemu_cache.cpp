@@ -0,0 +1,470 @@
+/********************************************************************
+ * Persistent block profiles. Shared by the backends, like the      *
+ * preferences handling.                                            *
+ ********************************************************************/
+
+/* This is a profile cache, not a cache of translated code. For every
+ * fully optimized block it keeps the path of 68k instructions the
+ * block was recorded from, its optimization level and a checksum of
+ * the 68k code it covers. When the same code runs in a later session,
+ * the block is compiled from the stored path the first time it is
+ * reached, without being interpreted, counted and recompiled first.
+ * The compile itself still happens every session: host code is not
+ * stored, it is full of absolute host addresses (natmem_offset, regs,
+ * cache_tags, the popall stubs) that change with every start. There
+ * is one table per JIT and memory configuration. */
+
+#include "crc32.h"
+
+#define JITCACHE_VERSION 3
+#define JITCACHE_HASH_SIZE 16384
+#define JITCACHE_MAX_ENTRIES 65536	// saved, twice as many are kept in memory
+#define JITCACHE_MAX_AGE 32		// sessions an entry is kept without being used
+#define JITCACHE_MAX_RANGES 64
+
+struct jitcache_range {
+	uae_u32 addr;
+	uae_u32 len;
+};
+
+struct jitcache_insn {
+	uae_u32 addr;
+	uae_u8 specmem;
+};
+
+struct jitcache_entry {
+	uae_u32 addr;		// 68k address of the block
+	uae_u32 c1, c2;		// checksum of the ranges
+	uae_u32 used;		// last session that used the entry
+	uae_u32 cycles;		// total_cycles execute_normal() passed to compile_block
+	uae_u8 optlevel;
+	uae_u8 nranges;
+	uae_u16 blocklen;
+	int ranges;		// first entry in jitcache_ranges
+	int insns;		// first entry in jitcache_insns
+	int next;		// same hash
+};
+
+static TCHAR *jitcache_dir;
+static uae_u32 jitcache_key;
+static uae_u32 jitcache_session;
+static bool jitcache_loaded, jitcache_dirty;
+static struct jitcache_entry *jitcache_entries;
+static int jitcache_count, jitcache_alloc;
+static struct jitcache_range *jitcache_ranges;
+static int jitcache_range_count, jitcache_range_alloc;
+static struct jitcache_insn *jitcache_insns;
+static int jitcache_insn_count, jitcache_insn_alloc;
+static int jitcache_hash[JITCACHE_HASH_SIZE];
+/* Optimization level of the block compile_block translates next, when
+   it comes from the cache */
+static int jitcache_level;
+
+static inline int jitcache_hashof(uae_u32 addr)
+{
+	return (addr >> 1) & (JITCACHE_HASH_SIZE - 1);
+}
+
+static bool jitcache_grow(void **p, int *alloc, int count, int n, size_t size)
+{
+	if (count + n <= *alloc)
+		return true;
+	int a = *alloc ? *alloc * 2 : 4096;
+	while (a < count + n)
+		a *= 2;
+	void *np = realloc(*p, a * size);
+	if (!np)
+		return false;
+	*p = np;
+	*alloc = a;
+	return true;
+}
+
+/* Everything the generated code depends on besides the 68k code itself */
+static uae_u32 jitcache_config_key(void)
+{
+	uae_u32 k[] = {
+		JITCACHE_VERSION,
+		(uae_u32)currprefs.cpu_model, (uae_u32)currprefs.fpu_model, currprefs.address_space_24,
+		currprefs.compnf, currprefs.comp_constjump, currprefs.compfpu,
+		(uae_u32)currprefs.comptrustbyte, (uae_u32)currprefs.comptrustword,
+		(uae_u32)currprefs.comptrustlong, (uae_u32)currprefs.comptrustnaddr,
+		currprefs.chipmem.size, currprefs.bogomem.size,
+		currprefs.fastmem[0].size, currprefs.z3fastmem[0].size,
+		currprefs.mbresmem_low.size, currprefs.mbresmem_high.size,
+		currprefs.rtgboards[0].rtgmem_size
+	};
+	return get_crc32(k, sizeof k);
+}
+
+/* Ranges are only read where 68k memory is mapped into natmem */
+static bool jitcache_mapped(uae_u32 addr, uae_u32 len)
+{
+	return (uae_u64)addr + len <= natmem_reserved_size && valid_address(addr, len)
+		&& get_real_address(addr) == natmem_offset + addr;
+}
+
+static void jitcache_sum(const struct jitcache_range *r, int n, uae_u32 *c1, uae_u32 *c2)
+{
+	uae_u32 k1 = 0;
+	uae_u32 k2 = 0;
+
+	/* same as calc_checksum() */
+	for (int i = 0; i < n; i++) {
+		uintptr tmp = (uintptr)(natmem_offset + r[i].addr);
+		uae_s32 len = r[i].len + (tmp & 3);
+		uae_u32 *pos = (uae_u32*)(tmp & ~((uintptr)3));
+		while (len > 0) {
+			k1 += *pos;
+			k2 ^= *pos;
+			pos++;
+			len -= 4;
+		}
+	}
+	*c1 = k1;
+	*c2 = k2;
+}
+
+/* Is the code the entry was recorded from still there? */
+static bool jitcache_check(const struct jitcache_entry *e)
+{
+	const struct jitcache_range *r = &jitcache_ranges[e->ranges];
+	uae_u32 c1, c2;
+
+	for (int i = 0; i < e->nranges; i++) {
+		if (!jitcache_mapped(r[i].addr, r[i].len))
+			return false;
+	}
+	jitcache_sum(r, e->nranges, &c1, &c2);
+	return c1 == e->c1 && c2 == e->c2;
+}
+
+static struct jitcache_entry *jitcache_add(uae_u32 addr, int nranges, int blocklen)
+{
+	if (jitcache_count >= JITCACHE_MAX_ENTRIES * 2)
+		return NULL;
+	if (!jitcache_grow((void**)&jitcache_entries, &jitcache_alloc, jitcache_count, 1, sizeof(struct jitcache_entry)) ||
+		!jitcache_grow((void**)&jitcache_ranges, &jitcache_range_alloc, jitcache_range_count, nranges, sizeof(struct jitcache_range)) ||
+		!jitcache_grow((void**)&jitcache_insns, &jitcache_insn_alloc, jitcache_insn_count, blocklen, sizeof(struct jitcache_insn)))
+		return NULL;
+	struct jitcache_entry *e = &jitcache_entries[jitcache_count];
+	memset(e, 0, sizeof(struct jitcache_entry));
+	e->addr = addr;
+	e->nranges = nranges;
+	e->blocklen = blocklen;
+	e->used = jitcache_session;
+	e->ranges = jitcache_range_count;
+	e->insns = jitcache_insn_count;
+	/* newest first, later sessions usually run the same code again */
+	e->next = jitcache_hash[jitcache_hashof(addr)];
+	jitcache_hash[jitcache_hashof(addr)] = jitcache_count++;
+	jitcache_range_count += nranges;
+	jitcache_insn_count += blocklen;
+	return e;
+}
+
+static int jitcache_cmp_used(const void *a, const void *b)
+{
+	int i1 = *(const int*)a;
+	int i2 = *(const int*)b;
+	uae_u32 age1 = jitcache_session - jitcache_entries[i1].used;
+	uae_u32 age2 = jitcache_session - jitcache_entries[i2].used;
+	if (age1 != age2)
+		return age1 < age2 ? -1 : 1;
+	return i2 - i1;
+}
+
+static int jitcache_cmp_index(const void *a, const void *b)
+{
+	return *(const int*)a - *(const int*)b;
+}
+
+/* Drops replaced entries and entries that were not used for
+ * JITCACHE_MAX_AGE sessions, then keeps the keep most recently used */
+static void jitcache_compact(int keep)
+{
+	int *order = xmalloc(int, jitcache_count + 1);
+	int n = 0, rc = 0, ic = 0;
+
+	if (!order)
+		return;
+	for (int i = 0; i < jitcache_count; i++) {
+		const struct jitcache_entry *e = &jitcache_entries[i];
+		if (e->addr != 0xffffffff && jitcache_session - e->used <= JITCACHE_MAX_AGE)
+			order[n++] = i;
+	}
+	if (n > keep) {
+		qsort(order, n, sizeof(int), jitcache_cmp_used);
+		n = keep;
+		qsort(order, n, sizeof(int), jitcache_cmp_index);
+	}
+	if (n < jitcache_count)
+		jitcache_dirty = true;
+	/* entries, ranges and insns stay in the same order and only move down */
+	for (int i = 0; i < JITCACHE_HASH_SIZE; i++)
+		jitcache_hash[i] = -1;
+	for (int i = 0; i < n; i++) {
+		struct jitcache_entry e = jitcache_entries[order[i]];
+		memmove(&jitcache_ranges[rc], &jitcache_ranges[e.ranges], e.nranges * sizeof(struct jitcache_range));
+		memmove(&jitcache_insns[ic], &jitcache_insns[e.insns], e.blocklen * sizeof(struct jitcache_insn));
+		e.ranges = rc;
+		e.insns = ic;
+		rc += e.nranges;
+		ic += e.blocklen;
+		e.next = jitcache_hash[jitcache_hashof(e.addr)];
+		jitcache_hash[jitcache_hashof(e.addr)] = i;
+		jitcache_entries[i] = e;
+	}
+	jitcache_count = n;
+	jitcache_range_count = rc;
+	jitcache_insn_count = ic;
+	xfree(order);
+}
+
+static void jitcache_clear(void)
+{
+	xfree(jitcache_entries);
+	xfree(jitcache_ranges);
+	xfree(jitcache_insns);
+	jitcache_entries = NULL;
+	jitcache_ranges = NULL;
+	jitcache_insns = NULL;
+	jitcache_count = jitcache_alloc = 0;
+	jitcache_range_count = jitcache_range_alloc = 0;
+	jitcache_insn_count = jitcache_insn_alloc = 0;
+	for (int i = 0; i < JITCACHE_HASH_SIZE; i++)
+		jitcache_hash[i] = -1;
+	jitcache_session = 0;
+	jitcache_loaded = false;
+	jitcache_dirty = false;
+}
+
+static void jitcache_filename(TCHAR *name, int size, uae_u32 key)
+{
+	_sntprintf(name, size, _T("%sjit-%08x.cache"), jitcache_dir, key);
+}
+
+/* Rejects entries the compiler can't be given as they are: the level
+ * indexes optcount[] and every instruction must lie in the checksummed
+ * ranges, or a damaged file could make the compiler read unmapped memory */
+static bool jitcache_valid(uae_u32 addr, int optlevel, const struct jitcache_range *r, int nranges,
+	const struct jitcache_insn *in, int blocklen)
+{
+	if (optlevel < 1 || optlevel > OPTLEV_TRACE || in[0].addr != addr)
+		return false;
+	for (int i = 0; i < blocklen; i++) {
+		int j;
+		for (j = 0; j < nranges; j++) {
+			if (in[i].addr >= r[j].addr && (uae_u64)in[i].addr < (uae_u64)r[j].addr + r[j].len)
+				break;
+		}
+		if (j == nranges)
+			return false;
+	}
+	return true;
+}
+
+static void jitcache_load(void)
+{
+	TCHAR name[MAX_DPATH];
+	uae_u32 hdr[5];
+	struct jitcache_range ranges[JITCACHE_MAX_RANGES];
+	struct jitcache_insn insns[MAXRUN];
+	int rejected = 0;
+	FILE *f;
+
+	jitcache_filename(name, MAX_DPATH, jitcache_key);
+	f = uae_tfopen(name, _T("rb"));
+	if (!f)
+		return;
+	if (fread(hdr, sizeof hdr, 1, f) != 1 || hdr[0] != 0x4a495443 || hdr[1] != JITCACHE_VERSION || hdr[2] != jitcache_key) {
+		fclose(f);
+		return;
+	}
+	jitcache_session = hdr[4] + 1;
+	for (uae_u32 i = 0; i < hdr[3]; i++) {
+		uae_u32 v[6];
+		struct jitcache_entry *e;
+
+		// addr, c1, c2, optlevel | nranges << 8 | blocklen << 16, last used session, cycles
+		if (fread(v, sizeof v, 1, f) != 1)
+			break;
+		int optlevel = v[3] & 0xff;
+		int nranges = (v[3] >> 8) & 0xff;
+		int blocklen = v[3] >> 16;
+		if (!nranges || nranges > JITCACHE_MAX_RANGES || !blocklen || blocklen > MAXRUN)
+			break;
+		if (fread(ranges, sizeof(struct jitcache_range), nranges, f) != (size_t)nranges)
+			break;
+		int j;
+		for (j = 0; j < blocklen; j++) {
+			if (fread(&insns[j].addr, sizeof(uae_u32), 1, f) != 1 || fread(&insns[j].specmem, 1, 1, f) != 1)
+				break;
+		}
+		if (j < blocklen)
+			break;
+		if (!jitcache_valid(v[0], optlevel, ranges, nranges, insns, blocklen)) {
+			rejected++;
+			continue;
+		}
+		e = jitcache_add(v[0], nranges, blocklen);
+		if (!e)
+			break;
+		e->c1 = v[1];
+		e->c2 = v[2];
+		e->optlevel = optlevel;
+		e->used = v[4];
+		e->cycles = v[5];
+		memcpy(&jitcache_ranges[e->ranges], ranges, nranges * sizeof(struct jitcache_range));
+		memcpy(&jitcache_insns[e->insns], insns, blocklen * sizeof(struct jitcache_insn));
+	}
+	fclose(f);
+	if (rejected) {
+		write_log(_T("JIT: %d invalid entries in %s ignored\n"), rejected, name);
+		jitcache_dirty = true;
+	}
+	jit_log("<JIT compiler> : %d block profiles in %s", jitcache_count, name);
+}
+
+/* Switches to the table of the current configuration */
+static bool jitcache_open(void)
+{
+	if (!jitcache_dir || !canbang || !natmem_offset)
+		return false;
+	uae_u32 key = jitcache_config_key();
+	if (jitcache_loaded && key == jitcache_key)
+		return true;
+	compiler_cache_save();
+	jitcache_clear();
+	jitcache_key = key;
+	jitcache_loaded = true;
+	jitcache_load();
+	return true;
+}
+
+/* Returns the length of the block stored for pc_p, if its code is unchanged */
+static int jitcache_lookup(void *pc_p, cpu_history *pc_hist, int *level, int *cycles)
+{
+	uae_u32 addr = (uae_u32)((uae_u8*)pc_p - natmem_offset);
+
+	if (!jitcache_open() || (uae_u8*)pc_p < natmem_offset || addr >= natmem_reserved_size)
+		return 0;
+	for (int i = jitcache_hash[jitcache_hashof(addr)]; i >= 0; i = jitcache_entries[i].next) {
+		struct jitcache_entry *e = &jitcache_entries[i];
+		if (e->addr != addr || !jitcache_check(e))
+			continue;
+		for (int j = 0; j < e->blocklen; j++) {
+			pc_hist[j].location = (uae_u16*)(natmem_offset + jitcache_insns[e->insns + j].addr);
+			pc_hist[j].specmem = jitcache_insns[e->insns + j].specmem;
+		}
+		if (e->used != jitcache_session) {
+			e->used = jitcache_session;
+			jitcache_dirty = true;
+		}
+		*level = e->optlevel;
+		*cycles = (int)e->cycles;
+		return e->blocklen;
+	}
+	return 0;
+}
+
+/* Remembers a block that is translated at optlevel */
+static void jitcache_record(cpu_history *pc_hist, int blocklen, int totcycles, int optlevel, checksum_info *csi)
+{
+	struct jitcache_range ranges[JITCACHE_MAX_RANGES];
+	struct jitcache_entry *e;
+	uae_u32 addr, c1, c2;
+	int nranges = 0, old = -1;
+
+	if (!jitcache_open())
+		return;
+	for (; csi; csi = csi->next) {
+		uae_u32 a = (uae_u32)(csi->start_p - natmem_offset);
+		if (nranges >= JITCACHE_MAX_RANGES || csi->start_p < natmem_offset ||
+			csi->length > MAX_CHECKSUM_LEN || !jitcache_mapped(a, csi->length))
+			return;
+		ranges[nranges].addr = a;
+		ranges[nranges].len = csi->length;
+		nranges++;
+	}
+	if (!nranges)
+		return;
+	jitcache_sum(ranges, nranges, &c1, &c2);
+	if (jitcache_count >= JITCACHE_MAX_ENTRIES * 2)
+		jitcache_compact(JITCACHE_MAX_ENTRIES);
+
+	/* an entry for the same code is replaced by a better one */
+	addr = (uae_u32)((uae_u8*)pc_hist[0].location - natmem_offset);
+	for (int i = jitcache_hash[jitcache_hashof(addr)]; i >= 0; i = jitcache_entries[i].next) {
+		e = &jitcache_entries[i];
+		if (e->addr == addr && jitcache_check(e)) {
+			if (e->optlevel >= optlevel)
+				return;
+			old = i;
+			break;
+		}
+	}
+
+	e = jitcache_add(addr, nranges, blocklen);
+	if (!e)
+		return;
+	e->c1 = c1;
+	e->c2 = c2;
+	e->optlevel = optlevel;
+	e->cycles = (uae_u32)totcycles;
+	memcpy(&jitcache_ranges[e->ranges], ranges, nranges * sizeof(struct jitcache_range));
+	for (int i = 0; i < blocklen; i++) {
+		jitcache_insns[e->insns + i].addr = (uae_u32)((uae_u8*)pc_hist[i].location - natmem_offset);
+		jitcache_insns[e->insns + i].specmem = pc_hist[i].specmem;
+	}
+	/* jitcache_add() may have moved the entries */
+	if (old >= 0)
+		jitcache_entries[old].addr = 0xffffffff; // dropped by jitcache_compact()
+	jitcache_dirty = true;
+}
+
+void compiler_cache_save(void)
+{
+	TCHAR name[MAX_DPATH], tmp[MAX_DPATH];
+	uae_u32 hdr[5] = { 0x4a495443, JITCACHE_VERSION, jitcache_key, 0, jitcache_session };
+	FILE *f;
+	bool ok;
+
+	if (!jitcache_loaded || !jitcache_dirty)
+		return;
+	jitcache_compact(JITCACHE_MAX_ENTRIES);
+	jitcache_dirty = false;
+	hdr[3] = jitcache_count;
+	jitcache_filename(name, MAX_DPATH, jitcache_key);
+	_sntprintf(tmp, MAX_DPATH, _T("%s.tmp"), name);
+	f = uae_tfopen(tmp, _T("wb"));
+	if (!f)
+		return;
+	ok = fwrite(hdr, sizeof hdr, 1, f) == 1;
+	/* oldest first, so that loading keeps the newest entries in front */
+	for (int i = 0; i < jitcache_count && ok; i++) {
+		const struct jitcache_entry *e = &jitcache_entries[i];
+		uae_u32 v[6] = { e->addr, e->c1, e->c2, (uae_u32)(e->optlevel | (e->nranges << 8) | (e->blocklen << 16)), e->used, e->cycles };
+		ok = fwrite(v, sizeof v, 1, f) == 1 &&
+			fwrite(&jitcache_ranges[e->ranges], sizeof(struct jitcache_range), e->nranges, f) == e->nranges;
+		for (int j = 0; j < e->blocklen && ok; j++) {
+			const struct jitcache_insn *in = &jitcache_insns[e->insns + j];
+			ok = fwrite(&in->addr, sizeof(uae_u32), 1, f) == 1 && fwrite(&in->specmem, 1, 1, f) == 1;
+		}
+	}
+	if (fclose(f) != 0)
+		ok = false;
+	if (!ok || rename(tmp, name) != 0) {
+		write_log(_T("JIT: could not write %s\n"), name);
+		unlink(tmp);
+		return;
+	}
+	jit_log("<JIT compiler> : %d block profiles saved to %s", hdr[3], name);
+}
+
+void compiler_cache_init(const TCHAR *path)
+{
+	xfree(jitcache_dir);
+	jitcache_dir = path ? my_strdup(path) : NULL;
+	jitcache_clear();
+}
@@ -375,6 +375,25 @@ static uintptr taken_pc_p;
 static int     branch_cc;
 static int redo_current_block;
 
+/* Trace formation: a translated block ending in a conditional branch gets
+   recompiled once it is hot. The new trace follows the direction each
+   branch took while it was recorded, the other direction becomes a side
+   exit and the register state is kept across the internal edges. */
+#define OPTLEV_TRACE	7	// Optimization level of blocks recompiled as traces
+#define MAX_TRACE_EXITS	8	// Max. conditional branches inside a trace
+static int trace_count	= 100;	// How often a block has to run before it is recompiled as a trace
+
+#include "../compemu_cache.cpp"
+
+typedef struct {
+	uae_u32* branchadd;
+	uintptr target;
+	int cycles;
+	bigstate state;
+} trace_exit;
+static trace_exit trace_exits[MAX_TRACE_EXITS];
+static int trace_exit_count;
+
 #ifdef UAE
 int segvcount=0;
 #endif
@@ -3262,6 +3281,110 @@ void register_branch(uae_u32 not_taken, uae_u32 taken, uae_u8 cond)
 	branch_cc=cond;
 }
 
+/* Called by execute_normal before it records a block: returns how many
+   conditional branches the recorded trace may run through */
+int compile_trace_start(void* pc_p)
+{
+	blockinfo* bi=get_blockinfo_addr(pc_p);
+
+	if (!follow_const_jumps || !bi)
+		return 0;
+	if (bi->optlevel==OPTLEV_TRACE || (bi->optlevel==OPTLEV_TRACE-1 && bi->count==-1))
+		return MAX_TRACE_EXITS;
+	return 0;
+}
+
+/* Can the trace continue at next_p after the block ending opcode? */
+bool compile_trace_branch(uae_u32 opcode, void* start_p, void* next_p)
+{
+	return prop[opcode].cflow==fl_branch && compfunctbl[opcode] && nfcompfunctbl[opcode] && next_p!=start_p;
+}
+
+/* Called by execute_normal before it interprets a block: translates it
+   right away if the profile cache knows it from an earlier session */
+bool compile_cached_block(void* pc_p)
+{
+	cpu_history pc_hist[MAXRUN];
+	blockinfo* bi;
+	int blocklen, level, cycles;
+
+	if (!cache_enabled || !compiled_code || currprefs.cpu_model < 68020)
+		return false;
+	bi=get_blockinfo_addr(pc_p);
+	if (bi && (bi->optlevel!=0 || bi->count!=optcount[0]-1))
+		return false;
+	blocklen=jitcache_lookup(pc_p, pc_hist, &level, &cycles);
+	if (!blocklen)
+		return false;
+	jitcache_level=level;
+	compile_block(pc_hist, blocklen, cycles);
+	jitcache_level=0;
+	return true;
+}
+
+/* A conditional branch was translated inside a trace. Jump to a side exit
+   if it goes the other way than recorded, and continue at follow. */
+static bool compile_trace_exit(uintptr follow, int cycles)
+{
+	trace_exit* e;
+	int cc=branch_cc;
+
+	if (trace_exit_count>=MAX_TRACE_EXITS || (follow!=next_pc_p && follow!=taken_pc_p))
+		return false;
+	e=&trace_exits[trace_exit_count++];
+	if (follow==taken_pc_p) {
+		e->target=next_pc_p;
+		cc=branch_cc^1;
+	}
+	else
+		e->target=taken_pc_p;
+	compemu_raw_jcc_l_oponly(cc);
+	e->branchadd=(uae_u32*)get_target();
+	skip_long();
+	e->cycles=cycles;
+	e->state=live;
+
+	set_const(PC_P,follow);
+	comp_pc_p=(uae_u8*)follow;
+	next_pc_p=0;
+	taken_pc_p=0;
+	return true;
+}
+
+/* The side exits are emitted behind the end of the trace, each with the
+   register state at its branch */
+static void compile_trace_exits(void)
+{
+	for (int i=0;i<trace_exit_count;i++) {
+		trace_exit* e=&trace_exits[i];
+		int r=REG_PC_TMP;
+		int r2=(r==0) ? 1 : 0;
+
+		align_target(align_jumps);
+#if defined(USE_DATA_BUFFER)
+		data_check_end(32, 128); // just a pessimistic guess...
+#endif
+		write_jmp_target(e->branchadd, (cpuop_func *)get_target());
+		live=e->state;
+		m68k_pc_offset=0;
+		flush(1);
+		flush_reg_count();
+
+		compemu_raw_mov_l_mi(JITPTR &regs.pc_p, JITPTR e->target);
+		compemu_raw_mov_l_ri(r,cacheline(e->target));
+		compemu_raw_mov_l_ri(r2, JITPTR popall_do_nothing);
+#ifdef UAE
+		raw_sub_l_mi(uae_p32(&countdown),e->cycles);
+		raw_cmov_l_rm_indexed(r2, JITPTR cache_tags,r,sizeof(void *),NATIVE_CC_PL);
+#else
+		compemu_raw_cmp_l_mi8((uintptr)&regs.spcflags,0);
+		compemu_raw_cmov_l_rm_indexed(r2,(uintptr)cache_tags,r,sizeof(void *),NATIVE_CC_EQ);
+#endif
+		compemu_raw_jmp_r(r2);
+	}
+	trace_exit_count=0;
+}
+
 /* Note: get_handler may fail in 64 Bit environments, if direct_handler_to_use is
  * outside 32 bit
  */
@@ -4760,6 +4883,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 		int i;
 		int r;
 		int was_comp=0;
+		bool cached=false;
 		uae_u8 liveflags[MAXRUN+1];
 #if USE_CHECKSUM_INFO
 		bool trace_in_rom = isinrom((uintptr)pc_hist[0].location) != 0;
@@ -4797,11 +4921,22 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 				/* What the heck? We are not supposed to be here! */
 			}
 		}
+		if (jitcache_level) {
+			/* Straight to the level it had in the earlier session */
+			optlev=jitcache_level-1;
+			bi->count=-1;
+			cached=true;
+		}
 		if (bi->count==-1) {
 			optlev++;
 			while (!optcount[optlev])
 				optlev++;
 			bi->count=optcount[optlev]-1;
+			if (optlev==OPTLEV_TRACE-1 && follow_const_jumps &&
+				prop[DO_GET_OPCODE(pc_hist[blocklen-1].location)].cflow==fl_branch) {
+				/* Count how often it runs before it becomes a trace */
+				bi->count=trace_count-1;
+			}
 		}
 		current_block_pc_p= JITPTR pc_hist[0].location;
 
@@ -4821,7 +4956,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 
 #if USE_CHECKSUM_INFO
 			trace_in_rom = trace_in_rom && isinrom((uintptr)currpcp);
-			if (follow_const_jumps && is_const_jump(op)) {
+			if ((follow_const_jumps && is_const_jump(op)) || (i<blocklen-1 && end_block(op))) {
 				checksum_info *csi = alloc_checksum_info();
 				csi->start_p = (uae_u8 *)min_pcp;
 				csi->length = JITPTR max_pcp - JITPTR min_pcp + LONGEST_68K_INST;
@@ -4837,6 +4972,11 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 				max_pcp=(uintptr)currpcp;
 #endif
 
+			if (i<blocklen-1 && end_block(op)) {
+				/* Branch inside a trace: the side exit needs all flags */
+				liveflags[i+1]=FLAG_ALL;
+			}
+
 #ifdef UAE
 			if (!currprefs.compnf) {
 				liveflags[i]=FLAG_ALL;
@@ -4856,6 +4996,8 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 		csi->length = JITPTR max_pcp - JITPTR min_pcp + LONGEST_68K_INST;
 		csi->next = bi->csi;
 		bi->csi = csi;
+		if (optlev>=OPTLEV_TRACE-1 && !cached)
+			jitcache_record(pc_hist, blocklen, totcycles, optlev, bi->csi);
 #endif
 
 		bi->needed_flags=liveflags[0];
@@ -4885,6 +5027,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 			next_pc_p=0;
 			taken_pc_p=0;
 			branch_cc=0; // Only to be initialized. Will be set together with next_pc_p
+			trace_exit_count=0;
 
 			comp_pc_p=(uae_u8*)pc_hist[0].location;
 			init_comp();
@@ -4909,6 +5052,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 #endif
 
 			for (i=0;i<blocklen && get_target_noopt() < MAX_COMPILE_PTR;i++) {
+				bool traced=false;
 				cpuop_func **cputbl;
 				compop_func **comptbl;
 				uae_u32 opcode=DO_GET_OPCODE(pc_hist[i].location);
@@ -4975,6 +5119,14 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 
 					comptbl[opcode](opcode);
 					freescratch();
+					if (next_pc_p && i<blocklen-1) {
+#ifdef UAE
+						traced=compile_trace_exit((uintptr)pc_hist[i+1].location,
+							scaled_cycles(totcycles*(i+1)/blocklen));
+#else
+						traced=compile_trace_exit((uintptr)pc_hist[i+1].location, 0);
+#endif
+					}
 					if (!(liveflags[i+1] & FLAG_CZNV)) {
 						/* We can forget about flags */
 						dont_care_flags();
@@ -5076,6 +5228,14 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 						*branchadd = JITPTR get_target() - (JITPTR branchadd + 1);
 					}
 				}
+
+				if (i<blocklen-1 && end_block(opcode) && !traced) {
+					/* No side exit for this branch, the trace ends here */
+#ifdef UAE
+					totcycles=totcycles*(i+1)/blocklen;
+#endif
+					blocklen=i+1;
+				}
 			}
 #if 1 /* This isn't completely kosher yet; It really needs to be
 		 integrated into a general inter-block-dependency scheme */
@@ -5230,6 +5390,8 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 					compemu_raw_jmp_r(r2);
 				}
 			}
+
+			compile_trace_exits();
 		}
 
 #if USE_MATCH
@@ -22,6 +22,7 @@
 #include "inputdevice.h"
 #include "custom.h"
 #include "savestate.h"
+#include "runahead.h"
 
 int key_swap_hack2 = false;
 
@@ -210,6 +211,9 @@ static bool can_inject(void)
 int keys_available (void)
 {
 	int val;
+	// keys consumed by ahead frames would be lost by the rollback
+	if (runahead_active)
+		return 0;
 	val = kpb_first != kpb_last;
 	if (can_inject() && ((keyinject && keyinject[keyinject_offset]) || keyinject_state))
 		val = 1;
@@ -1323,6 +1323,9 @@ static void start_program ()
 
 static void leave_program ()
 {
+#ifdef JIT
+	compiler_cache_save ();
+#endif
 	do_leave_program ();
 }
 
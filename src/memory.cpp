@@ -23,6 +23,7 @@
 #include "custom.h"
 #include "events.h"
 #include "newcpu.h"
+#include "mmu_common.h"
 #include "autoconf.h"
 #include "savestate.h"
 #include "ar.h"
@@ -3507,6 +3508,8 @@ static void map_banks2 (addrbank *bank, int start, int size, int realsize, int q
 		old = debug_bankchange (-1);
 #endif
 	flush_icache(3); /* Sure don't want to keep any old mappings around! */
+	if (currprefs.mmu_model)
+		mmu_flush_host_pages();
 #ifdef NATMEM_OFFSET
 	if (!quick)
 		delete_shmmaps (start << 16, size << 16);
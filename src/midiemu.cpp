@@ -6,6 +6,7 @@
 #include "fsdb.h"
 #include "uae.h"
 #include "audio.h"
+#include "threaddep/thread.h"
 #define MT32EMU_API_TYPE 1
 #include <mt32emu.h>
 #include "midiemu.h"
@@ -13,6 +14,23 @@
 
 // MUNT MT-32/CM-32L emulation
 
+// Synth renders in blocks on its own thread. Audio is passed back through
+// a single producer/single consumer frame ring, MIDI bytes go the other way
+// with timestamps MIDI_EMU_LATENCY frames after the current play position.
+#define MIDI_EMU_BLOCK 256
+#define MIDI_EMU_LATENCY (4 * MIDI_EMU_BLOCK)
+#define MIDI_EMU_RING 4096
+#define MIDI_EMU_MSGRING 65536
+
+static mt32emu_bit16s midi_ring[MIDI_EMU_RING * 2];
+static volatile uae_atomic midi_ring_read, midi_ring_write;
+static uae_u8 midi_msgring[MIDI_EMU_MSGRING];
+static uae_u8 midi_msgbuf[MIDI_EMU_MSGRING];
+static volatile uae_atomic midi_msg_read, midi_msg_write;
+static uae_sem_t midi_render_sem;
+static uae_thread_id midi_render_tid;
+static volatile int midi_render_quit;
+
 static mt32emu_context mt32context;
 static int midi_emu_streamid;
 static float base_midi_emu_event;
@@ -211,16 +229,68 @@ void midi_update_sound(float v)
 	base_midi_emu_event = v;
 }
 
+static void midi_msg_copy(uae_u8 *dst, uae_u32 pos, int len)
+{
+	for (int i = 0; i < len; i++) {
+		dst[i] = midi_msgring[(pos + i) & (MIDI_EMU_MSGRING - 1)];
+	}
+}
+
+static void midi_msg_put(const uae_u8 *src, uae_u32 pos, int len)
+{
+	for (int i = 0; i < len; i++) {
+		midi_msgring[(pos + i) & (MIDI_EMU_MSGRING - 1)] = src[i];
+	}
+}
+
+// render thread: feed queued MIDI data to the synth
+static void midi_emu_drain(void)
+{
+	uae_u32 r = midi_msg_read;
+	while (r != atomic_get(&midi_msg_write)) {
+		uae_u32 hdr[2];
+		midi_msg_copy((uae_u8*)hdr, r, sizeof hdr);
+		midi_msg_copy(midi_msgbuf, r + sizeof hdr, hdr[1]);
+		mt32emu_parse_stream_at(mt32context, midi_msgbuf, hdr[1], mt32emu_convert_output_to_synth_timestamp(mt32context, hdr[0]));
+		r += sizeof hdr + hdr[1];
+		atomic_set(&midi_msg_read, r);
+	}
+}
+
+static int midi_emu_render_thread(void *v)
+{
+	while (!midi_render_quit) {
+		midi_emu_drain();
+		uae_u32 w = midi_ring_write;
+		// never render past play position + latency so that no MIDI timestamp is in the past
+		while ((uae_u32)(w + MIDI_EMU_BLOCK - atomic_get(&midi_ring_read)) <= MIDI_EMU_LATENCY && !midi_render_quit) {
+			mt32emu_render_bit16s(mt32context, midi_ring + (w & (MIDI_EMU_RING - 1)) * 2, MIDI_EMU_BLOCK);
+			w += MIDI_EMU_BLOCK;
+			atomic_set(&midi_ring_write, w);
+			midi_emu_drain();
+		}
+		uae_sem_wait(&midi_render_sem);
+	}
+	return 0;
+}
+
 static bool audio_state_midi_emu(int streamid, void *params)
 {
 	int sample[2] = { 0 };
 
 	if (mt32context) {
-		int vol = (100 - currprefs.sound_volume_midi) * 32768 / 100;
-		mt32emu_bit16s stream[2];
-		mt32emu_render_bit16s(mt32context, stream, 1);
-		sample[0] = stream[0] * vol / 32768;
-		sample[1] = stream[1] * vol / 32768;
+		uae_u32 r = midi_ring_read;
+		if (r != atomic_get(&midi_ring_write)) {
+			int vol = (100 - currprefs.sound_volume_midi) * 32768 / 100;
+			mt32emu_bit16s *stream = midi_ring + (r & (MIDI_EMU_RING - 1)) * 2;
+			sample[0] = stream[0] * vol / 32768;
+			sample[1] = stream[1] * vol / 32768;
+			r++;
+			atomic_set(&midi_ring_read, r);
+			if (!(r & (MIDI_EMU_BLOCK - 1))) {
+				uae_sem_post(&midi_render_sem);
+			}
+		}
 	}
 
 	midi_evt_time = (int)(base_midi_emu_event * CYCLE_UNIT / midi_emu_freq);
@@ -231,7 +301,17 @@ static bool audio_state_midi_emu(int streamid, void *params)
 void midi_emu_parse(uae_u8 *midi, int len)
 {
 	if (mt32context) {
-		mt32emu_parse_stream(mt32context, midi, len);
+		uae_u32 w = midi_msg_write;
+		uae_u32 hdr[2];
+		if (MIDI_EMU_MSGRING - (w - atomic_get(&midi_msg_read)) < sizeof hdr + len) {
+			write_log(_T("mt32emu: MIDI queue overflow, %d bytes dropped\n"), len);
+			return;
+		}
+		hdr[0] = midi_ring_read + MIDI_EMU_LATENCY;
+		hdr[1] = len;
+		midi_msg_put((uae_u8*)hdr, w, sizeof hdr);
+		midi_msg_put(midi, w + sizeof hdr, len);
+		atomic_set(&midi_msg_write, w + sizeof hdr + len);
 	}
 }
 
@@ -242,6 +322,13 @@ void midi_emu_close(void)
 		audio_enable_stream(false, midi_emu_streamid, 0, NULL, NULL);
 		midi_emu_streamid = 0;
 	}
+	if (midi_render_tid) {
+		midi_render_quit = 1;
+		uae_sem_post(&midi_render_sem);
+		uae_wait_thread(&midi_render_tid);
+		midi_render_tid = 0;
+	}
+	uae_sem_destroy(&midi_render_sem);
 	if (mt32context) {
 		mt32emu_close_synth(mt32context);
 		mt32emu_free_context(mt32context);
@@ -286,6 +373,15 @@ int midi_emu_open(const TCHAR *id)
 	}
 	midi_emu_freq = mt32emu_get_actual_stereo_output_samplerate(mt32context);
 	write_log("mt32emu frequency: %d\n", midi_emu_freq);
+	midi_ring_read = midi_ring_write = 0;
+	midi_msg_read = midi_msg_write = 0;
+	midi_render_quit = 0;
+	uae_sem_init(&midi_render_sem, 0, 0);
+	if (!uae_start_thread(_T("mt32emu"), midi_emu_render_thread, NULL, &midi_render_tid)) {
+		write_log("mt32emu render thread failed to start\n");
+		midi_emu_close();
+		return 0;
+	}
 	midi_emu_streamid = audio_enable_stream(true, -1, 2, audio_state_midi_emu, NULL);
 
 	return 1;
@@ -37,6 +37,7 @@
 #include "debugmem.h"
 #include "gui.h"
 #include "savestate.h"
+#include "runahead.h"
 #include "blitter.h"
 #include "ar.h"
 #include "gayle.h"
@@ -56,6 +57,7 @@
 #endif
 #include "bsdsocket.h"
 #include "devices.h"
+#include "cpuprofile.h"
 #ifdef WITH_DRACO
 #include "draco.h"
 #endif
@@ -1823,6 +1825,8 @@ void set_cpu_caches (bool flush)
 
 STATIC_INLINE void count_instr (uae_u32 opcode)
 {
+	if (cpu_profile_active)
+		cpu_profile_instr(opcode, regs.instruction_pc);
 }
 
 static uae_u32 opcode_swap(uae_u16 opcode)
@@ -1892,6 +1896,64 @@ const struct cputbl *getjitcputbl(int cpulvl, int direct)
 
 #endif
 
+/* Predecoded block cache for the direct fetch non-compatible interpreter.
+ * Straight runs of instructions are remembered by host PC pointer together
+ * with their handlers and lengths. Every cached opcode word is compared to
+ * memory before it is executed, so modified code simply ends the block. */
+
+#define CPU_BLOCK_BITS 12
+#define CPU_BLOCK_COUNT (1 << CPU_BLOCK_BITS)
+#define CPU_BLOCK_MAXINSN 16
+#define CPU_BLOCK_MAXLEN 22
+
+struct cpu_block_insn
+{
+	cpuop_func *func;
+	uae_u16 opcode;
+	uae_u16 len;
+};
+
+struct cpu_block
+{
+	uae_u8 *start;
+	int count;
+	struct cpu_block_insn insn[CPU_BLOCK_MAXINSN];
+};
+
+static struct cpu_block *cpu_blocks;
+static bool cpu_blocks_active;
+
+static void cpu_block_init()
+{
+	cpu_blocks_active = false;
+	if (!currprefs.cpu_blockcache || currprefs.cachesize || m68k_pc_indirect || currprefs.mmu_model) {
+		xfree(cpu_blocks);
+		cpu_blocks = nullptr;
+		return;
+	}
+	if (!cpu_blocks) {
+		cpu_blocks = xcalloc(struct cpu_block, CPU_BLOCK_COUNT);
+		if (!cpu_blocks)
+			return;
+	} else {
+		// handlers may have changed
+		memset(cpu_blocks, 0, CPU_BLOCK_COUNT * sizeof(struct cpu_block));
+	}
+	cpu_blocks_active = true;
+}
+
+STATIC_INLINE bool cpu_block_usable()
+{
+#ifdef DEBUGGER
+	if (debug_opcode_watch)
+		return false;
+#endif
+	// replayed blocks bypass count_instr()
+	if (cpu_profile_active)
+		return false;
+	return cpu_blocks_active;
+}
+
 static void build_cpufunctbl ()
 {
 	int i, opcnt;
@@ -2052,6 +2114,8 @@ static void build_cpufunctbl ()
 		currprefs.cachesize ? (currprefs.compfpu ? _T("=CPU/FPU") : _T("=CPU")) : _T(""),
 		currprefs.cachesize);
 
+	cpu_block_init();
+
 	regs.address_space_mask = 0xffffffff;
 	if (currprefs.cpu_compatible) {
 		if (currprefs.address_space_24 && currprefs.cpu_model >= 68040)
@@ -2092,6 +2156,9 @@ static void build_cpufunctbl ()
 	if (currprefs.fpu_no_unimplemented && currprefs.fpu_model) {
 		write_log(_T(" no unimplemented floating point instructions"));
 	}
+	if (cpu_blocks_active) {
+		write_log(_T(" block cache"));
+	}
 	if (currprefs.address_space_24) {
 		regs.address_space_mask = 0x00ffffff;
 		write_log(_T(" 24-bit"));
@@ -2228,6 +2295,7 @@ static void prefs_changed_cpu ()
 		currprefs.cpu_data_cache = changed_prefs.cpu_data_cache;
 		invalidate_cpu_data_caches();
 	}
+	currprefs.cpu_blockcache = changed_prefs.cpu_blockcache;
 	currprefs.address_space_24 = changed_prefs.address_space_24;
 	currprefs.cpu_cycle_exact = changed_prefs.cpu_cycle_exact;
 	currprefs.cpu_memory_cycle_exact = changed_prefs.cpu_memory_cycle_exact;
@@ -2254,6 +2322,7 @@ static int check_prefs_changed_cpu2()
 		|| currprefs.int_no_unimplemented != changed_prefs.int_no_unimplemented
 		|| currprefs.fpu_no_unimplemented != changed_prefs.fpu_no_unimplemented
 		|| currprefs.cpu_compatible != changed_prefs.cpu_compatible
+		|| currprefs.cpu_blockcache != changed_prefs.cpu_blockcache
 		|| currprefs.cpu_cycle_exact != changed_prefs.cpu_cycle_exact
 		|| currprefs.cpu_memory_cycle_exact != changed_prefs.cpu_memory_cycle_exact
 		|| currprefs.fpu_mode != changed_prefs.fpu_mode) {
@@ -4953,8 +5022,6 @@ static void m68k_run_1 ()
 			while (!exit) {
 				r->opcode = r->ir;
 
-				count_instr (r->opcode);
-
 #if DEBUG_CD32CDTVIO
 				out_cd32io (m68k_getpc ());
 #endif
@@ -4975,6 +5042,7 @@ static void m68k_run_1 ()
 				}
 #endif
 				r->instruction_pc = m68k_getpc ();
+				count_instr (r->opcode);
 				cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode) & 0xffff;
 				if (!regs.loop_mode)
 					regs.ird = regs.opcode;
@@ -5529,14 +5597,22 @@ void execute_normal(void)
 	int blocklen;
 	cpu_history pc_hist[MAXRUN];
 	int total_cycles;
+	int trace_branches;
 
 	if (check_for_cache_miss ())
 		return;
+	if (cpu_profile_active)
+		cpu_profile_jit(CPU_PROFILE_JIT_NORMAL, r->pc);
 
 	total_cycles = 0;
 	blocklen = 0;
 	start_pc_p = r->pc_oldp;
 	start_pc = r->pc;
+	/* known from an earlier session? */
+	if (compile_cached_block (r->pc_p))
+		return;
+	/* hot blocks are recorded as traces through conditional branches */
+	trace_branches = compile_trace_start (r->pc_p);
 	for (;;) {
 		/* Take note: This is the do-it-normal loop */
 		r->opcode = get_jit_opcode();
@@ -5556,7 +5632,14 @@ void execute_normal(void)
 
 		pc_hist[blocklen].specmem = special_mem;
 		blocklen++;
-		if (end_block (r->opcode) || blocklen >= MAXRUN || r->spcflags || uae_int_requested) {
+		int stop = end_block (r->opcode);
+		if (stop && trace_branches > 0 && compile_trace_branch (r->opcode, pc_hist[0].location, r->pc_p)) {
+			trace_branches--;
+			stop = 0;
+		}
+		if (stop || blocklen >= MAXRUN || r->spcflags || uae_int_requested) {
+			if (cpu_profile_active)
+				cpu_profile_jit(CPU_PROFILE_JIT_COMPILE, start_pc);
 			compile_block (pc_hist, blocklen, total_cycles);
 			return; /* We will deal with the spcflags in the caller */
 		}
@@ -5583,6 +5666,8 @@ static int cpu_thread_run_jit(void *v)
 	{
 		for (;;) {
 			((compiled_handler*)(pushall_call_handler))();
+			if (cpu_profile_active)
+				cpu_profile_jit(CPU_PROFILE_JIT_EXIT, m68k_getpc());
 			/* Whenever we return from that, we should check spcflags */
 			if (regs.spcflags || cpu_thread_ilvl > 0) {
 				if (do_specialties_thread()) {
@@ -5621,6 +5706,8 @@ static void m68k_run_jit(void)
 #endif
 			for (;;) {
 				((compiled_handler*)(pushall_call_handler))();
+				if (cpu_profile_active)
+					cpu_profile_jit(CPU_PROFILE_JIT_EXIT, m68k_getpc());
 				/* Whenever we return from that, we should check spcflags */
 				check_uae_int_request();
 				if (regs.spcflags) {
@@ -6446,6 +6533,61 @@ static int cpu_thread_run_2(void *v)
 }
 #endif
 
+/* Runs one cached block, or records a new one while executing it.
+ * Returns the raw cycle sum, adjust_cycles() is applied once per block. */
+static int cpu_block_run(struct regstruct *r, int shift)
+{
+	uae_u8 *p = r->pc_p;
+	struct cpu_block *b = &cpu_blocks[((uintptr_t)p >> 1) & (CPU_BLOCK_COUNT - 1)];
+	int cycles = 0;
+
+	if (b->start == p && b->count) {
+		for (int i = 0; i < b->count; i++) {
+			struct cpu_block_insn *in = &b->insn[i];
+			uae_u16 opcode = do_get_mem_word((uae_u16*)p);
+			if (opcode != in->opcode) {
+				// code changed, keep the part that still matches
+				b->count = i;
+				if (!i)
+					break;
+				return cycles;
+			}
+			r->instruction_pc = m68k_getpc_p(p);
+			r->opcode = opcode;
+			cycles += ((*in->func)(opcode) >> shift) & 0xffff;
+			p += in->len;
+			if (r->pc_p != p || r->spcflags)
+				return cycles;
+		}
+		if (b->count)
+			return cycles;
+	}
+
+	b->start = p;
+	b->count = 0;
+	for (;;) {
+		uae_u8 *oldp = r->pc_oldp;
+		uae_u16 opcode = do_get_mem_word((uae_u16*)p);
+		cpuop_func *func = cpufunctbl[opcode];
+		r->instruction_pc = m68k_getpc_p(p);
+		r->opcode = opcode;
+		count_instr(opcode);
+		cycles += ((*func)(opcode) >> shift) & 0xffff;
+		ptrdiff_t len = r->pc_p - p;
+		// taken branch or exception: not part of the block
+		if (r->pc_oldp != oldp || len < 2 || len > CPU_BLOCK_MAXLEN)
+			break;
+		struct cpu_block_insn *in = &b->insn[b->count++];
+		in->func = func;
+		in->opcode = opcode;
+		in->len = (uae_u16)len;
+		p += len;
+		if (table68k[opcode].cflow != fl_normal || r->spcflags || b->count >= CPU_BLOCK_MAXINSN)
+			break;
+	}
+	return cycles;
+}
+
 /* Same thing, but don't use prefetch to get opcode.  */
 static void m68k_run_2_000()
 {
@@ -6456,17 +6598,21 @@ static void m68k_run_2_000()
 		check_debugger();
 		TRY(prb) {
 			while (!exit) {
-				r->instruction_pc = m68k_getpc ();
+				if (cpu_block_usable()) {
+					cpu_cycles = cpu_block_run(r, 0);
+				} else {
+					r->instruction_pc = m68k_getpc ();
 
-				r->opcode = x_get_iword(0);
-				count_instr (r->opcode);
+					r->opcode = x_get_iword(0);
+					count_instr (r->opcode);
 #ifdef DEBUGGER
-				if (debug_opcode_watch) {
-					debug_trainer_match();
-				}
+					if (debug_opcode_watch) {
+						debug_trainer_match();
+					}
 #endif
 
-				cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode) & 0xffff;
+					cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode) & 0xffff;
+				}
 				cpu_cycles = adjust_cycles (cpu_cycles);
 				do_cycles(cpu_cycles);
 
@@ -6501,18 +6647,22 @@ static void m68k_run_2_020()
 		check_debugger();
 		TRY(prb) {
 			while (!exit) {
-				r->instruction_pc = m68k_getpc();
+				if (cpu_block_usable()) {
+					cpu_cycles = cpu_block_run(r, 16);
+				} else {
+					r->instruction_pc = m68k_getpc();
 
-				r->opcode = x_get_iword(0);
-				count_instr(r->opcode);
+					r->opcode = x_get_iword(0);
+					count_instr(r->opcode);
 
 #ifdef DEBUGGER
-				if (debug_opcode_watch) {
-					debug_trainer_match();
-				}
+					if (debug_opcode_watch) {
+						debug_trainer_match();
+					}
 #endif
 
-				cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode) >> 16;
+					cpu_cycles = (*cpufunctbl[r->opcode])(r->opcode) >> 16;
+				}
 				cpu_cycles = adjust_cycles(cpu_cycles);
 				do_cycles(cpu_cycles);
 
@@ -6625,6 +6775,26 @@ void m68k_go (int may_quit)
 		if (input_play || input_record)
 			inprec_startup ();
 
+#ifdef SAVESTATE
+		if (quit_program > 0 && savestate_state == STATE_RUNAHEAD) {
+			// run-ahead rollback, done every frame: restore the snapshot in
+			// place without going through the reset path below.
+			quit_program = 0;
+			if (runahead_restore ()) {
+				custom_reset (false, false);
+				m68k_reset2 (false);
+				savestate_restore_finish ();
+				if (currprefs.mmu_model == 68030) {
+					mmu030_decode_tc (tc_030, true);
+				} else if (currprefs.mmu_model >= 68040) {
+					mmu_set_tc (regs.tcr);
+				}
+				if (currprefs.produce_sound == 0)
+					eventtab[ev_audio].active = false;
+				m68k_setpc_normal (regs.pc);
+			}
+		} else
+#endif
 		if (quit_program > 0) {
 			cpu_keyboardreset = quit_program == UAE_RESET_KEYBOARD;
 			cpu_hardreset = ((quit_program == UAE_RESET_HARD ? 1 : 0) || hardboot) != 0;
@@ -6647,6 +6817,7 @@ void m68k_go (int may_quit)
 			} else if (savestate_state == STATE_REWIND) {
 				savestate_rewind ();
 			}
+			runahead_reset ();
 #endif
 			if (cpu_hardreset) {
 				m68k_reset_restore();
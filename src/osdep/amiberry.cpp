@@ -43,6 +43,9 @@
 #include "rtgmodes.h"
 #include "gfxboard.h"
 #include "devices.h"
+#ifdef JIT
+#include "jit/compemu.h"
+#endif
 #include <map>
 #include "ioport.h"
 #include <parser.h>
@@ -2294,6 +2297,7 @@ void target_default_options(uae_prefs* p, const int type)
 	}
 
 	p->multithreaded_drawing = amiberry_options.default_multithreaded_drawing;
+	p->multithreaded_drawing_workers = 0;
 
 	p->kbd_led_num = -1; // No status on numlock
 	p->kbd_led_scr = -1; // No status on scrollock
@@ -3455,6 +3459,12 @@ void save_amiberry_settings()
 	// Use JST instead of WHDLoad
 	write_bool_option("use_jst_instead_of_whd", amiberry_options.use_jst_instead_of_whd);
 
+	// Size of the unpacked archive cache in MB, 0 = disabled
+	write_int_option("archive_cache_size", amiberry_options.archive_cache_size);
+
+	// Remember JIT block profiles across sessions
+	write_bool_option("jit_profile_cache", amiberry_options.jit_profile_cache);
+
 	// Disable Shutdown button in GUI
 	write_bool_option("disable_shutdown_button", amiberry_options.disable_shutdown_button);
 
@@ -3676,6 +3686,8 @@ static int parse_amiberry_settings_line(const char *path, char *linea)
 		ret |= cfgfile_yesno(option, value, "default_whd_writecache", &amiberry_options.default_whd_writecache);
 		ret |= cfgfile_yesno(option, value, "default_whd_quit_on_exit", &amiberry_options.default_whd_quit_on_exit);
 		ret |= cfgfile_yesno(option, value, "use_jst_instead_of_whd", &amiberry_options.use_jst_instead_of_whd);
+		ret |= cfgfile_intval(option, value, "archive_cache_size", &amiberry_options.archive_cache_size, 1);
+		ret |= cfgfile_yesno(option, value, "jit_profile_cache", &amiberry_options.jit_profile_cache);
 		ret |= cfgfile_yesno(option, value, "disable_shutdown_button", &amiberry_options.disable_shutdown_button);
 		ret |= cfgfile_yesno(option, value, "allow_display_settings_from_xml", &amiberry_options.allow_display_settings_from_xml);
 		ret |= cfgfile_intval(option, value, "default_soundcard", &amiberry_options.default_soundcard, 1);
@@ -3777,6 +3789,11 @@ static std::string get_xdg_config_home()
 	return get_xdg_home("XDG_CONFIG_HOME", "/.config");
 }
 
+static std::string get_xdg_cache_home()
+{
+	return get_xdg_home("XDG_CACHE_HOME", "/.cache");
+}
+
 bool directory_exists(std::string directory, const std::string& sub_dir)
 {
 	if (directory.empty() || sub_dir.empty()) return false;
@@ -4446,6 +4463,55 @@ static void init_amiberry_dirs(const bool portable_mode)
 	floppy_sounds_dir.append("floppy_sounds/");
 }
 
+// Creates and returns a subdirectory of the cache directory, empty on failure
+static std::string get_cache_subdir(const bool portable_mode, const std::string& name)
+{
+#ifdef __MACH__
+	const std::string amiberry_dir = "Amiberry";
+#else
+	const std::string amiberry_dir = "amiberry";
+#endif
+	std::string cache_dir = portable_mode ? home_dir : get_xdg_cache_home();
+	if (cache_dir.empty())
+		return {};
+	if (!my_existsdir(cache_dir.c_str()))
+		my_mkdir(cache_dir.c_str());
+	if (!portable_mode)
+	{
+		cache_dir += "/" + amiberry_dir;
+		if (!my_existsdir(cache_dir.c_str()))
+			my_mkdir(cache_dir.c_str());
+	}
+	cache_dir += "/" + name + "/";
+	if (!my_existsdir(cache_dir.c_str()))
+		my_mkdir(cache_dir.c_str());
+	if (!my_existsdir(cache_dir.c_str()))
+		return {};
+	return cache_dir;
+}
+
+// Unpacked archive members, see zfile_cache_init()
+static void init_archive_cache(const bool portable_mode)
+{
+	if (amiberry_options.archive_cache_size <= 0)
+		return;
+	const std::string cache_dir = get_cache_subdir(portable_mode, "archive-cache");
+	if (!cache_dir.empty())
+		zfile_cache_init(cache_dir.c_str(), static_cast<uae_u64>(amiberry_options.archive_cache_size) * 1024 * 1024);
+}
+
+// JIT block profiles, see compiler_cache_init()
+static void init_jit_profile_cache(const bool portable_mode)
+{
+#ifdef JIT
+	if (!amiberry_options.jit_profile_cache)
+		return;
+	const std::string cache_dir = get_cache_subdir(portable_mode, "jit-profiles");
+	if (!cache_dir.empty())
+		compiler_cache_init(cache_dir.c_str());
+#endif
+}
+
 void load_amiberry_settings()
 {
 	auto* const fh = zfile_fopen(amiberry_conf_file.c_str(), _T("r"), ZFD_NORMAL);
@@ -4673,6 +4739,8 @@ int main(int argc, char* argv[])
 		load_amiberry_settings();
 	}
 	create_missing_amiberry_folders();
+	init_archive_cache(portable_mode);
+	init_jit_profile_cache(portable_mode);
 
 	// Parse command line and remove used amiberry specific args
 	// and modify both argc & argv accordingly
@@ -43,6 +43,11 @@ struct my_openfile_s {
 static bool has_logged_iconv_fail = false;
 void utf8_to_latin1_string(std::string& input, std::string& output)
 {
+	// plain ASCII is the same in both
+	if (std::all_of(input.begin(), input.end(), [](const char c) { return static_cast<uint8_t>(c) < 0x80; })) {
+		output = input;
+		return;
+	}
 	std::vector<char> in_buf(input.begin(), input.end());
 	char* src_ptr = in_buf.data();
 	size_t src_size = input.size();
@@ -321,13 +326,21 @@ void my_closedir(struct my_opendir_s* mod)
 	}
 }
 
+// Host files that are never shown on the Amiga side
+bool my_readdir_ignored(const char* name)
+{
+	static const set<std::string> ignoreList = { "_UAEFSDB.___", "Thumbs.db", ".DS_Store", "UAEFS.ini" };
+	const int len = strlen(name);
+
+	return ignoreList.find(name) != ignoreList.end() ||
+		(len > 5 && strncmp(name + len - 5, ".uaem", 5) == 0);
+}
+
 int my_readdir(struct my_opendir_s* mod, TCHAR* name)
 {
 	if (!mod || !name)
 		return 0;
 
-	const set<std::string> ignoreList = { "_UAEFSDB.___", "Thumbs.db", ".DS_Store", "UAEFS.ini" };
-
 	while (true)
 	{
 		auto* entry = readdir(mod->dir);
@@ -335,10 +348,8 @@ int my_readdir(struct my_opendir_s* mod, TCHAR* name)
 			return 0;
 
 		auto* result = entry->d_name;
-		const int len = strlen(result);
 
-		if (ignoreList.find(result) != ignoreList.end() ||
-			(len > 5 && strncmp(result + len - 5, ".uaem", 5) == 0)) {
+		if (my_readdir_ignored(result)) {
 			continue;
 		}
 
@@ -523,6 +534,41 @@ unsigned int my_write(struct my_openfile_s* mos, void* b, unsigned int size)
 	return static_cast<unsigned int>(bytes_written);
 }
 
+unsigned int my_pread(struct my_openfile_s* mos, void* b, unsigned int size, uae_u64 pos)
+{
+	if (mos == nullptr || b == nullptr) {
+		write_log("my_pread: null pointer provided\n");
+		return 0;
+	}
+
+	const auto bytes_read = pread(mos->fd, b, size, static_cast<off_t>(pos));
+	if (bytes_read == -1) {
+		write_log("my_pread: read on file %s failed with error %s\n", mos->path, strerror(errno));
+		return 0;
+	}
+
+	return static_cast<unsigned int>(bytes_read);
+}
+
+unsigned int my_pwrite(struct my_openfile_s* mos, const void* b, unsigned int size, uae_u64 pos)
+{
+	if (mos == nullptr || b == nullptr) {
+		write_log("my_pwrite: null pointer provided\n");
+		return 0;
+	}
+
+	const auto bytes_written = pwrite(mos->fd, b, size, static_cast<off_t>(pos));
+	if (bytes_written == -1) {
+		write_log("my_pwrite: write on file %s failed with error %s\n", mos->path, strerror(errno));
+		return 0;
+	}
+	else if (bytes_written < size) {
+		write_log("my_pwrite: write on file %s wrote less bytes than requested\n", mos->path);
+	}
+
+	return static_cast<unsigned int>(bytes_written);
+}
+
 int my_mkdir(const TCHAR* path)
 {
 	if (path == nullptr) {
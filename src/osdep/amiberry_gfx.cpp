@@ -961,7 +961,22 @@ void show_screen(const int monid, int mode)
 	if (amiga_texture && amiga_surface)
 	{
 		SDL_RenderClear(mon->amiga_renderer);
-		SDL_UpdateTexture(amiga_texture, nullptr, amiga_surface->pixels, amiga_surface->pitch);
+		if (rtg && mon->rtg_partial_upload && amiga_texture == mon->rtg_uploaded_texture && amiga_surface->pixels == mon->rtg_uploaded_pixels) {
+			// RTG: the texture already holds the previous frame, only upload rows picasso_flushpixels() invalidated
+			if (mon->p96_double_buffer_needs_flushing) {
+				int first = std::max(mon->p96_double_buffer_first, 0);
+				int last = std::min(mon->p96_double_buffer_last, amiga_surface->h - 1);
+				if (first <= last) {
+					SDL_Rect r = { 0, first, amiga_surface->w, last - first + 1 };
+					SDL_UpdateTexture(amiga_texture, &r, static_cast<uae_u8*>(amiga_surface->pixels) + first * amiga_surface->pitch, amiga_surface->pitch);
+				}
+			}
+		} else {
+			SDL_UpdateTexture(amiga_texture, nullptr, amiga_surface->pixels, amiga_surface->pitch);
+		}
+		mon->rtg_uploaded_texture = rtg ? amiga_texture : nullptr;
+		mon->rtg_uploaded_pixels = rtg ? amiga_surface->pixels : nullptr;
+		mon->p96_double_buffer_needs_flushing = 0;
 		SDL_RenderCopyEx(mon->amiga_renderer, amiga_texture, &crop_rect, &renderQuad, amiberry_options.rotation_angle, nullptr, SDL_FLIP_NONE);
 		if (vkbd_allowed(monid))
 		{
@@ -1004,6 +1019,8 @@ uae_u8* gfx_lock_picasso(const int monid, bool fullupdate)
 	struct AmigaMonitor* mon = &AMonitors[monid];
 	struct picasso_vidbuf_description* vidinfo = &picasso_vidinfo[monid];
 	static uae_u8* p;
+	// someone other than picasso_flushpixels() may draw: upload everything
+	mon->rtg_partial_upload = false;
 	if (amiga_surface == nullptr || mon->screen_is_picasso == 0)
 		return nullptr;
 	if (mon->rtg_locked) {
@@ -1426,6 +1443,7 @@ int check_prefs_changed_gfx()
 
 #ifdef AMIBERRY
 	c |= currprefs.multithreaded_drawing != changed_prefs.multithreaded_drawing ? (512) : 0;
+	c |= currprefs.multithreaded_drawing_workers != changed_prefs.multithreaded_drawing_workers ? (512) : 0;
 #endif
 
 	if (display_change_requested || c)
@@ -1491,6 +1509,7 @@ int check_prefs_changed_gfx()
 		currprefs.gfx_apmode[APMODE_NATIVE].gfx_refreshrate = changed_prefs.gfx_apmode[APMODE_NATIVE].gfx_refreshrate;
 
 		currprefs.multithreaded_drawing = changed_prefs.multithreaded_drawing;
+		currprefs.multithreaded_drawing_workers = changed_prefs.multithreaded_drawing_workers;
 		currprefs.gfx_horizontal_offset = changed_prefs.gfx_horizontal_offset;
 		currprefs.gfx_vertical_offset = changed_prefs.gfx_vertical_offset;
 		currprefs.gfx_manual_crop_width = changed_prefs.gfx_manual_crop_width;
@@ -1918,6 +1937,13 @@ void DX_Invalidate(struct AmigaMonitor* mon, int x, int y, int width, int height
 	}
 	last = y + height - 1;
 	lastx = x + width - 1;
+	if (mon->p96_double_buffer_needs_flushing) {
+		// not yet uploaded, merge with the pending area
+		y = std::min(y, mon->p96_double_buffer_first);
+		x = std::min(x, mon->p96_double_buffer_firstx);
+		last = std::max(last, mon->p96_double_buffer_last);
+		lastx = std::max(lastx, mon->p96_double_buffer_lastx);
+	}
 	mon->p96_double_buffer_first = y;
 	mon->p96_double_buffer_last = last;
 	mon->p96_double_buffer_firstx = x;
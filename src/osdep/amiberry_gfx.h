@@ -102,6 +102,9 @@ struct AmigaMonitor {
 	int p96_double_buffer_firstx, p96_double_buffer_lastx;
 	int p96_double_buffer_first, p96_double_buffer_last;
 	int p96_double_buffer_needs_flushing;
+	bool rtg_partial_upload;
+	SDL_Texture* rtg_uploaded_texture;
+	void* rtg_uploaded_pixels;
 
 	struct winuae_currentmode currentmode;
 	struct uae_filter* usedfilter;
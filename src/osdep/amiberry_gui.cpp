@@ -8,6 +8,11 @@
 #include <algorithm>
 #include <vector>
 #include <string>
+#include <map>
+#include <sstream>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <guisan.hpp>
 #include <guisan/sdl.hpp>
@@ -43,6 +48,7 @@
 #include "registry.h"
 #include "scsi.h"
 #include "target.h"
+#include "threaddep/thread.h"
 
 #ifdef AMIBERRY
 #ifndef __MACH__
@@ -294,41 +300,48 @@ static int addrom(UAEREG* fkey, struct romdata* rd, const TCHAR* name)
 	return 1;
 }
 
+struct rom_scan_hit
+{
+	int id; // -1 = rom.key
+	int group;
+	std::string name;
+};
+
 struct romscandata {
-	UAEREG* fkey;
-	int got;
+	std::vector<rom_scan_hit>* hits;
+	bool encrypted;
 };
 
-static struct romdata* scan_single_rom_2(struct zfile* f)
+// Identifies a ROM from the complete file contents
+static struct romdata* identify_rom(const uae_u8* data, const int filesize, bool* encrypted)
 {
-	uae_u8 buffer[20] = {};
 	auto cl = 0;
+	int offset = 0;
+	int size = filesize;
 	struct romdata* rd = nullptr;
 
-	zfile_fseek(f, 0, SEEK_END);
-	int size = zfile_ftell32(f);
-	zfile_fseek(f, 0, SEEK_SET);
 	if (size > 524288 * 2) /* don't skip KICK disks or 1M ROMs */
 		return nullptr;
-	zfile_fread(buffer, 1, 11, f);
-	if (!memcmp(buffer, "KICK", 4))
+	if (size >= 4 && !memcmp(data, "KICK", 4))
 	{
-		zfile_fseek(f, 512, SEEK_SET);
+		offset = 512;
 		size = std::min(size, 262144);
 	}
-	else if (!memcmp(buffer, "AMIROMTYPE1", 11))
+	else if (size >= 11 && !memcmp(data, "AMIROMTYPE1", 11))
 	{
 		cl = 1;
+		offset = 11;
 		size -= 11;
+		if (encrypted)
+			*encrypted = true;
 	}
-	else
-	{
-		zfile_fseek(f, 0, SEEK_SET);
-	}
+	if (size <= 0)
+		return nullptr;
 	auto* rombuf = xcalloc(uae_u8, size);
 	if (!rombuf)
 		return nullptr;
-	zfile_fread(rombuf, 1, size, f);
+	if (filesize > offset)
+		memcpy(rombuf, data + offset, std::min(size, filesize - offset));
 	if (cl > 0)
 	{
 		decode_cloanto_rom_do(rombuf, size, size);
@@ -352,6 +365,22 @@ static struct romdata* scan_single_rom_2(struct zfile* f)
 	return rd;
 }
 
+static struct romdata* scan_single_rom_2(struct zfile* f, bool* encrypted = nullptr)
+{
+	zfile_fseek(f, 0, SEEK_END);
+	const int size = zfile_ftell32(f);
+	zfile_fseek(f, 0, SEEK_SET);
+	if (size > 524288 * 2) /* don't skip KICK disks or 1M ROMs */
+		return nullptr;
+	auto* data = xcalloc(uae_u8, size + 1);
+	if (!data)
+		return nullptr;
+	const int len = static_cast<int>(zfile_fread(data, 1, size, f));
+	struct romdata* rd = identify_rom(data, len, encrypted);
+	xfree(data);
+	return rd;
+}
+
 struct romdata *scan_single_rom (const TCHAR *path)
 {
 	struct zfile *z;
@@ -434,46 +463,286 @@ static int scan_rom_2(struct zfile* f, void* vrsd)
 
 	if (!isromext(path, true))
 		return 0;
-	rd = scan_single_rom_2(f);
+	rd = scan_single_rom_2(f, &rsd->encrypted);
 	if (rd)
 	{
-		TCHAR name[MAX_DPATH];
-		getromname(rd, name);
-		addrom(rsd->fkey, rd, path);
-		if (rd->type & ROMTYPE_KEY)
-			addkeyfile(path);
-		rsd->got = 1;
+		rsd->hits->push_back({ rd->id, rd->group, path });
 	} else if (_tcslen(path) > _tcslen(romkey) && !_tcsicmp(path + _tcslen(path) - _tcslen(romkey), romkey)) {
-		addkeyfile(path);
+		rsd->hits->push_back({ -1, 0, path });
 	}
 	return 0;
 }
 
-static int scan_rom(const std::string& path, UAEREG* fkey, bool deepscan)
+static int addromhits(UAEREG* fkey, const std::vector<rom_scan_hit>& hits)
+{
+	int got = 0;
+	for (const auto& hit : hits)
+	{
+		if (hit.id < 0)
+		{
+			addkeyfile(hit.name.c_str());
+			continue;
+		}
+		struct romdata* rd = getromdatabyidgroup(hit.id, hit.group >> 16, hit.group & 65535);
+		if (!rd)
+			continue;
+		addrom(fkey, rd, hit.name.c_str());
+		if (rd->type & ROMTYPE_KEY)
+			addkeyfile(hit.name.c_str());
+		got = 1;
+	}
+	return got;
+}
+
+/* ROM scan cache
+ *
+ * Scan results are kept per host file, keyed by path, size and mtime, so
+ * unchanged files are never opened again. Plain ROM images that are not
+ * in the cache are identified on a pool of worker threads. Archives,
+ * compressed and encrypted images go through the zfile layer on the
+ * calling thread, as zfile is not thread safe and encrypted ROMs depend
+ * on key files found earlier in the same scan.
+ */
+
+enum
+{
+	ROMSCAN_SERIAL, // needs a zfile scan
+	ROMSCAN_NONE,
+	ROMSCAN_FOUND
+};
+
+struct rom_scan_entry
+{
+	uae_s64 size = 0;
+	uae_s64 mtime = 0;
+	std::vector<rom_scan_hit> hits;
+};
+
+struct rom_scan_file
 {
-	struct romscandata rsd = { fkey, 0 };
+	std::string path;
+	uae_s64 size;
+	uae_s64 mtime;
+	bool deepscan;
+	const rom_scan_entry* cached;
+	int result;
 	struct romdata* rd;
-	int cnt = 0;
+};
 
-	if (!isromext(path, deepscan)) {
-		//write_log("ROMSCAN: skipping file '%s', unknown extension\n", path);
-		return 0;
+static std::map<std::string, rom_scan_entry> rom_scan_cache, rom_scan_cache_new;
+
+static std::string rom_scan_cache_file()
+{
+	std::string path = get_ini_file_path();
+	const auto sep = path.find_last_of('/');
+	path.erase(sep == std::string::npos ? 0 : sep + 1);
+	return path + "romscan.cache";
+}
+
+// Cached results are dropped when the ROM database changes
+static std::string rom_scan_cache_header()
+{
+	int id = 1;
+	while (getromdatabyid(id))
+		id++;
+	return "ROMSCAN 1 " + std::to_string(id);
+}
+
+static void load_rom_scan_cache()
+{
+	rom_scan_cache.clear();
+	rom_scan_cache_new.clear();
+	std::ifstream in(rom_scan_cache_file());
+	std::string line;
+	if (!std::getline(in, line) || line != rom_scan_cache_header())
+		return;
+	// <size> <mtime> <hits> <path>, followed by <id> <group> <name> per hit
+	while (std::getline(in, line))
+	{
+		std::istringstream ss(line);
+		rom_scan_entry e;
+		int count;
+		std::string path;
+		if (!(ss >> e.size >> e.mtime >> count) || count < 0)
+			break;
+		ss.get();
+		std::getline(ss, path);
+		for (int i = 0; i < count && std::getline(in, line); i++)
+		{
+			std::istringstream hs(line);
+			rom_scan_hit hit;
+			hs >> hit.id >> hit.group;
+			hs.get();
+			std::getline(hs, hit.name);
+			e.hits.push_back(hit);
+		}
+		rom_scan_cache[path] = e;
 	}
-#ifdef ARCADIA
-	for (;;) {
-		TCHAR tmp[MAX_DPATH];
-		_tcscpy(tmp, path.c_str());
-		rd = scan_arcadia_rom(tmp, cnt++);
-		if (rd) {
-			if (!addrom(fkey, rd, tmp))
-				return 1;
-			continue;
+}
+
+static void save_rom_scan_cache()
+{
+	const std::string cache_file = rom_scan_cache_file();
+	const std::string tmp_file = cache_file + ".tmp";
+	std::ofstream out(tmp_file, std::ios::trunc);
+	if (out)
+	{
+		out << rom_scan_cache_header() << "\n";
+		for (const auto& entry : rom_scan_cache_new)
+		{
+			out << entry.second.size << " " << entry.second.mtime << " " << entry.second.hits.size() << " " << entry.first << "\n";
+			for (const auto& hit : entry.second.hits)
+				out << hit.id << " " << hit.group << " " << hit.name << "\n";
 		}
-		break;
+		out.close();
+		if (!out || rename(tmp_file.c_str(), cache_file.c_str()) != 0)
+			unlink(tmp_file.c_str());
 	}
+	rom_scan_cache.clear();
+	rom_scan_cache_new.clear();
+}
+
+// Headers zfile unpacks or opens as an archive or disk image
+static bool rom_needs_zfile(const uae_u8* h)
+{
+	return (h[0] == 0x1f && h[1] == 0x8b) || (h[0] == 'P' && h[1] == 'K') ||
+		!memcmp(h, "\xfd" "7zXZ", 5) || !memcmp(h, "DMS!", 4) || !memcmp(h, "CAPS", 4) ||
+		!memcmp(h, "conectix", 8) || !memcmp(h, "Formatte", 8) || !memcmp(h, "UAE-1ADF", 8) ||
+		!memcmp(h, "Rar!", 4) || !memcmp(h, "LZX", 3) || (h[2] == '-' && h[3] == 'l' && h[4] == 'h' && h[6] == '-') ||
+		!memcmp(h, "DOS", 3) || !memcmp(h, "SFS", 3) || (h[510] == 0x55 && h[511] == 0xaa);
+}
+
+static void identify_rom_file(rom_scan_file& f)
+{
+	f.result = ROMSCAN_SERIAL;
+	f.rd = nullptr;
+	const auto ext_pos = f.path.find_last_of('.');
+	if (!isromext(f.path, false) || strcasecmp(f.path.c_str() + ext_pos + 1, "roz") == 0)
+		return;
+	const int fd = open(f.path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	// larger files can only be compressed ROMs, only the header is needed
+	const int size = f.size > 524288 * 2 ? 512 : static_cast<int>(f.size);
+	auto* data = xcalloc(uae_u8, std::max(size, 512));
+	const ssize_t len = data ? read(fd, data, size) : -1;
+	close(fd);
+	if (len == size && !(size >= 11 && !memcmp(data, "AMIROMTYPE1", 11)))
+	{
+		if (f.size <= 524288 * 2)
+			f.rd = identify_rom(data, size, nullptr);
+		if (f.rd)
+			f.result = ROMSCAN_FOUND;
+		else if (!rom_needs_zfile(data))
+			f.result = ROMSCAN_NONE;
+	}
+	xfree(data);
+}
+
+struct rom_scan_pool
+{
+	std::vector<rom_scan_file*>* jobs;
+	std::atomic<size_t> next;
+};
+
+static int rom_scan_worker(void* arg)
+{
+	auto* pool = static_cast<rom_scan_pool*>(arg);
+	for (;;)
+	{
+		const size_t i = pool->next++;
+		if (i >= pool->jobs->size())
+			break;
+		identify_rom_file(*(*pool->jobs)[i]);
+	}
+	return 0;
+}
+
+static void identify_rom_files(std::vector<rom_scan_file*>& jobs)
+{
+	rom_scan_pool pool;
+	pool.jobs = &jobs;
+	pool.next = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int count = static_cast<int>(std::min<size_t>(std::min<long>(std::max<long>(cpus, 1), 8), jobs.size() / 16 + 1)) - 1;
+	std::vector<uae_thread_id> threads;
+	for (int i = 0; i < count; i++)
+	{
+		uae_thread_id tid;
+		if (uae_start_thread(_T("romscan"), rom_scan_worker, &pool, &tid))
+			threads.push_back(tid);
+	}
+	rom_scan_worker(&pool);
+	for (auto& tid : threads)
+		uae_wait_thread(&tid);
+}
+
+static int scan_rom_files(UAEREG* fkey, std::vector<rom_scan_file>& files)
+{
+	std::vector<rom_scan_file*> jobs;
+	int ret = 0;
+
+	for (auto& f : files)
+	{
+		const auto it = rom_scan_cache.find(f.path);
+		if (it != rom_scan_cache.end() && it->second.size == f.size && it->second.mtime == f.mtime)
+			f.cached = &it->second;
+		else
+			jobs.push_back(&f);
+	}
+	if (!jobs.empty())
+	{
+		write_log(_T("ROM scan: %zu cached, %zu new or changed files\n"), files.size() - jobs.size(), jobs.size());
+		identify_rom_files(jobs);
+	}
+
+	// results are added in directory order, earlier files win ties in addrom()
+	for (auto& f : files)
+	{
+		std::vector<rom_scan_hit> hits;
+		bool cacheable = f.path.find('\n') == std::string::npos;
+		if (f.cached)
+		{
+			hits = f.cached->hits;
+		}
+		else
+		{
+#ifdef ARCADIA
+			for (int cnt = 0;; cnt++) {
+				TCHAR tmp[MAX_DPATH];
+				_tcscpy(tmp, f.path.c_str());
+				struct romdata* rd = scan_arcadia_rom(tmp, cnt);
+				if (!rd)
+					break;
+				hits.push_back({ rd->id, rd->group, tmp });
+			}
 #endif
-	zfile_zopen(path, scan_rom_2, (void*)&rsd);
-	return rsd.got;
+			if (f.result == ROMSCAN_FOUND)
+			{
+				hits.push_back({ f.rd->id, f.rd->group, f.path });
+			}
+			else if (f.result == ROMSCAN_SERIAL)
+			{
+				struct romscandata rsd = { &hits, false };
+				zfile_zopen(f.path, scan_rom_2, &rsd);
+				// may be found once the key is available
+				if (rsd.encrypted && hits.empty())
+					cacheable = false;
+			}
+			for (const auto& hit : hits)
+			{
+				if (hit.name.find('\n') != std::string::npos)
+					cacheable = false;
+			}
+		}
+		if (addromhits(fkey, hits))
+			ret = 1;
+		if (cacheable)
+			rom_scan_cache_new[f.path] = { f.size, f.mtime, hits };
+		if (!scan_rom_hook(nullptr, 0))
+			break;
+	}
+	return ret;
 }
 
 static int listrom(const int* roms)
@@ -571,21 +840,20 @@ static void show_rom_list()
 	//free(p);
 }
 
-static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level)
+static void scan_roms_2(std::vector<rom_scan_file>& files, const TCHAR* path, bool deepscan, int level)
 {
 	struct dirent* entry;
 	struct stat statbuf{};
 	DIR* dp;
-	int ret = 0;
 
 	if (!path)
-		return 0;
+		return;
 
 	write_log(_T("ROM scan directory '%s'\n"), path);
 
 	dp = opendir(path);
 	if (dp == nullptr)
-		return 0;
+		return;
 
 	scan_rom_hook(path, 1);
 
@@ -597,10 +865,10 @@ static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level
             continue;
 
         if (S_ISREG(statbuf.st_mode) && statbuf.st_size < 10000000) {
-            if (scan_rom(tmppath, fkey, deepscan))
-                ret = 1;
+            if (isromext(tmppath, deepscan))
+                files.push_back({ tmppath, statbuf.st_size, statbuf.st_mtime, deepscan, nullptr, ROMSCAN_SERIAL, nullptr });
         } else if (deepscan && S_ISDIR(statbuf.st_mode) && entry->d_name[0] != '.' && (recursiveromscan < 0 || recursiveromscan > level)) {
-            scan_roms_2(fkey, tmppath, deepscan, level + 1);
+            scan_roms_2(files, tmppath, deepscan, level + 1);
         }
 
         if (!scan_rom_hook(nullptr, 0))
@@ -608,7 +876,6 @@ static int scan_roms_2(UAEREG* fkey, const TCHAR* path, bool deepscan, int level
     }
 
 	closedir(dp);
-	return ret;
 }
 
 #define MAX_ROM_PATHS 10
@@ -631,7 +898,9 @@ static int scan_roms_3(UAEREG* fkey, TCHAR** paths, const TCHAR* path)
 		if (paths[i] && !_tcsicmp(paths[i], pathp))
 			return ret;
 	}
-	ret = scan_roms_2(fkey, pathp, deepscan, 0);
+	std::vector<rom_scan_file> files;
+	scan_roms_2(files, pathp, deepscan, 0);
+	ret = scan_rom_files(fkey, files);
 	for (i = 0; i < MAX_ROM_PATHS; i++) {
 		if (!paths[i]) {
 			paths[i] = my_strdup(pathp);
@@ -663,6 +932,7 @@ int scan_roms(int show)
 	cnt = 0;
 	for (i = 0; i < MAX_ROM_PATHS; i++)
 		paths[i] = nullptr;
+	load_rom_scan_cache();
 	scan_rom_hook(nullptr, 0);
 	while (scan_rom_hook(nullptr, 0)) {
 		keys = get_keyring();
@@ -693,6 +963,7 @@ int scan_roms(int show)
 
 	for (i = 0; i < MAX_ROM_PATHS; i++)
 		xfree(paths[i]);
+	save_rom_scan_cache();
 
 	fkey2 = regcreatetree(nullptr, _T("DetectedROMS"));
 	if (fkey2) {
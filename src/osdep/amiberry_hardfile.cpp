@@ -5,13 +5,50 @@
 #include "filesys.h"
 #include "zfile.h"
 #include "uae.h"
+#include "threaddep/thread.h"
 
+#include <unistd.h>
+#include <algorithm>
+
+#define CACHE_SIZE 16384
+#define CACHE_FLUSH_TIME 5
+
+/* Read cache: set associative, CACHE_SIZE sized lines, LRU within a set */
+#define HDF_CACHE_WAYS 8
+#define HDF_CACHE_SETS 32
+#define HDF_CACHE_LINES (HDF_CACHE_WAYS * HDF_CACHE_SETS)
+#define HDF_READAHEAD_LINES 4
+
+struct hdf_cacheline
+{
+	uae_u64 line;
+	int len; // 0 = empty
+	uae_u32 lastuse;
+};
 
 struct hardfilehandle
 {
 	int zfile;
 	struct zfile *zf;
 	FILE *h;
+	int fd;
+
+	uae_sem_t cache_sem;
+	uae_u8 *cache_data;
+	struct hdf_cacheline cache[HDF_CACHE_LINES];
+	uae_u32 cache_use;
+	uae_u32 cache_gen;
+	uae_u64 hits, misses, readaheads;
+	uae_u64 lastline;
+	int seqcnt;
+
+	/* read-ahead thread */
+	uae_thread_id ra_tid;
+	uae_sem_t ra_sem;
+	volatile int ra_state;
+	uae_u64 ra_line;
+	int ra_count;
+	uae_u8 *ra_buf;
 };
 
 struct uae_driveinfo {
@@ -43,9 +80,6 @@ struct uae_driveinfo {
 #undef INVALID_HANDLE_VALUE
 #define INVALID_HANDLE_VALUE NULL
 
-#define CACHE_SIZE 16384
-#define CACHE_FLUSH_TIME 5
-
 /* safety check: only accept drives that:
 * - contain RDSK in block 0
 * - block 0 is zeroed
@@ -182,6 +216,8 @@ int hdf_open_target(struct hardfiledata *hfd, const TCHAR *pname)
 	}
 	hfd->handle = xcalloc(struct hardfilehandle, 1);
 	hfd->handle->h = nullptr;
+	hfd->handle->fd = -1;
+	uae_sem_init(&hfd->handle->cache_sem, 0, 1);
 	write_log(_T("hfd attempting to open: '%s'\n"), name);
 
 	char* ext;
@@ -223,10 +259,12 @@ int hdf_open_target(struct hardfiledata *hfd, const TCHAR *pname)
 			goto end;
 		}
 		hfd->handle_valid = HDF_HANDLE_LINUX;
+		hfd->handle->fd = fileno(h);
 		if (hfd->physsize < 64 * 1024 * 1024 && zmode) {
 			write_log("HDF '%s' re-opened in zfile-mode\n", name);
 			fclose(h);
 			hfd->handle->h = nullptr;
+			hfd->handle->fd = -1;
 			hfd->handle->zf = zfile_fopen(name, _T("rb"), ZFD_NORMAL);
 			hfd->handle->zfile = 1;
 			if (!hfd->handle->zf)
@@ -252,16 +290,36 @@ end:
 	return 0;
 }
 
+static void hdf_readahead_stop(struct hardfilehandle* h)
+{
+	if (h->ra_state <= 0)
+		return;
+	h->ra_state = -1;
+	uae_sem_post(&h->ra_sem);
+	uae_wait_thread(&h->ra_tid);
+	h->ra_state = 0;
+}
+
 static void freehandle(struct hardfilehandle* h)
 {
 	if (!h)
 		return;
+	hdf_readahead_stop(h);
+	if (h->hits || h->misses)
+		write_log(_T("HDF cache: %llu hits, %llu misses, %llu lines read ahead\n"), h->hits, h->misses, h->readaheads);
+	uae_sem_destroy(&h->ra_sem);
+	uae_sem_destroy(&h->cache_sem);
+	xfree(h->ra_buf);
+	xfree(h->cache_data);
+	h->ra_buf = nullptr;
+	h->cache_data = nullptr;
 	if (!h->zfile && h->h != nullptr)
 		fclose(h->h);
 	if (h->zfile && h->zf)
 		zfile_fclose(h->zf);
 	h->zf = nullptr;
 	h->h = nullptr;
+	h->fd = -1;
 	h->zfile = 0;
 }
 
@@ -379,50 +437,211 @@ static void poscheck(const struct hardfiledata *hfd, int len)
 	}
 }
 
-static int isincache(const struct hardfiledata *hfd, uae_u64 offset, int len)
+static uae_u64 hdf_cache_limit(const struct hardfiledata *hfd)
 {
-	if (!hfd->cache_valid)
-		return -1;
-	if (offset >= hfd->cache_offset && offset + len <= hfd->cache_offset + CACHE_SIZE)
-		return static_cast<int>(offset - hfd->cache_offset);
-	return -1;
+	return hfd->physsize - hfd->virtual_size;
 }
 
-static int hdf_read_2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+/* Positional read, offset relative to hfd->offset. Raw files need no seek. */
+static int hdf_pread(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
 {
-	size_t outlen = 0;
+	auto p = static_cast<uae_u8*>(buffer);
+	int got = 0;
 
-	if (offset == 0)
-		hfd->cache_valid = 0;
-	auto coffset = isincache(hfd, offset, len);
-	if (coffset >= 0)
+	if (hfd->handle_valid == HDF_HANDLE_LINUX)
 	{
-		memcpy(buffer, hfd->cache + coffset, len);
-		return len;
+		while (got < len)
+		{
+			const auto ret = pread(hfd->handle->fd, p + got, len - got, hfd->offset + offset + got);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret <= 0)
+				break;
+			got += ret;
+		}
 	}
-	hfd->cache_offset = offset;
-	if (offset + CACHE_SIZE > hfd->offset + (hfd->physsize - hfd->virtual_size))
-		hfd->cache_offset = hfd->offset + (hfd->physsize - hfd->virtual_size) - CACHE_SIZE;
-	if (hdf_seek(hfd, hfd->cache_offset))
-		return 0;
-	poscheck(hfd, CACHE_SIZE);
-	if (hfd->handle_valid == HDF_HANDLE_LINUX)
-		outlen = fread(hfd->cache, 1, CACHE_SIZE, hfd->handle->h);
 	else if (hfd->handle_valid == HDF_HANDLE_ZFILE)
-		outlen = zfile_fread(hfd->cache, 1, CACHE_SIZE, hfd->handle->zf);
-	hfd->cache_valid = 0;
-	if (outlen != CACHE_SIZE)
+	{
+		if (hdf_seek(hfd, offset))
+			return 0;
+		got = zfile_fread(p, 1, len, hfd->handle->zf);
+	}
+	return got;
+}
+
+static int hdf_pwrite(struct hardfiledata *hfd, const void *buffer, uae_u64 offset, int len)
+{
+	auto p = static_cast<const uae_u8*>(buffer);
+	int got = 0;
+
+	while (got < len)
+	{
+		const auto ret = pwrite(hfd->handle->fd, p + got, len - got, hfd->offset + offset + got);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		got += ret;
+	}
+	return got;
+}
+
+static uae_u8 *hdf_cache_linedata(struct hardfilehandle *h, const struct hdf_cacheline *cl)
+{
+	return h->cache_data + (cl - h->cache) * CACHE_SIZE;
+}
+
+static struct hdf_cacheline *hdf_cache_find(struct hardfilehandle *h, uae_u64 line)
+{
+	struct hdf_cacheline *set = &h->cache[(line % HDF_CACHE_SETS) * HDF_CACHE_WAYS];
+	for (int i = 0; i < HDF_CACHE_WAYS; i++)
+	{
+		if (set[i].len && set[i].line == line)
+			return &set[i];
+	}
+	return nullptr;
+}
+
+static struct hdf_cacheline *hdf_cache_victim(struct hardfilehandle *h, uae_u64 line)
+{
+	struct hdf_cacheline *set = &h->cache[(line % HDF_CACHE_SETS) * HDF_CACHE_WAYS];
+	struct hdf_cacheline *victim = &set[0];
+	for (int i = 0; i < HDF_CACHE_WAYS; i++)
+	{
+		if (!set[i].len)
+			return &set[i];
+		if ((uae_s32)(set[i].lastuse - victim->lastuse) < 0)
+			victim = &set[i];
+	}
+	return victim;
+}
+
+static int hdf_readahead_thread(void *v)
+{
+	auto hfd = static_cast<struct hardfiledata*>(v);
+	struct hardfilehandle *h = hfd->handle;
+	const uae_u64 limit = hdf_cache_limit(hfd);
+
+	for (;;)
+	{
+		uae_sem_wait(&h->ra_sem);
+		if (h->ra_state < 0)
+			break;
+		uae_sem_wait(&h->cache_sem);
+		uae_u64 line = h->ra_line;
+		int cnt = h->ra_count;
+		h->ra_count = 0;
+		uae_sem_post(&h->cache_sem);
+
+		for (int i = 0; i < cnt && h->ra_state > 0; i++, line++)
+		{
+			if (line * CACHE_SIZE >= limit)
+				break;
+			const int len = static_cast<int>(std::min<uae_u64>(CACHE_SIZE, limit - line * CACHE_SIZE));
+			uae_sem_wait(&h->cache_sem);
+			const bool cached = hdf_cache_find(h, line) != nullptr;
+			const uae_u32 gen = h->cache_gen;
+			uae_sem_post(&h->cache_sem);
+			if (cached)
+				continue;
+			if (hdf_pread(hfd, h->ra_buf, line * CACHE_SIZE, len) != len)
+				break;
+			uae_sem_wait(&h->cache_sem);
+			// drop the data if a write or another read got there first
+			if (gen == h->cache_gen && !hdf_cache_find(h, line))
+			{
+				struct hdf_cacheline *cl = hdf_cache_victim(h, line);
+				memcpy(hdf_cache_linedata(h, cl), h->ra_buf, len);
+				cl->line = line;
+				cl->len = len;
+				cl->lastuse = h->cache_use;
+				h->readaheads++;
+			}
+			uae_sem_post(&h->cache_sem);
+		}
+	}
+	return 0;
+}
+
+/* called with cache_sem held */
+static void hdf_cache_access(struct hardfiledata *hfd, uae_u64 line)
+{
+	struct hardfilehandle *h = hfd->handle;
+
+	if (line == h->lastline)
+		return;
+	h->seqcnt = line == h->lastline + 1 ? h->seqcnt + 1 : 0;
+	h->lastline = line;
+	if (h->seqcnt < 2 || hfd->handle_valid != HDF_HANDLE_LINUX)
+		return;
+	if (hdf_cache_find(h, line + HDF_READAHEAD_LINES))
+		return;
+	if (h->ra_state == 0)
+	{
+		h->ra_buf = xmalloc(uae_u8, CACHE_SIZE);
+		uae_sem_init(&h->ra_sem, 0, 0);
+		h->ra_state = 1;
+		if (!h->ra_buf || !uae_start_thread(_T("hdf_readahead"), hdf_readahead_thread, hfd, &h->ra_tid))
+		{
+			h->ra_state = -2;
+			return;
+		}
+	}
+	if (h->ra_state < 0)
+		return;
+	h->ra_line = line + 1;
+	h->ra_count = HDF_READAHEAD_LINES;
+	uae_sem_post(&h->ra_sem);
+}
+
+/* read within one cache line */
+static int hdf_read_2(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
+{
+	struct hardfilehandle *h = hfd->handle;
+	const uae_u64 limit = hdf_cache_limit(hfd);
+	const uae_u64 line = offset / CACHE_SIZE;
+	const int coffset = static_cast<int>(offset % CACHE_SIZE);
+
+	if (offset >= limit)
 		return 0;
-	hfd->cache_valid = 1;
-	coffset = isincache(hfd, offset, len);
-	if (coffset >= 0)
+	if (!h->cache_data)
 	{
-		memcpy(buffer, hfd->cache + coffset, len);
+		h->cache_data = xmalloc(uae_u8, HDF_CACHE_LINES * CACHE_SIZE);
+		if (!h->cache_data)
+			return hdf_pread(hfd, buffer, offset, len);
+	}
+	uae_sem_wait(&h->cache_sem);
+	struct hdf_cacheline *cl = hdf_cache_find(h, line);
+	// block zero (RDB) is always read from the image
+	if (cl && offset == 0)
+		cl->len = 0;
+	if (cl && cl->len >= coffset + len)
+	{
+		memcpy(buffer, hdf_cache_linedata(h, cl) + coffset, len);
+		cl->lastuse = ++h->cache_use;
+		h->hits++;
+		hdf_cache_access(hfd, line);
+		uae_sem_post(&h->cache_sem);
 		return len;
 	}
-	write_log(_T("hdf_read: cache bug! offset=%I64d len=%d\n"), offset, len);
-	hfd->cache_valid = 0;
-	return 0;
+	h->misses++;
+	if (!cl)
+		cl = hdf_cache_victim(h, line);
+	cl->len = 0;
+	const int linelen = static_cast<int>(std::min<uae_u64>(CACHE_SIZE, limit - line * CACHE_SIZE));
+	uae_u8 *data = hdf_cache_linedata(h, cl);
+	if (hdf_pread(hfd, data, line * CACHE_SIZE, linelen) != linelen || coffset + len > linelen)
+	{
+		uae_sem_post(&h->cache_sem);
+		return 0;
+	}
+	cl->line = line;
+	cl->len = linelen;
+	cl->lastuse = ++h->cache_use;
+	memcpy(buffer, data + coffset, len);
+	hdf_cache_access(hfd, line);
+	uae_sem_post(&h->cache_sem);
+	return len;
 }
 
 int hdf_read_target(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int len)
@@ -439,25 +658,21 @@ int hdf_read_target(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 		size_t ret = 0;
 		if (hfd->physsize < CACHE_SIZE)
 		{
-			hfd->cache_valid = 0;
-			if (hdf_seek(hfd, offset))
-				return got;
-			if (hfd->physsize)
-				poscheck(hfd, len);
-			if (hfd->handle_valid == HDF_HANDLE_LINUX)
+			if (hfd->physsize && hfd->handle_valid == HDF_HANDLE_ZFILE)
 			{
-				ret = fread(hfd->cache, 1, len, hfd->handle->h);
-				memcpy(buffer, hfd->cache, ret);
-			}
-			else if (hfd->handle_valid == HDF_HANDLE_ZFILE)
-			{
-				ret = zfile_fread(buffer, 1, len, hfd->handle->zf);
+				if (hdf_seek(hfd, offset))
+					return got;
+				poscheck(hfd, len);
 			}
+			ret = hdf_pread(hfd, p, offset, len);
 			maxlen = len;
 		}
 		else
 		{
-			maxlen = len > CACHE_SIZE ? CACHE_SIZE : len;
+			// never cross a cache line
+			maxlen = CACHE_SIZE - static_cast<int>(offset % CACHE_SIZE);
+			if (maxlen > len)
+				maxlen = len;
 			ret = hdf_read_2(hfd, p, offset, maxlen);
 		}
 		got += ret;
@@ -470,6 +685,29 @@ int hdf_read_target(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 	return got;
 }
 
+/* write through: update cached copy, stale read-ahead data is dropped */
+static void hdf_cache_write(struct hardfiledata *hfd, const void *buffer, uae_u64 offset, int len)
+{
+	struct hardfilehandle *h = hfd->handle;
+
+	uae_sem_wait(&h->cache_sem);
+	h->cache_gen++;
+	if (h->cache_data)
+	{
+		struct hdf_cacheline *cl = hdf_cache_find(h, offset / CACHE_SIZE);
+		if (cl)
+		{
+			const int coffset = static_cast<int>(offset % CACHE_SIZE);
+			if (coffset + len <= cl->len)
+				memcpy(hdf_cache_linedata(h, cl) + coffset, buffer, len);
+			else
+				cl->len = 0;
+		}
+	}
+	uae_sem_post(&h->cache_sem);
+}
+
+/* write within one cache line */
 static int hdf_write_2(struct hardfiledata *hfd, const void *buffer, uae_u64 offset, int len)
 {
 	size_t outlen = 0;
@@ -481,14 +719,12 @@ static int hdf_write_2(struct hardfiledata *hfd, const void *buffer, uae_u64 off
 	if (len == 0)
 		return 0;
 
-	hfd->cache_valid = 0;
-	if (hdf_seek(hfd, offset))
-		return 0;
-	poscheck(hfd, len);
-	memcpy(hfd->cache, buffer, len);
 	if (hfd->handle_valid == HDF_HANDLE_LINUX)
 	{
-		outlen = fwrite(hfd->cache, 1, len, hfd->handle->h);
+		if (offset >= hdf_cache_limit(hfd))
+			return 0;
+		outlen = hdf_pwrite(hfd, buffer, offset, len);
+		hdf_cache_write(hfd, buffer, offset, len);
 		const auto* const name = hfd->emptyname == nullptr ? _T("<unknown>") : hfd->emptyname;
 		if (offset == 0)
 		{
@@ -498,16 +734,22 @@ static int hdf_write_2(struct hardfiledata *hfd, const void *buffer, uae_u64 off
 			{
 				int cmplen = tmplen > len ? len : tmplen;
 				memset(tmp, 0xa1, tmplen);
-				hdf_seek(hfd, offset);
-				auto outlen2 = fread(tmp, 1, tmplen, hfd->handle->h);
-				if (memcmp(hfd->cache, tmp, cmplen) != 0 || outlen != len)
+				hdf_pread(hfd, tmp, offset, tmplen);
+				if (memcmp(buffer, tmp, cmplen) != 0 || outlen != len)
 					gui_message(_T("\"%s\"\n\nblock zero write failed!"), name);
 				xfree(tmp);
 			}
 		}
 	}
 	else if (hfd->handle_valid == HDF_HANDLE_ZFILE)
+	{
+		if (hdf_seek(hfd, offset))
+			return 0;
+		poscheck(hfd, len);
+		memcpy(hfd->cache, buffer, len);
 		outlen = zfile_fwrite(hfd->cache, 1, len, hfd->handle->zf);
+		hdf_cache_write(hfd, buffer, offset, len);
+	}
 	return static_cast<int>(outlen);
 }
 
@@ -521,7 +763,9 @@ int hdf_write_target(struct hardfiledata *hfd, void *buffer, uae_u64 offset, int
 
 	while (len > 0)
 	{
-		const auto maxlen = len > CACHE_SIZE ? CACHE_SIZE : len;
+		auto maxlen = CACHE_SIZE - static_cast<int>(offset % CACHE_SIZE);
+		if (maxlen > len)
+			maxlen = len;
 		const auto ret = hdf_write_2(hfd, p, offset, maxlen);
 		if (ret < 0)
 			return ret;
@@ -544,13 +788,9 @@ int hdf_resize_target(struct hardfiledata* hfd, uae_u64 newsize)
 	if (newsize == hfd->physsize) {
 		return 1;
 	}
-	/* Now, newsize must be larger than hfd->physsize, we seek to newsize - 1
-	 * and write a single 0 byte to make the file exactly newsize bytes big. */
-	if (_fseeki64(hfd->handle->h, newsize - 1, SEEK_SET) != 0) {
-		write_log("hdf_resize_target: fseek failed errno %d\n", errno);
-		return 0;
-	}
-	if (fwrite("", 1, 1, hfd->handle->h) != 1) {
+	/* Now, newsize must be larger than hfd->physsize, we write a single 0
+	 * byte at newsize - 1 to make the file exactly newsize bytes big. */
+	if (pwrite(hfd->handle->fd, "", 1, newsize - 1) != 1) {
 		write_log("hdf_resize_target: failed to write byte at position "
 			"%lld errno %d\n", newsize - 1, errno);
 		return 0;
@@ -560,6 +800,16 @@ int hdf_resize_target(struct hardfiledata* hfd, uae_u64 newsize)
 	return 1;
 }
 
+#ifdef AMIBERRY
+void hdf_cache_stats_target(const struct hardfiledata *hfd, uae_u64 *hits, uae_u64 *misses, uae_u64 *readaheads)
+{
+	const struct hardfilehandle *h = hfd->handle;
+	*hits = h ? h->hits : 0;
+	*misses = h ? h->misses : 0;
+	*readaheads = h ? h->readaheads : 0;
+}
+#endif
+
 int get_guid_target(uae_u8* out)
 {
 	return 0;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
@@ -13,6 +14,7 @@
 #include "rommgr.h"
 #include "newcpu.h"
 #include <sys/mman.h>
+#include <csignal>
 
 #include "gui.h"
 #include "sys/types.h"
@@ -181,6 +183,21 @@ uae_u32 max_physmem;
 #define MAXZ3MEM64 0xF0000000
 
 static struct uae_shmid_ds shmids[MAX_SHMID];
+/* Watched segments used to emulate MEM_WRITE_WATCH (see mman_GetWriteWatch) */
+struct writewatch_region {
+	uae_u8 *base;
+	uae_u32 size;
+	bool protect;
+	// protect: one byte per host page, set by the fault handler
+	uae_u8 *dirty;
+	// host syscalls writing into the segment, pages stay writable meanwhile
+	int hostwrites;
+	// !protect: shadow copy
+	uae_u8 *copy;
+};
+// serializes re-protecting pages with uae_mman_writewatch_begin()
+static uae_sem_t watch_sem;
+static struct writewatch_region watch_regions[MAX_SHMID];
 uae_u8 *natmem_reserved, *natmem_offset;
 uae_u32 natmem_reserved_size;
 static uae_u8 *p96mem_offset;
@@ -227,9 +244,28 @@ static uae_u32 lowmem ()
 
 static uae_u64 size64;
 
+static void free_watch_region (int shmid)
+{
+	struct writewatch_region *ww = &watch_regions[shmid];
+	uae_u8 *base = ww->base;
+	// the fault handler ignores the range from here on
+	__atomic_store_n (&ww->base, static_cast<uae_u8*>(nullptr), __ATOMIC_SEQ_CST);
+	if (base && ww->protect)
+		mprotect (base, ww->size, PROT_READ | PROT_WRITE);
+	xfree (ww->dirty);
+	ww->dirty = nullptr;
+	xfree (ww->copy);
+	ww->copy = nullptr;
+	ww->protect = false;
+	ww->hostwrites = 0;
+	ww->size = 0;
+}
+
 static void clear_shm ()
 {
 	shm_start = nullptr;
+	for (int i = 0; i < MAX_SHMID; i++)
+		free_watch_region (i);
 	for (auto & shmid : shmids) {
 		memset (&shmid, 0, sizeof(struct uae_shmid_ds));
 		shmid.key = -1;
@@ -660,6 +696,7 @@ void mapped_free (addrbank *ab)
 		while(x) {
 			if (ab->baseaddr == x->native_address) {
 				int shmid = x->id;
+				free_watch_region (shmid);
 				shmids[shmid].key = -1;
 				shmids[shmid].name[0] = '\0';
 				shmids[shmid].size = 0;
@@ -1192,6 +1229,7 @@ int uae_shmctl (int shmid, int cmd, struct uae_shmid_ds *buf)
 			break;
 		case UAE_IPC_RMID:
 			VirtualFree (shmids[shmid].attached, shmids[shmid].size, MEM_DECOMMIT);
+			free_watch_region (shmid);
 			shmids[shmid].key = -1;
 			shmids[shmid].name[0] = '\0';
 			shmids[shmid].size = 0;
@@ -1205,3 +1243,249 @@ int uae_shmctl (int shmid, int cmd, struct uae_shmid_ds *buf)
 	}
 	return result;
 }
+
+/*
+ * Host write watch.
+ *
+ * WinUAE commits RTG memory with MEM_WRITE_WATCH and asks the kernel which
+ * pages were written since the last query. Here reported pages are made
+ * read-only again and the first write to each of them ends up in the SIGSEGV
+ * handler (SIGBUS on macOS), which marks the page dirty and makes it writable.
+ * Host syscalls can't fault that way, code that lets the kernel write into
+ * Amiga memory brackets the call with uae_mman_writewatch_begin()/end().
+ *
+ * If a segment can't be protected, it keeps a shadow copy instead and a page
+ * counts as written when it no longer matches its shadow.
+ */
+
+static int find_watch_shmid (const uae_u8 *addr)
+{
+	for (int i = 0; i < MAX_SHMID; i++) {
+		const uae_u8 *start = static_cast<uae_u8*>(shmids[i].attached);
+		if (shmids[i].key != i || !start)
+			continue;
+		if (addr >= start && addr < start + shmids[i].size)
+			return i;
+	}
+	return -1;
+}
+
+extern void signal_segv (int signum, siginfo_t *info, void *ptr);
+
+/* Page protection needs our fault handler, which is not installed on every host. */
+static bool watch_can_protect ()
+{
+	struct sigaction sa{};
+	return sigaction (SIGSEGV, nullptr, &sa) == 0 && (sa.sa_flags & SA_SIGINFO) && sa.sa_sigaction == signal_segv;
+}
+
+static bool watch_shadow_init (struct writewatch_region *ww)
+{
+	// calloc: untouched parts of a large VRAM shadow stay unbacked
+	ww->copy = xcalloc (uae_u8, ww->size);
+	return ww->copy != nullptr;
+}
+
+static struct writewatch_region *get_watch_region (int shmid, bool *fresh)
+{
+	struct writewatch_region *ww = &watch_regions[shmid];
+	auto *base = static_cast<uae_u8*>(shmids[shmid].attached);
+	const int pagesize = getpagesize ();
+
+	*fresh = false;
+	if (ww->base == base && ww->size == shmids[shmid].size && (ww->dirty || ww->copy))
+		return ww;
+	free_watch_region (shmid);
+	if (!watch_sem)
+		uae_sem_init (&watch_sem, 0, 1);
+	ww->size = shmids[shmid].size;
+	if (watch_can_protect () && !((uintptr_t)base & (pagesize - 1)) && !(ww->size & (pagesize - 1))) {
+		// everything starts dirty and writable, the first query protects it
+		ww->dirty = xmalloc (uae_u8, ww->size / pagesize);
+		if (ww->dirty) {
+			memset (ww->dirty, 1, ww->size / pagesize);
+			ww->protect = true;
+		}
+	}
+	if (!ww->protect && !watch_shadow_init (ww)) {
+		ww->size = 0;
+		return nullptr;
+	}
+	__atomic_store_n (&ww->base, base, __ATOMIC_SEQ_CST);
+	write_log (_T("MMAN: write watch for %s (%dk, %s)\n"), shmids[shmid].name, ww->size >> 10,
+		ww->protect ? _T("page protection") : _T("shadow copy"));
+	*fresh = true;
+	return ww;
+}
+
+/* Page protection failed: keep watching the segment with a shadow copy. */
+static bool watch_fallback_shadow (struct writewatch_region *ww)
+{
+	write_log (_T("MMAN: write watch page protection failed (%d), using shadow copy\n"), errno);
+	__atomic_store_n (&ww->protect, false, __ATOMIC_SEQ_CST);
+	mprotect (ww->base, ww->size, PROT_READ | PROT_WRITE);
+	xfree (ww->dirty);
+	ww->dirty = nullptr;
+	return watch_shadow_init (ww);
+}
+
+/* Called from the SIGSEGV/SIGBUS handler, true if the fault was a write to a
+ * watched page and the access can be restarted. */
+bool uae_mman_writewatch_fault (void *addr)
+{
+	auto *p = static_cast<uae_u8*>(addr);
+	const int pagesize = getpagesize ();
+
+	for (auto & ww : watch_regions) {
+		uae_u8 *base = __atomic_load_n (&ww.base, __ATOMIC_ACQUIRE);
+		if (!base || p < base || p >= base + ww.size || !__atomic_load_n (&ww.protect, __ATOMIC_ACQUIRE))
+			continue;
+		uintptr_t page = (p - base) / pagesize;
+		// writable before marked dirty: a query in between can't re-protect
+		// the page after this has made it writable and lose the write.
+		mprotect (base + page * pagesize, pagesize, PROT_READ | PROT_WRITE);
+		__atomic_store_n (&ww.dirty[page], 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	return false;
+}
+
+static bool watch_overlaps (const struct writewatch_region *ww, const uae_u8 *p, size_t size)
+{
+	return ww->base && ww->protect && p + size > ww->base && p < ww->base + ww->size;
+}
+
+void uae_mman_writewatch_begin (void *addr, size_t size)
+{
+	auto *p = static_cast<uae_u8*>(addr);
+	const int pagesize = getpagesize ();
+
+	for (auto & ww : watch_regions) {
+		if (!watch_overlaps (&ww, p, size))
+			continue;
+		uintptr_t first = (std::max (p, ww.base) - ww.base) / pagesize;
+		uintptr_t last = (std::min (p + size, ww.base + ww.size) - ww.base + pagesize - 1) / pagesize;
+		uae_sem_wait (&watch_sem);
+		ww.hostwrites++;
+		mprotect (ww.base + first * pagesize, (last - first) * pagesize, PROT_READ | PROT_WRITE);
+		for (uintptr_t i = first; i < last; i++)
+			__atomic_store_n (&ww.dirty[i], 1, __ATOMIC_RELEASE);
+		uae_sem_post (&watch_sem);
+	}
+}
+
+void uae_mman_writewatch_end (void *addr, size_t size)
+{
+	auto *p = static_cast<uae_u8*>(addr);
+
+	for (auto & ww : watch_regions) {
+		if (!watch_overlaps (&ww, p, size))
+			continue;
+		uae_sem_wait (&watch_sem);
+		ww.hostwrites--;
+		uae_sem_post (&watch_sem);
+	}
+}
+
+static bool watch_query_protect (struct writewatch_region *ww, uae_u8 *addr, uae_u8 *end, void **lpAddresses, uintptr_t *lpdwCount)
+{
+	const int pagesize = getpagesize ();
+	uintptr_t cnt = 0;
+	uintptr_t page = (addr - ww->base) / pagesize;
+	uintptr_t last = (end - ww->base + pagesize - 1) / pagesize;
+
+	bool ok = true;
+	uae_sem_wait (&watch_sem);
+	// pages a host syscall may be writing to are reported and stay dirty
+	bool rearm = ww->hostwrites == 0;
+	while (page < last && cnt < *lpdwCount) {
+		if (!__atomic_load_n (&ww->dirty[page], __ATOMIC_ACQUIRE)) {
+			page++;
+			continue;
+		}
+		uintptr_t run = page;
+		while (run < last && cnt < *lpdwCount && __atomic_load_n (&ww->dirty[run], __ATOMIC_ACQUIRE)) {
+			// cleared before protected, writes in between are still in the page
+			if (rearm)
+				__atomic_store_n (&ww->dirty[run], 0, __ATOMIC_RELEASE);
+			lpAddresses[cnt++] = ww->base + run * pagesize;
+			run++;
+		}
+		if (rearm && mprotect (ww->base + page * pagesize, (run - page) * pagesize, PROT_READ)) {
+			ok = false;
+			break;
+		}
+		page = run;
+	}
+	uae_sem_post (&watch_sem);
+	*lpdwCount = cnt;
+	return ok;
+}
+
+int mman_GetWriteWatch (void *lpBaseAddress, size_t dwRegionSize, void **lpAddresses, uintptr_t *lpdwCount, unsigned long *lpdwGranularity)
+{
+	auto *addr = static_cast<uae_u8*>(lpBaseAddress);
+	const int pagesize = getpagesize ();
+	uintptr_t cnt = 0;
+	bool fresh;
+
+	int shmid = find_watch_shmid (addr);
+	if (shmid < 0)
+		return -1;
+	struct writewatch_region *ww = get_watch_region (shmid, &fresh);
+	if (!ww)
+		return -1;
+	*lpdwGranularity = pagesize;
+
+	uae_u8 *end = std::min (addr + dwRegionSize, ww->base + ww->size);
+	if (ww->protect) {
+		if (watch_query_protect (ww, addr, end, lpAddresses, lpdwCount))
+			return 0;
+		if (!watch_fallback_shadow (ww))
+			return -1;
+		fresh = true;
+	}
+	uae_u8 *p = ww->base + ((addr - ww->base) & ~(pagesize - 1));
+	while (p < end && cnt < *lpdwCount) {
+		uae_u8 *s = ww->copy + (p - ww->base);
+		size_t len = std::min (static_cast<size_t>(pagesize), static_cast<size_t>(ww->base + ww->size - p));
+		// a new shadow has nothing to compare against: everything is dirty
+		if (fresh || memcmp (p, s, len)) {
+			memcpy (s, p, len);
+			lpAddresses[cnt++] = p;
+		}
+		p += pagesize;
+	}
+	*lpdwCount = cnt;
+	return 0;
+}
+
+void mman_ResetWatch (void *lpBaseAddress, size_t dwRegionSize)
+{
+	auto *addr = static_cast<uae_u8*>(lpBaseAddress);
+	const int pagesize = getpagesize ();
+	int shmid = find_watch_shmid (addr);
+	if (shmid < 0)
+		return;
+	struct writewatch_region *ww = &watch_regions[shmid];
+	if (ww->base != shmids[shmid].attached)
+		return;
+	size_t size = std::min (dwRegionSize, static_cast<size_t>(ww->base + ww->size - addr));
+	if (ww->protect) {
+		uintptr_t first = (addr - ww->base) / pagesize;
+		uintptr_t last = (addr + size - ww->base + pagesize - 1) / pagesize;
+		uae_sem_wait (&watch_sem);
+		bool ok = true;
+		if (ww->hostwrites == 0) {
+			for (uintptr_t i = first; i < last; i++)
+				__atomic_store_n (&ww->dirty[i], 0, __ATOMIC_RELEASE);
+			ok = mprotect (ww->base + first * pagesize, (last - first) * pagesize, PROT_READ) == 0;
+		}
+		uae_sem_post (&watch_sem);
+		if (ok)
+			return;
+		watch_fallback_shadow (ww);
+	}
+	if (ww->copy)
+		memcpy (ww->copy + (addr - ww->base), addr, size);
+}
@@ -11,6 +11,11 @@
 #include <cstdlib>
 #include <cstring>
 #include <sstream>
+#include <map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "sysdeps.h"
@@ -910,143 +915,425 @@ void parse_slave_custom_fields(whdload_slave& slave, const std::string& custom)
 	}
 }
 
-game_hardware_options parse_settings_from_xml(uae_prefs* prefs, const char* filepath)
+static game_hardware_options parse_game_node(uae_prefs* prefs, tinyxml2::XMLElement* game_node)
 {
-	tinyxml2::XMLDocument doc;
-	write_log(_T("WHDBooter - Searching whdload_db.xml for %s\n"), whdload_prefs.filename.c_str());
+	game_hardware_options game_detail{};
 
-	FILE* f = fopen(whd_config.c_str(), _T("rb"));
-	if (!f)
+	// Name
+	auto xml_element = game_node->FirstChildElement("name");
+	if (xml_element)
 	{
-		write_log(_T("Failed to open '%s'\n"), whd_config.c_str());
-		return {};
+		whdload_prefs.game_name.assign(xml_element->GetText());
 	}
 
-	tinyxml2::XMLError err = doc.LoadFile(f);
-	fclose(f);
-	if (err != tinyxml2::XML_SUCCESS)
+	// Sub Path
+	xml_element = game_node->FirstChildElement("subpath");
+	if (xml_element)
 	{
-		write_log(_T("Failed to parse '%s':  %d\n"), whd_config.c_str(), err);
-		return {};
+		whdload_prefs.sub_path.assign(xml_element->GetText());
 	}
 
-	game_hardware_options game_detail{};
-	auto sha1 = my_get_sha1_of_file(filepath);
-	std::transform(sha1.begin(), sha1.end(), sha1.begin(), ::tolower);
+	// Variant UUID
+	xml_element = game_node->FirstChildElement("variant_uuid");
+	if (xml_element)
+	{
+		whdload_prefs.variant_uuid.assign(xml_element->GetText());
+	}
 
-	tinyxml2::XMLElement* game_node = doc.FirstChildElement("whdbooter")->FirstChildElement("game");
-	while (game_node != nullptr)
+	// Slave count
+	xml_element = game_node->FirstChildElement("slave_count");
+	if (xml_element)
 	{
-		// Ideally we'd just match by sha1, but filename has worked up until now, so try that first
-		// then fall back to sha1 if a user has renamed the file!
-		//
-		if (game_node->Attribute("filename", whdload_prefs.filename.c_str()) || 
-			game_node->Attribute("sha1", sha1.c_str()))
-		{
-			// Name
-			auto xml_element = game_node->FirstChildElement("name");
-			if (xml_element)
-			{
-				whdload_prefs.game_name.assign(xml_element->GetText());
-			}
+		whdload_prefs.slave_count = xml_element->IntText(0);
+	}
 
-			// Sub Path
-			xml_element = game_node->FirstChildElement("subpath");
-			if (xml_element)
-			{
-				whdload_prefs.sub_path.assign(xml_element->GetText());
-			}
+	// Default slave
+	xml_element = game_node->FirstChildElement("slave_default");
+	if (xml_element)
+	{
+		whdload_prefs.slave_default.assign(xml_element->GetText());
+		write_log("WHDBooter - Selected Slave: %s \n", whdload_prefs.slave_default.c_str());
+	}
 
-			// Variant UUID
-			xml_element = game_node->FirstChildElement("variant_uuid");
-			if (xml_element)
-			{
-				whdload_prefs.variant_uuid.assign(xml_element->GetText());
-			}
+	// Slave_libraries
+	xml_element = game_node->FirstChildElement("slave_libraries");
+	if (xml_element->GetText() != nullptr)
+	{
+		if (strcmpi(xml_element->GetText(), "true") == 0)
+			whdload_prefs.slave_libraries = true;
+	}
 
-			// Slave count
-			xml_element = game_node->FirstChildElement("slave_count");
-			if (xml_element)
-			{
-				whdload_prefs.slave_count = xml_element->IntText(0);
-			}
+	// Get slaves and settings
+	xml_element = game_node->FirstChildElement("slave");
+	whdload_prefs.slaves.clear();
 
-			// Default slave
-			xml_element = game_node->FirstChildElement("slave_default");
-			if (xml_element)
-			{
-				whdload_prefs.slave_default.assign(xml_element->GetText());
-				write_log("WHDBooter - Selected Slave: %s \n", whdload_prefs.slave_default.c_str());
-			}
+	for (int i = 0; i < whdload_prefs.slave_count && xml_element; ++i)
+	{
+		whdload_slave slave;
+		const char* slave_text = nullptr;
 
-			// Slave_libraries
-			xml_element = game_node->FirstChildElement("slave_libraries");
-			if (xml_element->GetText() != nullptr)
-			{
-				if (strcmpi(xml_element->GetText(), "true") == 0)
-					whdload_prefs.slave_libraries = true;
-			}
+		slave_text = xml_element->FirstChildElement("filename")->GetText();
+		if (slave_text)
+			slave.filename.assign(slave_text);
 
-			// Get slaves and settings
-			xml_element = game_node->FirstChildElement("slave");
-			whdload_prefs.slaves.clear();
+		slave_text = xml_element->FirstChildElement("datapath")->GetText();
+		if (slave_text)
+			slave.data_path.assign(slave_text);
 
-			for (int i = 0; i < whdload_prefs.slave_count && xml_element; ++i)
-			{
-				whdload_slave slave;
-				const char* slave_text = nullptr;
+		auto customElement = xml_element->FirstChildElement("custom");
+		if (customElement && ((slave_text = customElement->GetText())))
+		{
+			auto custom = std::string(slave_text);
+			parse_slave_custom_fields(slave, custom);
+		}
 
-				slave_text = xml_element->FirstChildElement("filename")->GetText();
-				if (slave_text)
-					slave.filename.assign(slave_text);
+		whdload_prefs.slaves.emplace_back(slave);
 
-				slave_text = xml_element->FirstChildElement("datapath")->GetText();
-				if (slave_text)
-					slave.data_path.assign(slave_text);
+		// Set the default slave as the selected one
+		if (slave.filename == whdload_prefs.slave_default)
+			whdload_prefs.selected_slave = slave;
 
-				auto customElement = xml_element->FirstChildElement("custom");
-				if (customElement && ((slave_text = customElement->GetText())))
-				{
-					auto custom = std::string(slave_text);
-					parse_slave_custom_fields(slave, custom);
-				}
+		xml_element = xml_element->NextSiblingElement("slave");
+	}
 
-				whdload_prefs.slaves.emplace_back(slave);
+	// get hardware
+	xml_element = game_node->FirstChildElement("hardware");
+	if (xml_element)
+	{
+		std::string hardware;
+		hardware.assign(xml_element->GetText());
+		if (!hardware.empty())
+		{
+			game_detail = get_game_hardware_settings(hardware);
+			write_log("WHDBooter - Game H/W Settings: \n%s\n", hardware.c_str());
+		}
+	}
 
-				// Set the default slave as the selected one
-				if (slave.filename == whdload_prefs.slave_default)
-					whdload_prefs.selected_slave = slave;
+	// get custom controls
+	xml_element = game_node->FirstChildElement("custom_controls");
+	if (xml_element)
+	{
+		std::string custom_settings;
+		custom_settings.assign(xml_element->GetText());
+		if (!custom_settings.empty())
+		{
+			parse_custom_settings(prefs, custom_settings);
+			write_log("WHDBooter - Game Custom Settings: \n%s\n", custom_settings.c_str());
+		}
+	}
 
-				xml_element = xml_element->NextSiblingElement("slave");
-			}
+	return game_detail;
+}
 
-			// get hardware
-			xml_element = game_node->FirstChildElement("hardware");
-			if (xml_element)
-			{
-				std::string hardware;
-				hardware.assign(xml_element->GetText());
-				if (!hardware.empty())
-				{
-					game_detail = get_game_hardware_settings(hardware);
-					write_log("WHDBooter - Game H/W Settings: \n%s\n", hardware.c_str());
-				}
-			}
+// Compiled index of whdload_db.xml, rebuilt whenever the XML size or
+// modification time changes. It maps the game filename and the archive
+// SHA1 to the byte range of the <game> element, so a launch only maps the
+// index and parses a single element instead of the whole database.
+#define WHD_INDEX_MAGIC 0x58444857 // "WHDX"
+#define WHD_INDEX_VERSION 1
 
-			// get custom controls
-			xml_element = game_node->FirstChildElement("custom_controls");
-			if (xml_element)
-			{
-				std::string custom_settings;
-				custom_settings.assign(xml_element->GetText());
-				if (!custom_settings.empty())
-				{
-					parse_custom_settings(prefs, custom_settings);
-					write_log("WHDBooter - Game Custom Settings: \n%s\n", custom_settings.c_str());
-				}
-			}
+struct whd_index_header
+{
+	uae_u32 magic;
+	uae_u32 version;
+	uae_u64 xml_size;
+	uae_s64 xml_mtime;
+	uae_u32 name_count;
+	uae_u32 sha1_count;
+	uae_u32 pool_size;
+	uae_u32 reserved;
+};
+
+// Entries are sorted by hash, equal hashes keep the XML order
+struct whd_index_entry
+{
+	uae_u32 hash;
+	uae_u32 key; // offset in the string pool
+	uae_u32 offset; // <game> element in the XML
+	uae_u32 length;
+};
+
+struct whd_index
+{
+	void* mem = nullptr;
+	size_t size = 0;
+	const whd_index_header* header = nullptr;
+	const whd_index_entry* names = nullptr;
+	const whd_index_entry* sha1s = nullptr;
+	const char* pool = nullptr;
+};
+
+static uae_u32 whd_index_hash(const char* s)
+{
+	uae_u32 h = 2166136261u;
+	while (*s)
+	{
+		h ^= static_cast<uae_u8>(*s++);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void add_index_key(std::vector<whd_index_entry>& entries, std::string& pool, const char* key, size_t offset, size_t length)
+{
+	if (key == nullptr || *key == 0)
+		return;
+	whd_index_entry e{};
+	e.hash = whd_index_hash(key);
+	e.key = static_cast<uae_u32>(pool.size());
+	e.offset = static_cast<uae_u32>(offset);
+	e.length = static_cast<uae_u32>(length);
+	pool.append(key);
+	pool.push_back(0);
+	entries.push_back(e);
+}
 
+static bool build_whd_index(const std::string& xml_file, const struct stat& xml_stat, const std::string& index_file)
+{
+	std::ifstream in(xml_file, std::ios::binary);
+	if (!in)
+		return false;
+	const std::string xml((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (xml.size() != static_cast<size_t>(xml_stat.st_size) || xml.size() >= 0xffffffffu)
+		return false;
+
+	std::vector<whd_index_entry> names, sha1s;
+	std::string pool;
+	size_t pos = 0;
+	while ((pos = xml.find("<game", pos)) != std::string::npos)
+	{
+		const char c = pos + 5 < xml.size() ? xml[pos + 5] : 0;
+		if (c != ' ' && c != '>' && c != '\t' && c != '\r' && c != '\n')
+		{
+			pos += 5;
+			continue;
+		}
+		const size_t end = xml.find("</game>", pos);
+		if (end == std::string::npos)
 			break;
+		const size_t length = end + 7 - pos;
+		tinyxml2::XMLDocument doc;
+		if (doc.Parse(xml.c_str() + pos, length) == tinyxml2::XML_SUCCESS)
+		{
+			const auto* game_node = doc.FirstChildElement("game");
+			add_index_key(names, pool, game_node->Attribute("filename"), pos, length);
+			add_index_key(sha1s, pool, game_node->Attribute("sha1"), pos, length);
+		}
+		pos = end + 7;
+	}
+	auto by_hash = [](const whd_index_entry& a, const whd_index_entry& b) { return a.hash < b.hash; };
+	std::stable_sort(names.begin(), names.end(), by_hash);
+	std::stable_sort(sha1s.begin(), sha1s.end(), by_hash);
+
+	whd_index_header header{};
+	header.magic = WHD_INDEX_MAGIC;
+	header.version = WHD_INDEX_VERSION;
+	header.xml_size = xml_stat.st_size;
+	header.xml_mtime = xml_stat.st_mtime;
+	header.name_count = static_cast<uae_u32>(names.size());
+	header.sha1_count = static_cast<uae_u32>(sha1s.size());
+	header.pool_size = static_cast<uae_u32>(pool.size());
+
+	// write to a temporary file so a concurrent launch never maps a partial index
+	const std::string tmp_file = index_file + ".tmp";
+	std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+	out.write(reinterpret_cast<const char*>(&header), sizeof header);
+	out.write(reinterpret_cast<const char*>(names.data()), names.size() * sizeof(whd_index_entry));
+	out.write(reinterpret_cast<const char*>(sha1s.data()), sha1s.size() * sizeof(whd_index_entry));
+	out.write(pool.data(), pool.size());
+	out.close();
+	if (!out || rename(tmp_file.c_str(), index_file.c_str()) != 0)
+	{
+		std::filesystem::remove(tmp_file);
+		return false;
+	}
+	write_log("WHDBooter - Built whdload_db index, %zu games\n", names.size());
+	return true;
+}
+
+static void close_whd_index(whd_index& index)
+{
+	if (index.mem)
+		munmap(index.mem, index.size);
+	index = whd_index();
+}
+
+static bool map_whd_index(whd_index& index, const std::string& index_file, const struct stat& xml_stat)
+{
+	const int fd = open(index_file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st{};
+	if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(whd_index_header)))
+	{
+		close(fd);
+		return false;
+	}
+	void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return false;
+
+	index.mem = mem;
+	index.size = st.st_size;
+	index.header = static_cast<const whd_index_header*>(mem);
+	const auto* h = index.header;
+	const uae_u64 needed = sizeof(whd_index_header) + (static_cast<uae_u64>(h->name_count) + h->sha1_count) * sizeof(whd_index_entry) + h->pool_size;
+	if (h->magic != WHD_INDEX_MAGIC || h->version != WHD_INDEX_VERSION ||
+		h->xml_size != static_cast<uae_u64>(xml_stat.st_size) || h->xml_mtime != xml_stat.st_mtime ||
+		needed != index.size || (h->pool_size && static_cast<const char*>(mem)[index.size - 1] != 0))
+	{
+		close_whd_index(index);
+		return false;
+	}
+	index.names = reinterpret_cast<const whd_index_entry*>(h + 1);
+	index.sha1s = index.names + h->name_count;
+	index.pool = reinterpret_cast<const char*>(index.sha1s + h->sha1_count);
+	return true;
+}
+
+static bool open_whd_index(whd_index& index)
+{
+	struct stat xml_stat{};
+	if (stat(whd_config.c_str(), &xml_stat) < 0)
+		return false;
+	const std::string index_file = (whd_path / "whdload_db.idx").string();
+	if (map_whd_index(index, index_file, xml_stat))
+		return true;
+	if (!build_whd_index(whd_config, xml_stat, index_file))
+	{
+		write_log("WHDBooter - Could not write whdload_db index '%s'\n", index_file.c_str());
+		return false;
+	}
+	return map_whd_index(index, index_file, xml_stat);
+}
+
+static const whd_index_entry* find_whd_index(const whd_index& index, const whd_index_entry* entries, uae_u32 count, const std::string& key)
+{
+	const uae_u32 hash = whd_index_hash(key.c_str());
+	const auto* e = std::lower_bound(entries, entries + count, hash,
+		[](const whd_index_entry& a, uae_u32 h) { return a.hash < h; });
+	for (; e < entries + count && e->hash == hash; ++e)
+	{
+		if (e->key < index.header->pool_size && key == index.pool + e->key)
+			return e;
+	}
+	return nullptr;
+}
+
+// SHA1 of the game archives, cached by path, size and modification time
+static std::string get_cached_sha1(const char* filepath)
+{
+	struct stat st{};
+	if (stat(filepath, &st) < 0)
+		return "";
+
+	const std::string cache_file = (whd_path / "whdload_sha1.cache").string();
+	std::map<std::string, std::string> cache;
+	std::ifstream in(cache_file);
+	std::string line;
+	while (std::getline(in, line))
+	{
+		// <size> <mtime> <sha1> <path>
+		const auto sep = line.find(' ', line.find(' ', line.find(' ') + 1) + 1);
+		if (sep != std::string::npos)
+			cache[line.substr(sep + 1)] = line.substr(0, sep);
+	}
+	in.close();
+
+	const std::string stamp = std::to_string(st.st_size) + " " + std::to_string(st.st_mtime) + " ";
+	const auto it = cache.find(filepath);
+	if (it != cache.end() && it->second.compare(0, stamp.size(), stamp) == 0)
+		return it->second.substr(stamp.size());
+
+	auto sha1 = my_get_sha1_of_file(filepath);
+	std::transform(sha1.begin(), sha1.end(), sha1.begin(), ::tolower);
+	if (sha1.empty())
+		return sha1;
+	cache[filepath] = stamp + sha1;
+
+	const std::string tmp_file = cache_file + ".tmp";
+	std::ofstream out(tmp_file, std::ios::trunc);
+	for (const auto& entry : cache)
+		out << entry.second << " " << entry.first << "\n";
+	out.close();
+	if (!out || rename(tmp_file.c_str(), cache_file.c_str()) != 0)
+		std::filesystem::remove(tmp_file);
+	return sha1;
+}
+
+static bool find_game_in_index(uae_prefs* prefs, const char* filepath, game_hardware_options& game_detail)
+{
+	whd_index index;
+	if (!open_whd_index(index))
+		return false;
+
+	// Ideally we'd just match by sha1, but filename has worked up until now, so try that first
+	// then fall back to sha1 if a user has renamed the file!
+	const auto* e = find_whd_index(index, index.names, index.header->name_count, whdload_prefs.filename);
+	if (e == nullptr)
+	{
+		const auto sha1 = get_cached_sha1(filepath);
+		if (!sha1.empty())
+			e = find_whd_index(index, index.sha1s, index.header->sha1_count, sha1);
+	}
+	if (e == nullptr)
+	{
+		close_whd_index(index);
+		game_detail = {};
+		return true;
+	}
+	const uae_u32 offset = e->offset;
+	const uae_u32 length = e->length;
+	close_whd_index(index);
+
+	std::string fragment(length, 0);
+	std::ifstream in(whd_config, std::ios::binary);
+	if (!in.seekg(offset) || !in.read(&fragment[0], length))
+		return false;
+	tinyxml2::XMLDocument doc;
+	if (doc.Parse(fragment.c_str(), fragment.size()) != tinyxml2::XML_SUCCESS)
+		return false;
+	game_detail = parse_game_node(prefs, doc.FirstChildElement("game"));
+	return true;
+}
+
+game_hardware_options parse_settings_from_xml(uae_prefs* prefs, const char* filepath)
+{
+	tinyxml2::XMLDocument doc;
+	write_log(_T("WHDBooter - Searching whdload_db.xml for %s\n"), whdload_prefs.filename.c_str());
+
+	game_hardware_options game_detail{};
+	if (find_game_in_index(prefs, filepath, game_detail))
+		return game_detail;
+
+	// no usable index, parse the whole database
+	FILE* f = fopen(whd_config.c_str(), _T("rb"));
+	if (!f)
+	{
+		write_log(_T("Failed to open '%s'\n"), whd_config.c_str());
+		return {};
+	}
+
+	tinyxml2::XMLError err = doc.LoadFile(f);
+	fclose(f);
+	if (err != tinyxml2::XML_SUCCESS)
+	{
+		write_log(_T("Failed to parse '%s':  %d\n"), whd_config.c_str(), err);
+		return {};
+	}
+
+	const auto sha1 = get_cached_sha1(filepath);
+
+	tinyxml2::XMLElement* game_node = doc.FirstChildElement("whdbooter")->FirstChildElement("game");
+	while (game_node != nullptr)
+	{
+		if (game_node->Attribute("filename", whdload_prefs.filename.c_str()) || 
+			(!sha1.empty() && game_node->Attribute("sha1", sha1.c_str())))
+		{
+			return parse_game_node(prefs, game_node);
 		}
 		game_node = game_node->NextSiblingElement();
 	}
@@ -27,6 +27,7 @@
 
 #include "options.h"
 #include "memory.h"
+#include "uae/mman.h"
 #include "custom.h"
 #include "newcpu.h"
 #include "autoconf.h"
@@ -37,7 +38,10 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #include <sys/ioctl.h>
 #ifdef HAVE_SYS_FILIO_H
 # include <sys/filio.h>
@@ -76,13 +80,11 @@
 
 uae_u32 bsdthr_Accept_2 (SB);
 uae_u32 bsdthr_Recv_2 (SB);
-uae_u32 bsdthr_blockingstuff (uae_u32 (*tryfunc)(SB), SB);
-uae_u32 bsdthr_SendRecvAcceptConnect (uae_u32 (*tryfunc)(SB), SB);
 uae_u32 bsdthr_Send_2 (SB);
 uae_u32 bsdthr_Connect_2 (SB);
-uae_u32 bsdthr_WaitSelect (SB);
 uae_u32 bsdthr_Wait (SB);
 void clearsockabort (SB);
+static void reactor_submit (SB);
 
 static uae_sem_t sem_queue;
 
@@ -439,7 +441,7 @@ static void mapsockoptvalue(int level, int optname, uae_u32 optval, void *buf)
 
 STATIC_INLINE int bsd_amigaside_FD_ISSET (int n, uae_u32 set)
 {
-	uae_u32 foo = get_long (set + (n / 32));
+	uae_u32 foo = get_long (set + (n / 32) * 4);
 	if (foo & (1 << (n % 32)))
 		return 1;
 	return 0;
@@ -453,7 +455,7 @@ STATIC_INLINE void bsd_amigaside_FD_ZERO (uae_u32 set)
 
 STATIC_INLINE void bsd_amigaside_FD_SET (int n, uae_u32 set)
 {
-	set = set + (n / 32);
+	set = set + (n / 32) * 4;
 	put_long (set, get_long (set) | (1 << (n % 32)));
 }
 
@@ -627,6 +629,7 @@ uae_u32 bsdthr_Accept_2 (SB)
 uae_u32 bsdthr_Recv_2 (SB)
 {
 	int foo;
+	uae_mman_writewatch_begin (sb->buf, sb->len);
 	if (sb->from == 0) {
 		foo = recv (sb->s, sb->buf, sb->len, sb->flags /*| MSG_NOSIGNAL*/);
 		write_log ("recv2, recv returns %d, errno is %d\n", foo, errno);
@@ -642,6 +645,9 @@ uae_u32 bsdthr_Recv_2 (SB)
 			put_long (sb->fromlen, l);
 		}
 	}
+	int err = errno;
+	uae_mman_writewatch_end (sb->buf, sb->len);
+	errno = err;
 	return foo;
 }
 
@@ -687,150 +693,768 @@ uae_u32 bsdthr_Connect_2 (SB)
 	}
 }
 
-uae_u32 bsdthr_SendRecvAcceptConnect (uae_u32 (*tryfunc)(SB), SB)
+void clearsockabort(SB)
+{
+	int chr;
+	int num;
+
+	while ((num = read(sb->sockabort[0], &chr, sizeof(chr))) >= 0) {
+		write_log("Sockabort got %d bytes\n", num);
+	}
+}
+
+static void fd_zero(TrapContext *ctx, uae_u32 fdset, uae_u32 nfds)
+{
+	unsigned int i;
+	for (i = 0; i < nfds; i += 32, fdset += 4)
+		trap_put_long(ctx, fdset,0);
+}
+
+/*
+ * Socket reactor
+ *
+ * One host thread serves the blocking calls of all socket bases. A call
+ * is tried nonblocking when it is submitted. If it would block, the base
+ * is added to the waiters of its sockets and its abort pipe, and the call
+ * is retried when one of them becomes ready. On Linux every host
+ * descriptor stays registered edge triggered in one epoll set once it has
+ * been waited on, other hosts build a poll() set of the pending bases. Completion signals the owner task, as
+ * the per base threads did before. The resolver calls block inside the
+ * C library, they run on a thread of their own.
+ */
+
+static uae_sem_t reactor_lock;	/* protects the queues below */
+static uae_sem_t resolver_sem;
+static struct socketbase *reactor_queue;
+static struct socketbase *resolver_queue, *resolver_busy;
+static struct socketbase *reactor_pending;	/* owned by the reactor thread */
+static uae_thread_id reactor_thread, resolver_thread;
+static int reactor_wake[2] = { -1, -1 };
+static volatile bool reactor_quit;
+static bool reactor_running;
+static struct socketbase **reactor_ready;
+static int reactor_readycount, reactor_readyalloc;
+#ifdef __linux__
+static int reactor_epfd = -1;
+
+/* A pfd entry of a pending operation */
+struct reactor_waiter
+{
+	struct socketbase *sb;
+	short events;
+	struct reactor_waiter *next;
+};
+
+/* Indexed by host descriptor. The registered mask only grows, edges
+ * nobody waits for are dropped when they arrive. */
+struct reactor_watch
+{
+	uae_u32 events;		/* registered with epoll, 0 if not registered */
+	struct reactor_waiter *waiters;
+};
+static struct reactor_watch *reactor_watches;	/* protected by reactor_lock */
+static int reactor_watchalloc;
+#else
+static struct pollfd *reactor_pfd;
+static struct socketbase **reactor_pfdsb;
+static int reactor_pfdalloc;
+#endif
+
+#define REACTOR_MAX_EVENTS 64
+
+static uae_s64 reactor_time (void)
+{
+	struct timespec ts {};
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uae_s64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void reactor_wakeup (void)
+{
+	char c = 0;
+	/* a full pipe already guarantees a wakeup */
+	if (write (reactor_wake[1], &c, 1) < 0 && errno != EAGAIN)
+		write_log (_T("BSDSOCK: reactor wakeup failed %d\n"), errno);
+}
+
+static bool reactor_setpfd (SB, int count)
+{
+	if (count > sb->pfdalloc) {
+		int alloc = count < 16 ? 16 : count;
+		struct pollfd *pfd = xrealloc (struct pollfd, sb->pfd, alloc);
+		if (!pfd)
+			return false;
+		sb->pfd = pfd;
+		int *pfdsd = xrealloc (int, sb->pfdsd, alloc);
+		if (!pfdsd)
+			return false;
+		sb->pfdsd = pfdsd;
+#ifdef __linux__
+		struct reactor_waiter *pfdw = xrealloc (struct reactor_waiter, sb->pfdw, alloc);
+		if (!pfdw)
+			return false;
+		sb->pfdw = pfdw;
+#endif
+		sb->pfdalloc = alloc;
+	}
+	sb->pfd[0].fd = sb->sockabort[0];
+	sb->pfd[0].events = POLLIN;
+	sb->pfd[0].revents = 0;
+	sb->pfdsd[0] = -1;
+	sb->pfdcount = count;
+	return true;
+}
+
+static void reactor_addready (SB)
+{
+	if (reactor_readycount > 0 && reactor_ready[reactor_readycount - 1] == sb)
+		return;
+	if (reactor_readycount >= reactor_readyalloc) {
+		int alloc = reactor_readyalloc ? reactor_readyalloc * 2 : REACTOR_MAX_EVENTS;
+		struct socketbase **ready = xrealloc (struct socketbase *, reactor_ready, alloc);
+		if (!ready)
+			return;
+		reactor_ready = ready;
+		reactor_readyalloc = alloc;
+	}
+	reactor_ready[reactor_readycount++] = sb;
+}
+
+#ifdef __linux__
+static uae_u32 reactor_epoll_events (short events)
 {
-	return bsdthr_blockingstuff (tryfunc, sb);
+	uae_u32 ev = EPOLLET;
+	if (events & POLLIN)
+		ev |= EPOLLIN;
+	if (events & POLLOUT)
+		ev |= EPOLLOUT;
+	if (events & POLLPRI)
+		ev |= EPOLLPRI;
+	return ev;
 }
 
-uae_u32 bsdthr_blockingstuff(uae_u32(*tryfunc)(SB), SB)
+static struct reactor_watch *reactor_getwatch (int fd)
+{
+	if (fd >= reactor_watchalloc) {
+		int alloc = fd + 64;
+		struct reactor_watch *w = xrealloc (struct reactor_watch, reactor_watches, alloc);
+		if (!w)
+			return NULL;
+		memset (w + reactor_watchalloc, 0, (alloc - reactor_watchalloc) * sizeof (struct reactor_watch));
+		reactor_watches = w;
+		reactor_watchalloc = alloc;
+	}
+	return &reactor_watches[fd];
+}
+
+/* Make the registration of fd cover events. Changing it makes epoll check
+ * the current state, so readiness from before the change is not lost. */
+static void reactor_watch_events (int fd, struct reactor_watch *w, short events, bool recheck)
+{
+	uae_u32 ev = reactor_epoll_events (events) | w->events;
+	if (ev == w->events && !recheck)
+		return;
+	struct epoll_event e {};
+	e.events = ev;
+	e.data.fd = fd;
+	int op = w->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	if (epoll_ctl (reactor_epfd, op, fd, &e) < 0) {
+		int op2 = errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+		if (epoll_ctl (reactor_epfd, op2, fd, &e) < 0) {
+			write_log (_T("BSDSOCK: epoll_ctl(%d) failed %d\n"), fd, errno);
+			return;
+		}
+	}
+	w->events = ev;
+}
+#endif
+
+/* Make the pending operation of sb wait for its descriptors. Sockets may
+ * be shared between bases, each descriptor keeps a list of the bases
+ * waiting on it. Once armed an operation stays armed until it is
+ * disarmed, rearming after a stale edge has nothing to do. */
+static void reactor_arm (SB)
+{
+	if (sb->pending)
+		return;
+	sb->pending = 1;
+	sb->nextop = reactor_pending;
+	reactor_pending = sb;
+#ifdef __linux__
+	uae_sem_wait (&reactor_lock);
+	for (int i = 0; i < sb->pfdcount; i++) {
+		int fd = sb->pfd[i].fd;
+		struct reactor_waiter *wt = &sb->pfdw[i];
+		struct reactor_watch *w = reactor_getwatch (fd);
+		wt->sb = sb;
+		wt->events = sb->pfd[i].events;
+		wt->next = NULL;
+		if (!w)
+			continue;
+		wt->next = w->waiters;
+		w->waiters = wt;
+		/* an abort written while nothing waited on the pipe was not seen */
+		reactor_watch_events (fd, w, wt->events, i == 0);
+	}
+	uae_sem_post (&reactor_lock);
+#endif
+}
+
+static void reactor_disarm (SB)
+{
+	if (!sb->pending)
+		return;
+#ifdef __linux__
+	uae_sem_wait (&reactor_lock);
+	for (int i = 0; i < sb->pfdcount; i++) {
+		int fd = sb->pfd[i].fd;
+		if (fd < 0 || fd >= reactor_watchalloc)
+			continue;
+		for (struct reactor_waiter **p = &reactor_watches[fd].waiters; *p; p = &(*p)->next) {
+			if (*p == &sb->pfdw[i]) {
+				*p = sb->pfdw[i].next;
+				break;
+			}
+		}
+	}
+	uae_sem_post (&reactor_lock);
+#endif
+	for (struct socketbase **p = &reactor_pending; *p; p = &(*p)->nextop) {
+		if (*p == sb) {
+			*p = sb->nextop;
+			break;
+		}
+	}
+	sb->nextop = NULL;
+	sb->pending = 0;
+}
+
+/* Called before a host descriptor is closed: a registration of a closed
+ * descriptor would stay alive as long as a dup() of it exists and the
+ * number can be reused. Waiters stay until their owner aborts them. */
+static void reactor_forget (int fd)
+{
+#ifdef __linux__
+	if (!reactor_running || fd < 0)
+		return;
+	uae_sem_wait (&reactor_lock);
+	if (fd < reactor_watchalloc && reactor_watches[fd].events) {
+		epoll_ctl (reactor_epfd, EPOLL_CTL_DEL, fd, NULL);
+		reactor_watches[fd].events = 0;
+	}
+	uae_sem_post (&reactor_lock);
+#endif
+}
+
+/* Drop the pending operation without signalling: the owner gave up on it */
+static void reactor_drop (SB)
+{
+	reactor_disarm (sb);
+	if (sb->tryfunc) {
+		fcntl (sb->pfd[1].fd, F_SETFL, sb->sockflags);
+		sb->tryfunc = NULL;
+	}
+	clearsockabort (sb);
+}
+
+static void reactor_finish (SB, int result)
+{
+	TrapContext* ctx = sb->context;  // FIXME: Correct?
+	int err = errno;
+
+	reactor_disarm (sb);
+	if (sb->tryfunc) {
+		fcntl (sb->pfd[1].fd, F_SETFL, sb->sockflags);
+		sb->tryfunc = NULL;
+	}
+	sb->resultval = result;
+	errno = err;
+	SETERRNO;
+	SETSIGNAL;
+}
+
+static void reactor_blocking_try (SB)
+{
+	int foo = sb->tryfunc (sb);
+	if (foo < 0 && !(sb->sockflags & O_NONBLOCK) &&
+		(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS)) {
+		reactor_arm (sb);
+		return;
+	}
+	reactor_finish (sb, foo);
+}
+
+static void reactor_blocking_start (SB, uae_u32 (*tryfunc)(SB), short events)
 {
-	int done = 0, foo = 0;
 	long flags;
-	int nonblock;
-	if ((flags = fcntl(sb->s, F_GETFL)) == -1)
+
+	if (!reactor_setpfd (sb, 2)) {
+		errno = ENOBUFS;
+		reactor_finish (sb, -1);
+		return;
+	}
+	if ((flags = fcntl (sb->s, F_GETFL)) == -1)
 		flags = 0;
-	nonblock = (flags & O_NONBLOCK);
-	fcntl(sb->s, F_SETFL, flags | O_NONBLOCK);
-	while (!done) {
-		done = 1;
-		foo = tryfunc(sb);
-		if (foo < 0 && !nonblock) {
-			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINPROGRESS)) {
-				fd_set readset, writeset, exceptset;
-				int maxfd = (sb->s > sb->sockabort[0]) ? sb->s : sb->sockabort[0];
-				int num;
-
-				FD_ZERO(&readset);
-				FD_ZERO(&writeset);
-				FD_ZERO(&exceptset);
-
-				if (sb->action == 3 || sb->action == 6)
-					FD_SET(sb->s, &readset);
-				if (sb->action == 2 || sb->action == 1 || sb->action == 4)
-					FD_SET(sb->s, &writeset);
-				FD_SET(sb->sockabort[0], &readset);
-
-				num = select(maxfd + 1, &readset, &writeset, &exceptset, NULL);
-				if (num == -1) {
-					write_log("Blocking select(%d) returns -1,errno is %d\n", sb->sockabort[0], errno);
-					fcntl(sb->s, F_SETFL, flags);
-					return -1;
-				}
-
-				if (FD_ISSET(sb->sockabort[0], &readset) || FD_ISSET(sb->sockabort[0], &writeset)) {
-					/* reset sock abort pipe */
-					/* read from the pipe to reset it */
-					write_log("select aborted from signal\n");
-
-					clearsockabort(sb);
-					write_log("Done read\n");
-					errno = EINTR;
-					done = 1;
-				}
-				else {
-					done = 0;
-				}
+	fcntl (sb->s, F_SETFL, flags | O_NONBLOCK);
+	sb->sockflags = flags;
+	sb->tryfunc = tryfunc;
+	sb->pfd[1].fd = sb->s;
+	sb->pfd[1].events = events;
+	sb->pfd[1].revents = 0;
+	sb->pfdsd[1] = -1;
+	reactor_blocking_try (sb);
+}
+
+/* Report the poll() result of a WaitSelect in the Amiga side sets */
+static void reactor_waitselect_done (SB, int r)
+{
+	TrapContext* ctx = NULL;  // FIXME: Correct?
+	int i, set;
+
+	for (set = 0; set < 3; set++)
+		if (sb->sets[set] != 0)
+			fd_zero (ctx, sb->sets[set], sb->nfds);
+	if (r > 0) {
+		r = 0;
+		for (i = 1; i < sb->pfdcount; i++) {
+			short ev = sb->pfd[i].events;
+			short rev = sb->pfd[i].revents;
+			if (rev & POLLNVAL) {
+				errno = EBADF;
+				r = -1;
+				break;
+			}
+			/* errors and hangups are reported in every set asked for */
+			if ((ev & POLLIN) && (rev & (POLLIN | POLLERR | POLLHUP))) {
+				bsd_amigaside_FD_SET (sb->pfdsd[i], sb->sets[0]);
+				r++;
+			}
+			if ((ev & POLLOUT) && (rev & (POLLOUT | POLLERR | POLLHUP))) {
+				bsd_amigaside_FD_SET (sb->pfdsd[i], sb->sets[1]);
+				r++;
+			}
+			if ((ev & POLLPRI) && (rev & (POLLPRI | POLLERR | POLLHUP))) {
+				bsd_amigaside_FD_SET (sb->pfdsd[i], sb->sets[2]);
+				r++;
 			}
-			else if (errno == EINTR)
-				done = 1;
 		}
 	}
-	fcntl(sb->s, F_SETFL, flags);
-	return foo;
+	if (r >= 0)
+		errno = 0;
+	write_log("WaitSelect: r=%d errno=%d\n", r, errno);
+	reactor_finish (sb, r);
 }
 
-static int bsdlib_threadfunc(void* arg)
+static void reactor_waitselect_start (SB)
 {
-	auto* sb = (struct socketbase*)arg;
+	TrapContext* ctx = NULL;  // FIXME: Correct?
+	int i, set, n = 1;
 
-	write_log("THREAD_START\n");
+	write_log("WaitSelect: %d 0x%x 0x%x 0x%x 0x%x 0x%x\n", sb->nfds, sb->sets[0], sb->sets[1], sb->sets[2], sb->timeout, sb->sigmp);
 
-	while (1) {
-		uae_sem_wait(&sb->sem);
+	if (!reactor_setpfd (sb, sb->nfds + 1)) {
+		errno = ENOBUFS;
+		reactor_finish (sb, -1);
+		return;
+	}
+	for (i = 0; i < sb->nfds; i++) {
+		short events = 0;
+		for (set = 0; set < 3; set++) {
+			if (sb->sets[set] != 0 && bsd_amigaside_FD_ISSET (i, sb->sets[set]))
+				events |= set == 0 ? POLLIN : set == 1 ? POLLOUT : POLLPRI;
+		}
+		if (!events)
+			continue;
+		int s = getsock (ctx, sb, i + 1);
+		write_log("WaitSelect: AmigaSide %d set. NativeSide %d.\n", i, s);
+		if (s == -1) {
+			write_log("BSDSOCK: WaitSelect() called with invalid descriptor %d.\n", i);
+			continue;
+		}
+		sb->pfd[n].fd = s;
+		sb->pfd[n].events = events;
+		sb->pfd[n].revents = 0;
+		sb->pfdsd[n] = i;
+		n++;
+	}
+	sb->pfdcount = n;
 
-		write_log("Socket thread got action %d\n", sb->action);
+	sb->deadline = -1;
+	if (sb->timeout) {
+		write_log("WaitSelect: timeout %d %d\n", get_long(sb->timeout), get_long(sb->timeout + 4));
+		sb->deadline = reactor_time () + (uae_s64)get_long (sb->timeout) * 1000000 + get_long (sb->timeout + 4);
+	}
+
+	int r = poll (sb->pfd, sb->pfdcount, 0);
+	if (r < 0) {
+		reactor_finish (sb, -1);
+	} else if (sb->pfd[0].revents) {
+		write_log("WaitSelect aborted from signal\n");
+		clearsockabort (sb);
+		reactor_waitselect_done (sb, 0);
+	} else if (r > 0 || (sb->deadline > 0 && sb->deadline <= reactor_time ())) {
+		reactor_waitselect_done (sb, r);
+	} else {
+		reactor_arm (sb);
+	}
+}
 
-		TrapContext* ctx = sb->context;  // FIXME: Correct?
+/* Called when one of the descriptors of a pending operation fired */
+static void reactor_retry (SB)
+{
+	if (!sb->pending)
+		return;
+	int r = poll (sb->pfd, sb->pfdcount, 0);
+	if (r < 0) {
+		if (errno != EINTR)
+			reactor_finish (sb, -1);
+		else
+			reactor_arm (sb);
+		return;
+	}
+	if (sb->pfd[0].revents) {
+		write_log("select aborted from signal\n");
+		clearsockabort (sb);
+		if (sb->action == 5) {
+			reactor_waitselect_done (sb, 0);
+		} else {
+			errno = EINTR;
+			reactor_finish (sb, -1);
+		}
+	} else if (r == 0) {
+		/* stale edge, stay armed */
+	} else if (sb->action == 5) {
+		reactor_waitselect_done (sb, r);
+	} else {
+		reactor_blocking_try (sb);
+	}
+}
 
-		switch (sb->action) {
-		case 0:       /* kill thread (CloseLibrary) */
+static void reactor_start (SB)
+{
+	write_log("Socket reactor got action %d\n", sb->action);
 
-			write_log("THREAD_END\n");
+	if (sb->pending)
+		reactor_drop (sb);
 
-			uae_sem_destroy(&sb->sem);
-			return 0;
+	switch (sb->action) {
+	case 0:       /* release base (CloseLibrary) */
+		uae_sem_post (&sb->sem);
+		break;
 
-		case 1:       /* Connect */
-			sb->resultval = bsdthr_SendRecvAcceptConnect(bsdthr_Connect_2, sb);
-			break;
+	case 1:       /* Connect */
+		reactor_blocking_start (sb, bsdthr_Connect_2, POLLOUT);
+		break;
 
-			/* @@@ Should check (from|to)len so it's 16.. */
-		case 2:       /* Send[to] */
-			sb->resultval = bsdthr_SendRecvAcceptConnect(bsdthr_Send_2, sb);
-			break;
+		/* @@@ Should check (from|to)len so it's 16.. */
+	case 2:       /* Send[to] */
+		reactor_blocking_start (sb, bsdthr_Send_2, POLLOUT);
+		break;
 
-		case 3:       /* Recv[from] */
-			sb->resultval = bsdthr_SendRecvAcceptConnect(bsdthr_Recv_2, sb);
-			break;
+	case 3:       /* Recv[from] */
+		reactor_blocking_start (sb, bsdthr_Recv_2, POLLIN);
+		break;
 
-		case 4: {     /* Gethostbyname */
-			struct hostent* tmphostent = gethostbyname((char*)get_real_address(sb->name));
+	case 4:       /* Gethostbyname */
+	case 7:       /* Gethostbyaddr */
+		uae_sem_wait (&reactor_lock);
+		sb->nextop = NULL;
+		{
+			struct socketbase **p = &resolver_queue;
+			while (*p)
+				p = &(*p)->nextop;
+			*p = sb;
+		}
+		uae_sem_post (&reactor_lock);
+		uae_sem_post (&resolver_sem);
+		break;
+
+	case 5:       /* WaitSelect */
+		reactor_waitselect_start (sb);
+		break;
+
+	case 6:       /* Accept */
+		reactor_blocking_start (sb, bsdthr_Accept_2, POLLIN);
+		break;
+	}
+}
 
-			if (tmphostent) {
-				copyHostent(ctx, tmphostent, sb);
-				bsdsocklib_setherrno(ctx, sb, 0);
+/* Take the submitted operations off the queue */
+static struct socketbase *reactor_take (void)
+{
+	struct socketbase *list = NULL, *sb, *next;
+
+	uae_sem_wait (&reactor_lock);
+	for (sb = reactor_queue; sb; sb = next) {
+		next = sb->nextsubmit;
+		sb->submitted = 0;
+		if (sb == resolver_busy) {
+			/* resolver resubmits it when the lookup returns */
+			sb->deferred = 1;
+			continue;
+		}
+		/* a queued lookup the owner gave up on */
+		for (struct socketbase **p = &resolver_queue; *p; p = &(*p)->nextop) {
+			if (*p == sb) {
+				*p = sb->nextop;
+				break;
 			}
-			else
-				SETHERRNO;
+		}
+		sb->nextsubmit = list;
+		list = sb;
+	}
+	reactor_queue = NULL;
+	uae_sem_post (&reactor_lock);
+	return list;
+}
 
-			break;
+/* Collect the bases with a descriptor that fired in reactor_ready */
+static void reactor_wait (int timeout)
+{
+	reactor_readycount = 0;
+#ifdef __linux__
+	struct epoll_event ev[REACTOR_MAX_EVENTS];
+	int r = epoll_wait (reactor_epfd, ev, REACTOR_MAX_EVENTS, timeout);
+	if (r <= 0)
+		return;
+	uae_sem_wait (&reactor_lock);
+	for (int i = 0; i < r; i++) {
+		int fd = ev[i].data.fd;
+		if (fd == reactor_wake[0] || fd >= reactor_watchalloc)
+			continue;
+		/* errors and hangups concern every waiter */
+		uae_u32 hit = (ev[i].events & (EPOLLERR | EPOLLHUP)) ? EPOLLIN | EPOLLOUT | EPOLLPRI : ev[i].events;
+		for (struct reactor_waiter *wt = reactor_watches[fd].waiters; wt; wt = wt->next) {
+			if (reactor_epoll_events (wt->events) & hit & ~EPOLLET)
+				reactor_addready (wt->sb);
+		}
+	}
+	uae_sem_post (&reactor_lock);
+#else
+	struct socketbase *sb;
+	int count = 1;
+	for (sb = reactor_pending; sb; sb = sb->nextop)
+		count += sb->pfdcount;
+	if (count > reactor_pfdalloc) {
+		xfree (reactor_pfd);
+		xfree (reactor_pfdsb);
+		reactor_pfdalloc = count + 64;
+		reactor_pfd = xmalloc (struct pollfd, reactor_pfdalloc);
+		reactor_pfdsb = xmalloc (struct socketbase *, reactor_pfdalloc);
+	}
+	reactor_pfd[0].fd = reactor_wake[0];
+	reactor_pfd[0].events = POLLIN;
+	reactor_pfdsb[0] = NULL;
+	count = 1;
+	for (sb = reactor_pending; sb; sb = sb->nextop) {
+		for (int i = 0; i < sb->pfdcount; i++) {
+			reactor_pfd[count] = sb->pfd[i];
+			reactor_pfdsb[count++] = sb;
+		}
+	}
+	if (poll (reactor_pfd, count, timeout) > 0) {
+		for (int i = 1; i < count; i++) {
+			if (reactor_pfd[i].revents)
+				reactor_addready (reactor_pfdsb[i]);
 		}
+	}
+#endif
+}
 
-		case 5:       /* WaitSelect */
-			sb->resultval = bsdthr_WaitSelect(sb);
-			break;
+static int reactor_threadfunc (void *arg)
+{
+	write_log("THREAD_START\n");
 
-		case 6:       /* Accept */
-			sb->resultval = bsdthr_SendRecvAcceptConnect(bsdthr_Accept_2, sb);
-			break;
+	while (!reactor_quit) {
+		struct socketbase *sb, *next;
+		uae_s64 now = reactor_time ();
+		int timeout = -1;
+
+		for (sb = reactor_pending; sb; sb = sb->nextop) {
+			if (sb->action == 5 && sb->deadline > 0) {
+				int ms = sb->deadline <= now ? 0 : (int)((sb->deadline - now + 999) / 1000);
+				if (timeout < 0 || ms < timeout)
+					timeout = ms;
+			}
+		}
+
+		reactor_wait (timeout);
 
-		case 7: {
-			struct hostent* tmphostent = gethostbyaddr(get_real_address(sb->name), sb->a_addrlen, sb->flags);
+		/* a base may show up once per fired descriptor, retrying twice is harmless */
+		for (int i = 0; i < reactor_readycount; i++)
+			reactor_retry (reactor_ready[i]);
 
-			if (tmphostent) {
-				copyHostent(ctx, tmphostent, sb);
-				bsdsocklib_setherrno(ctx, sb, 0);
+		char buf[64];
+		while (read (reactor_wake[0], buf, sizeof buf) > 0);
+		for (sb = reactor_take (); sb; sb = next) {
+			next = sb->nextsubmit;
+			reactor_start (sb);
+		}
+
+		now = reactor_time ();
+		for (sb = reactor_pending; sb; sb = next) {
+			next = sb->nextop;
+			if (sb->action == 5 && sb->deadline > 0 && sb->deadline <= now) {
+				/* Timeout. I think we're supposed to clear the sets.. */
+				for (int i = 0; i < sb->pfdcount; i++)
+					sb->pfd[i].revents = 0;
+				reactor_waitselect_done (sb, 0);
 			}
-			else
-				SETHERRNO;
+		}
+	}
 
-			break;
+	write_log("THREAD_END\n");
+	return 0;
+}
+
+static int resolver_threadfunc (void *arg)
+{
+	for (;;) {
+		uae_sem_wait (&resolver_sem);
+
+		uae_sem_wait (&reactor_lock);
+		SB = resolver_queue;
+		if (sb) {
+			resolver_queue = sb->nextop;
+			sb->nextop = NULL;
+			resolver_busy = sb;
+		}
+		uae_sem_post (&reactor_lock);
+		if (!sb) {
+			if (reactor_quit)
+				break;
+			continue;
 		}
+
+		TrapContext* ctx = sb->context;  // FIXME: Correct?
+		struct hostent* tmphostent;
+
+		if (sb->action == 4)
+			tmphostent = gethostbyname((char*)get_real_address(sb->name));
+		else
+			tmphostent = gethostbyaddr(get_real_address(sb->name), sb->a_addrlen, sb->flags);
+
+		if (tmphostent) {
+			copyHostent(ctx, tmphostent, sb);
+			bsdsocklib_setherrno(ctx, sb, 0);
 		}
+		else
+			SETHERRNO;
+
 		SETERRNO;
 		SETSIGNAL;
+
+		uae_sem_wait (&reactor_lock);
+		resolver_busy = NULL;
+		if (sb->deferred) {
+			sb->deferred = 0;
+			sb->submitted = 1;
+			sb->nextsubmit = reactor_queue;
+			reactor_queue = sb;
+			reactor_wakeup ();
+		}
+		uae_sem_post (&reactor_lock);
 	}
-	return 0;        /* Just to keep GCC happy.. */
+	return 0;
 }
 
-void clearsockabort(SB)
+/* Hand the operation described by the sb fields to the reactor */
+static void reactor_submit (SB)
 {
-	int chr;
-	int num;
+	uae_sem_wait (&reactor_lock);
+	if (!sb->submitted) {
+		sb->submitted = 1;
+		sb->nextsubmit = reactor_queue;
+		reactor_queue = sb;
+	}
+	uae_sem_post (&reactor_lock);
+	reactor_wakeup ();
+}
 
-	while ((num = read(sb->sockabort[0], &chr, sizeof(chr))) >= 0) {
-		write_log("Sockabort got %d bytes\n", num);
+static bool reactor_init (void)
+{
+	if (reactor_running)
+		return true;
+	if (pipe (reactor_wake) < 0)
+		return false;
+	fcntl (reactor_wake[0], F_SETFL, O_NONBLOCK);
+	fcntl (reactor_wake[1], F_SETFL, O_NONBLOCK);
+#ifdef __linux__
+	reactor_epfd = epoll_create1 (EPOLL_CLOEXEC);
+	if (reactor_epfd >= 0) {
+		struct epoll_event ev {};
+		ev.events = EPOLLIN;
+		ev.data.fd = reactor_wake[0];
+		epoll_ctl (reactor_epfd, EPOLL_CTL_ADD, reactor_wake[0], &ev);
+	}
+	if (reactor_epfd < 0) {
+		write_log ("BSDSOCK: epoll_create failed %d\n", errno);
+		close (reactor_wake[0]);
+		close (reactor_wake[1]);
+		return false;
 	}
+#endif
+	uae_sem_init (&reactor_lock, 0, 1);
+	uae_sem_init (&resolver_sem, 0, 0);
+	reactor_quit = false;
+	reactor_pending = NULL;
+	reactor_queue = resolver_queue = resolver_busy = NULL;
+	if (uae_start_thread ("bsdsocket", reactor_threadfunc, NULL, &reactor_thread) == BAD_THREAD ||
+		uae_start_thread ("bsdsocket resolver", resolver_threadfunc, NULL, &resolver_thread) == BAD_THREAD) {
+		write_log ("BSDSOCK: Failed to create thread.\n");
+		reactor_quit = true;
+		if (reactor_thread) {
+			reactor_wakeup ();
+			uae_wait_thread (&reactor_thread);
+			reactor_thread = BAD_THREAD;
+		}
+#ifdef __linux__
+		close (reactor_epfd);
+		reactor_epfd = -1;
+#endif
+		close (reactor_wake[0]);
+		close (reactor_wake[1]);
+		uae_sem_destroy (&resolver_sem);
+		uae_sem_destroy (&reactor_lock);
+		return false;
+	}
+	reactor_running = true;
+	return true;
+}
+
+static void reactor_free (void)
+{
+	if (!reactor_running)
+		return;
+	reactor_quit = true;
+	reactor_wakeup ();
+	uae_sem_post (&resolver_sem);
+	/* the resolver may still be blocked in a lookup */
+	uae_wait_thread (&reactor_thread);
+	uae_wait_thread (&resolver_thread);
+	reactor_thread = resolver_thread = BAD_THREAD;
+	xfree (reactor_ready);
+	reactor_ready = NULL;
+	reactor_readycount = reactor_readyalloc = 0;
+#ifdef __linux__
+	close (reactor_epfd);
+	reactor_epfd = -1;
+	xfree (reactor_watches);
+	reactor_watches = NULL;
+	reactor_watchalloc = 0;
+#else
+	xfree (reactor_pfd);
+	xfree (reactor_pfdsb);
+	reactor_pfd = NULL;
+	reactor_pfdsb = NULL;
+	reactor_pfdalloc = 0;
+#endif
+	close (reactor_wake[0]);
+	close (reactor_wake[1]);
+	reactor_wake[0] = reactor_wake[1] = -1;
+	uae_sem_destroy (&resolver_sem);
+	uae_sem_destroy (&reactor_lock);
+	reactor_running = false;
 }
 
 int init_socket_layer(void)
@@ -861,6 +1485,7 @@ void unlocksigqueue(void)
 int host_sbinit (TrapContext *ctx, SB)
 {
 	if (pipe (sb->sockabort) < 0) {
+		sb->sockabort[0] = sb->sockabort[1] = -1;
 		return 0;
 	}
 
@@ -872,6 +1497,7 @@ int host_sbinit (TrapContext *ctx, SB)
 		write_log ("BSDSOCK: Failed to create semaphore.\n");
 		close (sb->sockabort[0]);
 		close (sb->sockabort[1]);
+		sb->sockabort[0] = sb->sockabort[1] = -1;
 		return 0;
 	}
 
@@ -879,12 +1505,11 @@ int host_sbinit (TrapContext *ctx, SB)
 	sb->hostent = uae_AllocMem (ctx, 1024, 0, sb->sysbase);
 	sb->hostentsize = 1024;
 
-	/* @@@ The thread should be PTHREAD_CREATE_DETACHED */
-	if (uae_start_thread ("bsdsocket", bsdlib_threadfunc, (void *)sb, &sb->thread) == BAD_THREAD) {
-		write_log ("BSDSOCK: Failed to create thread.\n");
+	if (!reactor_init ()) {
 		uae_sem_destroy (&sb->sem);
 		close (sb->sockabort[0]);
 		close (sb->sockabort[1]);
+		sb->sockabort[0] = sb->sockabort[1] = -1;
 		return 0;
 	}
 	return 1;
@@ -897,6 +1522,7 @@ void host_closesocketquick (int s)
 	l.l_linger = 0;
 	if(s != -1) {
 		setsockopt (s, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+		reactor_forget (s);
 		close (s);
 	}
 }
@@ -909,29 +1535,35 @@ void host_sbcleanup (SB)
 		return;
 	}
 
-	uae_thread_id thread = sb->thread;
-	close (sb->sockabort[0]);
-	close (sb->sockabort[1]);
+	if (sb->sockabort[0] >= 0) {
+		/* the reactor may still hold an aborted operation of this base */
+		sb->action = 0;
+		reactor_submit (sb);
+		uae_sem_wait (&sb->sem);
+		uae_sem_destroy (&sb->sem);
+		reactor_forget (sb->sockabort[0]);
+		close (sb->sockabort[0]);
+		close (sb->sockabort[1]);
+		sb->sockabort[0] = sb->sockabort[1] = -1;
+	}
 	for (i = 0; i < sb->dtablesize; i++) {
 		if (sb->dtable[i] != -1) {
+			reactor_forget (sb->dtable[i]);
 			close(sb->dtable[i]);
 		}
 	}
-	sb->action = 0;
-
-	uae_sem_post (&sb->sem); /* destroy happens on socket thread */
-
-	/* We need to join with the socket thread to allow the thread to die
-	 * and clean up resources when the underlying thread layer is pthreads.
-	 * Ideally, this shouldn't be necessary, but, for example, when SDL uses
-	 * pthreads, it always creates joinable threads - and we can't do anything
-	 * about that. */
-	uae_wait_thread (&thread);
+	xfree (sb->pfd);
+	xfree (sb->pfdsd);
+	xfree (sb->pfdw);
+	sb->pfd = NULL;
+	sb->pfdsd = NULL;
+	sb->pfdw = NULL;
+	sb->pfdalloc = sb->pfdcount = 0;
 }
 
 void host_sbreset (void)
 {
-	//STUB("");
+	reactor_free ();
 }
 
 void sockabort (SB)
@@ -958,6 +1590,7 @@ int host_dup2socket(TrapContext *ctx, SB, int fd1, int fd2)
 			fd2++;
 			s2 = getsock(ctx, sb, fd2);
 			if (s2 != -1) {
+				reactor_forget (s2);
 				close (s2);
 			}
 			setsd (ctx, sb, fd2, dup (s1));
@@ -1064,7 +1697,7 @@ void host_accept(TrapContext *ctx, SB, uae_u32 sd, uae_u32 name, uae_u32 namelen
 	// used by bsdthr_Accept_2
 	sb->context = ctx;
 
-	uae_sem_post (&sb->sem);
+	reactor_submit (sb);
 
 	WAITSIGNAL;
 	write_log("Accept returns %d\n", sb->resultval);
@@ -1093,7 +1726,7 @@ void host_connect(TrapContext *ctx, SB, uae_u32 sd, uae_u32 name, uae_u32 namele
 			sb->a_addrlen = namelen;
 			sb->action    = 1;
 
-			uae_sem_post (&sb->sem);
+			reactor_submit (sb);
 
 			WAITSIGNAL;
 		} else {
@@ -1135,7 +1768,7 @@ void host_sendto (TrapContext *ctx, SB, uae_u32 sd, uae_u32 msg, uae_u8 *hmsg, u
 		sb->tolen  = tolen;
 		sb->action = 2;
 
-		uae_sem_post (&sb->sem);
+		reactor_submit (sb);
 
 		WAITSIGNAL;
 
@@ -1179,7 +1812,7 @@ void host_recvfrom(TrapContext *ctx, SB, uae_u32 sd, uae_u32 msg, uae_u8 *hmsg,
 	sb->fromlen= addrlen;
 	sb->action = 3;
 
-	uae_sem_post (&sb->sem);
+	reactor_submit (sb);
 
 	WAITSIGNAL;
 }
@@ -1454,108 +2087,13 @@ int host_CloseSocket(TrapContext *ctx, SB, int sd)
 	}
 	*/
 	write_log("CloseSocket Amiga: %d, NativeSide %d\n", sd, s);
+	reactor_forget (s);
 	retval = close (s);
 	SETERRNO;
 	releasesock (ctx, sb, sd + 1);
 	return retval;
 }
 
-static void fd_zero(TrapContext *ctx, uae_u32 fdset, uae_u32 nfds)
-{
-	unsigned int i;
-	for (i = 0; i < nfds; i += 32, fdset += 4)
-		trap_put_long(ctx, fdset,0);
-}
-
-uae_u32 bsdthr_WaitSelect(SB)
-{
-	fd_set sets[3];
-	int i, s, set, a_s, max;
-	uae_u32 a_set;
-	struct timeval tv {};
-	int r;
-	TrapContext* ctx = NULL;  // FIXME: Correct?
-
-	write_log("WaitSelect: %d 0x%x 0x%x 0x%x 0x%x 0x%x\n", sb->nfds, sb->sets[0], sb->sets[1], sb->sets[2], sb->timeout, sb->sigmp);
-
-	if (sb->timeout)
-		write_log("WaitSelect: timeout %d %d\n", get_long(sb->timeout), get_long(sb->timeout + 4));
-
-	FD_ZERO(&sets[0]);
-	FD_ZERO(&sets[1]);
-	FD_ZERO(&sets[2]);
-
-	/* Set up the abort socket */
-	FD_SET(sb->sockabort[0], &sets[0]);
-	FD_SET(sb->sockabort[0], &sets[2]);
-	max = sb->sockabort[0];
-
-	for (set = 0; set < 3; set++) {
-		if (sb->sets[set] != 0) {
-			a_set = sb->sets[set];
-			for (i = 0; i < sb->nfds; i++) {
-				if (bsd_amigaside_FD_ISSET(i, a_set)) {
-					s = getsock(ctx, sb, i + 1);
-					write_log("WaitSelect: AmigaSide %d set. NativeSide %d.\n", i, s);
-					if (s == -1) {
-						write_log("BSDSOCK: WaitSelect() called with invalid descriptor %d in set %d.\n", i, set);
-					} else {
-						FD_SET(s, &sets[set]);
-						if (max < s) max = s;
-					}
-				}
-			}
-		}
-	}
-
-	max++;
-
-	if (sb->timeout) {
-		tv.tv_sec = get_long(sb->timeout);
-		tv.tv_usec = get_long(sb->timeout + 4);
-	}
-
-	write_log("Select going to select\n");
-	r = select(max, &sets[0], &sets[1], &sets[2], (sb->timeout == 0) ? NULL : &tv);
-	write_log("Select returns %d, errno is %d\n", r, errno);
-	if (r > 0) {
-		/* Socket told us to abort */
-		if (FD_ISSET(sb->sockabort[0], &sets[0])) {
-			/* read from the pipe to reset it */
-			write_log("WaitSelect aborted from signal\n");
-			r = 0;
-			for (set = 0; set < 3; set++)
-				if (sb->sets[set] != 0)
-					bsd_amigaside_FD_ZERO(sb->sets[set]);
-			clearsockabort(sb);
-		}
-		else
-			/* This is perhaps slightly inefficient, but I don't care.. */
-			for (set = 0; set < 3; set++) {
-				a_set = sb->sets[set];
-				if (a_set != 0) {
-					bsd_amigaside_FD_ZERO(a_set);
-					for (i = 0; i < sb->nfds; i++) {
-						a_s = getsock(ctx, sb, i + 1);
-						if (a_s != -1) {
-							if (FD_ISSET(a_s, &sets[set])) {
-								write_log("WaitSelect: NativeSide %d set. AmigaSide %d.\n", a_s, i);
-
-								bsd_amigaside_FD_SET(i, a_set);
-							}
-						}
-					}
-				}
-			}
-	} else if (r == 0) {         /* Timeout. I think we're supposed to clear the sets.. */
-		for (set = 0; set < 3; set++)
-			if (sb->sets[set] != 0)
-				bsd_amigaside_FD_ZERO(sb->sets[set]);
-	}
-	write_log("WaitSelect: r=%d errno=%d\n", r, errno);
-	return r;
-}
-
 void host_WaitSelect(TrapContext *ctx, SB, uae_u32 nfds, uae_u32 readfds, uae_u32 writefds, uae_u32 exceptfds, uae_u32 timeout, uae_u32 sigmp)
 {
 	uae_u32 wssigs = (sigmp) ? trap_get_long(ctx, sigmp) : 0;
@@ -1606,7 +2144,7 @@ void host_WaitSelect(TrapContext *ctx, SB, uae_u32 nfds, uae_u32 readfds, uae_u3
 	sb->sigmp    = wssigs;
 	sb->action   = 5;
 
-	uae_sem_post (&sb->sem);
+	reactor_submit (sb);
 
 	trap_call_add_dreg(ctx, 0, (((uae_u32)1) << sb->signal) | sb->eintrsigs | wssigs);
 	sigs = trap_call_lib(ctx, sb->sysbase, -0x13e);	// Wait()
@@ -1691,7 +2229,7 @@ void host_gethostbynameaddr (TrapContext *ctx, SB, uae_u32 name, uae_u32 namelen
 	else
 		sb->action = 7;
 
-	uae_sem_post (&sb->sem);
+	reactor_submit (sb);
 
 	WAITSIGNAL;
 }
@@ -214,27 +214,589 @@ int fsdb_mode_supported(const a_inode* aino)
 	return mask;
 }
 
+static void fill_file_attrs_stat(a_inode* aino, const struct stat* statbuf)
+{
+	aino->dir = S_ISDIR(statbuf->st_mode) ? 1 : 0;
+	aino->amigaos_mode = ((S_IXUSR & statbuf->st_mode ? 0 : A_FIBF_EXECUTE)
+		| (S_IWUSR & statbuf->st_mode ? 0 : A_FIBF_WRITE)
+		| (S_IRUSR & statbuf->st_mode ? 0 : A_FIBF_READ));
+
+#if defined(AMIBERRY)
+	// Always give execute & read permission
+	// Temporary do this for raspberry...
+	aino->amigaos_mode &= ~A_FIBF_EXECUTE;
+	aino->amigaos_mode &= ~A_FIBF_READ;
+#endif
+}
+
+/* Directory metadata cache.
+ *
+ * Names of a directory are read once and kept in a hash table, stat data
+ * and the _UAEFSDB.___ records are loaded on first use. An inotify watch
+ * on each cached directory keeps the cache coherent: events update the
+ * entries and also feed AmigaDOS notifications. Directory entries are
+ * not stat cached, their timestamps change without an event in the parent.
+ * The same host directory can be cached through several a_inodes, they
+ * share the inotify watch, which is removed with the last of them.
+ */
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+#define DIRCACHE_MAX 32
+/* deleted entries kept before the table is compacted */
+#define DIRCACHE_GONE_MIN 64
+#define DIRCACHE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE)
+
+struct fsdb_dircache_entry
+{
+	TCHAR* name;
+	int hnext;
+	bool gone;
+	bool stat_valid;
+	bool stat_ok;
+	struct stat st;
+};
+
+struct fsdb_dircache
+{
+	struct fsdb_dircache *next, *prev;
+	struct fsdb_dircache_set* set;
+	a_inode* dir;
+	int wd;
+	int pins;
+	bool loaded;
+	struct fsdb_dircache_entry* entries;
+	int num, alloc, gone;
+	int* hash;
+	int hashsize;
+	uae_u8* records;
+	int numrecords;
+	bool records_valid;
+};
+
+struct fsdb_dircache_set
+{
+	int fd;
+	struct fsdb_dircache* first;
+	int count;
+};
+
+/* case insensitive, like fsdb_search_dir () matches */
+static unsigned int dircache_hash(const TCHAR* name)
+{
+	unsigned int h = 2166136261u;
+	for (const uae_u8* p = (const uae_u8*)name; *p; p++) {
+		h ^= tolower(*p);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void dircache_clear(struct fsdb_dircache* c)
+{
+	for (int i = 0; i < c->num; i++)
+		xfree(c->entries[i].name);
+	xfree(c->entries);
+	xfree(c->hash);
+	xfree(c->records);
+	c->entries = NULL;
+	c->hash = NULL;
+	c->records = NULL;
+	c->num = c->alloc = c->gone = c->hashsize = c->numrecords = 0;
+	c->records_valid = false;
+	c->loaded = false;
+}
+
+static void dircache_unlink(struct fsdb_dircache* c)
+{
+	struct fsdb_dircache_set* set = c->set;
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		set->first = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	c->next = c->prev = NULL;
+}
+
+static bool dircache_watch_shared(struct fsdb_dircache* c)
+{
+	for (struct fsdb_dircache* c2 = c->set->first; c2; c2 = c2->next) {
+		if (c2 != c && c2->wd == c->wd)
+			return true;
+	}
+	return false;
+}
+
+static void dircache_destroy(struct fsdb_dircache* c, bool rmwatch)
+{
+	if (rmwatch && c->wd >= 0 && !dircache_watch_shared(c))
+		inotify_rm_watch(c->set->fd, c->wd);
+	dircache_unlink(c);
+	c->set->count--;
+	if (c->dir)
+		c->dir->dircache = NULL;
+	dircache_clear(c);
+	xfree(c);
+}
+
+static void dircache_rehash(struct fsdb_dircache* c, int size)
+{
+	xfree(c->hash);
+	c->hash = xmalloc(int, size);
+	c->hashsize = size;
+	for (int i = 0; i < size; i++)
+		c->hash[i] = -1;
+	for (int i = 0; i < c->num; i++) {
+		int h = dircache_hash(c->entries[i].name) & (size - 1);
+		c->entries[i].hnext = c->hash[h];
+		c->hash[h] = i;
+	}
+}
+
+static struct fsdb_dircache_entry* dircache_find(struct fsdb_dircache* c, const TCHAR* name)
+{
+	if (!c->hashsize)
+		return NULL;
+	for (int i = c->hash[dircache_hash(name) & (c->hashsize - 1)]; i >= 0; i = c->entries[i].hnext) {
+		if (!_tcscmp(c->entries[i].name, name))
+			return &c->entries[i];
+	}
+	return NULL;
+}
+
+/* Drop deleted entries. Entry indexes change, so not while a directory
+ * scan, which pins the cache, is walking them. */
+static void dircache_compact(struct fsdb_dircache* c)
+{
+	if (c->pins || !c->gone)
+		return;
+	int n = 0;
+	for (int i = 0; i < c->num; i++) {
+		if (c->entries[i].gone)
+			xfree(c->entries[i].name);
+		else
+			c->entries[n++] = c->entries[i];
+	}
+	c->num = n;
+	c->gone = 0;
+	dircache_rehash(c, c->hashsize);
+}
+
+static void dircache_remove(struct fsdb_dircache* c, struct fsdb_dircache_entry* e)
+{
+	if (e->gone)
+		return;
+	e->gone = true;
+	c->gone++;
+	if (c->gone >= DIRCACHE_GONE_MIN && c->gone * 2 >= c->num)
+		dircache_compact(c);
+}
+
+static struct fsdb_dircache_entry* dircache_add(struct fsdb_dircache* c, const TCHAR* name)
+{
+	struct fsdb_dircache_entry* e = dircache_find(c, name);
+	if (e) {
+		if (e->gone)
+			c->gone--;
+		e->gone = false;
+		e->stat_valid = false;
+		return e;
+	}
+	// reuse the space of deleted entries before growing
+	if (c->num >= c->alloc)
+		dircache_compact(c);
+	if (c->num >= c->alloc) {
+		int alloc = c->alloc ? c->alloc * 2 : 64;
+		c->entries = xrealloc(struct fsdb_dircache_entry, c->entries, alloc);
+		c->alloc = alloc;
+	}
+	e = &c->entries[c->num++];
+	memset(e, 0, sizeof(struct fsdb_dircache_entry));
+	e->name = my_strdup(name);
+	if (c->num > c->hashsize) {
+		dircache_rehash(c, c->hashsize ? c->hashsize * 2 : 64);
+	} else {
+		int h = dircache_hash(name) & (c->hashsize - 1);
+		e->hnext = c->hash[h];
+		c->hash[h] = c->num - 1;
+	}
+	return e;
+}
+
+static bool dircache_read(struct fsdb_dircache* c)
+{
+	TCHAR fn[MAX_DPATH];
+	struct my_opendir_s* od = my_opendir(c->dir->nname);
+	if (!od)
+		return false;
+	while (my_readdir(od, fn))
+		dircache_add(c, fn);
+	my_closedir(od);
+	c->loaded = true;
+	return true;
+}
+
+static struct fsdb_dircache* dircache_get(a_inode* dir)
+{
+	struct fsdb_dircache* c = dir ? dir->dircache : NULL;
+	return c && c->loaded ? c : NULL;
+}
+
+static struct fsdb_dircache_entry* dircache_entry(a_inode* dir, a_inode* aino)
+{
+	struct fsdb_dircache* c = dircache_get(dir);
+	if (!c)
+		return NULL;
+	struct fsdb_dircache_entry* e = dircache_find(c, nname_begin(aino->nname));
+	if (!e || e->gone)
+		return NULL;
+	if (!e->stat_valid) {
+		const auto output = iso_8859_1_to_utf8(string(aino->nname));
+		e->stat_ok = stat(output.c_str(), &e->st) == 0;
+		e->stat_valid = e->stat_ok && !S_ISDIR(e->st.st_mode);
+	}
+	return e;
+}
+
+struct fsdb_dircache_set* fsdb_dircache_open(void)
+{
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		write_log(_T("FSDB: inotify not available (%d), directory cache disabled\n"), errno);
+		return NULL;
+	}
+	struct fsdb_dircache_set* set = xcalloc(struct fsdb_dircache_set, 1);
+	set->fd = fd;
+	return set;
+}
+
+void fsdb_dircache_flush(struct fsdb_dircache_set* set)
+{
+	if (!set)
+		return;
+	while (set->first)
+		dircache_destroy(set->first, true);
+}
+
+void fsdb_dircache_close(struct fsdb_dircache_set* set)
+{
+	if (!set)
+		return;
+	fsdb_dircache_flush(set);
+	close(set->fd);
+	xfree(set);
+}
+
+bool fsdb_dircache_load(struct fsdb_dircache_set* set, a_inode* dir)
+{
+	struct fsdb_dircache* c = dir->dircache;
+
+	if (!set || !dir->nname)
+		return false;
+	if (c) {
+		if (c != set->first) {
+			dircache_unlink(c);
+			c->next = set->first;
+			set->first->prev = c;
+			set->first = c;
+		}
+		return c->loaded || dircache_read(c);
+	}
+
+	const auto output = iso_8859_1_to_utf8(string(dir->nname));
+	// same host directory through another a_inode returns the same wd
+	int wd = inotify_add_watch(set->fd, output.c_str(), DIRCACHE_EVENTS | IN_ONLYDIR);
+	if (wd < 0)
+		return false;
+	int unpinned = 0;
+	struct fsdb_dircache* last = NULL;
+	for (c = set->first; c; c = c->next) {
+		if (!c->pins) {
+			unpinned++;
+			last = c;
+		}
+	}
+	if (unpinned >= DIRCACHE_MAX)
+		dircache_destroy(last, true);
+
+	c = xcalloc(struct fsdb_dircache, 1);
+	c->set = set;
+	c->dir = dir;
+	c->wd = wd;
+	c->next = set->first;
+	if (set->first)
+		set->first->prev = c;
+	set->first = c;
+	set->count++;
+	dir->dircache = c;
+	return dircache_read(c);
+}
+
+void fsdb_dircache_free(a_inode* dir)
+{
+	if (dir->dircache)
+		dircache_destroy(dir->dircache, true);
+}
+
+void fsdb_dircache_move(a_inode* from, a_inode* to)
+{
+	fsdb_dircache_free(to);
+	to->dircache = from->dircache;
+	from->dircache = NULL;
+	if (to->dircache)
+		to->dircache->dir = to;
+}
+
+void fsdb_dircache_pin(a_inode* dir, bool pin)
+{
+	struct fsdb_dircache* c = dir->dircache;
+	if (!c)
+		return;
+	if (pin)
+		c->pins++;
+	else if (c->pins > 0 && !--c->pins && c->gone >= DIRCACHE_GONE_MIN && c->gone * 2 >= c->num)
+		dircache_compact(c);
+}
+
+void fsdb_dircache_records_changed(a_inode* dir)
+{
+	if (dir->dircache)
+		dir->dircache->records_valid = false;
+}
+
+void fsdb_dircache_poll(struct fsdb_dircache_set* set, fsdb_dircache_func changed, void* ud)
+{
+	alignas(struct inotify_event) char buf[4096];
+
+	if (!set)
+		return;
+	for (;;) {
+		const ssize_t len = read(set->fd, buf, sizeof buf);
+		if (len <= 0)
+			break;
+		const struct inotify_event* ev;
+		std::vector<a_inode*> dirs;
+		for (const char* p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event*)p;
+			struct fsdb_dircache *c, *next;
+			dirs.clear();
+			if (ev->mask & IN_Q_OVERFLOW) {
+				// anything may have changed, the callback can load or evict caches
+				write_log(_T("FSDB: inotify queue overflow\n"));
+				for (c = set->first; c; c = c->next) {
+					dircache_clear(c);
+					dirs.push_back(c->dir);
+				}
+				if (changed) {
+					for (auto* dir : dirs)
+						changed(ud, dir, NULL);
+				}
+				continue;
+			}
+			if (ev->mask & IN_IGNORED) {
+				for (c = set->first; c; c = next) {
+					next = c->next;
+					if (c->wd == ev->wd) {
+						c->wd = -1;
+						dircache_destroy(c, false);
+					}
+				}
+				continue;
+			}
+			if (!ev->len || !ev->name[0])
+				continue;
+			bool records = !strcmp(ev->name, FSDB_FILE);
+			if (!records && my_readdir_ignored(ev->name))
+				continue;
+			string input = ev->name, name;
+			utf8_to_latin1_string(input, name);
+			for (c = set->first; c; c = c->next) {
+				if (c->wd != ev->wd)
+					continue;
+				if (records) {
+					c->records_valid = false;
+					continue;
+				}
+				if (c->loaded) {
+					if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+						dircache_add(c, name.c_str());
+					} else {
+						struct fsdb_dircache_entry* e = dircache_find(c, name.c_str());
+						if (e) {
+							e->stat_valid = false;
+							if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+								dircache_remove(c, e);
+						}
+					}
+				}
+				dirs.push_back(c->dir);
+			}
+			// plain writes are reported when the file is closed
+			if (changed && !(ev->mask & IN_MODIFY)) {
+				for (auto* dir : dirs)
+					changed(ud, dir, name.c_str());
+			}
+		}
+	}
+}
+
+int fsdb_dircache_readdir(a_inode* dir, int* idx, TCHAR* fn)
+{
+	struct fsdb_dircache* c = dircache_get(dir);
+	if (!c)
+		return -1;
+	while (*idx < c->num) {
+		struct fsdb_dircache_entry* e = &c->entries[(*idx)++];
+		if (!e->gone) {
+			_tcscpy(fn, e->name);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int fsdb_dircache_search(a_inode* dir, TCHAR* rel, TCHAR** found)
+{
+	struct fsdb_dircache* c = dircache_get(dir);
+	if (!c)
+		return -1;
+	*found = NULL;
+	if (!c->hashsize)
+		return 0;
+	struct fsdb_dircache_entry* nocase = NULL;
+	for (int i = c->hash[dircache_hash(rel) & (c->hashsize - 1)]; i >= 0; i = c->entries[i].hnext) {
+		struct fsdb_dircache_entry* e = &c->entries[i];
+		if (e->gone)
+			continue;
+		if (!_tcscmp(e->name, rel)) {
+			*found = rel;
+			return 0;
+		}
+		if (!nocase && !stricmp(e->name, rel))
+			nocase = e;
+	}
+	if (nocase)
+		*found = my_strdup(nocase->name);
+	return 0;
+}
+
+int fsdb_dircache_stat(a_inode* aino, struct mystat* ms)
+{
+	struct fsdb_dircache_entry* e = dircache_entry(aino->parent, aino);
+	if (!e)
+		return -1;
+	if (!e->stat_ok)
+		return 0;
+	memset(ms, 0, sizeof(struct mystat));
+	ms->size = e->st.st_size;
+	ms->mode = ((e->st.st_mode & S_IRUSR) ? FILEFLAG_READ : 0) |
+		((e->st.st_mode & S_IWUSR) ? FILEFLAG_WRITE : 0);
+	ms->mtime.tv_sec = e->st.st_mtime;
+	ms->mtime.tv_usec = 0;
+	return 1;
+}
+
+const uae_u8* fsdb_dircache_records(a_inode* dir, int* count)
+{
+	struct fsdb_dircache* c = dircache_get(dir);
+	if (!c)
+		return NULL;
+	if (!c->records_valid) {
+		xfree(c->records);
+		c->records = NULL;
+		c->numrecords = 0;
+		TCHAR* n = build_nname(dir->nname, FSDB_FILE);
+		FILE* f = uae_tfopen(n, _T("rb"));
+		xfree(n);
+		if (f) {
+			fseek(f, 0, SEEK_END);
+			long size = ftell(f);
+			fseek(f, 0, SEEK_SET);
+			int num = size / FSDB_RECORD_SIZE;
+			if (num > 0) {
+				c->records = xmalloc(uae_u8, num * FSDB_RECORD_SIZE);
+				c->numrecords = fread(c->records, FSDB_RECORD_SIZE, num, f);
+			}
+			fclose(f);
+		}
+		c->records_valid = true;
+	}
+	*count = c->numrecords;
+	return c->records ? c->records : (const uae_u8*)"";
+}
+
+static int fill_file_attrs_cached(a_inode* base, a_inode* aino)
+{
+	struct fsdb_dircache_entry* e = dircache_entry(base, aino);
+	if (!e)
+		return -1;
+	if (!e->stat_ok)
+		return 0;
+	fill_file_attrs_stat(aino, &e->st);
+	return 1;
+}
+
+#else
+
+struct fsdb_dircache_set* fsdb_dircache_open(void)
+{
+	return NULL;
+}
+void fsdb_dircache_close(struct fsdb_dircache_set*) {}
+void fsdb_dircache_flush(struct fsdb_dircache_set*) {}
+void fsdb_dircache_poll(struct fsdb_dircache_set*, fsdb_dircache_func, void*) {}
+bool fsdb_dircache_load(struct fsdb_dircache_set*, a_inode*)
+{
+	return false;
+}
+void fsdb_dircache_free(a_inode*) {}
+void fsdb_dircache_move(a_inode*, a_inode*) {}
+void fsdb_dircache_pin(a_inode*, bool) {}
+void fsdb_dircache_records_changed(a_inode*) {}
+int fsdb_dircache_readdir(a_inode*, int*, TCHAR*)
+{
+	return -1;
+}
+int fsdb_dircache_search(a_inode*, TCHAR*, TCHAR**)
+{
+	return -1;
+}
+int fsdb_dircache_stat(a_inode*, struct mystat*)
+{
+	return -1;
+}
+const uae_u8* fsdb_dircache_records(a_inode*, int*)
+{
+	return NULL;
+}
+static int fill_file_attrs_cached(a_inode*, a_inode*)
+{
+	return -1;
+}
+
+#endif
+
 /* For an a_inode we have newly created based on a filename we found on the
  * native fs, fill in information about this file/directory.  */
 int fsdb_fill_file_attrs(a_inode* base, a_inode* aino)
 {
 	struct stat statbuf {};
+
+	const int ret = fill_file_attrs_cached(base, aino);
+	if (ret >= 0)
+		return ret;
 	/* This really shouldn't happen...  */
 	const auto output = iso_8859_1_to_utf8(string(aino->nname));
 
 	if (stat(output.c_str(), &statbuf) == -1)
 		return 0;
-	aino->dir = S_ISDIR(statbuf.st_mode) ? 1 : 0;
-	aino->amigaos_mode = ((S_IXUSR & statbuf.st_mode ? 0 : A_FIBF_EXECUTE)
-		| (S_IWUSR & statbuf.st_mode ? 0 : A_FIBF_WRITE)
-		| (S_IRUSR & statbuf.st_mode ? 0 : A_FIBF_READ));
-
-#if defined(AMIBERRY)
-	// Always give execute & read permission
-	// Temporary do this for raspberry...
-	aino->amigaos_mode &= ~A_FIBF_EXECUTE;
-	aino->amigaos_mode &= ~A_FIBF_READ;
-#endif
+	fill_file_attrs_stat(aino, &statbuf);
 	return 1;
 }
 
@@ -8,9 +8,6 @@
 #include <mpg123.h>
 
 
-#define MP3_BLOCK_SIZE 522
-#define RAW_BLOCK_SIZE 32768
-
 static int mp3_bitrates[] = {
 	0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, -1,
 	0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, -1,
@@ -29,32 +26,39 @@ static int mp3_samplesperframe[] = {
 	1152, 576, 576
 };
 
+static ssize_t mp3_read_callback(void* handle, void* buf, size_t size)
+{
+	return zfile_fread(buf, 1, size, static_cast<struct zfile*>(handle));
+}
+
+static off_t mp3_lseek_callback(void* handle, off_t offset, int whence)
+{
+	auto* zf = static_cast<struct zfile*>(handle);
+	if (zfile_fseek(zf, offset, whence) < 0)
+		return -1;
+	return static_cast<off_t>(zfile_ftell(zf));
+}
+
 mp3decoder::~mp3decoder()
-= default;
+{
+	close();
+}
 
 mp3decoder::mp3decoder()
 = default;
 
-uae_u8* mp3decoder::get(struct zfile* zf, uae_u8* outbuf, int maxsize)
-{
-	int outoffset = 0;
-	unsigned char mp3buf[MP3_BLOCK_SIZE];
-	unsigned char rawbuf[RAW_BLOCK_SIZE];
+#define MP3_PCM_FRAMES 4608
 
-	write_log(_T("MP3: decoding '%s'..\n"), zfile_getname(zf));
+// Open zf for streaming decode. Output is always 44100Hz 16-bit stereo,
+// other rates and mono streams are converted in read().
+bool mp3decoder::open(struct zfile* zf)
+{
+	close();
 
 	if (mpg123_init() != MPG123_OK)
 	{
 		write_log("MP3: failed to init mpeg123\n");
-		return nullptr;
-	}
-
-	const char** decoders = mpg123_decoders();
-	if (decoders == nullptr || decoders[0] == nullptr)
-	{
-		write_log("MP3: no mp3 decoder available\n");
-		mpg123_exit();
-		return nullptr;
+		return false;
 	}
 
 	mpg123_handle* mh = mpg123_new(nullptr, nullptr); // Open default decoder
@@ -62,56 +66,166 @@ uae_u8* mp3decoder::get(struct zfile* zf, uae_u8* outbuf, int maxsize)
 	{
 		write_log("MP3: failed to init default decoder\n");
 		mpg123_exit();
-		return nullptr;
+		return false;
 	}
 
-	if (mpg123_open_feed(mh) == MPG123_OK)
+	// keep the native rate and channel count, only ask for 16-bit samples
+	const long* rates;
+	size_t ratecount;
+	mpg123_rates(&rates, &ratecount);
+	mpg123_format_none(mh);
+	for (size_t i = 0; i < ratecount; i++)
+		mpg123_format(mh, rates[i], MPG123_MONO | MPG123_STEREO, MPG123_ENC_SIGNED_16);
+	zfile_fseek(zf, 0, SEEK_SET);
+	int encoding = 0;
+	if (mpg123_replace_reader_handle(mh, mp3_read_callback, mp3_lseek_callback, nullptr) != MPG123_OK ||
+		mpg123_open_handle(mh, zf) != MPG123_OK ||
+		mpg123_getformat(mh, &rate, &channels, &encoding) != MPG123_OK ||
+		rate <= 0 || (channels != 1 && channels != 2))
 	{
-		zfile_fseek(zf, 0, SEEK_SET);
-		while (outoffset < maxsize)
+		write_log("MP3: failed to open '%s'\n", zfile_getname(zf));
+		mpg123_delete(mh);
+		mpg123_exit();
+		return false;
+	}
+	// The frame index is built as the stream is read. Seeking past the end
+	// of the index parses frame headers forward, so it is still exact
+	// without a full mpg123_scan() on open.
+	g_mp3stream = mh;
+	if (rate != 44100 || channels != 2)
+	{
+		pcm = xmalloc(uae_s16, MP3_PCM_FRAMES * 2);
+		if (pcm == nullptr)
 		{
-			size_t count = zfile_fread(mp3buf, 1, MP3_BLOCK_SIZE, zf);
-			if (count != MP3_BLOCK_SIZE)
-				break;
+			close();
+			return false;
+		}
+		step = (static_cast<uae_u64>(rate) << 32) / 44100;
+		write_log("MP3: converting %ldHz %s to 44100Hz stereo\n", rate, channels == 1 ? "mono" : "stereo");
+	}
+	pcmfill = 0;
+	frac = 0;
+	pcmeof = false;
+	return true;
+}
 
-			size_t decoded = 0;
-			int ret = mpg123_decode(mh, mp3buf, MP3_BLOCK_SIZE, rawbuf, RAW_BLOCK_SIZE, &decoded);
+bool mp3decoder::seek(uae_s64 sample)
+{
+	auto* mh = static_cast<mpg123_handle*>(g_mp3stream);
+	if (mh == nullptr)
+		return false;
+	if (pcm == nullptr)
+		return mpg123_seek(mh, static_cast<off_t>(sample), SEEK_SET) >= 0;
+	// sample counts 44100Hz frames, seek to the native frame before it
+	uae_u64 src = static_cast<uae_u64>(sample) * rate;
+	pcmfill = 0;
+	pcmeof = false;
+	frac = ((src % 44100) << 32) / 44100;
+	return mpg123_seek(mh, static_cast<off_t>(src / 44100), SEEK_SET) >= 0;
+}
 
-			if (ret != MPG123_ERR && decoded != 0)
-			{
-				if (outoffset + decoded > maxsize)
-					decoded = maxsize - outoffset;
-				memcpy(outbuf + outoffset, rawbuf, decoded);
-				outoffset += decoded;
-			}
+// Decode more native frames behind the unread ones, expanding mono to stereo
+bool mp3decoder::refill()
+{
+	auto* mh = static_cast<mpg123_handle*>(g_mp3stream);
+	int first = static_cast<int>(frac >> 32);
+	if (first > pcmfill)
+		first = pcmfill;
+	memmove(pcm, pcm + first * 2, (pcmfill - first) * 2 * sizeof(uae_s16));
+	pcmfill -= first;
+	frac -= static_cast<uae_u64>(first) << 32;
+	while (!pcmeof && pcmfill < MP3_PCM_FRAMES)
+	{
+		// mono samples are expanded in place, the buffer has room for that
+		int frames = MP3_PCM_FRAMES - pcmfill;
+		uae_s16* dst = pcm + pcmfill * 2;
+		size_t decoded = 0;
+		int ret = mpg123_read(mh, dst, frames * channels * sizeof(uae_s16), &decoded);
+		int got = static_cast<int>(decoded / (channels * sizeof(uae_s16)));
+		if (channels == 1)
+		{
+			for (int i = got - 1; i >= 0; i--)
+				dst[i * 2 + 1] = dst[i * 2] = dst[i];
+		}
+		pcmfill += got;
+		if (ret != MPG123_OK && ret != MPG123_DONE && ret != MPG123_NEW_FORMAT && ret != MPG123_NEED_MORE)
+		{
+			write_log("MP3: error while decoding: %s\n", mpg123_strerror(mh));
+			return false;
+		}
+		if (got > 0)
+			break;
+		if (ret != MPG123_NEW_FORMAT)
+			pcmeof = true;
+	}
+	return true;
+}
 
-			while (ret != MPG123_ERR && ret != MPG123_NEED_MORE && outoffset < maxsize)
+// Returns number of decoded bytes, 0 at end of stream, -1 on error.
+int mp3decoder::read(uae_u8* outbuf, int size)
+{
+	auto* mh = static_cast<mpg123_handle*>(g_mp3stream);
+	if (mh == nullptr)
+		return -1;
+	if (pcm != nullptr)
+	{
+		// linear interpolation between native frames
+		auto* out = reinterpret_cast<uae_s16*>(outbuf);
+		int frames = size / 4;
+		int done = 0;
+		while (done < frames)
+		{
+			int i = static_cast<int>(frac >> 32);
+			if (i + 1 >= pcmfill)
 			{
-				ret = mpg123_decode(mh, nullptr, 0, rawbuf, RAW_BLOCK_SIZE, &decoded);
-				if (ret != MPG123_ERR && decoded != 0)
-				{
-					if (outoffset + decoded > maxsize)
-						decoded = maxsize - outoffset;
-					memcpy(outbuf + outoffset, rawbuf, decoded);
-					outoffset += decoded;
-				}
+				if (pcmeof)
+					break;
+				if (!refill())
+					return done ? done * 4 : -1;
+				continue;
 			}
-
-			if (ret == MPG123_ERR)
+			int f = static_cast<int>((frac >> 16) & 0xffff);
+			for (int c = 0; c < 2; c++)
 			{
-				write_log("MP3: error while decoding\n");
-				outbuf = nullptr;
-				break;
+				int a = pcm[i * 2 + c];
+				int b = pcm[i * 2 + 2 + c];
+				out[done * 2 + c] = static_cast<uae_s16>(a + (((b - a) * f) >> 16));
 			}
+			done++;
+			frac += step;
 		}
-
-		mpg123_close(mh);
+		return done * 4;
 	}
+	size_t decoded = 0;
+	int ret = mpg123_read(mh, outbuf, size, &decoded);
+	if (decoded > 0)
+		return static_cast<int>(decoded);
+	if (ret == MPG123_DONE)
+		return 0;
+	if (ret == MPG123_NEW_FORMAT || ret == MPG123_NEED_MORE)
+	{
+		ret = mpg123_read(mh, outbuf, size, &decoded);
+		if (decoded > 0)
+			return static_cast<int>(decoded);
+		if (ret == MPG123_DONE)
+			return 0;
+	}
+	write_log("MP3: error while decoding: %s\n", mpg123_strerror(mh));
+	return -1;
+}
 
+void mp3decoder::close()
+{
+	xfree(pcm);
+	pcm = nullptr;
+	pcmfill = 0;
+	auto* mh = static_cast<mpg123_handle*>(g_mp3stream);
+	if (mh == nullptr)
+		return;
+	mpg123_close(mh);
 	mpg123_delete(mh);
 	mpg123_exit();
-
-	return outbuf;
+	g_mp3stream = nullptr;
 }
 
 uae_u32 mp3decoder::getsize(struct zfile* zf)
@@ -121,6 +235,7 @@ uae_u32 mp3decoder::getsize(struct zfile* zf)
 	int firstframe;
 	int oldbitrate;
 	int timelen = -1;
+	int lastfreq = 44100, laststereo = 1;
 
 	firstframe = -1;
 	oldbitrate = -1;
@@ -194,7 +309,7 @@ uae_u32 mp3decoder::getsize(struct zfile* zf)
 		uae_u8 header[4];
 
 		if (zfile_fread(header, sizeof header, 1, zf) != 1)
-			return size;
+			break;
 		if (header[0] != 0xff || ((header[1] & (0x80 | 0x40 | 0x20)) != (0x80 | 0x40 | 0x20)))
 		{
 			zfile_fseek(zf, -3, SEEK_CUR);
@@ -231,6 +346,8 @@ uae_u32 mp3decoder::getsize(struct zfile* zf)
 		}
 		channelmode = (header[3] >> 6) & 3;
 		isstereo = channelmode != 3;
+		lastfreq = freq;
+		laststereo = isstereo;
 		if (ver == 0)
 		{
 			bitindex = layer - 1;
@@ -277,5 +394,6 @@ uae_u32 mp3decoder::getsize(struct zfile* zf)
 			break;
 		}
 	}
-	return size;
+	// read() delivers 44100Hz stereo whatever the stream format is
+	return static_cast<uae_u32>(static_cast<uae_u64>(size / (laststereo ? 4 : 2)) * 44100 / lastfreq * 4);
 }
@@ -2,9 +2,20 @@
 class mp3decoder
 {
     void *g_mp3stream{};
+    // native stream format and conversion to 44100Hz stereo
+    long rate{};
+    int channels{};
+    uae_s16 *pcm{};     // decoded frames, always stereo
+    int pcmfill{};
+    uae_u64 step{}, frac{}; // 32.32 source position of the next output frame
+    bool pcmeof{};
+    bool refill();
 public:
     mp3decoder();
     ~mp3decoder();
-    uae_u8 *get(struct zfile *zf, uae_u8 *, int maxsize);
+    bool open(struct zfile *zf);
+    bool seek(uae_s64 sample);
+    int read(uae_u8 *outbuf, int size);
+    void close();
     uae_u32 getsize(struct zfile *zf);
 };
@@ -79,6 +79,7 @@
 #include "gfxboard.h"
 #include "devices.h"
 #include "statusline.h"
+#include "uae/vm.h"
 
 int debug_rtg_blitter = 3;
 
@@ -94,9 +95,12 @@ static int picasso96_BT = BT_uaegfx;
 static int picasso96_GCT = GCT_Unknown;
 static int picasso96_PCT = PCT_Unknown;
 
-#ifdef _WIN32
-int mman_GetWriteWatch (PVOID lpBaseAddress, SIZE_T dwRegionSize, PVOID *lpAddresses, PULONG_PTR lpdwCount, PULONG lpdwGranularity);
-void mman_ResetWatch (PVOID lpBaseAddress, SIZE_T dwRegionSize);
+/* Only convert pages the Amiga side wrote to. Amiberry emulates the
+ * Windows write watch in amiberry_mem.cpp. */
+#if defined(_WIN32) || defined(AMIBERRY)
+#define P96_WRITEWATCH
+int mman_GetWriteWatch (void *lpBaseAddress, size_t dwRegionSize, void **lpAddresses, uintptr_t *lpdwCount, unsigned long *lpdwGranularity);
+void mman_ResetWatch (void *lpBaseAddress, size_t dwRegionSize);
 #endif
 
 static void picasso_flushpixels(int index, uae_u8 *src, int offset, bool render);
@@ -2701,26 +2705,29 @@ static void CopyLibResolutionStructureU2A(TrapContext *ctx, const struct LibReso
 
 void picasso_allocatewritewatch (int index, int gfxmemsize)
 {
+#ifdef P96_WRITEWATCH
+	xfree (gwwbuf[index]);
 #ifdef _WIN32
 	SYSTEM_INFO si;
-
-	xfree (gwwbuf[index]);
 	GetSystemInfo (&si);
 	gwwpagesize[index] = si.dwPageSize;
+#else
+	gwwpagesize[index] = uae_vm_page_size ();
+#endif
 	gwwbufsize[index] = gfxmemsize / gwwpagesize[index] + 1;
 	gwwpagemask[index] = gwwpagesize[index] - 1;
 	gwwbuf[index] = xmalloc (void*, gwwbufsize[index]);
 #endif
 }
 
-#ifdef _WIN32
-static ULONG_PTR writewatchcount[MAX_RTG_BOARDS];
+#ifdef P96_WRITEWATCH
+static uintptr_t writewatchcount[MAX_RTG_BOARDS];
 static int watch_offset[MAX_RTG_BOARDS];
 #endif
 int picasso_getwritewatch (int index, int offset, uae_u8 ***gwwbufp, uae_u8 **startp)
 {
-#ifdef _WIN32
-	ULONG ps;
+#ifdef P96_WRITEWATCH
+	unsigned long ps;
 	writewatchcount[index] = gwwbufsize[index];
 	watch_offset[index] = offset;
 	if (gfxmem_banks[index]->start + offset >= max_physmem) {
@@ -2728,8 +2735,12 @@ int picasso_getwritewatch (int index, int offset, uae_u8 ***gwwbufp, uae_u8 **st
 		return -1;
 	}
 	uae_u8 *start = gfxmem_banks[index]->start + natmem_offset + offset;
+#ifdef _WIN32
 	if (GetWriteWatch (WRITE_WATCH_FLAG_RESET, start, (gwwbufsize[index] - 1) * gwwpagesize[index], gwwbuf[index], &writewatchcount[index], &ps)) {
 		write_log (_T("picasso_getwritewatch %d\n"), GetLastError ());
+#else
+	if (!gwwbuf[index] || mman_GetWriteWatch (start, (gwwbufsize[index] - 1) * gwwpagesize[index], gwwbuf[index], &writewatchcount[index], &ps)) {
+#endif
 		writewatchcount[index] = 0;
 		return -1;
 	}
@@ -2744,14 +2755,14 @@ int picasso_getwritewatch (int index, int offset, uae_u8 ***gwwbufp, uae_u8 **st
 }
 bool picasso_is_vram_dirty (int index, uaecptr addr, int size)
 {
-#ifdef _WIN32
-	static ULONG_PTR last;
+#ifdef P96_WRITEWATCH
+	static uintptr_t last;
 	uae_u8 *a = addr + natmem_offset + watch_offset[index];
 	int s = size;
 	int ms = gwwpagesize[index];
 
 	for (;;) {
-		for (ULONG_PTR i = last; i < writewatchcount[index]; i++) {
+		for (uintptr_t i = last; i < writewatchcount[index]; i++) {
 			uae_u8 *ma = (uae_u8*)gwwbuf[index][i];
 			if (
 				(a < ma && a + s >= ma) ||
@@ -2783,7 +2794,7 @@ static void init_alloc (TrapContext *ctx, int size)
 	}
 	picasso96_amemend = picasso96_amem + size;
 	write_log (_T("P96 RESINFO: %08X-%08X (%d,%d)\n"), picasso96_amem, picasso96_amemend, size / PSSO_ModeInfo_sizeof, size);
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 	picasso_allocatewritewatch (0, gfxmem_bank.allocated_size);
 #endif
 }
@@ -3404,7 +3415,7 @@ static void init_picasso_screen(int monid)
 		picasso_refresh(monid);
 	}
 	init_picasso_screen_called = 1;
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 	mman_ResetWatch (gfxmem_bank.start + natmem_offset, gfxmem_bank.allocated_size);
 #endif
 
@@ -5842,8 +5853,8 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 	struct picasso96_state_struct *state = &picasso96_state[monid];
 	uae_u8 *src_start[2];
 	uae_u8 *src_end[2];
-#ifdef _WIN32
-	ULONG_PTR gwwcnt;
+#ifdef P96_WRITEWATCH
+	uintptr_t gwwcnt;
 #endif
 	int pwidth = state->Width > state->VirtualWidth ? state->VirtualWidth : state->Width;
 	int pheight = state->Height > state->VirtualHeight ? state->VirtualHeight : state->Height;
@@ -5852,8 +5863,9 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 	int flushlines = 0, matchcount = 0;
 	struct picasso_vidbuf_description *vidinfo = &picasso_vidinfo[monid];
 	bool overlay_updated = false;
+	bool cleared = false;
 
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 	src_start[0] = src + (off & ~gwwpagemask[index]);
 	src_end[0] = src + ((off + state->BytesPerRow * pheight + gwwpagesize[index] - 1) & ~gwwpagemask[index]);
 	if (vidinfo->splitypos >= 0) {
@@ -5871,7 +5883,7 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 	} else {
 		src_start[1] = src_end[1] = nullptr;
 	}
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 	if (!vidinfo->extra_mem || !gwwbuf[index] || (src_start[0] >= src_end[0] && src_start[1] >= src_end[1])) {
 #else
 	if (!vidinfo->extra_mem || (src_start[0] >= src_end[0] && src_start[1] >= src_end[1])) {
@@ -5889,15 +5901,15 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 	for (;;) {
 		uae_u8 *dst = nullptr;
 		bool dofull;
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 		gwwcnt = 0;
 #endif
 		if (doskip() && p96skipmode == 1) {
 			break;
 		}
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 		if (!index && overlay_vram && overlay_active) {
-			ULONG ps;
+			unsigned long ps;
 			gwwcnt = gwwbufsize[index];
 			uae_u8 *ovr_start = src + (overlay_vram_offset & ~gwwpagemask[index]);
 			uae_u8 *ovr_end = src + ((overlay_vram_offset + overlay_src_width * overlay_src_height * overlay_pix + gwwpagesize[index] - 1) & ~gwwpagemask[index]);
@@ -5913,23 +5925,23 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 			}
 
 			if (vidinfo->full_refresh < 0 || overlay_updated) {
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 				gwwcnt = regionsize / gwwpagesize[index] + 1;
 #endif
 				vidinfo->full_refresh = 1;
-#ifdef _WIN32
-				for (int i = 0; i < gwwcnt; i++)
+#ifdef P96_WRITEWATCH
+				for (uintptr_t i = 0; i < gwwcnt; i++)
 					gwwbuf[index][i] = src_start[split] + i * gwwpagesize[index];
 #endif
 			} else {
-#ifdef _WIN32
-				ULONG ps;
+#ifdef P96_WRITEWATCH
+				unsigned long ps;
 				gwwcnt = gwwbufsize[index];
 				if (mman_GetWriteWatch(src_start[split], regionsize, gwwbuf[index], &gwwcnt, &ps))
 					continue;
 #endif
 			}
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 			matchcount += (int)gwwcnt;
 
 			if (gwwcnt == 0) {
@@ -5966,6 +5978,7 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 					p2 += vidinfo->rowbytes;
 				}
 				vidinfo->rtg_clear_flag--;
+				cleared = true;
 			}
 
 			dst += vidinfo->offset;
@@ -5995,8 +6008,8 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 			if (split) {
 				off = 0;
 			}
-#ifdef _WIN32
-			for (int i = 0; i < gwwcnt; i++) {
+#ifdef P96_WRITEWATCH
+			for (uintptr_t i = 0; i < gwwcnt; i++) {
 				uae_u8 *p = (uae_u8 *)gwwbuf[index][i];
 
 				if (p >= src_start[split] && p < src_end[split]) {
@@ -6084,11 +6097,17 @@ static void picasso_flushpixels(int index, uae_u8 *src, int off, bool render)
 		}
 	}
 
+#ifdef AMIBERRY
+	if (dstp && !cleared && !(overlay_vram && overlay_active)) {
+		// only the rows passed to picasso_invalidate() changed
+		AMonitors[monid].rtg_partial_upload = true;
+	}
+#endif
 	if (dstp || render) {
 		gfx_unlock_picasso(monid, render);
 	}
 
-#ifdef _WIN32
+#ifdef P96_WRITEWATCH
 	if (dstp && gwwcnt) {
 #else
 	if (dstp) {
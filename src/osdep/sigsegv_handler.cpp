@@ -35,6 +35,7 @@
 #include "jit/compemu.h"
 #endif
 #include "uae.h"
+#include "uae/mman.h"
 
 #if !defined(__MACH__) && !defined(CPU_AMD64) && !defined(__x86_64__) && !defined(__riscv)
 #include <asm/sigcontext.h>
@@ -344,6 +345,10 @@ static int handle_exception(mcontext_t sigcont, long fault_addr)
 
 void signal_segv(int signum, siginfo_t* info, void* ptr)
 {
+	// first write to a write watched page since the last query
+	if (signum == SIGSEGV && uae_mman_writewatch_fault(info->si_addr))
+		return;
+
 	int handled = HANDLE_EXCEPTION_NONE;
 
 	auto ucontext = static_cast<ucontext_t*>(ptr);
@@ -457,6 +462,10 @@ void signal_segv(int signum, siginfo_t* info, void* ptr)
 
 void signal_buserror(int signum, siginfo_t* info, void* ptr)
 {
+	// macOS reports writes to write protected pages as SIGBUS
+	if (uae_mman_writewatch_fault(info->si_addr))
+		return;
+
 	auto ucontext = static_cast<ucontext_t*>(ptr);
 	Dl_info dlinfo;
 
@@ -746,6 +755,10 @@ static int handle_exception(unsigned long* pregs, long fault_addr)
 
 void signal_segv(int signum, siginfo_t* info, void* ptr)
 {
+	// first write to a write watched page since the last query
+	if (signum == SIGSEGV && uae_mman_writewatch_fault(info->si_addr))
+		return;
+
 	int handled = HANDLE_EXCEPTION_NONE;
 	ucontext_t* ucontext = (ucontext_t*)ptr;
 	Dl_info dlinfo;
@@ -874,6 +887,10 @@ void signal_segv(int signum, siginfo_t* info, void* ptr)
 
 void signal_buserror(int signum, siginfo_t* info, void* ptr)
 {
+	// macOS reports writes to write protected pages as SIGBUS
+	if (uae_mman_writewatch_fault(info->si_addr))
+		return;
+
 	ucontext_t* ucontext = (ucontext_t*)ptr;
 	Dl_info dlinfo;
 
@@ -1736,7 +1736,19 @@ struct romdata *getromdatabyzfile (struct zfile *f)
 	int pos, size;
 	uae_u8 *p;
 	struct romdata *rd;
+	size_t len;
 
+	/* known size of delayed archive members and mapped files,
+	 * don't unpack or map anything too large to be a ROM */
+	if (zfile_size (f) > 2048 * 1024)
+		return NULL;
+	/* mapped file or unpacked data: no need to copy */
+	p = zfile_get_data_pointer (f, &len);
+	if (p) {
+		if (len > 2048 * 1024)
+			return NULL;
+		return getromdatabydata (p, (int)len);
+	}
 	pos = zfile_ftell32(f);
 	zfile_fseek (f, 0, SEEK_END);
 	size = zfile_ftell32(f);
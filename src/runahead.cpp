@@ -0,0 +1,114 @@
+ /*
+  * UAE - The Un*x Amiga Emulator
+  *
+  * Run-ahead input latency reduction
+  *
+  * Games usually react to input one or more frames after it was read. At
+  * the end of each real frame the machine state is captured in memory, the
+  * next frames are emulated as fast as possible with the current input held,
+  * the last of them is displayed and the machine is rolled back to the
+  * capture. The real frame that follows produces audio but is not displayed.
+  * The displayed frame is the one the game would show N frames later.
+  *
+  */
+
+#include "sysconfig.h"
+#include "sysdeps.h"
+
+#include "options.h"
+#include "uae.h"
+#include "custom.h"
+#include "xwin.h"
+#include "savestate.h"
+#include "inputrecord.h"
+#ifdef DEBUGGER
+#include "debug.h"
+#endif
+#include "runahead.h"
+
+bool runahead_active;
+static int runahead_left;
+static bool runahead_on;
+// real frame after a rollback, the ahead frame stays on screen
+static bool runahead_hide;
+
+static bool runahead_possible(void)
+{
+	struct amigadisplay *ad = &adisplays[0];
+
+	if (currprefs.runahead_frames <= 0)
+		return false;
+	// beam racing, CPU thread and RTG have their own frame timing
+	if (currprefs.turbo_emulation || currprefs.cpu_thread || isvsync_chipset() < 0 || ad->picasso_on)
+		return false;
+	if (input_record || input_play || savestate_state || quit_program)
+		return false;
+#ifdef DEBUGGER
+	if (debugging)
+		return false;
+#endif
+	if (is_savestate_incompatible())
+		return false;
+	return true;
+}
+
+bool runahead_vsync(void)
+{
+	if (runahead_active) {
+		if (--runahead_left > 0)
+			return false;
+		// last ahead frame is complete, it is still shown at display vsync
+		savestate_state = STATE_RUNAHEAD;
+		return true;
+	}
+	runahead_hide = false;
+	if (!runahead_possible()) {
+		if (runahead_on) {
+			write_log(_T("runahead: disabled\n"));
+			savestate_runahead_free();
+			runahead_on = false;
+		}
+		return false;
+	}
+	if (!savestate_runahead_capture()) {
+		// filesystem packet in progress or out of memory, try again next frame
+		return false;
+	}
+	if (!runahead_on) {
+		write_log(_T("runahead: %d frames\n"), std::min(currprefs.runahead_frames, RUNAHEAD_MAX_FRAMES));
+		runahead_on = true;
+	}
+	runahead_left = std::min(currprefs.runahead_frames, RUNAHEAD_MAX_FRAMES);
+	runahead_active = true;
+	return false;
+}
+
+bool runahead_restore(void)
+{
+	runahead_active = false;
+	runahead_left = 0;
+	runahead_hide = true;
+	if (!savestate_runahead_restore()) {
+		// emulation continues from the last ahead frame, the frames that
+		// were run with held input are not undone.
+		write_log(_T("runahead: rollback failed\n"));
+		savestate_state = 0;
+		runahead_hide = false;
+		return false;
+	}
+	return true;
+}
+
+bool runahead_frame_hidden(void)
+{
+	if (runahead_active)
+		return runahead_left != 1;
+	return runahead_hide;
+}
+
+void runahead_reset(void)
+{
+	runahead_active = false;
+	runahead_left = 0;
+	runahead_hide = false;
+}
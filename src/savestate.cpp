@@ -67,6 +67,7 @@
 #include "a2091.h"
 #include "devices.h"
 #include "fsdb.h"
+#include "fsjournal.h"
 #include "gfxboard.h"
 
 int savestate_state = 0;
@@ -102,6 +103,14 @@ struct staterecord
 	uae_u8 *data;
 	uae_u8 *end;
 	int inprecoffset;
+	// RAM pages, see rewind_capture_ram()
+	bool keyframe;
+	int pagecount;
+	uae_u32 *pageid;
+	uae_u64 *pagehash;
+	uae_u8 *pages;
+	// host directory filesystem journal position
+	uae_u32 fsmark;
 };
 
 static struct staterecord **staterecords;
@@ -1386,6 +1395,343 @@ bool savestate_check(void)
 
 static int rewindmode;
 
+/* Rewind RAM store
+ *
+ * Captures do not carry RAM inline. Chip, slow, fast and Z3 RAM are split
+ * in REWIND_PAGE_SIZE pages and a capture only stores pages whose hash
+ * changed since the previous capture. The oldest capture is always a
+ * keyframe containing every page: when it is dropped (ring wrap or memory
+ * budget) its pages are folded into the next capture.
+ */
+
+#define REWIND_PAGE_SHIFT 12
+#define REWIND_PAGE_SIZE (1 << REWIND_PAGE_SHIFT)
+#define REWIND_PAGE_MASK ((1 << 28) - 1)
+#define REWIND_RAM_REGIONS 4
+
+struct rewind_ram
+{
+	uae_u8 *base;
+	size_t size;
+	int pages;
+	uae_u64 *hash;
+};
+static struct rewind_ram rewind_rams[REWIND_RAM_REGIONS];
+static uae_u32 *rewind_scratch_id;
+static uae_u64 *rewind_scratch_hash;
+static int rewind_scratch_size;
+static size_t rewind_bytes;
+
+/* XXH64 style: four lanes with rotate-multiply rounds, so every input
+ * bit reaches every output bit, merged and finalized the same way */
+#define REWIND_PRIME1 0x9e3779b185ebca87ULL
+#define REWIND_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define REWIND_PRIME3 0x165667b19e3779f9ULL
+#define REWIND_PRIME4 0x85ebca77c2b2ae63ULL
+#define REWIND_PRIME5 0x27d4eb2f165667c5ULL
+
+static inline uae_u64 rewind_rotl (uae_u64 v, int n)
+{
+	return (v << n) | (v >> (64 - n));
+}
+
+static inline uae_u64 rewind_round (uae_u64 acc, uae_u64 v)
+{
+	acc += v * REWIND_PRIME2;
+	acc = rewind_rotl (acc, 31);
+	return acc * REWIND_PRIME1;
+}
+
+static inline uae_u64 rewind_merge (uae_u64 h, uae_u64 acc)
+{
+	h ^= rewind_round (0, acc);
+	return h * REWIND_PRIME1 + REWIND_PRIME4;
+}
+
+static uae_u64 rewind_hash_page (const uae_u8 *p, int len)
+{
+	uae_u64 h[4] = { REWIND_PRIME1 + REWIND_PRIME2, REWIND_PRIME2, 0, 0 - REWIND_PRIME1 };
+	uae_u64 r;
+	int i = 0;
+	for (; i + 32 <= len; i += 32) {
+		for (int j = 0; j < 4; j++) {
+			uae_u64 v;
+			memcpy (&v, p + i + j * 8, 8);
+			h[j] = rewind_round (h[j], v);
+		}
+	}
+	r = rewind_rotl (h[0], 1) + rewind_rotl (h[1], 7) + rewind_rotl (h[2], 12) + rewind_rotl (h[3], 18);
+	for (int j = 0; j < 4; j++)
+		r = rewind_merge (r, h[j]);
+	r += len;
+	for (; i < len; i++)
+		r = rewind_rotl (r ^ (p[i] * REWIND_PRIME5), 11) * REWIND_PRIME1;
+	r ^= r >> 33;
+	r *= REWIND_PRIME2;
+	r ^= r >> 29;
+	r *= REWIND_PRIME3;
+	r ^= r >> 32;
+	return r;
+}
+
+static int rewind_page_len (const struct rewind_ram *rr, int page)
+{
+	size_t off = (size_t)page << REWIND_PAGE_SHIFT;
+	return rr->size - off < REWIND_PAGE_SIZE ? (int)(rr->size - off) : REWIND_PAGE_SIZE;
+}
+
+static void rewind_free_pages (struct staterecord *st)
+{
+	if (!st)
+		return;
+	rewind_bytes -= (size_t)st->pagecount * (REWIND_PAGE_SIZE + sizeof (uae_u32) + sizeof (uae_u64));
+	xfree (st->pageid);
+	xfree (st->pagehash);
+	xfree (st->pages);
+	st->pageid = NULL;
+	st->pagehash = NULL;
+	st->pages = NULL;
+	st->pagecount = 0;
+	st->keyframe = false;
+}
+
+static void rewind_free_rams (void)
+{
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		xfree (rewind_rams[i].hash);
+		memset (&rewind_rams[i], 0, sizeof (struct rewind_ram));
+	}
+	xfree (rewind_scratch_id);
+	xfree (rewind_scratch_hash);
+	rewind_scratch_id = NULL;
+	rewind_scratch_hash = NULL;
+	rewind_scratch_size = 0;
+}
+
+static void rewind_ram_regions (uae_u8 **base, size_t *size)
+{
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++)
+		size[i] = 0;
+	base[0] = save_cram (&size[0]);
+	base[1] = save_bram (&size[1]);
+#ifdef AUTOCONFIG
+	base[2] = save_fram (&size[2], 0);
+	base[3] = save_zram (&size[3], 0);
+#else
+	base[2] = base[3] = NULL;
+#endif
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		if (!base[i])
+			size[i] = 0;
+	}
+}
+
+// returns true if RAM layout changed and the next capture must be a keyframe
+static bool rewind_update_rams (void)
+{
+	uae_u8 *base[REWIND_RAM_REGIONS];
+	size_t size[REWIND_RAM_REGIONS];
+	bool changed = false;
+	int total = 0;
+
+	rewind_ram_regions (base, size);
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		struct rewind_ram *rr = &rewind_rams[i];
+		if (rr->base == base[i] && rr->size == size[i]) {
+			total += rr->pages;
+			continue;
+		}
+		xfree (rr->hash);
+		rr->base = base[i];
+		rr->size = size[i];
+		rr->pages = (int)((size[i] + REWIND_PAGE_SIZE - 1) >> REWIND_PAGE_SHIFT);
+		rr->hash = rr->pages ? xcalloc (uae_u64, rr->pages) : NULL;
+		total += rr->pages;
+		changed = true;
+	}
+	if (total > rewind_scratch_size) {
+		xfree (rewind_scratch_id);
+		xfree (rewind_scratch_hash);
+		rewind_scratch_id = xmalloc (uae_u32, total);
+		rewind_scratch_hash = xmalloc (uae_u64, total);
+		rewind_scratch_size = total;
+	}
+	return changed;
+}
+
+// store RAM pages changed since the previous capture (all pages if keyframe)
+static bool rewind_capture_ram (struct staterecord *st, bool keyframe)
+{
+	int cnt = 0;
+
+	if (rewind_update_rams ())
+		keyframe = true;
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		struct rewind_ram *rr = &rewind_rams[i];
+		for (int j = 0; j < rr->pages; j++) {
+			uae_u64 h = rewind_hash_page (rr->base + ((size_t)j << REWIND_PAGE_SHIFT), rewind_page_len (rr, j));
+			if (!keyframe && h == rr->hash[j])
+				continue;
+			rewind_scratch_id[cnt] = (i << 28) | j;
+			rewind_scratch_hash[cnt] = h;
+			cnt++;
+		}
+	}
+	st->keyframe = keyframe;
+	st->pagecount = cnt;
+	if (cnt) {
+		st->pageid = xmalloc (uae_u32, cnt);
+		st->pagehash = xmalloc (uae_u64, cnt);
+		st->pages = xmalloc (uae_u8, (size_t)cnt << REWIND_PAGE_SHIFT);
+		if (!st->pageid || !st->pagehash || !st->pages) {
+			rewind_bytes += (size_t)cnt * (REWIND_PAGE_SIZE + sizeof (uae_u32) + sizeof (uae_u64));
+			rewind_free_pages (st);
+			return false;
+		}
+		memcpy (st->pageid, rewind_scratch_id, cnt * sizeof (uae_u32));
+		memcpy (st->pagehash, rewind_scratch_hash, cnt * sizeof (uae_u64));
+		for (int i = 0; i < cnt; i++) {
+			struct rewind_ram *rr = &rewind_rams[st->pageid[i] >> 28];
+			int page = st->pageid[i] & REWIND_PAGE_MASK;
+			memcpy (st->pages + ((size_t)i << REWIND_PAGE_SHIFT), rr->base + ((size_t)page << REWIND_PAGE_SHIFT), rewind_page_len (rr, page));
+			rr->hash[page] = st->pagehash[i];
+		}
+		rewind_bytes += (size_t)cnt * (REWIND_PAGE_SIZE + sizeof (uae_u32) + sizeof (uae_u64));
+	}
+	return true;
+}
+
+// merge keyframe 'old' into following delta capture 'st'
+static bool rewind_fold (struct staterecord *old, struct staterecord *st)
+{
+	int cnt = 0, i = 0, j = 0;
+
+	while (i < old->pagecount || j < st->pagecount) {
+		if (j >= st->pagecount || (i < old->pagecount && old->pageid[i] < st->pageid[j])) {
+			i++;
+		} else {
+			if (i < old->pagecount && old->pageid[i] == st->pageid[j])
+				i++;
+			j++;
+		}
+		cnt++;
+	}
+	uae_u32 *pageid = xmalloc (uae_u32, cnt);
+	uae_u64 *pagehash = xmalloc (uae_u64, cnt);
+	uae_u8 *pages = xmalloc (uae_u8, (size_t)cnt << REWIND_PAGE_SHIFT);
+	if (!pageid || !pagehash || !pages) {
+		xfree (pageid);
+		xfree (pagehash);
+		xfree (pages);
+		return false;
+	}
+	cnt = i = j = 0;
+	while (i < old->pagecount || j < st->pagecount) {
+		struct staterecord *src;
+		int idx;
+		if (j >= st->pagecount || (i < old->pagecount && old->pageid[i] < st->pageid[j])) {
+			src = old;
+			idx = i++;
+		} else {
+			if (i < old->pagecount && old->pageid[i] == st->pageid[j])
+				i++;
+			src = st;
+			idx = j++;
+		}
+		pageid[cnt] = src->pageid[idx];
+		pagehash[cnt] = src->pagehash[idx];
+		memcpy (pages + ((size_t)cnt << REWIND_PAGE_SHIFT), src->pages + ((size_t)idx << REWIND_PAGE_SHIFT), REWIND_PAGE_SIZE);
+		cnt++;
+	}
+	rewind_free_pages (st);
+	st->pageid = pageid;
+	st->pagehash = pagehash;
+	st->pages = pages;
+	st->pagecount = cnt;
+	st->keyframe = true;
+	rewind_bytes += (size_t)cnt * (REWIND_PAGE_SIZE + sizeof (uae_u32) + sizeof (uae_u64));
+	return true;
+}
+
+// invalidate oldest capture, next capture becomes the keyframe
+static void rewind_drop_oldest (void)
+{
+	struct staterecord *old = staterecords[staterecords_first];
+	int next = staterecords_first + 1;
+	if (next >= staterecords_max)
+		next -= staterecords_max;
+	struct staterecord *st = staterecords[next];
+
+	if (old && old->inuse && st && st->inuse && !st->keyframe) {
+		if (!rewind_fold (old, st)) {
+			// every later capture is a delta on top of st: drop them all
+			write_log (_T("rewind: out of memory, history discarded\n"));
+			for (int i = 0; i < staterecords_max; i++) {
+				if (staterecords[i]) {
+					rewind_free_pages (staterecords[i]);
+					staterecords[i]->inuse = 0;
+				}
+			}
+			staterecords_first = replaycounter;
+#ifdef FILESYS
+			fsjournal_trim (fsjournal_mark ());
+#endif
+			return;
+		}
+	}
+	if (old) {
+		rewind_free_pages (old);
+		old->inuse = 0;
+	}
+	staterecords_first = next;
+#ifdef FILESYS
+	if (st && st->inuse)
+		fsjournal_trim (st->fsmark);
+#endif
+}
+
+static void rewind_restore_ram (int pos)
+{
+	uae_u8 *done[REWIND_RAM_REGIONS];
+
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++)
+		done[i] = rewind_rams[i].pages ? xcalloc (uae_u8, (rewind_rams[i].pages + 7) / 8) : NULL;
+	for (;;) {
+		struct staterecord *st = staterecords[pos];
+		if (!st || !st->inuse)
+			break;
+		for (int i = 0; i < st->pagecount; i++) {
+			int r = st->pageid[i] >> 28;
+			int page = st->pageid[i] & REWIND_PAGE_MASK;
+			struct rewind_ram *rr = &rewind_rams[r];
+			if (page >= rr->pages || !done[r] || (done[r][page >> 3] & (1 << (page & 7))))
+				continue;
+			done[r][page >> 3] |= 1 << (page & 7);
+			memcpy (rr->base + ((size_t)page << REWIND_PAGE_SHIFT), st->pages + ((size_t)i << REWIND_PAGE_SHIFT), rewind_page_len (rr, page));
+			rr->hash[page] = st->pagehash[i];
+		}
+		if (st->keyframe || pos == staterecords_first)
+			break;
+		pos--;
+		if (pos < 0)
+			pos += staterecords_max;
+	}
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++)
+		xfree (done[i]);
+}
+
+static void rewind_check_budget (void)
+{
+	size_t budget = (size_t)currprefs.statecapturebudget * 1024 * 1024;
+	int last = replaycounter - 1;
+	if (last < 0)
+		last += staterecords_max;
+	if (!budget)
+		return;
+	while (rewind_bytes + fsjournal_size () > budget && staterecords_first != last)
+		rewind_drop_oldest ();
+}
+
 
 static struct staterecord *canrewind (int pos)
 {
@@ -1399,6 +1745,10 @@ static struct staterecord *canrewind (int pos)
 		return NULL;
 	if ((pos + 1) % staterecords_max  == staterecords_first)
 		return NULL;
+#ifdef FILESYS
+	if (!fsjournal_canrollback (staterecords[pos]->fsmark))
+		return NULL;
+#endif
 	return staterecords[pos];
 }
 
@@ -1439,32 +1789,13 @@ void savestate_listrewind (void)
 }
 #endif
 
-void savestate_rewind (void)
+/* Restore everything except RAM contents, false if the record doesn't match */
+static bool restore_state_record (struct staterecord *st)
 {
-	int len, i;
-	uae_u8 *p, *p2;
-	struct staterecord *st;
-	int pos;
-	bool rewind = false;
-	size_t dummy;
+	uae_u8 *p = st->data;
+	size_t len;
+	int i;
 
-	if (hsync_counter % currprefs.statecapturerate <= 25 && rewindmode <= -2) {
-		pos = replaycounter - 2;
-		rewind = true;
-	} else {
-		pos = replaycounter - 1;
-	}
-	st = canrewind (pos);
-	if (!st) {
-		rewind = false;
-		pos = replaycounter - 1;
-		st = canrewind (pos);
-		if (!st)
-			return;
-	}
-	p = st->data;
-	p2 = st->end;
-	write_log (_T("rewinding %d -> %d\n"), replaycounter - 1, pos);
 	hsync_counter = restore_u32_func (&p);
 	vsync_counter = restore_u32_func (&p);
 	p = restore_cpu (p);
@@ -1505,20 +1836,9 @@ void savestate_rewind (void)
 	if (restore_u32_func (&p))
 		p = restore_p96 (p);
 #endif
-	len = restore_u32_func (&p);
-	memcpy (chipmem_bank.baseaddr, p, currprefs.chipmem.size > len ? len : currprefs.chipmem.size);
-	p += len;
-	len = restore_u32_func (&p);
-	memcpy (save_bram (&dummy), p, currprefs.bogomem.size > len ? len : currprefs.bogomem.size);
-	p += len;
-#ifdef AUTOCONFIG
-	len = restore_u32_func (&p);
-	memcpy (save_fram (&dummy, 0), p, currprefs.fastmem[0].size > len ? len : currprefs.fastmem[0].size);
-	p += len;
-	len = restore_u32_func (&p);
-	memcpy (save_zram (&dummy, 0), p, currprefs.z3fastmem[0].size > len ? len : currprefs.z3fastmem[0].size);
-	p += len;
-#endif
+	// RAM sizes only, contents are in the rewind page store
+	for (i = 0; i < REWIND_RAM_REGIONS; i++)
+		restore_u32_func (&p);
 #ifdef ACTION_REPLAY
 	if (restore_u32_func (&p))
 		p = restore_action_replay (p);
@@ -1547,12 +1867,56 @@ void savestate_rewind (void)
 		if (restore_u32_func (&p))
 			p = restore_gayle_ide (p);
 	}
+#ifdef FILESYS
+	len = restore_u32_func (&p);
+	if (len) {
+		restore_filesys_rewind (p);
+		p += len;
+	}
+#endif
 	p += 4;
-	if (p != p2) {
-		gui_message (_T("reload failure, address mismatch %p != %p"), p, p2);
+	return p == st->end;
+}
+
+void savestate_rewind (void)
+{
+	struct staterecord *st;
+	int pos;
+	bool rewind = false;
+
+	if (hsync_counter % currprefs.statecapturerate <= 25 && rewindmode <= -2) {
+		pos = replaycounter - 2;
+		rewind = true;
+	} else {
+		pos = replaycounter - 1;
+	}
+	st = canrewind (pos);
+	if (!st) {
+		rewind = false;
+		pos = replaycounter - 1;
+		st = canrewind (pos);
+		if (!st)
+			return;
+	}
+	if (pos < 0)
+		pos += staterecords_max;
+	write_log (_T("rewinding %d -> %d\n"), replaycounter - 1, pos);
+#ifdef FILESYS
+	// undo host file changes before locks and open files are restored
+	if (!fsjournal_rollback (st->fsmark))
+		write_log (_T("rewind: directory filesystem rollback incomplete\n"));
+#endif
+	if (!restore_state_record (st)) {
+		gui_message (_T("reload failure, address mismatch"));
+		uae_reset (0, 0);
+		return;
+	}
+	if (rewind_update_rams ()) {
+		gui_message (_T("reload failure, RAM configuration changed"));
 		uae_reset (0, 0);
 		return;
 	}
+	rewind_restore_ram (pos);
 	inprec_setposition (st->inprecoffset, pos);
 	write_log (_T("state %d restored.  (%010ld/%03ld)\n"), pos, hsync_counter, vsync_counter);
 	if (rewind) {
@@ -1561,6 +1925,7 @@ void savestate_rewind (void)
 			replaycounter += staterecords_max;
 		st = canrewind (replaycounter);
 		st->inuse = 0;
+		rewind_free_pages (st);
 	}
 
 }
@@ -1584,43 +1949,19 @@ void savestate_memorysave (void)
 		save_state_internal (staterecord_statefile, _T("rerecording"), 1, false);
 }
 
-void savestate_capture (int force)
+/* Serialize everything except RAM contents, *stp is (re)allocated as needed */
+static bool capture_state_record (struct staterecord **stp)
 {
-	uae_u8 *p, *p2, *p3, *dst;
+	uae_u8 *p, *p2, *p3;
 	size_t len, tlen;
 	int i, retrycnt;
 	struct staterecord *st;
-	bool firstcapture = false;
-
-	if (!staterecords)
-		return;
-	if (!input_record)
-		return;
-#ifdef FILESYS
-	if (nr_units())
-		return;
-#endif
-	if (currprefs.statecapturerate && hsync_counter == 0 && input_record == INPREC_RECORD_START && savestate_first_capture > 0) {
-		// first capture
-		force = true;
-		firstcapture = true;
-	} else if (savestate_first_capture < 0) {
-		force = true;
-		firstcapture = false;
-	}
-	if (!force) {
-		if (currprefs.statecapturerate <= 0)
-			return;
-		if (hsync_counter % currprefs.statecapturerate)
-			return;
-	}
-	savestate_first_capture = false;
 
 	retrycnt = 0;
 retry2:
-	st = staterecords[replaycounter];
+	st = *stp;
 	if (st == NULL) {
-		st = (struct staterecord*)xmalloc (uae_u8, statefile_alloc);
+		st = (struct staterecord*)xcalloc (uae_u8, statefile_alloc);
 		st->len = statefile_alloc;
 	} else if (retrycnt > 0) {
 		write_log (_T("realloc %d -> %d\n"), st->len, st->len + STATEFILE_ALLOC_SIZE);
@@ -1631,7 +1972,7 @@ retry2:
 		statefile_alloc = st->len;
 	st->inuse = 0;
 	st->data = (uae_u8*)(st + 1);
-	staterecords[replaycounter] = st;
+	*stp = st;
 	retrycnt++;
 	p = p2 = st->data;
 	tlen = 0;
@@ -1798,36 +2139,23 @@ retry2:
 	}
 #endif
 
-	dst = save_cram(&len);
-	if (bufcheck(st, p, len))
+	// RAM contents go to the rewind page store, see rewind_capture_ram()
+	if (bufcheck(st, p, 0))
 		goto retry;
+	save_cram(&len);
 	save_u32t_func(&p, len);
-	memcpy(p, dst, len);
-	tlen += len + 4;
-	p += len;
-	dst = save_bram(&len);
-	if (bufcheck(st, p, len))
-		goto retry;
+	save_bram(&len);
 	save_u32t_func(&p, len);
-	memcpy(p, dst, len);
-	tlen += len + 4;
-	p += len;
 #ifdef AUTOCONFIG
-	dst = save_fram(&len, 0);
-	if (bufcheck(st, p, len))
-		goto retry;
+	save_fram(&len, 0);
 	save_u32t_func(&p, len);
-	memcpy(p, dst, len);
-	tlen += len + 4;
-	p += len;
-	dst = save_zram(&len, 0);
-	if (bufcheck(st, p, len))
-		goto retry;
+	save_zram(&len, 0);
 	save_u32t_func(&p, len);
-	memcpy(p, dst, len);
-	tlen += len + 4;
-	p += len;
+#else
+	save_u32t_func(&p, 0);
+	save_u32t_func(&p, 0);
 #endif
+	tlen += 4 * REWIND_RAM_REGIONS;
 #ifdef ACTION_REPLAY
 	if (bufcheck (st, p, 0))
 		goto retry;
@@ -1928,24 +2256,100 @@ retry2:
 			p += len;
 		}
 	}
+#ifdef FILESYS
+	p3 = p;
+	save_u32_func (&p, 0);
+	tlen += 4;
+	if (nr_units ()) {
+		uae_u8 *fs = save_filesys_rewind (&len);
+		if (fs) {
+			if (bufcheck (st, p, len)) {
+				xfree (fs);
+				goto retry;
+			}
+			save_u32_func (&p3, (uae_u32)len);
+			memcpy (p, fs, len);
+			tlen += len;
+			p += len;
+			xfree (fs);
+		}
+	}
+#endif
 	save_u32t_func(&p, tlen);
 	st->end = p;
+	return true;
+retry:
+	if (retrycnt < 10)
+		goto retry2;
+	return false;
+}
+
+void savestate_capture (int force)
+{
+	int i, prev;
+	struct staterecord *st;
+	bool firstcapture = false;
+	bool keyframe;
+
+	if (!staterecords)
+		return;
+	if (!input_record)
+		return;
+#ifdef FILESYS
+	// directory filesystem packet in progress, try again later
+	if (!save_filesys_rewind_cando ())
+		return;
+#endif
+	if (currprefs.statecapturerate && hsync_counter == 0 && input_record == INPREC_RECORD_START && savestate_first_capture > 0) {
+		// first capture
+		force = true;
+		firstcapture = true;
+	} else if (savestate_first_capture < 0) {
+		force = true;
+		firstcapture = false;
+	}
+	if (!force) {
+		if (currprefs.statecapturerate <= 0)
+			return;
+		if (hsync_counter % currprefs.statecapturerate)
+			return;
+	}
+	savestate_first_capture = false;
+
+	prev = replaycounter - 1;
+	if (prev < 0)
+		prev += staterecords_max;
+	keyframe = replaycounter == staterecords_first || !staterecords[prev] || !staterecords[prev]->inuse;
+	rewind_free_pages (staterecords[replaycounter]);
+
+	if (!capture_state_record (&staterecords[replaycounter])) {
+		write_log (_T("can't save, too small capture buffer or out of memory\n"));
+		return;
+	}
+	st = staterecords[replaycounter];
+	if (!rewind_capture_ram (st, keyframe)) {
+		write_log (_T("can't save, out of memory for rewind RAM pages\n"));
+		return;
+	}
 	st->inuse = 1;
 	st->inprecoffset = inprec_getposition ();
+#ifdef FILESYS
+	fsjournal_start ();
+	st->fsmark = fsjournal_mark ();
+#endif
 
 	replaycounter++;
 	if (replaycounter >= staterecords_max)
 		replaycounter -= staterecords_max;
-	if (replaycounter == staterecords_first) {
-		staterecords_first++;
-		if (staterecords_first >= staterecords_max)
-			staterecords_first -= staterecords_max;
-	}
+	if (replaycounter == staterecords_first)
+		rewind_drop_oldest ();
+	rewind_check_budget ();
 
-	write_log (_T("state capture %d (%010ld/%03ld,%ld/%d) (%ld bytes, alloc %d)\n"),
+	write_log (_T("state capture %d (%010ld/%03ld,%ld/%d) (%ld bytes, alloc %d, %d%s RAM pages, %zuk total)\n"),
 		replaycounter, hsync_counter, vsync_counter,
 		hsync_counter % current_maxvpos (), current_maxvpos (),
-		st->end - st->data, statefile_alloc);
+		st->end - st->data, statefile_alloc,
+		st->pagecount, st->keyframe ? _T(" keyframe") : _T(""), rewind_bytes >> 10);
 
 	if (firstcapture) {
 		savestate_memorysave ();
@@ -1957,20 +2361,127 @@ retry2:
 		}
 		input_record--;
 	}
+}
 
+/* Run-ahead snapshot
+ *
+ * A single in-memory state that is taken every frame and rolled back to
+ * after the ahead frames have been shown. It uses the rewind record format
+ * but keeps RAM as a flat copy. All buffers are kept between frames, so
+ * steady state capture and restore don't allocate.
+ */
+
+static struct staterecord *runahead_record;
+static uae_u8 *runahead_ram[REWIND_RAM_REGIONS];
+static uae_u8 *runahead_rambase[REWIND_RAM_REGIONS];
+static size_t runahead_ramsize[REWIND_RAM_REGIONS];
+
+/* Only pages written by the ahead frames are copied back, untouched live
+ * RAM stays clean in the host caches. Capture is a plain copy.
+ */
+static void runahead_restore_ram (uae_u8 *dst, const uae_u8 *src, size_t size)
+{
+	for (size_t off = 0; off < size; off += REWIND_PAGE_SIZE) {
+		size_t len = size - off < REWIND_PAGE_SIZE ? size - off : REWIND_PAGE_SIZE;
+		if (memcmp (dst + off, src + off, len))
+			memcpy (dst + off, src + off, len);
+	}
+}
 
-	return;
-retry:
-	if (retrycnt < 10)
-		goto retry2;
-	write_log (_T("can't save, too small capture buffer or out of memory\n"));
-	return;
+void savestate_runahead_free (void)
+{
+	xfree (runahead_record);
+	runahead_record = NULL;
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		xfree (runahead_ram[i]);
+		runahead_ram[i] = NULL;
+		runahead_rambase[i] = NULL;
+		runahead_ramsize[i] = 0;
+	}
+}
+
+bool savestate_runahead_capture (void)
+{
+	uae_u8 *base[REWIND_RAM_REGIONS];
+	size_t size[REWIND_RAM_REGIONS];
+
+#ifdef FILESYS
+	if (!save_filesys_rewind_cando ())
+		return false;
+#endif
+	if (!capture_state_record (&runahead_record))
+		return false;
+	rewind_ram_regions (base, size);
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		if (runahead_ramsize[i] != size[i]) {
+			xfree (runahead_ram[i]);
+			runahead_ram[i] = size[i] ? xcalloc (uae_u8, size[i]) : NULL;
+			runahead_ramsize[i] = runahead_ram[i] ? size[i] : 0;
+			if (size[i] && !runahead_ram[i]) {
+				runahead_record->inuse = 0;
+				return false;
+			}
+		}
+		runahead_rambase[i] = base[i];
+		if (size[i])
+			memcpy (runahead_ram[i], base[i], size[i]);
+	}
+#ifdef FILESYS
+	fsjournal_start ();
+	runahead_record->fsmark = fsjournal_mark ();
+#endif
+	runahead_record->inuse = 1;
+	return true;
+}
+
+bool savestate_runahead_restore (void)
+{
+	uae_u8 *base[REWIND_RAM_REGIONS];
+	size_t size[REWIND_RAM_REGIONS];
+	struct staterecord *st = runahead_record;
+
+	if (!st || !st->inuse)
+		return false;
+	st->inuse = 0;
+	rewind_ram_regions (base, size);
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		if (base[i] != runahead_rambase[i] || size[i] != runahead_ramsize[i])
+			return false;
+	}
+#ifdef FILESYS
+	if (!fsjournal_rollback (st->fsmark))
+		write_log (_T("runahead: directory filesystem rollback incomplete\n"));
+	// rewind keeps its own marks, only trim when nothing else needs older entries
+	if (!staterecords)
+		fsjournal_trim (st->fsmark);
+#endif
+	// called from the reset path, the caller clears savestate_state
+	if (!restore_state_record (st)) {
+		write_log (_T("runahead: reload failure, address mismatch\n"));
+		return false;
+	}
+	for (int i = 0; i < REWIND_RAM_REGIONS; i++) {
+		if (size[i])
+			runahead_restore_ram (base[i], runahead_ram[i], size[i]);
+	}
+	return true;
 }
 
 void savestate_free (void)
 {
+	if (staterecords) {
+		for (int i = 0; i < staterecords_max; i++) {
+			rewind_free_pages (staterecords[i]);
+			xfree (staterecords[i]);
+		}
+	}
 	xfree (staterecords);
 	staterecords = NULL;
+	rewind_free_rams ();
+	rewind_bytes = 0;
+#ifdef FILESYS
+	fsjournal_reset ();
+#endif
 }
 
 void savestate_capture_request (void)
@@ -1982,6 +2493,7 @@ void savestate_init (void)
 {
 	savestate_free ();
 	replaycounter = 0;
+	staterecords_first = 0;
 	staterecords_max = currprefs.statecapturebuffersize;
 	staterecords = xcalloc (struct staterecord*, staterecords_max);
 	statefile_alloc = STATEFILE_ALLOC_SIZE;
@@ -15,6 +15,10 @@
 #include "slirp/slirp.h"
 #include "slirp/libslirp.h"
 #include "threaddep/thread.h"
+#include <poll.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 #endif
 
 #ifdef WITH_QEMU_SLIRP
@@ -112,6 +116,7 @@ void uae_slirp_output(const uint8_t *pkt, int pkt_len)
 	write_log(_T("uae_slirp_output pkt_len %d\n"), pkt_len);
 #endif
 	slirp_output(pkt, pkt_len);
+	slirp_flush();
 }
 
 int uae_slirp_redir(int is_udp, int host_port, struct in_addr guest_addr,
@@ -136,17 +141,60 @@ int uae_slirp_redir(int is_udp, int host_port, struct in_addr guest_addr,
 static volatile int slirp_thread_active;
 static uae_thread_id slirp_tid;
 extern uae_sem_t slirp_sem2;
+/* eventfd on Linux (both entries), pipe elsewhere */
+static int slirp_wakeup_fd[2] = { -1, -1 };
+
+/* Make the slirp thread pick up new sockets and pending output now
+ * instead of when its current wait ends */
+void uae_slirp_wakeup(void)
+{
+	if (slirp_wakeup_fd[1] < 0)
+		return;
+#ifdef __linux__
+	uint64_t v = 1;
+	if (write(slirp_wakeup_fd[1], &v, sizeof v) < 0 && errno != EAGAIN)
+#else
+	char v = 0;
+	if (write(slirp_wakeup_fd[1], &v, sizeof v) < 0 && errno != EAGAIN)
+#endif
+		write_log(_T("SLIRP wakeup failed %d\n"), errno);
+}
+
+static bool slirp_wakeup_open(void)
+{
+#ifdef __linux__
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0)
+		return false;
+	slirp_wakeup_fd[0] = slirp_wakeup_fd[1] = fd;
+#else
+	if (pipe(slirp_wakeup_fd) < 0)
+		return false;
+	fcntl(slirp_wakeup_fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(slirp_wakeup_fd[1], F_SETFL, O_NONBLOCK);
+#endif
+	return true;
+}
+
+static void slirp_wakeup_close(void)
+{
+	if (slirp_wakeup_fd[0] >= 0)
+		close(slirp_wakeup_fd[0]);
+	if (slirp_wakeup_fd[1] >= 0 && slirp_wakeup_fd[1] != slirp_wakeup_fd[0])
+		close(slirp_wakeup_fd[1]);
+	slirp_wakeup_fd[0] = slirp_wakeup_fd[1] = -1;
+}
 
 static int slirp_receive_func(void *arg)
 {
+	struct pollfd *pfd = NULL;
+	int pfdalloc = 0;
+
 	slirp_thread_active = 1;
 	while (slirp_thread_active) {
-		// Wait for packets to arrive
 		fd_set rfds, wfds, xfds;
-		int nfds;
-		int ret, timeout;
+		int nfds, n, ret, timeout;
 
-		// ... in the output queue
 		nfds = -1;
 		FD_ZERO(&rfds);
 		FD_ZERO(&wfds);
@@ -154,26 +202,62 @@ static int slirp_receive_func(void *arg)
 		uae_sem_wait (&slirp_sem2);
 		timeout = slirp_select_fill(&nfds, &rfds, &wfds, &xfds);
 		uae_sem_post (&slirp_sem2);
-		if (nfds < 0) {
-			/* Windows does not honour the timeout if there is not
-			   descriptor to wait for */
-			sleep_millis (timeout / 1000);
-			ret = 0;
-		} else {
-			struct timeval tv;
-			tv.tv_sec = 0;
-			tv.tv_usec = timeout;
-			ret = select(0, &rfds, &wfds, &xfds, &tv);
-			if (ret == -1) {
-				write_log(_T("SLIRP socket ERR=%d\n"), WSAGetLastError());
+
+		// Wait for the sockets slirp is interested in, the wakeup
+		// from the network device side, or the next slirp timer.
+		if (nfds + 2 > pfdalloc) {
+			pfdalloc = nfds + 2 + 32;
+			pfd = xrealloc(struct pollfd, pfd, pfdalloc);
+		}
+		pfd[0].fd = slirp_wakeup_fd[0];
+		pfd[0].events = POLLIN;
+		pfd[0].revents = 0;
+		n = 1;
+		for (int fd = 0; fd <= nfds; fd++) {
+			short events = 0;
+			if (FD_ISSET(fd, &rfds))
+				events |= POLLIN;
+			if (FD_ISSET(fd, &wfds))
+				events |= POLLOUT;
+			if (FD_ISSET(fd, &xfds))
+				events |= POLLPRI;
+			if (events) {
+				pfd[n].fd = fd;
+				pfd[n].events = events;
+				pfd[n].revents = 0;
+				n++;
 			}
 		}
-		if (ret >= 0) {
-			uae_sem_wait (&slirp_sem2);
-			slirp_select_poll(&rfds, &wfds, &xfds);
-			uae_sem_post (&slirp_sem2);
+		ret = poll(pfd, n, timeout < 0 ? -1 : (timeout + 999) / 1000);
+		if (ret == -1) {
+			if (errno != EINTR)
+				write_log(_T("SLIRP socket ERR=%d\n"), errno);
+			continue;
+		}
+		if (pfd[0].revents) {
+			uint64_t v;
+			while (read(slirp_wakeup_fd[0], &v, sizeof v) > 0);
+		}
+
+		// Hand the result to slirp the way select() reports it
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_ZERO(&xfds);
+		for (int i = 1; i < n; i++) {
+			short rev = pfd[i].revents;
+			if ((pfd[i].events & POLLIN) && (rev & (POLLIN | POLLHUP | POLLERR)))
+				FD_SET(pfd[i].fd, &rfds);
+			if ((pfd[i].events & POLLOUT) && (rev & (POLLOUT | POLLHUP | POLLERR)))
+				FD_SET(pfd[i].fd, &wfds);
+			if ((pfd[i].events & POLLPRI) && (rev & POLLPRI))
+				FD_SET(pfd[i].fd, &xfds);
 		}
+		uae_sem_wait (&slirp_sem2);
+		slirp_select_poll(&rfds, &wfds, &xfds);
+		uae_sem_post (&slirp_sem2);
+		slirp_flush();
 	}
+	xfree(pfd);
 	slirp_thread_active = -1;
 	return 0;
 }
@@ -196,6 +280,10 @@ bool uae_slirp_start (void)
 #ifdef WITH_BUILTIN_SLIRP
 	if (impl == BUILTIN_IMPLEMENTATION) {
 		uae_slirp_end ();
+		if (!slirp_wakeup_open()) {
+			write_log(_T("SLIRP can't create wakeup event %d\n"), errno);
+			return false;
+		}
 		uae_start_thread(_T("slirp-receive"), slirp_receive_func, NULL,
 						 &slirp_tid);
 		return true;
@@ -216,12 +304,14 @@ void uae_slirp_end (void)
 	if (impl == BUILTIN_IMPLEMENTATION) {
 		if (slirp_thread_active > 0) {
 			slirp_thread_active = 0;
+			uae_slirp_wakeup();
 			while (slirp_thread_active == 0) {
 				sleep_millis (10);
 			}
 			uae_end_thread (&slirp_tid);
 		}
 		slirp_thread_active = 0;
+		slirp_wakeup_close();
 		return;
 	}
 #endif
@@ -19,6 +19,7 @@
 #include "threaddep/thread.h"
 #include "gui.h"
 #include "savestate.h"
+#include "runahead.h"
 #ifdef DRIVESOUND
 #include "driveclick.h"
 #endif
@@ -35,22 +36,29 @@ struct sound_dp
 	int framesperbuffer;
 	int sndbuf;
 	int pullmode;
-	uae_u8* pullbuffer;
-	unsigned int pullbufferlen;
-	int pullbuffermaxlen;
-	float avg_correct;
-	float cnt_correct;
+	// pull mode ring, written by finish_sound_buffer(), read by the SDL callback
+	uae_s16* ring;
+	uae_u32 ringframes;
+	volatile uae_atomic ring_read, ring_write;
+	uae_u32 ring_target;
+	int ring_primed;
+	// callback side resampler state
+	uae_u32 resample_frac;
+	float resample_ratio;
+	float fill_avg;
+	uae_s16 lastframe[8];
+	uae_u32 underruns;
+	uae_u32 overruns;
 	int stream_initialised;
 	int silence_written;
 };
 
 #define SND_STATUSCNT 10
 
-#define ADJUST_SIZE 20
-#define EXP 1.9
-
-#define ADJUST_VSSIZE 12
-#define EXPVS 1.6
+/* The callback resamples by at most this much to keep the ring at its target
+ * fill level. 0.5% is below audible pitch change. */
+#define RESAMPLE_MAXDEV 0.005f
+#define RESAMPLE_FILLAVG 0.05f
 
 int sound_debug = 0;
 static int have_sound = 0;
@@ -105,7 +113,6 @@ static int avioutput_audio;
 #endif
 
 #define ADJUST_LIMIT 6
-#define ADJUST_LIMIT2 1
 
 void sound_setadjust(float v)
 {
@@ -135,81 +142,29 @@ void sound_setadjust(float v)
 	}
 }
 
-static void docorrection(struct sound_dp* s, int sndbuf, float sync, int granulaty)
-{
-	static int tfprev;
-
-	s->avg_correct += sync;
-	s->cnt_correct++;
-
-	granulaty = std::max(granulaty, 10);
-
-	if (tfprev != timeframes) {
-		const auto avg = s->avg_correct / s->cnt_correct;
-
-		auto skipmode = sync / 100.0f;
-		const auto avgskipmode = avg / (10000.0f / granulaty);
-
-		if (sound_debug && (tfprev % 10) == 0) {
-			write_log(_T("%+05d S=%7.1f AVG=%7.1f (IMM=%7.1f + AVG=%7.1f = %7.1f)\n"), sndbuf, sync, avg, skipmode, avgskipmode, skipmode + avgskipmode);
-		}
-		gui_data.sndbuf = sndbuf;
-
-		if (skipmode > ADJUST_LIMIT2)
-			skipmode = ADJUST_LIMIT2;
-		if (skipmode < -ADJUST_LIMIT2)
-			skipmode = -ADJUST_LIMIT2;
-
-		sound_setadjust(skipmode + avgskipmode);
-		tfprev = static_cast<int>(timeframes);
-	}
-}
-
-static float sync_sound(float m)
-{
-	float skipmode;
-	if (isvsync()) {
-
-		skipmode = static_cast<float>(pow(m < 0 ? -m : m, EXPVS)) / 2.0f;
-		if (m < 0)
-			skipmode = -skipmode;
-		if (skipmode < -ADJUST_VSSIZE)
-			skipmode = -ADJUST_VSSIZE;
-		if (skipmode > ADJUST_VSSIZE)
-			skipmode = ADJUST_VSSIZE;
-
-	}
-	else {
-
-		skipmode = static_cast<float>(pow(m < 0 ? -m : m, EXP)) / 2.0f;
-		if (m < 0)
-			skipmode = -skipmode;
-		if (skipmode < -ADJUST_SIZE)
-			skipmode = -ADJUST_SIZE;
-		if (skipmode > ADJUST_SIZE)
-			skipmode = ADJUST_SIZE;
-	}
-
-	return skipmode;
-}
-
 static void clearbuffer_sdl2(struct sound_data *sd)
 {
-	const sound_dp* s = sd->data;
+	sound_dp* s = sd->data;
 	
 	SDL_LockAudioDevice(s->dev);
 	memset(paula_sndbuffer, 0, sizeof paula_sndbuffer);
+	if (s->ring) {
+		memset(s->ring, 0, s->ringframes * sd->samplesize);
+		atomic_set(&s->ring_read, 0);
+		atomic_set(&s->ring_write, 0);
+		s->ring_primed = 0;
+		s->resample_frac = 0;
+		s->resample_ratio = 1.0f;
+		s->fill_avg = static_cast<float>(s->ring_target);
+		memset(s->lastframe, 0, sizeof s->lastframe);
+	}
 	SDL_UnlockAudioDevice(s->dev);
 }
 
 static void clearbuffer(struct sound_data* sd)
 {
-	const auto* s = sd->data;
 	if (sd->devicetype == SOUND_DEVICE_SDL2)
 		clearbuffer_sdl2(sd);
-	if (s->pullbuffer) {
-		memset(s->pullbuffer, 0, s->pullbuffermaxlen);
-	}
 }
 
 static void set_reset(struct sound_data* sd)
@@ -233,8 +188,6 @@ static void resume_audio_sdl2(struct sound_data* sd)
 	
 	clearbuffer(sd);
 	sd->waiting_for_buffer = 1;
-	s->avg_correct = 0;
-	s->cnt_correct = 0;
 	SDL_PauseAudioDevice(s->dev, 0);
 	sd->paused = 0;
 }
@@ -245,12 +198,12 @@ static void close_audio_sdl2(struct sound_data* sd)
 	SDL_PauseAudioDevice(s->dev, 1);
 	
 	SDL_LockAudioDevice(s->dev);
-	if (s->pullbuffer != nullptr)
-	{
-		xfree(s->pullbuffer);
-		s->pullbuffer = nullptr;
-	}
-	s->pullbufferlen = 0;
+	if (s->ring && (s->underruns || s->overruns))
+		write_log(_T("SDL2: ring buffer %u underruns, %u overruns, last ratio %.4f\n"),
+			s->underruns, s->overruns, s->resample_ratio);
+	xfree(s->ring);
+	s->ring = nullptr;
+	s->ringframes = 0;
 	SDL_UnlockAudioDevice(s->dev);
 	
 	SDL_CloseAudioDevice(s->dev);
@@ -282,21 +235,37 @@ void set_volume(int volume, int mute)
 	config_changed = 1;
 }
 
+static uae_u32 ring_fill(sound_dp* s)
+{
+	return atomic_get(&s->ring_write) - atomic_get(&s->ring_read);
+}
+
 static void finish_sound_buffer_pull(struct sound_data* sd, uae_u16* sndbuffer)
 {
 	auto* s = sd->data;
-
-	if (s->pullbufferlen + sd->sndbufsize > s->pullbuffermaxlen) {
-		write_log(_T("pull overflow! %d %d %d\n"), s->pullbufferlen, sd->sndbufsize, s->pullbuffermaxlen);
-		s->pullbufferlen = 0;
+	const uae_u32 mask = s->ringframes - 1;
+	uae_u32 frames = sd->sndbufsize / sd->samplesize;
+	const uae_u32 w = s->ring_write;
+	const uae_u32 fill = w - atomic_get(&s->ring_read);
+
+	// never touch frames the callback has not consumed yet, drop the tail instead
+	if (fill + frames > s->ringframes) {
+		s->overruns++;
+		if (sound_debug)
+			write_log(_T("pull overflow! %u %u %u\n"), fill, frames, s->ringframes);
+		frames = s->ringframes - fill;
 		gui_data.sndbuf_status = 1;
 	}
 	else 
 		gui_data.sndbuf_status = 0;
-	memcpy(s->pullbuffer + s->pullbufferlen, sndbuffer, sd->sndbufsize);
-	s->pullbufferlen += sd->sndbufsize;
 
-	gui_data.sndbuf = (1000.0f * s->pullbufferlen) / s->pullbuffermaxlen;
+	const uae_u32 first = std::min(frames, s->ringframes - (w & mask));
+	memcpy(s->ring + (w & mask) * sd->channels, sndbuffer, first * sd->samplesize);
+	if (first < frames)
+		memcpy(s->ring, reinterpret_cast<uae_u8*>(sndbuffer) + first * sd->samplesize, (frames - first) * sd->samplesize);
+	atomic_set(&s->ring_write, w + frames);
+
+	gui_data.sndbuf = static_cast<int>((1000.0f * (fill + frames)) / s->ringframes);
 }
 
 static int open_audio_sdl2(struct sound_data* sd, int index)
@@ -343,9 +312,14 @@ static int open_audio_sdl2(struct sound_data* sd, int index)
 
 	if (s->pullmode)
 	{
-		s->pullbuffermaxlen = sd->sndbufsize * 2;
-		s->pullbuffer = xcalloc(uae_u8, s->pullbuffermaxlen);
-		s->pullbufferlen = 0;
+		// two emulator buffers queued is the steady state, room for four before overflowing
+		const uae_u32 frames = sd->sndbufsize / sd->samplesize;
+		s->ringframes = 1;
+		while (s->ringframes < frames * 4)
+			s->ringframes <<= 1;
+		s->ring_target = frames * 2;
+		s->ring = xcalloc(uae_s16, s->ringframes * ch);
+		s->underruns = s->overruns = 0;
 	}
 	write_log("SDL2: CH=%d, FREQ=%d '%s' buffer %d/%d (%s)\n", ch, freq, sound_devices[index]->name,
 		s->sndbufsize, s->framesperbuffer, !s->pullmode ? _T("push") : _T("pull"));
@@ -662,8 +636,8 @@ int audio_pull_buffer()
 	auto cnt = 0;
 	if (sdp->paused || sdp->deactive || sdp->reset)
 		return 0;
-	const auto* s = sdp->data;
-	if (s->pullbufferlen > 0) {
+	auto* s = sdp->data;
+	if (ring_fill(s) >= s->ring_target) {
 		cnt++;
 		int size = static_cast<int>(reinterpret_cast<uae_u8*>(paula_sndbufpt) - reinterpret_cast<uae_u8*>(paula_sndbuffer));
 		if (size > sdp->sndbufsize * 2 / 3)
@@ -737,7 +711,8 @@ void finish_sound_buffer()
 		return;
 	}
 	
-	if (currprefs.turbo_emulation) {
+	// ahead frames are rolled back, their audio is produced again by the real frames
+	if (currprefs.turbo_emulation || runahead_active) {
 		paula_sndbufpt = paula_sndbuffer;
 		return;
 	}
@@ -895,36 +870,84 @@ void master_sound_volume(int dir)
 	config_changed = 1;
 }
 
+/* Linear interpolating resampler on the consumer side of the ring. The step
+ * follows the smoothed fill level, so the device clock drifting against the
+ * emulated one is absorbed without dropping or repeating whole buffers. */
+static void ring_resample(struct sound_data* sd, sound_dp* s, uae_s16* out, int frames)
+{
+	const int ch = sd->channels;
+	const uae_u32 mask = s->ringframes - 1;
+	uae_u32 r = s->ring_read;
+	uae_u32 avail = atomic_get(&s->ring_write) - r;
+
+	if (!s->ring_primed) {
+		// wait until target fill level is reached before starting or after an underrun
+		if (avail < s->ring_target)
+			frames = 0;
+		else
+			s->ring_primed = 1;
+	}
+
+	s->fill_avg += (static_cast<float>(avail) - s->fill_avg) * RESAMPLE_FILLAVG;
+	float dev = (s->fill_avg - s->ring_target) / s->ring_target * RESAMPLE_MAXDEV;
+	dev = std::clamp(dev, -RESAMPLE_MAXDEV, RESAMPLE_MAXDEV);
+	s->resample_ratio = 1.0f + dev;
+	const uae_u32 step = static_cast<uae_u32>(s->resample_ratio * 65536.0f);
+
+	int i = 0;
+	for (; i < frames && avail >= 2; i++) {
+		const uae_s16* a = s->ring + (r & mask) * ch;
+		const uae_s16* b = s->ring + ((r + 1) & mask) * ch;
+		const int frac = static_cast<int>(s->resample_frac);
+		for (int c = 0; c < ch; c++)
+			out[c] = static_cast<uae_s16>(a[c] + (((b[c] - a[c]) * frac) >> 16));
+		out += ch;
+		s->resample_frac += step;
+		r += s->resample_frac >> 16;
+		avail -= s->resample_frac >> 16;
+		s->resample_frac &= 0xffff;
+	}
+	if (i > 0)
+		memcpy(s->lastframe, out - ch, ch * sizeof(uae_s16));
+	atomic_set(&s->ring_read, r);
+
+	if (i < frames) {
+		// hold the last output level instead of dropping to zero, that would click
+		if (s->ring_primed) {
+			s->underruns++;
+			s->ring_primed = 0;
+			gui_data.sndbuf_status = -1;
+		}
+		for (; i < frames; i++) {
+			memcpy(out, s->lastframe, ch * sizeof(uae_s16));
+			out += ch;
+		}
+	}
+}
+
 // Audio callback function
 void sdl2_audio_callback(void* userdata, Uint8* stream, int len)
 {
 	auto* sd = static_cast<sound_data*>(userdata);
 	auto* s = sd->data;
 
-	if (!s->stream_initialised || sd->mute) {
+	if (!s->stream_initialised) {
 		std::fill_n(stream, len, 0);
-		if (sd->mute) s->silence_written++;
 		s->stream_initialised = 1;
 		return;
 	}
 
-	if (!s->framesperbuffer || sdp->deactive)
-		return;
-
-	if (s->pullbufferlen <= 0) {
-		gui_data.sndbuf_status = -1;
+	if (!s->framesperbuffer || sdp->deactive || !s->ring) {
+		std::fill_n(stream, len, 0);
 		return;
 	}
 
-	const auto bytes_to_copy = std::min(static_cast<unsigned int>(s->framesperbuffer * sd->samplesize), s->pullbufferlen);
-	if (sd->mute == 0 && bytes_to_copy > 0) {
-		std::copy(s->pullbuffer, s->pullbuffer + bytes_to_copy, stream);
-	}
-
-	if (bytes_to_copy < s->pullbufferlen) {
-		std::memmove(s->pullbuffer, s->pullbuffer + bytes_to_copy, s->pullbufferlen - bytes_to_copy);
+	// keep consuming while muted so that the ring does not overflow
+	ring_resample(sd, s, reinterpret_cast<uae_s16*>(stream), len / sd->samplesize);
+	if (sd->mute) {
+		std::fill_n(stream, len, 0);
+		s->silence_written++;
 	}
-	s->pullbufferlen -= bytes_to_copy;
 }
 
 int sound_get_silence()
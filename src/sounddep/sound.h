@@ -64,6 +64,7 @@ void set_volume_sound_device(struct sound_data* sd, int volume, int mute);
 
 int sound_get_silence();
 
+
 extern int active_sound_stereo;
 
 #define PUT_SOUND_WORD(b) do { *(uae_u16 *)paula_sndbufpt = b; paula_sndbufpt = (uae_u16 *)(((uae_u8 *)paula_sndbufpt) + 2); } while (0)
@@ -71,4 +71,9 @@ static void atomic_set(volatile uae_atomic* p, uae_u32 v)
 {
     __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
 }
+
+static uae_u32 atomic_get(volatile uae_atomic* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
 #endif
@@ -24,6 +24,15 @@
 #include "diskutil.h"
 #include "fdi2raw.h"
 #include "uae.h"
+#ifdef AMIBERRY
+#include <algorithm>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
 // OS X does not have off64_t, fopen64, fseeko64 or ftello64, the functions are already 64bit
 #ifdef __MACH__
 #  define off64_t off_t
@@ -199,6 +208,51 @@ static struct zfile *zfile_create (struct zfile *prev, const TCHAR *originalname
 	return z;
 }
 
+#ifdef AMIBERRY
+/* copy mapped data to memory before it grows */
+static void zfile_unmap(struct zfile *z)
+{
+	if (!z->mapsize)
+		return;
+	uae_u8 *data = xmalloc(uae_u8, z->allocsize > 0 ? (size_t)z->allocsize : 1);
+	if (data && z->size)
+		memcpy(data, z->data, (size_t)z->size);
+	munmap(z->data, z->mapsize);
+	z->mapsize = 0;
+	z->data = data;
+}
+
+/* zfile_get_data_pointer() maps regular files opened read only instead
+ * of loading them, later reads become plain copies from the page cache.
+ * Files are not mapped when opened: if the host truncates a mapped file,
+ * touching the lost pages raises SIGBUS, plain reads only fail. Small
+ * files are not worth a mapping, huge ones would use up the address
+ * space of 32-bit hosts. */
+#define ZFILE_MAP_MIN 65536
+#define ZFILE_MAP_MAX (sizeof(void*) > 4 ? ((uae_s64)1 << 40) : ((uae_s64)256 << 20))
+
+static void zfile_mapfile(struct zfile *z, const TCHAR *mode)
+{
+	struct stat st;
+
+	if (!z->f || z->data || z->textmode || !mode || _tcscmp(mode, _T("rb")))
+		return;
+	int fd = fileno(z->f);
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < ZFILE_MAP_MIN || st.st_size > ZFILE_MAP_MAX)
+		return;
+	// private writable mapping, users may patch the data in memory
+	void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		return;
+	uae_s64 pos = _ftelli64(z->f);
+	z->data = (uae_u8*)p;
+	z->mapsize = (size_t)st.st_size;
+	z->mapfile = 1;
+	z->size = z->datasize = z->allocsize = st.st_size;
+	z->seek = pos > 0 ? pos : 0;
+}
+#endif
+
 static void zfile_free (struct zfile *f)
 {
 	if (f->f)
@@ -209,6 +263,11 @@ static void zfile_free (struct zfile *f)
 	}
 	xfree (f->name);
 	xfree (f->originalname);
+#ifdef AMIBERRY
+	if (f->mapsize)
+		munmap (f->data, f->mapsize);
+	else
+#endif
 	xfree (f->data);
 	xfree (f->mode);
 	xfree (f->userdata);
@@ -2065,7 +2124,7 @@ struct zfile *zfile_dup (struct zfile *zf)
 		return NULL;
 	if (!zf->data && zf->dataseek) {
 		nzf = zfile_create (zf, NULL);
-	} else if (zf->data) {
+	} else if (zf->data && !zf->mapfile) {
 		if (zf->size > INT_MAX) {
 			return NULL;
 		}
@@ -2121,7 +2180,7 @@ int zfile_exists (const TCHAR *name)
 
 int zfile_iscompressed (struct zfile *z)
 {
-	return z->data ? 1 : 0;
+	return z->data && !z->mapfile ? 1 : 0;
 }
 
 struct zfile *zfile_fopen_empty (struct zfile *prev, const TCHAR *name, uae_u64 size)
@@ -2210,9 +2269,15 @@ struct zfile *zfile_fopen_data (const TCHAR *name, uae_u64 size, const uae_u8 *d
 	return l;
 }
 
-/* dump file use only */
+/* Whole file in memory, NULL if it is only available through reads.
+ * Plain files are mapped, cached archive members return their mapping.
+ * Delayed archive members are unpacked, check zfile_size() first. */
 uae_u8 *zfile_get_data_pointer(struct zfile *z, size_t *len)
 {
+	checkarchiveparent (z);
+#ifdef AMIBERRY
+	zfile_mapfile (z, z->mode);
+#endif
 	if (!z->data)
 		return NULL;
 	*len = (size_t)z->size;
@@ -2405,6 +2470,8 @@ size_t zfile_fwrite(const void *b, size_t l1, size_t l2, struct zfile *z)
 		return (size_t)z->zfilewrite(b, l1, l2, z);
 	if (z->parent && z->useparent)
 		return 0;
+	if (z->mapfile)
+		return 0;
 	if (z->data) {
 		uae_s64 off = z->seek + l1 * l2;
 		if (z->allocsize == 0) {
@@ -2416,6 +2483,9 @@ size_t zfile_fwrite(const void *b, size_t l1, size_t l2, struct zfile *z)
 			if (inc < 10000)
 				inc = 10000;
 			z->allocsize += inc;
+#ifdef AMIBERRY
+			zfile_unmap (z);
+#endif
 			z->data = xrealloc (uae_u8, z->data, (size_t)z->allocsize);
 		}
 		memcpy (z->data + z->seek, b, l1 * l2);
@@ -3600,6 +3670,168 @@ void zfile_close_archive (struct zfile *d)
 	/* do nothing, keep file cached */
 }
 
+#ifdef AMIBERRY
+
+/* Unpacked members of compressed archives mounted as directory
+ * filesystems (WHDLoad LHA/ZIP) are stored on disk, named by the SHA1
+ * of archive path, size, mtime and member path. Later opens map the
+ * cached file instead of decompressing into memory again. Least
+ * recently used files are removed when the cache exceeds its size.
+ */
+
+#define ZCACHE_MINSIZE 16384
+
+static TCHAR *zcache_path;
+static uae_u64 zcache_maxsize;
+static uae_s64 zcache_total = -1;
+
+void zfile_cache_init(const TCHAR *path, uae_u64 maxsize)
+{
+	xfree(zcache_path);
+	zcache_path = NULL;
+	zcache_maxsize = maxsize;
+	zcache_total = -1;
+	if (path && path[0] && maxsize)
+		zcache_path = my_strdup(path);
+}
+
+static bool zcache_name(struct znode *zn, TCHAR *out, int size)
+{
+	struct zvolume *zv = zn->volume;
+	struct mystat st;
+	TCHAR key[MAX_DPATH * 2 + 64];
+
+	if (!zcache_path || !zv || !zv->archive || zn->size < ZCACHE_MINSIZE || zn->size > INT_MAX)
+		return false;
+	switch (zv->id)
+	{
+	case ArchiveFormatZIP:
+	case ArchiveFormat7Zip:
+	case ArchiveFormatRAR:
+	case ArchiveFormatLHA:
+	case ArchiveFormatLZX:
+		break;
+	default:
+		return false;
+	}
+	// nested archives have no host file to identify them
+	if (!my_stat(zv->archive->name, &st))
+		return false;
+	_sntprintf(key, sizeof key / sizeof(TCHAR), _T("%s|%lld|%lld|%s|%lld"), zv->archive->name,
+		(long long)st.size, (long long)st.mtime.tv_sec, zn->fullname, (long long)zn->size);
+	_sntprintf(out, size, _T("%s%s"), zcache_path, get_sha1_txt(key, (int)(_tcslen(key) * sizeof(TCHAR))));
+	return true;
+}
+
+static struct zfile *zcache_open(struct znode *zn, const TCHAR *name)
+{
+	struct stat st;
+	int fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0 || st.st_size != zn->size) {
+		close(fd);
+		return NULL;
+	}
+	// private writable mapping, writes stay in memory like with unpacked data
+	void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+	struct zfile *z = zfile_create(NULL, NULL);
+	if (!z) {
+		munmap(p, (size_t)st.st_size);
+		return NULL;
+	}
+	z->name = my_strdup(zn->fullname);
+	z->data = (uae_u8*)p;
+	z->mapsize = (size_t)st.st_size;
+	z->size = z->datasize = z->allocsize = st.st_size;
+	z->archiveid = zn->volume->id;
+	// file modification time is the LRU stamp
+	utimes(name, NULL);
+	return z;
+}
+
+static void zcache_evict(void)
+{
+	struct entry {
+		time_t mtime;
+		uae_s64 size;
+		TCHAR name[64];
+	};
+	DIR *d = opendir(zcache_path);
+	if (!d)
+		return;
+	struct entry *list = NULL;
+	int count = 0, alloc = 0;
+	uae_s64 total = 0;
+	struct dirent *de;
+	while ((de = readdir(d))) {
+		TCHAR path[MAX_DPATH];
+		struct stat st;
+		if (de->d_name[0] == '.' || _tcslen(de->d_name) >= 64)
+			continue;
+		_sntprintf(path, MAX_DPATH, _T("%s%s"), zcache_path, de->d_name);
+		if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+			continue;
+		if (count >= alloc) {
+			alloc = alloc ? alloc * 2 : 256;
+			struct entry *n = xrealloc(struct entry, list, alloc);
+			if (!n)
+				break;
+			list = n;
+		}
+		list[count].mtime = st.st_mtime;
+		list[count].size = st.st_size;
+		_tcscpy(list[count].name, de->d_name);
+		total += st.st_size;
+		count++;
+	}
+	closedir(d);
+	if (total > (uae_s64)zcache_maxsize) {
+		std::sort(list, list + count, [](const struct entry &a, const struct entry &b) { return a.mtime < b.mtime; });
+		for (int i = 0; i < count && total > (uae_s64)zcache_maxsize; i++) {
+			TCHAR path[MAX_DPATH];
+			_sntprintf(path, MAX_DPATH, _T("%s%s"), zcache_path, list[i].name);
+			if (!unlink(path))
+				total -= list[i].size;
+		}
+	}
+	zcache_total = total;
+	xfree(list);
+}
+
+static struct zfile *zcache_store(struct znode *zn, const TCHAR *name, struct zfile *z)
+{
+	TCHAR tmp[MAX_DPATH];
+
+	// only completely unpacked data, not delayed unpack or temporary files
+	if (!z->data || z->mapsize || z->archiveparent || z->size != zn->size || z->size > (uae_s64)zcache_maxsize)
+		return z;
+	_sntprintf(tmp, MAX_DPATH, _T("%s.tmp"), name);
+	FILE *f = uae_tfopen(tmp, _T("wb"));
+	if (!f)
+		return z;
+	bool ok = fwrite(z->data, 1, (size_t)z->size, f) == (size_t)z->size;
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp, name)) {
+		unlink(tmp);
+		return z;
+	}
+	if (zcache_total >= 0)
+		zcache_total += z->size;
+	if (zcache_total < 0 || zcache_total > (uae_s64)zcache_maxsize)
+		zcache_evict();
+	struct zfile *zm = zcache_open(zn, name);
+	if (!zm)
+		return z;
+	zfile_fclose(z);
+	return zm;
+}
+
+#endif
+
 struct zfile *zfile_open_archive (const TCHAR *path, int flags)
 {
 	struct zvolume *zv = get_zvolume (path);
@@ -3614,7 +3846,18 @@ struct zfile *zfile_open_archive (const TCHAR *path, int flags)
 	}
 	if (zn->vfile)
 		zn = zn->vfile;
+#ifdef AMIBERRY
+	TCHAR cachename[MAX_DPATH];
+	bool cached = zcache_name (zn, cachename, MAX_DPATH);
+	z = cached ? zcache_open (zn, cachename) : NULL;
+	if (!z) {
+		z = archive_getzfile (zn, zn->volume->id, 0);
+		if (z && cached)
+			z = zcache_store (zn, cachename, z);
+	}
+#else
 	z = archive_getzfile (zn, zn->volume->id, 0);
+#endif
 	if (z)
 		zfile_fseek (z, 0, SEEK_SET);
 	zn->f = z;